@@ -0,0 +1,432 @@
+// fm-cli: runs plugin operations in batch, without the GUI
+//
+// Usage: fm-cli [--plugins DIR | --daemon [SOCKET]] [--keep-going] [--quiet] [--stats] OPERATION [ARGS...]
+//        fm-cli [--plugins DIR | --daemon [SOCKET]] [--keep-going] [--quiet] [--stats] -
+//        fm-cli [--plugins DIR] --list
+//   --plugins     plugin directory (default: ../plugins next to the executable)
+//   --daemon      send the operations to a running fm-daemon instead of
+//                 loading the plugins (default socket: fmd::defaultSocketPath())
+//   --keep-going  carry on after a failed operation (-k)
+//   --quiet       no info messages, errors only (-q)
+//   --stats       report operations, failures and throughput on stderr
+//   --list        print the operations the loaded plugins provide
+//
+// With "-" operations are read from stdin, one per line:
+//
+//   copy /data/a.txt /backup/a.txt
+//   move "/data/with space" /data/moved
+//   # comments and empty lines are skipped
+//
+// Words are split like a shell does: blanks separate, '...' and "..."
+// quote, a backslash escapes the next character. Exit status: 0 if every
+// operation succeeded, 1 if one failed, 2 for usage or setup errors.
+//
+// Links only file_manager_core: no Qt, start-up is loading the plugins.
+// With --daemon not even that: the operations are pipelined to fm-daemon,
+// up to DAEMON_WINDOW at a time with --keep-going, one at a time without
+// (an operation after a failed one must not have started), each with the
+// working directory of fm-cli so relative paths resolve as they would here. Locally,
+// --keep-going runs consecutive lines of one operation as a batch of up to
+// BATCH_SIZE through PluginManager::executeBatch, their words parsed
+// into one arena that is released after each batch.
+
+#include "core/daemon_client.hpp"
+#include "core/plugin_manager.hpp"
+#include "utilities/error_handler.hpp"
+#include "utilities/metrics.hpp"
+#include "utilities/tracer.hpp"
+#include "utilities/workload_recorder.hpp"
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <unistd.h>
+#include <unordered_map>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// Operations outstanding at the daemon in a --keep-going batch
+static constexpr size_t DAEMON_WINDOW = 64;
+
+// Calls in one local --keep-going batch
+static constexpr size_t BATCH_SIZE = 256;
+
+static void printUsage() {
+    std::cerr << "Usage: fm-cli [--plugins DIR | --daemon [SOCKET]] [--keep-going] [--quiet] [--stats] "
+                 "OPERATION [ARGS...]\n"
+                 "       fm-cli [--plugins DIR | --daemon [SOCKET]] [--keep-going] [--quiet] [--stats] -"
+                 "   (operations from stdin)\n"
+                 "       fm-cli [--plugins DIR] --list\n";
+}
+
+// ../plugins next to the executable, where the build and the install put them
+static std::string defaultPluginDirectory() {
+    std::error_code ec;
+    const fs::path executable = fs::read_symlink("/proc/self/exe", ec);
+    if (ec) {
+        return "plugins";
+    }
+    return (executable.parent_path() / ".." / "plugins").lexically_normal().string();
+}
+
+// Splits one line into words, false on an unterminated quote
+// The words get the allocator of `words` (the batch arena for PluginArgs)
+template <typename Words>
+static bool splitWords(const std::string& line, Words& words) {
+    words.clear();
+    typename Words::value_type word(words.get_allocator());
+    bool inWord = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+        const char c = line[i];
+        if (quote) {
+            if (c == quote) {
+                quote = 0;
+            } else if (c == '\\' && quote == '"' && i + 1 < line.size()) {
+                word += line[++i];
+            } else {
+                word += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            inWord = true;
+        } else if (c == '\\' && i + 1 < line.size()) {
+            word += line[++i];
+            inWord = true;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (inWord) {
+                words.push_back(std::move(word));
+                word.clear();
+                inWord = false;
+            }
+        } else {
+            word += c;
+            inWord = true;
+        }
+    }
+    if (inWord) {
+        words.push_back(std::move(word));
+    }
+    return quote == 0;
+}
+
+struct BatchStats {
+    uint64_t operations = 0;
+    uint64_t failed = 0;
+};
+
+// Where an operation came from, for error messages
+static std::string originOf(uint64_t lineNumber) {
+    return lineNumber ? "line " + std::to_string(lineNumber) : std::string("argv");
+}
+
+static void reportFailure(const std::string& operation, const std::vector<std::string>& args,
+                          uint64_t lineNumber) {
+    std::cerr << "fm-cli: " << originOf(lineNumber) << ": " << operation << " failed";
+    for (const auto& arg : args) {
+        std::cerr << ' ' << arg;
+    }
+    std::cerr << '\n';
+}
+
+static void reportFailure(const std::vector<std::string>& words, uint64_t lineNumber) {
+    reportFailure(words[0], std::vector<std::string>(words.begin() + 1, words.end()), lineNumber);
+}
+
+// Runs operations in this process, or at fm-daemon if a client is given
+class Runner {
+public:
+    Runner(PluginManager& plugins, DaemonClient* daemon, size_t window, bool batch, BatchStats& stats)
+        : plugins_(plugins), daemon_(daemon), window_(window), batching_(batch && !daemon), stats_(stats) {}
+
+    // True if lines go through lineWords() and runBatched() instead of run()
+    bool batching() const { return batching_; }
+
+    // Empty words for the next line, in a buffer reused for every line
+    PluginArgs& lineWords() {
+        lineWords_ = PluginArgs(&lineArena_);
+        lineArena_.release();
+        return lineWords_;
+    }
+
+    // Queues the line in lineWords() into the current batch, running the
+    // batch first if it is full or for another operation
+    void runBatched(uint64_t lineNumber) {
+        ++stats_.operations;
+        if (!calls_.empty() && (std::string_view(lineWords_[0]) != operation_ || calls_.size() == BATCH_SIZE)) {
+            flushBatch();
+        }
+        if (calls_.empty()) {
+            operation_.assign(lineWords_[0].data(), lineWords_[0].size());
+        }
+        calls_.emplace_back(lineWords_.begin() + 1, lineWords_.end());   // copied into the batch arena
+        lines_.push_back(lineNumber);
+    }
+
+    // Runs (or queues) one operation, `lineNumber` is 0 for the command line
+    // False once an operation has failed
+    bool run(std::vector<std::string> words, uint64_t lineNumber) {
+        ++stats_.operations;
+        if (!daemon_) {
+            const std::vector<std::string> args(words.begin() + 1, words.end());
+            if (plugins_.executeOperation(words[0], args)) {
+                return true;
+            }
+            fail(words, lineNumber);
+            return false;
+        }
+        // Relative paths mean the same as when run here, not the daemon's cwd
+        std::vector<std::string> request;
+        request.reserve(words.size() + 1);
+        request.push_back(workingDirectory());
+        request.insert(request.end(), words.begin(), words.end());
+        const uint32_t id = daemon_->send(fmd::Opcode::EXECUTE_IN, std::move(request));
+        pending_.emplace(id, Pending{lineNumber, std::move(words)});
+        while (pending_.size() >= window_ && ok_) {
+            receiveOne();
+        }
+        return ok_;
+    }
+
+    // Waits for everything still at the daemon, false if anything failed
+    bool finish() {
+        if (!calls_.empty()) {
+            flushBatch();
+        }
+        while (!pending_.empty() && !lost_) {
+            receiveOne();
+        }
+        return ok_;
+    }
+
+private:
+    struct Pending {
+        uint64_t lineNumber;
+        std::vector<std::string> words;
+    };
+
+    const std::string& workingDirectory() {
+        if (workingDirectory_.empty()) {
+            std::error_code ec;
+            workingDirectory_ = fs::current_path(ec).string();
+        }
+        return workingDirectory_;
+    }
+
+    void fail(const std::vector<std::string>& words, uint64_t lineNumber) {
+        ++stats_.failed;
+        ok_ = false;
+        reportFailure(words, lineNumber);
+    }
+
+    void flushBatch() {
+        plugins_.executeBatch(operation_, calls_, &arena_, results_);
+        for (size_t i = 0; i < calls_.size(); ++i) {
+            if (!results_[i]) {
+                ++stats_.failed;
+                ok_ = false;
+                std::vector<std::string> args;
+                for (const auto& arg : calls_[i]) {
+                    args.emplace_back(arg.data(), arg.size());
+                }
+                reportFailure(operation_, args, lines_[i]);
+            }
+        }
+        // Nothing may point into the arena when it is released
+        calls_ = std::pmr::vector<PluginArgs>(&arena_);
+        lines_.clear();
+        arena_.release();
+    }
+
+    void receiveOne() {
+        const auto response = daemon_->receive();
+        if (!response) {
+            std::cerr << "fm-cli: lost the daemon: " << response.message() << '\n';
+            stats_.failed += pending_.size();
+            pending_.clear();
+            ok_ = false;
+            lost_ = true;
+            return;
+        }
+        auto it = pending_.find(response.value().id);
+        if (it == pending_.end()) {
+            return;
+        }
+        if (response.value().status != fmd::Status::OK) {
+            fail(it->second.words, it->second.lineNumber);
+        }
+        pending_.erase(it);
+    }
+
+    PluginManager& plugins_;
+    DaemonClient* daemon_;
+    size_t window_;
+    const bool batching_;
+    BatchStats& stats_;
+
+    // Local batch: the calls of one operation and their line numbers
+    char lineBuffer_[4096];
+    std::pmr::monotonic_buffer_resource lineArena_{lineBuffer_, sizeof(lineBuffer_)};
+    PluginArgs lineWords_{&lineArena_};
+    std::pmr::monotonic_buffer_resource arena_{64 * 1024};
+    std::pmr::vector<PluginArgs> calls_{&arena_};
+    std::string operation_;
+    std::vector<uint64_t> lines_;
+    std::vector<bool> results_;
+    std::unordered_map<uint32_t, Pending> pending_;
+    std::string workingDirectory_;   // sent to the daemon with every operation
+    bool ok_ = true;
+    bool lost_ = false;
+};
+
+int main(int argc, char* argv[]) {
+    std::ios::sync_with_stdio(false);
+
+    std::string pluginDir;
+    std::string daemonSocket;
+    bool keepGoing = false;
+    bool quiet = false;
+    bool printStats = false;
+    bool list = false;
+    bool fromStdin = false;
+    std::vector<std::string> command;
+
+    int i = 1;
+    for (; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--plugins" && i + 1 < argc) {
+            pluginDir = argv[++i];
+        } else if (arg == "--daemon") {
+            // The socket is optional, an operation name never starts with '/'
+            daemonSocket = (i + 1 < argc && argv[i + 1][0] == '/') ? argv[++i] : fmd::defaultSocketPath();
+        } else if (arg == "--keep-going" || arg == "-k") {
+            keepGoing = true;
+        } else if (arg == "--quiet" || arg == "-q") {
+            quiet = true;
+        } else if (arg == "--stats") {
+            printStats = true;
+        } else if (arg == "--list") {
+            list = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (arg == "-") {
+            fromStdin = true;
+        } else if (arg == "--") {
+            ++i;
+            break;
+        } else if (!arg.empty() && arg[0] == '-') {
+            printUsage();
+            return 2;
+        } else {
+            break;   // the operation, everything from here on is its arguments
+        }
+    }
+    command.assign(argv + i, argv + argc);
+    if ((!list && fromStdin == !command.empty()) || (list && !daemonSocket.empty())) {
+        printUsage();
+        return 2;
+    }
+
+    if (quiet) {
+        ErrorHandler::setMinimumSeverity(ErrorSeverity::ERROR);
+    }
+
+    // Same observability switches as the GUI
+    const char* metricsFile = std::getenv("FM_METRICS_FILE");
+    if (metricsFile && *metricsFile) {
+        Metrics::setEnabled(true);
+    }
+    const char* traceFile = std::getenv("FM_TRACE_FILE");
+    if (traceFile && *traceFile) {
+        Tracer::setThreadName("fm-cli");
+        Tracer::start(traceFile);
+    }
+    const char* workloadFile = std::getenv("FM_WORKLOAD_FILE");
+    if (workloadFile && *workloadFile) {
+        WorkloadRecorder::start(workloadFile);
+    }
+
+    PluginManager plugins;
+    DaemonClient daemon;
+    if (!daemonSocket.empty()) {
+        const FsStatus connected = daemon.connect(daemonSocket);
+        if (!connected) {
+            std::cerr << "fm-cli: " << daemonSocket << ": " << connected.message() << '\n';
+            return 2;
+        }
+    } else {
+        if (pluginDir.empty()) {
+            pluginDir = defaultPluginDirectory();
+        }
+        if (!plugins.loadPlugins(pluginDir) || plugins.pluginCount() == 0) {
+            std::cerr << "fm-cli: no plugins loaded from " << pluginDir << '\n';
+            return 2;
+        }
+    }
+
+    if (list) {
+        for (const IFileManagerPlugin* plugin : plugins.plugins()) {
+            for (const auto& operation : plugin->operations()) {
+                std::cout << operation << '\t' << plugin->name() << '\n';
+            }
+        }
+        return 0;
+    }
+
+    BatchStats stats;
+    Runner runner(plugins, daemon.isConnected() ? &daemon : nullptr, keepGoing ? DAEMON_WINDOW : 1, keepGoing,
+                  stats);
+    const auto started = std::chrono::steady_clock::now();
+    if (fromStdin) {
+        std::string line;
+        std::vector<std::string> words;
+        for (uint64_t lineNumber = 1; std::getline(std::cin, line); ++lineNumber) {
+            const size_t first = line.find_first_not_of(" \t\r");
+            if (first == std::string::npos || line[first] == '#') {
+                continue;
+            }
+            const bool split = runner.batching() ? splitWords(line, runner.lineWords()) : splitWords(line, words);
+            if (!split) {
+                ++stats.operations;
+                ++stats.failed;
+                std::cerr << "fm-cli: " << originOf(lineNumber) << ": unterminated quote\n";
+            } else if (runner.batching()) {
+                runner.runBatched(lineNumber);   // failures are reported when the batch has run
+                continue;
+            } else if (runner.run(std::move(words), lineNumber)) {
+                continue;
+            }
+            if (!keepGoing) {
+                break;
+            }
+        }
+    } else {
+        runner.run(std::move(command), 0);
+    }
+    runner.finish();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    if (printStats) {
+        std::cerr << "fm-cli: " << stats.operations << " operations, " << stats.failed << " failed, "
+                  << static_cast<uint64_t>(seconds * 1000.0) << " ms";
+        if (seconds > 0) {
+            std::cerr << " (" << static_cast<uint64_t>(stats.operations / seconds) << " ops/s)";
+        }
+        std::cerr << '\n';
+    }
+
+    if (workloadFile && *workloadFile) {
+        WorkloadRecorder::stop();
+    }
+    if (traceFile && *traceFile) {
+        Tracer::stop();
+    }
+    if (metricsFile && *metricsFile) {
+        Metrics::writePrometheus(metricsFile);
+    }
+    return stats.failed ? 1 : 0;
+}
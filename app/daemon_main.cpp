@@ -0,0 +1,140 @@
+// fm-daemon: keeps the plugins and caches resident and serves requests on a Unix socket
+//
+// Usage: fm-daemon [--socket PATH] [--plugins DIR] [--cache-mb N] [--quiet]
+//   --socket    socket to listen on (default: $XDG_RUNTIME_DIR/file_manager.sock)
+//   --plugins   plugin directory (default: ../plugins next to the executable)
+//   --cache-mb  memory budget of the listing cache (default 64)
+//   --quiet     no info messages, errors only (-q)
+//
+// Runs in the foreground until SIGINT or SIGTERM. Clients speak the protocol
+// in core/daemon_protocol.hpp; `fm-cli --daemon` and fm-daemon-load are two.
+// Relative paths resolve against the working directory an EXECUTE_IN request
+// carries (fm-cli sends its own), else against the daemon's.
+
+#include "core/daemon_server.hpp"
+#include "core/trash_manager.hpp"
+#include "utilities/binary_log.hpp"
+#include "utilities/error_handler.hpp"
+#include "utilities/metrics.hpp"
+#include "utilities/tracer.hpp"
+#include <atomic>
+#include <csignal>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <string>
+
+namespace fs = std::filesystem;
+
+// Lock-free, so the signal handler may read it
+static std::atomic<DaemonServer*> runningServer{nullptr};
+
+static void handleSignal(int) {
+    if (DaemonServer* server = runningServer.load()) {
+        server->stop();
+    }
+}
+
+static void printUsage() {
+    std::cerr << "Usage: fm-daemon [--socket PATH] [--plugins DIR] [--cache-mb N] [--quiet]\n";
+}
+
+// ../plugins next to the executable, where the build and the install put them
+static std::string defaultPluginDirectory() {
+    std::error_code ec;
+    const fs::path executable = fs::read_symlink("/proc/self/exe", ec);
+    if (ec) {
+        return "plugins";
+    }
+    return (executable.parent_path() / ".." / "plugins").lexically_normal().string();
+}
+
+int main(int argc, char* argv[]) {
+    std::string socketPath = fmd::defaultSocketPath();
+    std::string pluginDir = defaultPluginDirectory();
+    size_t cacheMiB = DirectoryCache::DEFAULT_BUDGET / (1024 * 1024);
+    bool quiet = false;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socketPath = argv[++i];
+        } else if (arg == "--plugins" && i + 1 < argc) {
+            pluginDir = argv[++i];
+        } else if (arg == "--cache-mb" && i + 1 < argc) {
+            cacheMiB = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--quiet" || arg == "-q") {
+            quiet = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (quiet) {
+        ErrorHandler::setMinimumSeverity(ErrorSeverity::ERROR);
+    }
+
+    const char* metricsFile = std::getenv("FM_METRICS_FILE");
+    if (metricsFile && *metricsFile) {
+        Metrics::setEnabled(true);
+    }
+    const char* traceFile = std::getenv("FM_TRACE_FILE");
+    if (traceFile && *traceFile) {
+        Tracer::setThreadName("fm-daemon");
+        Tracer::start(traceFile);
+    }
+
+    // One binary record per request, decoded offline with fm-logdecode
+    std::unique_ptr<BinaryLogSink> requestLog;
+    const char* requestLogFile = std::getenv("FM_BINARY_LOG_FILE");
+    if (requestLogFile && *requestLogFile) {
+        requestLog = std::make_unique<BinaryLogSink>(requestLogFile);
+    }
+
+    PluginManager plugins;
+    if (!plugins.loadPlugins(pluginDir) || plugins.pluginCount() == 0) {
+        FM_WARNING("No plugins loaded from ", pluginDir, ", only listings will be served");
+    }
+    DirectoryCache::instance().setBudget(cacheMiB * 1024 * 1024);
+
+    // Trash limits (FM_TRASH_MAX_MB, FM_TRASH_MAX_DAYS) are applied from the
+    // start, not only after the next delete
+    TrashManager::instance().schedulePurge();
+
+    {
+        DaemonServer server(plugins);
+        server.setRequestLog(requestLog.get());
+        const FsStatus listening = server.listen(socketPath);
+        if (!listening) {
+            std::cerr << "fm-daemon: " << socketPath << ": " << listening.message() << '\n';
+            return 2;
+        }
+
+        runningServer = &server;
+        struct sigaction action {};
+        action.sa_handler = handleSignal;
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGINT, &action, nullptr);
+        sigaction(SIGTERM, &action, nullptr);
+        std::signal(SIGPIPE, SIG_IGN);
+
+        FM_INFO("fm-daemon listening on ", socketPath);
+        server.run();
+        FM_INFO("fm-daemon stopping after ", server.requestCount(), " requests");
+
+        std::signal(SIGINT, SIG_DFL);
+        std::signal(SIGTERM, SIG_DFL);
+        runningServer = nullptr;
+    }   // waits for running requests, before the plugins are unloaded
+
+    if (traceFile && *traceFile) {
+        Tracer::stop();
+    }
+    if (metricsFile && *metricsFile) {
+        Metrics::writePrometheus(metricsFile);
+    }
+    return 0;
+}
@@ -1,10 +1,54 @@
 #include <QApplication>
+#include <chrono>
+#include <cstdlib>
 #include "gui/main_window.hpp"
+#include "utilities/metrics.hpp"
+#include "utilities/startup_timer.hpp"
+#include "utilities/tracer.hpp"
+#include "utilities/workload_recorder.hpp"
 
 int main(int argc, char *argv[]) {
+    // Time-to-first-paint and time-to-interactive are measured from here,
+    // MainWindow logs them once the window is usable
+    StartupTimer::begin();
+
+    // FM_METRICS_FILE=/path/metrics.prom turns on metrics and dumps them
+    // there every few seconds in Prometheus text format
+    const char* metricsFile = std::getenv("FM_METRICS_FILE");
+    if (metricsFile && *metricsFile) {
+        Metrics::setEnabled(true);
+        Metrics::startPeriodicDump(metricsFile, std::chrono::seconds(5));
+    }
+
+    // FM_TRACE_FILE=/path/trace.json records spans until the window closes,
+    // open the file in chrome://tracing or ui.perfetto.dev
+    const char* traceFile = std::getenv("FM_TRACE_FILE");
+    if (traceFile && *traceFile) {
+        Tracer::setThreadName("gui");
+        Tracer::start(traceFile);
+    }
+
+    // FM_WORKLOAD_FILE=/path/session.fmw records every FileSystem and plugin
+    // call of the session for fm-replay
+    const char* workloadFile = std::getenv("FM_WORKLOAD_FILE");
+    if (workloadFile && *workloadFile) {
+        WorkloadRecorder::start(workloadFile);
+    }
+
     QApplication app(argc, argv);
     MainWindow mainWin;
     mainWin.resize(800, 600);
     mainWin.show();
-    return app.exec();
+    const int result = app.exec();
+
+    if (workloadFile && *workloadFile) {
+        WorkloadRecorder::stop();
+    }
+    if (traceFile && *traceFile) {
+        Tracer::stop();
+    }
+    if (metricsFile && *metricsFile) {
+        Metrics::stopPeriodicDump();
+    }
+    return result;
 }
@@ -0,0 +1,67 @@
+// Cost of a failing FileSystem call: the printing wrappers, the
+// exception-based ErrorHandler path and the error_code based try* API
+#include "core/file_system.hpp"
+#include "utilities/error_handler.hpp"
+#include "../bench_utils.hpp"
+#include <iostream>
+#include <streambuf>
+
+// Swallows everything written to it, so the terminal does not dominate the numbers
+// (the formatting and stream machinery is still paid for)
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+int main(int argc, char* argv[]) {
+    NullBuffer nullBuffer;
+    std::streambuf* originalCerr = std::cerr.rdbuf(&nullBuffer);
+
+    const fs::path missing = "/non/existing/dir/file.txt";
+    const fs::path existing = fs::temp_directory_path() / "error_path_bench.txt";
+    FileSystem::writeFile(existing, "benchmark");
+
+    BenchReporter reporter;
+
+    // --- Error path ---
+    reporter.add(runBenchmark("fileSize missing (prints to cerr)", [&] {
+        doNotOptimize(FileSystem::fileSize(missing));
+    }));
+    reporter.add(runBenchmark("tryFileSize missing", [&] {
+        doNotOptimize(FileSystem::tryFileSize(missing).code());
+    }));
+    reporter.add(runBenchmark("safeExecute + FM_THROW_FS missing", [&] {
+        auto result = ErrorHandler::safeExecute([&]() -> uintmax_t {
+            auto size = FileSystem::tryFileSize(missing);
+            if (!size) {
+                FM_THROW_FS("Cannot get size of ", missing.string(), ": ", size.message());
+            }
+            return size.value();
+        }, "fileSize");
+        doNotOptimize(result.isSuccess());
+    }));
+    reporter.add(runBenchmark("readFile missing (prints to cerr)", [&] {
+        doNotOptimize(FileSystem::readFile(missing));
+    }));
+    reporter.add(runBenchmark("tryReadFile missing", [&] {
+        doNotOptimize(FileSystem::tryReadFile(missing).code());
+    }));
+
+    // --- Success path, for reference: the syscall cost the error path is compared to ---
+    reporter.add(runBenchmark("fileSize existing", [&] {
+        doNotOptimize(FileSystem::fileSize(existing));
+    }));
+    reporter.add(runBenchmark("tryFileSize existing", [&] {
+        doNotOptimize(FileSystem::tryFileSize(existing).code());
+    }));
+
+    std::cerr.rdbuf(originalCerr);
+    fs::remove(existing);
+
+    const std::string jsonPath = jsonOutputPath(argc, argv);
+    if (!jsonPath.empty() && !reporter.writeJson(jsonPath)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,314 @@
+// Microbenchmarks of the core FileSystem layer, the Logger and plugin dispatch
+//
+// Usage: file_manager_bench [--json results.json] [--dir scratch_dir] [--plugins dir] [--large]
+//   --large adds the 1M entry directory listing (needs a few hundred MB of inodes)
+#include "core/file_system.hpp"
+#include "core/plugin_manager.hpp"
+#include "utilities/logger.hpp"
+#include "../bench_utils.hpp"
+#include <atomic>
+#include <cstdio>
+#include <fcntl.h>
+#include <iostream>
+#include <memory_resource>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+// Creates `count` empty files in `dir` (plain syscalls, the setup is not measured)
+static void createEntries(const fs::path& dir, size_t count) {
+    fs::create_directories(dir);
+    for (size_t i = 0; i < count; ++i) {
+        const std::string name = (dir / ("entry_" + std::to_string(i))).string();
+        const int fd = ::open(name.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+// Chain of `depth` nested directories with one small file in each
+// One letter names keep depth 500 below PATH_MAX
+static void createDeepTree(const fs::path& root, int depth) {
+    fs::path dir = root;
+    for (int i = 0; i < depth; ++i) {
+        dir /= "d";
+        fs::create_directories(dir);
+        FileSystem::writeFile(dir / "f", "deep tree");
+    }
+}
+
+static std::string sizeLabel(size_t bytes) {
+    if (bytes >= (1u << 20)) {
+        return std::to_string(bytes >> 20) + "MiB";
+    }
+    return std::to_string(bytes >> 10) + "KiB";
+}
+
+static BenchResult withThroughput(BenchResult result, double bytesPerOp) {
+    result.counters.emplace_back("MB_per_sec", bytesPerOp / result.nsPerOp * 1e3);
+    return result;
+}
+
+// --- FileSystem ---
+
+static void benchListDirectory(BenchReporter& reporter, const fs::path& scratch, bool large) {
+    const fs::path small = scratch / "list_10k";
+    createEntries(small, 10000);
+    BenchResult result = runBenchmark("listDirectory 10k entries", [&] {
+        doNotOptimize(FileSystem::listDirectory(small).size());
+    });
+    result.counters.emplace_back("entries_per_sec", 10000 / result.nsPerOp * 1e9);
+    reporter.add(result);
+
+    // Same listing with every path in one arena, released after each listing
+    // (back to its first buffer, which then holds a whole listing)
+    std::vector<char> buffer(1 << 20);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+    const std::string smallPath = small.string();
+    BenchResult pmrResult = runBenchmark("listDirectory 10k entries (pmr arena)", [&] {
+        doNotOptimize(FileSystem::listDirectory(smallPath, &arena).size());
+        arena.release();
+    });
+    pmrResult.counters.emplace_back("entries_per_sec", 10000 / pmrResult.nsPerOp * 1e9);
+    reporter.add(pmrResult);
+
+    // Bulk metadata: a size for each entry of the listing
+    const std::vector<fs::directory_entry> entries = FileSystem::listDirectory(small);
+    BenchResult sizes = runBenchmark("tryFileSize x10k (fs::path per entry)", [&] {
+        uintmax_t total = 0;
+        for (const auto& entry : entries) {
+            total += FileSystem::tryFileSize(small / entry.path().filename()).valueOr(0);
+        }
+        doNotOptimize(total);
+    });
+    sizes.counters.emplace_back("entries_per_sec", 10000 / sizes.nsPerOp * 1e9);
+    reporter.add(sizes);
+    // Listed once outside the arena, so only the size queries are timed
+    const std::pmr::vector<ListedEntry> listed = FileSystem::listDirectory(smallPath, std::pmr::get_default_resource());
+    BenchResult pmrSizes = runBenchmark("tryFileSize x10k (pmr arena)", [&] {
+        uintmax_t total = 0;
+        for (const ListedEntry& entry : listed) {
+            total += FileSystem::tryFileSize(entry.path, &arena).valueOr(0);
+        }
+        doNotOptimize(total);
+        arena.release();
+    });
+    pmrSizes.counters.emplace_back("entries_per_sec", 10000 / pmrSizes.nsPerOp * 1e9);
+    reporter.add(pmrSizes);
+    fs::remove_all(small);
+
+    if (large) {
+        const fs::path huge = scratch / "list_1m";
+        createEntries(huge, 1000000);
+        BenchResult hugeResult = runBenchmarkFixed("listDirectory 1M entries", 3, [&] {
+            doNotOptimize(FileSystem::listDirectory(huge).size());
+        });
+        hugeResult.counters.emplace_back("entries_per_sec", 1000000 / hugeResult.nsPerOp * 1e9);
+        reporter.add(hugeResult);
+        fs::remove_all(huge);
+    }
+}
+
+static void benchReadWrite(BenchReporter& reporter, const fs::path& scratch) {
+    for (size_t size : {4u << 10, 64u << 10, 1u << 20, 16u << 20}) {
+        const fs::path file = scratch / ("rw_" + sizeLabel(size));
+        const std::string content(size, 'x');
+
+        reporter.add(withThroughput(runBenchmark("writeFile " + sizeLabel(size), [&] {
+            doNotOptimize(FileSystem::writeFile(file, content));
+        }), static_cast<double>(size)));
+
+        reporter.add(withThroughput(runBenchmark("readFile " + sizeLabel(size), [&] {
+            doNotOptimize(FileSystem::readFile(file));
+        }), static_cast<double>(size)));
+
+        fs::remove(file);
+    }
+}
+
+static void benchCopy(BenchReporter& reporter, const fs::path& scratch) {
+    const fs::path smallSource = scratch / "copy_small_src";
+    const fs::path smallDestination = scratch / "copy_small_dst";
+    FileSystem::writeFile(smallSource, std::string(4096, 's'));
+    reporter.add(withThroughput(runBenchmark("copy small file 4KiB", [&] {
+        doNotOptimize(FileSystem::copy(smallSource, smallDestination, true));
+    }), 4096));
+
+    const size_t largeSize = 256u << 20;
+    const fs::path largeSource = scratch / "copy_large_src";
+    const fs::path largeDestination = scratch / "copy_large_dst";
+    FileSystem::writeFile(largeSource, std::string(largeSize, 'l'));
+    reporter.add(withThroughput(runBenchmarkFixed("copy large file 256MiB", 5, [&] {
+        doNotOptimize(FileSystem::copy(largeSource, largeDestination, true));
+    }), static_cast<double>(largeSize)));
+
+    for (const auto& path : {smallSource, smallDestination, largeSource, largeDestination}) {
+        fs::remove(path);
+    }
+}
+
+static void benchRemove(BenchReporter& reporter, const fs::path& scratch) {
+    const fs::path root = scratch / "deep_tree";
+    for (int depth : {10, 100, 500}) {
+        BenchResult result = runBenchmarkWithSetup("remove deep tree depth " + std::to_string(depth), 20,
+            [&] { createDeepTree(root, depth); },
+            [&] { doNotOptimize(FileSystem::remove(root)); });
+        result.counters.emplace_back("entries_per_sec", 2.0 * depth / result.nsPerOp * 1e9);
+        reporter.add(result);
+    }
+}
+
+// --- Logger ---
+
+// Every thread logs `perThread` records at once; ns/op is wall time per record
+static BenchResult logContention(const std::string& name, Logger& logger, int threads, int perThread) {
+    std::atomic<bool> go{false};
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; ++t) {
+        workers.emplace_back([&, t] {
+            while (!go.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+            for (int i = 0; i < perThread; ++i) {
+                logger.log(ErrorSeverity::WARNING, "bench thread " + std::to_string(t) + " record " + std::to_string(i));
+            }
+        });
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+    logger.flush();
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = static_cast<uint64_t>(threads) * perThread;
+    result.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() / static_cast<double>(result.iterations);
+    return result;
+}
+
+static void benchLogger(BenchReporter& reporter, const fs::path& scratch) {
+    const int perThread = 50000;
+    for (int threads : {1, 2, 4, 8}) {
+        const std::string suffix = " " + std::to_string(threads) + " threads";
+        {
+            const fs::path file = scratch / "bench_sync.log";
+            Logger logger(file.string());
+            reporter.add(logContention("Logger::log sync" + suffix, logger, threads, perThread));
+        }
+        {
+            const fs::path file = scratch / "bench_async.log";
+            Logger logger(file.string(), AsyncLogOptions{});
+            BenchResult result = logContention("Logger::log async" + suffix, logger, threads, perThread);
+            result.counters.emplace_back("dropped", static_cast<double>(logger.droppedCount()));
+            reporter.add(result);
+        }
+        fs::remove(scratch / "bench_sync.log");
+        fs::remove(scratch / "bench_async.log");
+    }
+}
+
+// --- PluginManager ---
+
+static void benchDispatch(BenchReporter& reporter, const std::string& pluginDir) {
+    PluginManager manager;
+    if (!manager.loadPlugins(pluginDir) || !manager.getPluginByName("Noop Plugin")) {
+        std::cerr << "Noop plugin not found in " << pluginDir << ", skipping dispatch benchmarks" << std::endl;
+        return;
+    }
+    const std::vector<std::string> args = {"/tmp/source", "/tmp/destination"};
+
+    IFileManagerPlugin* plugin = manager.getPluginByName("Noop Plugin");
+    reporter.add(runBenchmark("plugin execute (direct virtual call)", [&] {
+        doNotOptimize(plugin->execute("noop", args));
+    }));
+    reporter.add(runBenchmark("PluginManager getPluginByName + execute", [&] {
+        doNotOptimize(manager.getPluginByName("Noop Plugin")->execute("noop", args));
+    }));
+    reporter.add(runBenchmark("PluginManager executeOperation", [&] {
+        doNotOptimize(manager.executeOperation("noop", args));
+    }));
+
+    Metrics::setEnabled(true);
+    reporter.add(runBenchmark("PluginManager executeOperation (metrics on)", [&] {
+        doNotOptimize(manager.executeOperation("noop", args));
+    }));
+    Metrics::setEnabled(false);
+
+    // A batch of 256 calls with fm-cli sized paths, as words of a parsed line:
+    // a std::vector<std::string> per call, or all of them in one arena
+    constexpr size_t batch = 256;
+    const std::string source = "/home/user/projects/file_manager/build/source/file_";
+    const std::string destination = "/home/user/projects/file_manager/build/destination/file_";
+    BenchResult perCall = runBenchmark("256 calls, executeOperation (std::string args)", [&] {
+        for (size_t i = 0; i < batch; ++i) {
+            const std::vector<std::string> callArgs = {source + std::to_string(i), destination + std::to_string(i)};
+            doNotOptimize(manager.executeOperation("noop", callArgs));
+        }
+    });
+    perCall.counters.emplace_back("calls_per_sec", batch / perCall.nsPerOp * 1e9);
+    reporter.add(perCall);
+
+    std::vector<char> buffer(256 * 1024);
+    std::pmr::monotonic_buffer_resource arena(buffer.data(), buffer.size());
+    std::vector<bool> results;
+    char number[24];
+    BenchResult batched = runBenchmark("256 calls, executeBatch (pmr arena)", [&] {
+        {
+            std::pmr::vector<PluginArgs> calls(&arena);
+            calls.reserve(batch);
+            for (size_t i = 0; i < batch; ++i) {
+                const int length = std::snprintf(number, sizeof(number), "%zu", i);
+                PluginArgs& call = calls.emplace_back();
+                call.reserve(2);
+                for (const std::string* prefix : {&source, &destination}) {
+                    std::pmr::string& arg = call.emplace_back();
+                    arg.reserve(prefix->size() + length);
+                    arg.append(*prefix).append(number, length);
+                }
+            }
+            doNotOptimize(manager.executeBatch("noop", calls, &arena, results));
+        }
+        arena.release();
+    });
+    batched.counters.emplace_back("calls_per_sec", batch / batched.nsPerOp * 1e9);
+    reporter.add(batched);
+}
+
+int main(int argc, char* argv[]) {
+    std::string scratchOption = optionValue(argc, argv, "--dir");
+    const fs::path scratch = (scratchOption.empty() ? fs::temp_directory_path() : fs::path(scratchOption))
+                             / ("file_manager_bench_" + std::to_string(::getpid()));
+    std::string pluginDir = optionValue(argc, argv, "--plugins");
+#ifdef BENCH_PLUGIN_DIR
+    if (pluginDir.empty()) {
+        pluginDir = BENCH_PLUGIN_DIR;
+    }
+#endif
+    const bool large = hasFlag(argc, argv, "--large");
+
+    fs::create_directories(scratch);
+    BenchReporter reporter;
+
+    benchListDirectory(reporter, scratch, large);
+    benchReadWrite(reporter, scratch);
+    benchCopy(reporter, scratch);
+    benchRemove(reporter, scratch);
+    benchLogger(reporter, scratch);
+    if (!pluginDir.empty()) {
+        benchDispatch(reporter, pluginDir);
+    }
+
+    fs::remove_all(scratch);
+
+    const std::string jsonPath = jsonOutputPath(argc, argv);
+    if (!jsonPath.empty() && !reporter.writeJson(jsonPath)) {
+        return 1;
+    }
+    return 0;
+}
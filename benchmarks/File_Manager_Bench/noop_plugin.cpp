@@ -0,0 +1,29 @@
+// Plugin whose only operation does nothing, so the dispatch benchmark
+// measures PluginManager and the virtual call instead of a real operation
+#include "core/plugin_interface.hpp"
+
+class NoopPlugin : public IFileManagerPlugin, public IBatchPlugin {
+public:
+    std::string name() const override { return "Noop Plugin"; }
+    std::string version() const override { return "1.0"; }
+    std::string description() const override { return "Does nothing, used by file_manager_bench"; }
+    std::vector<std::string> operations() const override { return {"noop"}; }
+
+    bool execute(const std::string& operation, const std::vector<std::string>&) override {
+        return operation == "noop";
+    }
+
+    size_t executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                        std::pmr::memory_resource*, std::vector<bool>& results) override {
+        results.assign(calls.size(), operation == "noop");
+        return operation == "noop" ? calls.size() : 0;
+    }
+};
+
+extern "C" IFileManagerPlugin* create_plugin() {
+    return new NoopPlugin();
+}
+
+extern "C" IBatchPlugin* get_batch_plugin(IFileManagerPlugin* plugin) {
+    return static_cast<NoopPlugin*>(plugin);
+}
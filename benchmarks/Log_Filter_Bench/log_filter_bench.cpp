@@ -0,0 +1,57 @@
+// Per-call cost of the FM_* logging macros with and without filtering
+#include "utilities/error_handler.hpp"
+#include "../bench_utils.hpp"
+#include <iostream>
+#include <streambuf>
+#include <string>
+
+// Defined in log_filter_compiled_out.cpp, built with FM_ERROR compiled away
+void logCompiledOut(const std::string& name, int value);
+
+// Swallows everything written to it, so stderr I/O does not dominate the numbers
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) override { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+};
+
+int main(int argc, char* argv[]) {
+    NullBuffer nullBuffer;
+    std::streambuf* originalCerr = std::cerr.rdbuf(&nullBuffer);
+
+    const std::string pluginName = "Copy Plugin";
+    int counter = 0;
+    BenchReporter reporter;
+
+    // Runtime filter rejects DEBUG (default minimum is INFO)
+    reporter.add(runBenchmark("FM_DEBUG filtered at runtime", [&] {
+        FM_DEBUG("Loaded plugin: ", pluginName, " (", ++counter, ")");
+    }));
+
+    // Compile-time filter: the call site is empty
+    reporter.add(runBenchmark("FM_ERROR compiled out (FM_MIN_LOG_LEVEL=CRITICAL)", [&] {
+        logCompiledOut(pluginName, ++counter);
+    }));
+
+    // What every filtered call used to cost: the message was built before anything was checked
+    reporter.add(runBenchmark("format then filter (previous FM_* behaviour)", [&] {
+        std::string message = ErrorHandler::format("Loaded plugin: ", pluginName, " (", ++counter, ")");
+        if (ErrorHandler::isEnabled(ErrorSeverity::DEBUG)) {
+            std::cerr << message;
+        }
+        doNotOptimize(message);
+    }));
+
+    // Enabled message: formatting, mutex and the (discarded) stream write
+    reporter.add(runBenchmark("FM_INFO enabled, stderr discarded", [&] {
+        FM_INFO("Loaded plugin: ", pluginName, " (", ++counter, ")");
+    }));
+
+    std::cerr.rdbuf(originalCerr);
+
+    const std::string jsonPath = jsonOutputPath(argc, argv);
+    if (!jsonPath.empty() && !reporter.writeJson(jsonPath)) {
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,10 @@
+// Built with -DFM_MIN_LOG_LEVEL=FM_LOG_LEVEL_CRITICAL (see CMakeLists.txt),
+// so every FM_* macro below CRITICAL compiles to nothing in this file
+#include "utilities/error_handler.hpp"
+#include <string>
+
+static_assert(FM_MIN_LOG_LEVEL == FM_LOG_LEVEL_CRITICAL, "this file must be built with logging compiled out");
+
+void logCompiledOut(const std::string& name, int value) {
+    FM_ERROR("Loaded plugin: ", name, " (", value, ")");
+}
@@ -0,0 +1,173 @@
+#pragma once
+
+// Small helpers shared by the benchmark executables
+// Header only, every benchmark directory includes it from here
+
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Stops the compiler from optimising away a value computed in a benchmark loop
+template<typename T>
+inline void doNotOptimize(const T& value) {
+    asm volatile("" : : "r,m"(value) : "memory");
+}
+
+// Result of one measured case
+struct BenchResult {
+    std::string name;
+    uint64_t iterations = 0;
+    double nsPerOp = 0;
+    // Extra values reported next to the timing (bytes/s, entries, ...)
+    std::vector<std::pair<std::string, double>> counters;
+
+    double opsPerSecond() const { return nsPerOp > 0 ? 1e9 / nsPerOp : 0; }
+};
+
+// Runs func exactly `iterations` times and measures the average cost
+template<typename Func>
+BenchResult runBenchmarkFixed(const std::string& name, uint64_t iterations, Func&& func) {
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+        func();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() /
+                     static_cast<double>(iterations ? iterations : 1);
+    return result;
+}
+
+// Like runBenchmarkFixed, but `setup` runs untimed before every iteration
+// (for operations that consume their input, such as removing a tree)
+template<typename Setup, typename Func>
+BenchResult runBenchmarkWithSetup(const std::string& name, uint64_t iterations, Setup&& setup, Func&& func) {
+    std::chrono::steady_clock::duration elapsed{};
+    for (uint64_t i = 0; i < iterations; ++i) {
+        setup();
+        const auto start = std::chrono::steady_clock::now();
+        func();
+        elapsed += std::chrono::steady_clock::now() - start;
+    }
+
+    BenchResult result;
+    result.name = name;
+    result.iterations = iterations;
+    result.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() /
+                     static_cast<double>(iterations ? iterations : 1);
+    return result;
+}
+
+// Runs func with a growing iteration count until one round takes at least
+// `minTime`, so cheap and expensive cases both get a stable measurement
+template<typename Func>
+BenchResult runBenchmark(const std::string& name, Func&& func,
+                         std::chrono::milliseconds minTime = std::chrono::milliseconds(200)) {
+    // warm up caches and lazy initialisation
+    for (int i = 0; i < 10; ++i) {
+        func();
+    }
+    uint64_t iterations = 1;
+    while (true) {
+        const auto start = std::chrono::steady_clock::now();
+        for (uint64_t i = 0; i < iterations; ++i) {
+            func();
+        }
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        if (elapsed >= minTime || iterations >= (1ULL << 40)) {
+            BenchResult result;
+            result.name = name;
+            result.iterations = iterations;
+            result.nsPerOp = std::chrono::duration<double, std::nano>(elapsed).count() /
+                             static_cast<double>(iterations);
+            return result;
+        }
+        iterations *= 2;
+    }
+}
+
+// Collects results, prints them as a table and optionally as JSON
+class BenchReporter {
+public:
+    void add(const BenchResult& result) {
+        results_.push_back(result);
+        std::cout << std::left << std::setw(56) << result.name << std::right
+                  << std::setw(14) << std::fixed << std::setprecision(1) << result.nsPerOp << " ns/op"
+                  << std::setw(16) << std::setprecision(0) << result.opsPerSecond() << " ops/s";
+        for (const auto& [key, value] : result.counters) {
+            std::cout << "  " << key << "=" << std::setprecision(2) << value;
+        }
+        std::cout << std::endl;
+    }
+
+    const std::vector<BenchResult>& results() const { return results_; }
+
+    // Machine readable output used to track regressions between runs
+    bool writeJson(const std::string& path) const {
+        std::ofstream out(path);
+        if (!out) {
+            std::cerr << "Cannot write benchmark results to " << path << std::endl;
+            return false;
+        }
+        out << "{\n  \"benchmarks\": [\n";
+        for (size_t i = 0; i < results_.size(); ++i) {
+            const BenchResult& r = results_[i];
+            out << "    {\"name\": \"" << escape(r.name) << "\", \"iterations\": " << r.iterations
+                << ", \"ns_per_op\": " << std::setprecision(3) << std::fixed << r.nsPerOp
+                << ", \"ops_per_sec\": " << r.opsPerSecond();
+            for (const auto& [key, value] : r.counters) {
+                out << ", \"" << escape(key) << "\": " << value;
+            }
+            out << "}" << (i + 1 < results_.size() ? "," : "") << "\n";
+        }
+        out << "  ]\n}\n";
+        return static_cast<bool>(out);
+    }
+
+private:
+    static std::string escape(const std::string& text) {
+        std::string escaped;
+        for (char c : text) {
+            if (c == '"' || c == '\\') {
+                escaped.push_back('\\');
+            }
+            escaped.push_back(c);
+        }
+        return escaped;
+    }
+
+    std::vector<BenchResult> results_;
+};
+
+// Returns the value following `option` on the command line, or an empty string
+inline std::string optionValue(int argc, char* argv[], const std::string& option) {
+    for (int i = 1; i + 1 < argc; ++i) {
+        if (argv[i] == option) {
+            return argv[i + 1];
+        }
+    }
+    return {};
+}
+
+// True if `flag` appears on the command line
+inline bool hasFlag(int argc, char* argv[], const std::string& flag) {
+    for (int i = 1; i < argc; ++i) {
+        if (argv[i] == flag) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns the value following `--json` on the command line, or an empty string
+inline std::string jsonOutputPath(int argc, char* argv[]) {
+    return optionValue(argc, argv, "--json");
+}
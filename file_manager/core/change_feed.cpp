@@ -0,0 +1,1042 @@
+#include "change_feed.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fcntl.h>
+#include <poll.h>
+#include <string_view>
+#include <sys/eventfd.h>
+#include <sys/fanotify.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "directory_listing.hpp"
+#include "error_handler.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+
+namespace {
+
+// Raw changes of one event, both backends are translated to these
+constexpr uint32_t RAW_CREATE = 1u << 0;
+constexpr uint32_t RAW_MODIFY = 1u << 1;
+constexpr uint32_t RAW_ATTRIB = 1u << 2;
+constexpr uint32_t RAW_DELETE = 1u << 3;
+
+constexpr uint32_t INOTIFY_MASK = IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVED_FROM |
+                                  IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR | IN_DONT_FOLLOW | IN_EXCL_UNLINK;
+
+#ifdef FAN_REPORT_DFID_NAME
+constexpr uint64_t FANOTIFY_MASK = FAN_CREATE | FAN_DELETE | FAN_MODIFY | FAN_CLOSE_WRITE | FAN_ATTRIB | FAN_ONDIR;
+#endif
+
+// Directories resolved from fanotify handles kept per window
+constexpr size_t MAX_HANDLE_PATHS = 65536;
+
+// Entries read per getdents64 batch while adding inotify watches
+constexpr size_t WALK_CHUNK = 4096;
+
+// Events read per read() call, both interfaces return whole events only
+constexpr size_t READ_BUFFER = 64 * 1024;
+
+// True if `path` is `prefix` or below it ("" is above everything)
+bool isUnder(std::string_view path, std::string_view prefix) {
+    if (prefix.empty()) {
+        return true;
+    }
+    if (path.size() < prefix.size() || path.compare(0, prefix.size(), prefix) != 0) {
+        return false;
+    }
+    return path.size() == prefix.size() || prefix.back() == '/' || path[prefix.size()] == '/';
+}
+
+std::string_view parentOf(std::string_view path) {
+    const size_t slash = path.rfind('/');
+    if (slash == std::string_view::npos) {
+        return {};
+    }
+    return slash == 0 ? path.substr(0, 1) : path.substr(0, slash);
+}
+
+std::string childPath(const std::string& directory, std::string_view name) {
+    std::string path;
+    path.reserve(directory.size() + 1 + name.size());
+    path = directory;
+    if (path.empty() || path.back() != '/') {
+        path += '/';
+    }
+    path += name;
+    return path;
+}
+
+// Symlinks resolved, so paths match what fanotify reports; lexical if it does not exist
+std::string canonicalPath(const std::string& path) {
+    if (char* real = ::realpath(path.c_str(), nullptr)) {
+        std::string result(real);
+        std::free(real);
+        return result;
+    }
+    std::string result = std::filesystem::path(path).lexically_normal().string();
+    while (result.size() > 1 && result.back() == '/') {
+        result.pop_back();
+    }
+    return result;
+}
+
+bool lexists(const std::string& path) {
+    struct stat st;
+    return ::lstat(path.c_str(), &st) == 0;
+}
+
+} // namespace
+
+// ---------------------------------------------------------------------------
+// ChangeCoalescer
+// ---------------------------------------------------------------------------
+
+ChangeCoalescer::Pending& ChangeCoalescer::recordFor(const std::string& path, bool directory, bool& created) {
+    const auto it = index_.find(path);
+    if (it != index_.end()) {
+        created = false;
+        Pending& record = records_[it->second];
+        record.directory = directory;
+        return record;
+    }
+    created = true;
+    index_.emplace(path, records_.size());
+    Pending record;
+    record.path = path;
+    record.directory = directory;
+    records_.push_back(std::move(record));
+    return records_.back();
+}
+
+void ChangeCoalescer::add(Raw kind, const std::string& path, bool directory) {
+    bool created = false;
+    Pending& record = recordFor(path, directory, created);
+    switch (kind) {
+        case Raw::CREATE:
+            if (created) {
+                record.bornHere = true;
+            } else if (!record.exists) {
+                record.exists = true;
+                record.replaced = !record.bornHere;
+            }
+            break;
+        case Raw::MODIFY:
+            record.content = true;
+            break;
+        case Raw::ATTRIB:
+            record.attrib = true;
+            break;
+        case Raw::DELETE:
+            record.exists = false;
+            break;
+    }
+}
+
+void ChangeCoalescer::rename(const std::string& from, const std::string& to, bool directory) {
+    if (from == to) {
+        return;
+    }
+
+    Pending moved;
+    const auto source = index_.find(from);
+    if (source != index_.end()) {
+        moved = records_[source->second];
+        records_[source->second].live = false;
+        index_.erase(source);
+        if (!moved.bornHere && moved.renamedFrom.empty()) {
+            moved.renamedFrom = from;
+        }
+    } else {
+        moved.renamedFrom = from;
+    }
+    moved.path = to;
+    moved.directory = directory;
+    moved.exists = true;
+    moved.live = true;
+
+    // Renamed over an existing entry: a file saved through a temporary is a
+    // modification of the target, not a new file
+    const auto target = index_.find(to);
+    if (target != index_.end()) {
+        Pending& old = records_[target->second];
+        old.live = false;
+        const bool existedBefore = !old.bornHere && old.renamedFrom.empty();
+        if (moved.bornHere && existedBefore) {
+            moved.bornHere = false;
+            moved.replaced = true;
+        }
+        const std::string oldOrigin = old.renamedFrom;
+        index_.erase(target);
+        // What was moved to `to` earlier is gone from where it came from
+        if (!oldOrigin.empty() && oldOrigin != to) {
+            add(Raw::DELETE, oldOrigin, old.directory);
+        }
+    }
+
+    index_[to] = records_.size();
+    records_.push_back(std::move(moved));
+    if (directory) {
+        moveDescendants(from, to);
+    }
+}
+
+void ChangeCoalescer::moveDescendants(const std::string& from, const std::string& to) {
+    std::vector<std::pair<std::string, size_t>> below;
+    for (const auto& [path, record] : index_) {
+        if (path.size() > from.size() && isUnder(path, from)) {
+            below.emplace_back(path, record);
+        }
+    }
+    for (const auto& [path, record] : below) {
+        index_.erase(path);
+        std::string moved = to + path.substr(from.size());
+        const auto clash = index_.find(moved);
+        if (clash != index_.end()) {
+            records_[clash->second].live = false;
+            clash->second = record;
+        } else {
+            index_.emplace(moved, record);
+        }
+        records_[record].path = std::move(moved);
+    }
+}
+
+void ChangeCoalescer::rescan(const std::string& path) {
+    rescans_.push_back(path);
+}
+
+std::vector<ChangeEvent> ChangeCoalescer::take() {
+    std::vector<ChangeEvent> events;
+    events.reserve(rescans_.size() + index_.size());
+    for (auto& path : rescans_) {
+        ChangeEvent event;
+        event.kind = ChangeKind::RESCAN;
+        event.directory = true;
+        event.path = std::move(path);
+        events.push_back(std::move(event));
+    }
+
+    for (auto& record : records_) {
+        if (!record.live) {
+            continue;
+        }
+        ChangeEvent event;
+        event.directory = record.directory;
+        const bool moved = !record.renamedFrom.empty() && record.renamedFrom != record.path;
+        if (record.bornHere) {
+            if (!record.exists) {
+                continue;   // came and went within the window
+            }
+            event.kind = ChangeKind::CREATED;
+            event.path = std::move(record.path);
+        } else if (!record.exists) {
+            event.kind = ChangeKind::DELETED;
+            event.path = moved ? std::move(record.renamedFrom) : std::move(record.path);
+        } else if (moved) {
+            event.kind = ChangeKind::RENAMED;
+            event.path = std::move(record.path);
+            event.oldPath = std::move(record.renamedFrom);
+        } else if (record.replaced || record.content) {
+            event.kind = ChangeKind::MODIFIED;
+            event.path = std::move(record.path);
+        } else if (record.attrib) {
+            event.kind = ChangeKind::ATTRIBUTES;
+            event.path = std::move(record.path);
+        } else {
+            continue;
+        }
+        events.push_back(std::move(event));
+    }
+    clear();
+
+    // Subtree folding: a created, deleted or rescanned directory stands for
+    // everything below it
+    std::unordered_set<std::string_view> covering;
+    for (const auto& event : events) {
+        if (event.kind == ChangeKind::RESCAN ||
+            (event.directory && (event.kind == ChangeKind::CREATED || event.kind == ChangeKind::DELETED))) {
+            covering.insert(event.path);
+        }
+    }
+    if (covering.empty()) {
+        return events;
+    }
+    const auto covered = [&covering](std::string_view path) {
+        for (std::string_view parent = parentOf(path); !parent.empty(); parent = parentOf(parent)) {
+            if (covering.count(parent)) {
+                return true;
+            }
+            if (parent.size() == 1) {
+                break;   // "/"
+            }
+        }
+        return false;
+    };
+
+    // Decided before anything is moved, `covering` points into the events
+    enum Fate : uint8_t { KEEP, DROP, OLD_PATH_DELETED };
+    std::vector<Fate> fates(events.size(), KEEP);
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (covered(events[i].path)) {
+            // Moved into a covered subtree: only its old location needs reporting
+            const bool movedIn = events[i].kind == ChangeKind::RENAMED && !covered(events[i].oldPath);
+            fates[i] = movedIn ? OLD_PATH_DELETED : DROP;
+        }
+    }
+    std::vector<ChangeEvent> folded;
+    folded.reserve(events.size());
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (fates[i] == KEEP) {
+            folded.push_back(std::move(events[i]));
+        } else if (fates[i] == OLD_PATH_DELETED) {
+            ChangeEvent gone;
+            gone.kind = ChangeKind::DELETED;
+            gone.directory = events[i].directory;
+            gone.path = std::move(events[i].oldPath);
+            folded.push_back(std::move(gone));
+        }
+    }
+    return folded;
+}
+
+void ChangeCoalescer::clear() {
+    records_.clear();
+    index_.clear();
+    rescans_.clear();
+}
+
+// ---------------------------------------------------------------------------
+// ChangeFeed
+// ---------------------------------------------------------------------------
+
+ChangeFeed& ChangeFeed::instance() {
+    static ChangeFeed* feed = new ChangeFeed();   // leaked, used until exit
+    return *feed;
+}
+
+ChangeFeed::ChangeFeed(Backend preferred, std::chrono::milliseconds window)
+    : window_(window)
+{
+    wakeFd_ = ::eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    inotifyFd_ = ::inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+#ifdef FAN_REPORT_DFID_NAME
+    if (preferred == Backend::FANOTIFY) {
+        // Fails with EPERM without CAP_SYS_ADMIN, every root then uses inotify
+        fanotifyFd_ = ::fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC | FAN_NONBLOCK | FAN_REPORT_DFID_NAME,
+                                      O_RDONLY | O_LARGEFILE);
+#ifdef FAN_RENAME
+        fanotifyMask_ = FANOTIFY_MASK | FAN_RENAME;
+#else
+        fanotifyMask_ = FANOTIFY_MASK | FAN_MOVED_FROM | FAN_MOVED_TO;
+#endif
+    }
+#else
+    (void)preferred;
+#endif
+}
+
+ChangeFeed::~ChangeFeed() {
+    stopping_ = true;
+    if (thread_.joinable()) {
+        const uint64_t one = 1;
+        (void)::write(wakeFd_, &one, sizeof(one));
+        thread_.join();
+    }
+    for (const auto& [fsid, mark] : filesystems_) {
+        ::close(mark.mountFd);
+    }
+    for (const int fd : {fanotifyFd_, inotifyFd_, wakeFd_}) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+}
+
+FsStatus ChangeFeed::watch(const std::string& root, bool recursive) {
+    const std::string path = canonicalPath(root);
+    struct stat st;
+    if (::stat(path.c_str(), &st) != 0) {
+        return FsStatus::failure(errno, "stat");
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return FsStatus::failure(ENOTDIR, "watch");
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& existing : roots_) {
+        if (existing.path != path) {
+            continue;
+        }
+        if (recursive && !existing.recursive) {
+            if (existing.backend == Backend::INOTIFY) {
+                const FsStatus added = addInotifyTree(path, true, false);
+                if (!added) {
+                    return added;
+                }
+            }
+            existing.recursive = true;
+        }
+        ++existing.references;
+        return {};
+    }
+
+    Root added;
+    added.path = path;
+    added.recursive = recursive;
+    added.references = 1;
+    if (markFilesystem(path, added.filesystem)) {
+        added.backend = Backend::FANOTIFY;
+    } else {
+        added.backend = Backend::INOTIFY;
+        const FsStatus status = addInotifyTree(path, recursive, false);
+        if (!status) {
+            removeInotifyWatches(path);   // the part of the tree watched before the error
+            return status;
+        }
+    }
+    roots_.push_back(std::move(added));
+
+    if (!thread_.joinable()) {
+        thread_ = std::thread(&ChangeFeed::run, this);
+    }
+    return {};
+}
+
+void ChangeFeed::unwatch(const std::string& root) {
+    const std::string path = canonicalPath(root);
+    std::lock_guard<std::mutex> lock(mutex_);
+    const auto it = std::find_if(roots_.begin(), roots_.end(), [&path](const Root& r) { return r.path == path; });
+    if (it == roots_.end() || --it->references > 0) {
+        return;
+    }
+    const Root removed = std::move(*it);
+    roots_.erase(it);
+    if (removed.backend == Backend::FANOTIFY) {
+        unmarkFilesystem(removed.path, removed.filesystem);
+    } else {
+        removeInotifyWatches(removed.path);
+    }
+}
+
+ChangeFeed::SubscriptionId ChangeFeed::subscribe(const std::string& prefix, Callback callback) {
+    std::lock_guard<std::mutex> lock(subscribersMutex_);
+    const SubscriptionId id = nextSubscription_++;
+    subscribers_.push_back({id, prefix.empty() ? prefix : canonicalPath(prefix), std::move(callback)});
+    return id;
+}
+
+void ChangeFeed::unsubscribe(SubscriptionId id) {
+    std::lock_guard<std::mutex> lock(subscribersMutex_);
+    subscribers_.erase(std::remove_if(subscribers_.begin(), subscribers_.end(),
+                                      [id](const Subscription& s) { return s.id == id; }),
+                       subscribers_.end());
+}
+
+ChangeFeed::Backend ChangeFeed::backend(const std::string& root) const {
+    const std::string path = canonicalPath(root);
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& existing : roots_) {
+        if (existing.path == path) {
+            return existing.backend;
+        }
+    }
+    return Backend::NONE;
+}
+
+size_t ChangeFeed::inotifyWatches() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return watchPaths_.size();
+}
+
+// PRIVATE METHODS
+
+bool ChangeFeed::markFilesystem(const std::string& root, std::string& filesystem) {
+#ifdef FAN_REPORT_DFID_NAME
+    if (fanotifyFd_ < 0) {
+        return false;
+    }
+    struct statfs info;
+    if (::statfs(root.c_str(), &info) != 0) {
+        return false;
+    }
+    filesystem.assign(reinterpret_cast<const char*>(&info.f_fsid), sizeof(info.f_fsid));
+    const auto marked = filesystems_.find(filesystem);
+    if (marked != filesystems_.end()) {
+        ++marked->second.roots;
+        return true;
+    }
+
+    const int mountFd = ::open(root.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (mountFd < 0) {
+        return false;
+    }
+    // Events are only useful if their handles can be opened again; this fails
+    // without CAP_DAC_READ_SEARCH or on filesystems that cannot decode handles
+    struct {
+        file_handle handle;
+        unsigned char bytes[MAX_HANDLE_SZ];
+    } probe {};
+    probe.handle.handle_bytes = MAX_HANDLE_SZ;
+    int mountId = 0;
+    bool usable = ::name_to_handle_at(mountFd, "", &probe.handle, &mountId, AT_EMPTY_PATH) == 0;
+    if (usable) {
+        const int opened = ::open_by_handle_at(mountFd, &probe.handle, O_PATH | O_CLOEXEC);
+        usable = opened >= 0;
+        if (usable) {
+            ::close(opened);
+        }
+    }
+    if (usable && ::fanotify_mark(fanotifyFd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fanotifyMask_, AT_FDCWD,
+                                  root.c_str()) != 0) {
+#ifdef FAN_RENAME
+        // Kernels before 5.17 know no FAN_RENAME, renames then arrive as delete + create
+        if (errno == EINVAL && (fanotifyMask_ & FAN_RENAME)) {
+            fanotifyMask_ = (fanotifyMask_ & ~static_cast<uint64_t>(FAN_RENAME)) | FAN_MOVED_FROM | FAN_MOVED_TO;
+            usable = ::fanotify_mark(fanotifyFd_, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, fanotifyMask_, AT_FDCWD,
+                                     root.c_str()) == 0;
+        } else
+#endif
+        {
+            usable = false;
+        }
+    }
+    if (!usable) {
+        FM_INFO("fanotify unavailable for ", root, " (", std::strerror(errno), "), using inotify");
+        ::close(mountFd);
+        return false;
+    }
+    filesystems_.emplace(filesystem, MarkedFilesystem{mountFd, 1});
+    return true;
+#else
+    (void)root;
+    (void)filesystem;
+    return false;
+#endif
+}
+
+void ChangeFeed::unmarkFilesystem(const std::string& root, const std::string& filesystem) {
+#ifdef FAN_REPORT_DFID_NAME
+    const auto marked = filesystems_.find(filesystem);
+    if (marked == filesystems_.end() || --marked->second.roots > 0) {
+        return;
+    }
+    // The root may be gone by now, the mount descriptor is on the same filesystem
+    if (::fanotify_mark(fanotifyFd_, FAN_MARK_REMOVE | FAN_MARK_FILESYSTEM, fanotifyMask_, marked->second.mountFd,
+                        nullptr) != 0) {
+        FM_WARNING("Failed to remove fanotify mark for ", root, ": ", std::strerror(errno));
+    }
+    ::close(marked->second.mountFd);
+    filesystems_.erase(marked);
+    handlePaths_.clear();
+#else
+    (void)root;
+    (void)filesystem;
+#endif
+}
+
+FsStatus ChangeFeed::addInotifyTree(const std::string& root, bool recursive, bool reportContents) {
+    if (inotifyFd_ < 0) {
+        return FsStatus::failure(ENOSYS, "inotify_init1");
+    }
+    std::vector<std::string> pending{root};
+    DirectoryListing listing;
+    while (!pending.empty()) {
+        const std::string directory = std::move(pending.back());
+        pending.pop_back();
+
+        const int wd = ::inotify_add_watch(inotifyFd_, directory.c_str(), INOTIFY_MASK);
+        if (wd < 0) {
+            if (errno == ENOSPC) {
+                FM_WARNING("inotify watch limit (fs.inotify.max_user_watches) reached while watching ", root);
+                return FsStatus::failure(ENOSPC, "inotify_add_watch");
+            }
+            if (errno == ENOENT || errno == EACCES || errno == ENOTDIR) {
+                continue;   // removed meanwhile, or not ours to read
+            }
+            return FsStatus::failure(errno, "inotify_add_watch");
+        }
+        // The same inode watched again (e.g. a renamed directory) keeps its wd
+        const auto previous = watchPaths_.find(wd);
+        if (previous != watchPaths_.end() && previous->second != directory) {
+            watchOf_.erase(previous->second);
+        }
+        watchPaths_[wd] = directory;
+        watchOf_[directory] = wd;
+
+        if (!recursive) {
+            continue;
+        }
+        DirectoryEnumerator enumerator;
+        if (!enumerator.open(directory)) {
+            continue;
+        }
+        listing.clear();
+        for (;;) {
+            const auto added = enumerator.next(listing, WALK_CHUNK);
+            if (!added || added.value() == 0) {
+                break;
+            }
+        }
+        for (size_t row = 0; row < listing.size(); ++row) {
+            const std::string_view name = listing.name(row);
+            bool isDirectory = listing.isDirectory(row);
+            if (listing.type(row) == EntryType::UNKNOWN) {
+                struct stat st;
+                const std::string entry(name);
+                isDirectory = ::fstatat(enumerator.fd(), entry.c_str(), &st, AT_SYMLINK_NOFOLLOW) == 0 &&
+                              S_ISDIR(st.st_mode);
+            }
+            std::string child = childPath(directory, name);
+            // Entries that appeared before the watch did: their events were never queued
+            if (reportContents) {
+                coalescer_.add(ChangeCoalescer::Raw::CREATE, child, isDirectory);
+            }
+            if (isDirectory) {
+                pending.push_back(std::move(child));
+            }
+        }
+    }
+    return {};
+}
+
+void ChangeFeed::removeInotifyWatches(const std::string& root) {
+    for (auto it = watchOf_.begin(); it != watchOf_.end();) {
+        if (isUnder(it->first, root) && !coversDirectory(it->first)) {
+            ::inotify_rm_watch(inotifyFd_, it->second);
+            watchPaths_.erase(it->second);
+            it = watchOf_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void ChangeFeed::moveInotifyWatches(const std::string& from, const std::string& to) {
+    std::vector<std::pair<std::string, int>> moved;
+    for (const auto& [path, wd] : watchOf_) {
+        if (isUnder(path, from)) {
+            moved.emplace_back(path, wd);
+        }
+    }
+    for (const auto& [path, wd] : moved) {
+        watchOf_.erase(path);
+        std::string target = to.empty() ? std::string() : to + path.substr(from.size());
+        if (!target.empty() && coversDirectory(target)) {
+            watchPaths_[wd] = target;
+            watchOf_[std::move(target)] = wd;
+        } else {
+            // Moved out of every inotify root
+            ::inotify_rm_watch(inotifyFd_, wd);
+            watchPaths_.erase(wd);
+        }
+    }
+}
+
+bool ChangeFeed::isWatched(const std::string& path) const {
+    for (const auto& root : roots_) {
+        if (root.recursive ? isUnder(path, root.path) : (path == root.path || parentOf(path) == root.path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ChangeFeed::coversDirectory(const std::string& directory) const {
+    for (const auto& root : roots_) {
+        if (root.backend == Backend::INOTIFY &&
+            (root.recursive ? isUnder(directory, root.path) : directory == root.path)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void ChangeFeed::run() {
+    pollfd fds[3] = {{wakeFd_, POLLIN, 0}, {fanotifyFd_, POLLIN, 0}, {inotifyFd_, POLLIN, 0}};
+    bool windowOpen = false;
+    std::chrono::steady_clock::time_point deadline;
+
+    while (!stopping_) {
+        int timeout = -1;
+        if (windowOpen) {
+            const auto left = std::chrono::ceil<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+            timeout = static_cast<int>(std::max<int64_t>(0, left.count()));
+        }
+        if (::poll(fds, 3, timeout) < 0 && errno != EINTR) {
+            FM_ERROR("Change feed poll failed: ", std::strerror(errno));
+            return;
+        }
+        if (stopping_) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            uint64_t value;
+            (void)::read(wakeFd_, &value, sizeof(value));
+        }
+        if (fds[1].revents & POLLIN) {
+            readFanotify();
+        }
+        if (fds[2].revents & POLLIN) {
+            readInotify();
+        }
+
+        // The deadline is fixed by the first event, a storm cannot postpone delivery
+        if (!windowOpen) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (!coalescer_.empty()) {
+                windowOpen = true;
+                deadline = std::chrono::steady_clock::now() + window_;
+            }
+        }
+        if (windowOpen && std::chrono::steady_clock::now() >= deadline) {
+            windowOpen = false;
+            flush();
+        }
+    }
+}
+
+void ChangeFeed::readFanotify() {
+#ifdef FAN_REPORT_DFID_NAME
+    alignas(fanotify_event_metadata) static thread_local char buffer[READ_BUFFER];
+    for (;;) {
+        const ssize_t got = ::read(fanotifyFd_, buffer, sizeof(buffer));
+        if (got <= 0) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        ssize_t left = got;
+        for (auto* event = reinterpret_cast<fanotify_event_metadata*>(buffer); FAN_EVENT_OK(event, left);
+             event = FAN_EVENT_NEXT(event, left)) {
+            rawEvents_.fetch_add(1, std::memory_order_relaxed);
+            if (event->vers != FANOTIFY_METADATA_VERSION) {
+                continue;
+            }
+            if (event->fd >= 0) {
+                ::close(event->fd);
+            }
+            if (event->mask & FAN_Q_OVERFLOW) {
+                overflow(Backend::FANOTIFY);
+                continue;
+            }
+
+            // One directory handle + name record, two for FAN_RENAME (old and new)
+            std::string paths[2];
+            const char* record = reinterpret_cast<const char*>(event + 1);
+            const char* end = reinterpret_cast<const char*>(event) + event->event_len;
+            while (record + sizeof(fanotify_event_info_header) <= end) {
+                const auto* info = reinterpret_cast<const fanotify_event_info_fid*>(record);
+                if (info->hdr.len == 0) {
+                    break;
+                }
+                record += info->hdr.len;
+                int slot = -1;
+                if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_DFID_NAME) {
+                    slot = 0;
+#ifdef FAN_EVENT_INFO_TYPE_OLD_DFID_NAME
+                } else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_OLD_DFID_NAME) {
+                    slot = 0;
+                } else if (info->hdr.info_type == FAN_EVENT_INFO_TYPE_NEW_DFID_NAME) {
+                    slot = 1;
+#endif
+                }
+                if (slot < 0) {
+                    continue;
+                }
+                std::string fsid(reinterpret_cast<const char*>(&info->fsid), sizeof(info->fsid));
+                const auto marked = filesystems_.find(fsid);
+                if (marked == filesystems_.end()) {
+                    continue;   // unwatched since the event was queued
+                }
+                auto* handle = reinterpret_cast<file_handle*>(const_cast<unsigned char*>(info->handle));
+                const char* name = reinterpret_cast<const char*>(handle->f_handle + handle->handle_bytes);
+                std::string key = std::move(fsid);
+                key.append(reinterpret_cast<const char*>(handle), sizeof(file_handle) + handle->handle_bytes);
+                const std::string directory = directoryOfHandle(key, marked->second.mountFd, handle);
+                if (directory.empty()) {
+                    continue;   // the directory is gone, its own deletion covers this
+                }
+                paths[slot] = std::strcmp(name, ".") == 0 ? directory : childPath(directory, name);
+            }
+
+            const bool directory = event->mask & FAN_ONDIR;
+#ifdef FAN_RENAME
+            if (event->mask & FAN_RENAME) {
+                if (!paths[0].empty() && !paths[1].empty()) {
+                    renamed(paths[0], paths[1], directory);
+                } else if (!paths[0].empty()) {
+                    changed(RAW_DELETE, paths[0], directory);
+                } else if (!paths[1].empty()) {
+                    changed(RAW_CREATE, paths[1], directory);
+                }
+                continue;
+            }
+#endif
+            if (paths[0].empty()) {
+                continue;
+            }
+            uint32_t changes = 0;
+            if (event->mask & (FAN_CREATE | FAN_MOVED_TO)) changes |= RAW_CREATE;
+            if (event->mask & (FAN_MODIFY | FAN_CLOSE_WRITE)) changes |= RAW_MODIFY;
+            if (event->mask & FAN_ATTRIB) changes |= RAW_ATTRIB;
+            if (event->mask & (FAN_DELETE | FAN_MOVED_FROM)) changes |= RAW_DELETE;
+            changed(changes, paths[0], directory);
+        }
+        limitPending();
+    }
+#endif
+}
+
+void ChangeFeed::readInotify() {
+    alignas(inotify_event) static thread_local char buffer[READ_BUFFER];
+    for (;;) {
+        const ssize_t got = ::read(inotifyFd_, buffer, sizeof(buffer));
+        if (got <= 0) {
+            break;
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (ssize_t offset = 0; offset < got;) {
+            const auto* event = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += static_cast<ssize_t>(sizeof(inotify_event) + event->len);
+            rawEvents_.fetch_add(1, std::memory_order_relaxed);
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                overflow(Backend::INOTIFY);
+                continue;
+            }
+            const auto watched = watchPaths_.find(event->wd);
+            if (event->mask & IN_IGNORED) {
+                if (watched != watchPaths_.end()) {
+                    const auto back = watchOf_.find(watched->second);
+                    if (back != watchOf_.end() && back->second == event->wd) {
+                        watchOf_.erase(back);
+                    }
+                    watchPaths_.erase(watched);
+                }
+                continue;
+            }
+            if (watched == watchPaths_.end()) {
+                continue;
+            }
+            const std::string directory = watched->second;
+            const bool isDirectory = event->mask & IN_ISDIR;
+            if (event->mask & IN_DELETE_SELF) {
+                // Other directories are reported by their parent, roots have none watched
+                if (std::any_of(roots_.begin(), roots_.end(), [&directory](const Root& r) { return r.path == directory; })) {
+                    changed(RAW_DELETE, directory, true);
+                }
+                continue;
+            }
+            if (event->len == 0) {
+                continue;   // about the directory itself, its parent reports it too
+            }
+            const std::string path = childPath(directory, event->name);
+
+            if (event->mask & IN_MOVED_FROM) {
+                moves_[event->cookie] = {path, isDirectory};
+                continue;
+            }
+            if (event->mask & IN_MOVED_TO) {
+                const auto from = moves_.find(event->cookie);
+                if (from != moves_.end()) {
+                    const std::string source = std::move(from->second.first);
+                    moves_.erase(from);
+                    renamed(source, path, isDirectory);
+                } else {
+                    renamed(std::string(), path, isDirectory);   // moved in from outside
+                }
+                continue;
+            }
+            uint32_t changes = 0;
+            if (event->mask & IN_CREATE) changes |= RAW_CREATE;
+            if (event->mask & (IN_MODIFY | IN_CLOSE_WRITE)) changes |= RAW_MODIFY;
+            if (event->mask & IN_ATTRIB) changes |= RAW_ATTRIB;
+            if (event->mask & IN_DELETE) changes |= RAW_DELETE;
+            changed(changes, path, isDirectory);
+        }
+        limitPending();
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    finishMoves();
+}
+
+void ChangeFeed::changed(uint32_t changes, const std::string& path, bool directory) {
+    if (!isWatched(path)) {
+        return;
+    }
+    using Raw = ChangeCoalescer::Raw;
+    // fanotify merges queued events on the same name into one mask, losing
+    // their order; whether the name exists now tells delete+create (replaced)
+    // from create+delete (temporary)
+    const bool deleteFirst = (changes & RAW_CREATE) && (changes & RAW_DELETE) && lexists(path);
+    if (deleteFirst) {
+        coalescer_.add(Raw::DELETE, path, directory);
+    }
+    if (changes & RAW_CREATE) {
+        coalescer_.add(Raw::CREATE, path, directory);
+        if (directory && coversDirectory(path)) {
+            (void)addInotifyTree(path, true, true);
+        }
+    }
+    if (changes & RAW_MODIFY) {
+        coalescer_.add(Raw::MODIFY, path, directory);
+    }
+    if (changes & RAW_ATTRIB) {
+        coalescer_.add(Raw::ATTRIB, path, directory);
+    }
+    if ((changes & RAW_DELETE) && !deleteFirst) {
+        coalescer_.add(Raw::DELETE, path, directory);
+    }
+    if (directory && (changes & RAW_DELETE)) {
+        handlePaths_.clear();
+    }
+}
+
+void ChangeFeed::renamed(const std::string& from, const std::string& to, bool directory) {
+    const bool fromWatched = !from.empty() && isWatched(from);
+    const bool toWatched = !to.empty() && isWatched(to);
+    if (directory) {
+        handlePaths_.clear();
+        const bool hadWatches = !from.empty() && coversDirectory(from);
+        if (hadWatches) {
+            moveInotifyWatches(from, to);
+        }
+        if (!to.empty() && !hadWatches && coversDirectory(to)) {
+            (void)addInotifyTree(to, true, false);
+        }
+    }
+    if (fromWatched && toWatched) {
+        coalescer_.rename(from, to, directory);
+    } else if (fromWatched) {
+        coalescer_.add(ChangeCoalescer::Raw::DELETE, from, directory);
+    } else if (toWatched) {
+        coalescer_.add(ChangeCoalescer::Raw::CREATE, to, directory);
+    }
+}
+
+void ChangeFeed::finishMoves() {
+    // No IN_MOVED_TO came: moved somewhere outside the watched directories
+    for (auto& [cookie, move] : moves_) {
+        renamed(move.first, std::string(), move.second);
+    }
+    moves_.clear();
+}
+
+void ChangeFeed::overflow(Backend backend) {
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    handlePaths_.clear();
+    for (const auto& root : roots_) {
+        if (root.backend == backend) {
+            coalescer_.rescan(root.path);
+        }
+    }
+    FM_WARNING("Change feed lost events, roots will be rescanned");
+}
+
+void ChangeFeed::limitPending() {
+    if (coalescer_.size() <= MAX_PENDING) {
+        return;
+    }
+    // Reporting this many paths one by one costs the subscribers more than re-reading
+    coalescer_.clear();
+    overflows_.fetch_add(1, std::memory_order_relaxed);
+    for (const auto& root : roots_) {
+        coalescer_.rescan(root.path);
+    }
+}
+
+std::string ChangeFeed::directoryOfHandle(const std::string& key, int mountFd, void* handle) {
+    const auto cached = handlePaths_.find(key);
+    if (cached != handlePaths_.end()) {
+        return cached->second;
+    }
+    const int fd = ::open_by_handle_at(mountFd, static_cast<file_handle*>(handle), O_PATH | O_CLOEXEC);
+    if (fd < 0) {
+        return {};   // ESTALE: deleted
+    }
+    char link[32];
+    std::snprintf(link, sizeof(link), "/proc/self/fd/%d", fd);
+    char target[PATH_MAX];
+    const ssize_t length = ::readlink(link, target, sizeof(target));
+    ::close(fd);
+    if (length <= 0 || static_cast<size_t>(length) >= sizeof(target)) {
+        return {};
+    }
+    std::string path(target, static_cast<size_t>(length));
+    // Unlinked while we looked, the kernel appends " (deleted)"
+    static constexpr std::string_view DELETED_SUFFIX = " (deleted)";
+    if (path.size() > DELETED_SUFFIX.size() &&
+        path.compare(path.size() - DELETED_SUFFIX.size(), DELETED_SUFFIX.size(), DELETED_SUFFIX) == 0 &&
+        !lexists(path)) {
+        return {};
+    }
+    if (handlePaths_.size() >= MAX_HANDLE_PATHS) {
+        handlePaths_.clear();
+    }
+    handlePaths_.emplace(key, path);
+    return path;
+}
+
+void ChangeFeed::flush() {
+    std::vector<ChangeEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events = coalescer_.take();
+        handlePaths_.clear();   // directories renamed since resolve to their new path
+    }
+    if (events.empty()) {
+        return;
+    }
+
+    static const MetricId metric = Metrics::registerOperation("change_feed.batch");
+    MetricsScope metrics(metric);
+    metrics.addEntries(events.size());
+    TraceScope trace("change_feed", "flush");
+    deliveredEvents_.fetch_add(events.size(), std::memory_order_relaxed);
+
+    // A subscriber sees what happened below its prefix, and the deletion,
+    // rename or rescan of a directory above it
+    const auto concerns = [](const ChangeEvent& event, const std::string& prefix) {
+        if (isUnder(event.path, prefix) || (!event.oldPath.empty() && isUnder(event.oldPath, prefix))) {
+            return true;
+        }
+        if (event.kind != ChangeKind::DELETED && event.kind != ChangeKind::RENAMED &&
+            event.kind != ChangeKind::RESCAN) {
+            return false;
+        }
+        return isUnder(prefix, event.path) || (!event.oldPath.empty() && isUnder(prefix, event.oldPath));
+    };
+
+    std::lock_guard<std::mutex> lock(subscribersMutex_);
+    std::vector<ChangeEvent> selected;
+    for (const auto& subscription : subscribers_) {
+        const std::vector<ChangeEvent>* batch = &events;
+        if (!subscription.prefix.empty()) {
+            selected.clear();
+            for (const auto& event : events) {
+                if (concerns(event, subscription.prefix)) {
+                    selected.push_back(event);
+                }
+            }
+            if (selected.empty()) {
+                continue;
+            }
+            batch = &selected;
+        }
+        try {
+            subscription.callback(*batch);
+        } catch (const std::exception& e) {
+            FM_ERROR("Change feed subscriber failed: ", e.what());
+        }
+    }
+}
@@ -0,0 +1,568 @@
+#include "copy_engine.hpp"
+#include "metrics.hpp"
+#include "xxhash64.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/aio_abi.h>
+#include <linux/fs.h>
+#include <memory>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Closes a descriptor when leaving the scope
+struct FdGuard {
+    int fd;
+    ~FdGuard() {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+};
+
+// Fallback when copy_file_range is not possible, returns bytes copied or -1
+static ssize_t copyChunkReadWrite(int in, int out, char* buffer, size_t size) {
+    ssize_t n;
+    do {
+        n = ::read(in, buffer, size);
+    } while (n < 0 && errno == EINTR);
+    if (n <= 0) {
+        return n;
+    }
+    ssize_t written = 0;
+    while (written < n) {
+        const ssize_t w = ::write(out, buffer + written, static_cast<size_t>(n - written));
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        written += w;
+    }
+    return n;
+}
+
+// pwrite() all of `size` bytes, false with errno set on failure
+static bool writeAllAt(int fd, const char* data, size_t size, uint64_t offset) {
+    while (size > 0) {
+        const ssize_t w = ::pwrite(fd, data, size, static_cast<off_t>(offset));
+        if (w < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += w;
+        size -= static_cast<size_t>(w);
+        offset += static_cast<uint64_t>(w);
+    }
+    return true;
+}
+
+static bool setDirect(int fd, bool direct) {
+    const int flags = ::fcntl(fd, F_GETFL);
+    return flags >= 0 && ::fcntl(fd, F_SETFL, direct ? flags | O_DIRECT : flags & ~O_DIRECT) == 0;
+}
+
+// Linux native AIO through the raw syscalls (no libaio). With O_DIRECT the
+// requests go to the device as they are, unlike glibc's POSIX AIO, which
+// runs them on helper threads through the page cache
+class AioContext {
+public:
+    explicit AioContext(unsigned depth) {
+#if defined(SYS_io_setup) && defined(SYS_io_getevents)
+        if (::syscall(SYS_io_setup, depth, &context_) != 0) {
+            context_ = 0;   // no CONFIG_AIO, aio-max-nr reached, seccomp
+        }
+#else
+        (void)depth;
+#endif
+    }
+
+    // Waits for requests still in flight
+    ~AioContext() {
+#if defined(SYS_io_setup) && defined(SYS_io_getevents)
+        if (context_) {
+            ::syscall(SYS_io_destroy, context_);
+        }
+#endif
+    }
+
+    bool valid() const { return context_ != 0; }
+
+    // 0 or an errno
+    int submit(iocb* request) {
+#if defined(SYS_io_setup) && defined(SYS_io_getevents)
+        iocb* requests[1] = {request};
+        long submitted;
+        do {
+            submitted = ::syscall(SYS_io_submit, context_, 1, requests);
+        } while (submitted < 0 && errno == EINTR);
+        return submitted == 1 ? 0 : (submitted < 0 ? errno : EAGAIN);
+#else
+        (void)request;
+        return ENOSYS;
+#endif
+    }
+
+    // Blocks for at least one completion, returns how many or -1
+    long wait(io_event* events, long max) {
+#if defined(SYS_io_setup) && defined(SYS_io_getevents)
+        long completed;
+        do {
+            completed = ::syscall(SYS_io_getevents, context_, 1, max, events, nullptr);
+        } while (completed < 0 && errno == EINTR);
+        return completed;
+#else
+        (void)events;
+        (void)max;
+        return -1;
+#endif
+    }
+
+    AioContext(const AioContext&) = delete;
+    AioContext& operator=(const AioContext&) = delete;
+
+private:
+    aio_context_t context_ = 0;
+};
+
+// One buffer of a DIRECT copy, reading a chunk and then writing it
+struct DirectSlot {
+    BufferPool::Buffer buffer;
+    iocb request{};
+    uint64_t offset = 0;
+    size_t length = 0;
+    bool writing = false;
+};
+
+// Copies [0, end) of two O_DIRECT descriptors, `end` aligned; `written` gets
+// the bytes that reached the destination
+static FsStatus transferDirect(int in, int out, uint64_t end, const CopyEngine::Progress& progress,
+                               MetricsScope& scope, uint64_t& written) {
+    DirectSlot slots[CopyEngine::DIRECT_QUEUE_DEPTH];
+    unsigned slotCount = 0;
+    for (DirectSlot& slot : slots) {
+        if (end <= slotCount * static_cast<uint64_t>(CopyEngine::CHUNK_SIZE)) {
+            break;   // a small file does not need every buffer
+        }
+        slot.buffer = CopyEngine::bufferPool().acquire();
+        if (!slot.buffer) {
+            break;
+        }
+        ++slotCount;
+    }
+    if (slotCount == 0) {
+        return end == 0 ? FsStatus() : FsStatus::failure(ENOMEM, "copy buffer");
+    }
+
+    uint64_t next = 0;
+    FsStatus status;
+    auto completed = [&](DirectSlot& slot) {
+        written += slot.length;
+        scope.addBytes(slot.length);
+        if (progress && !progress(slot.length)) {
+            status = FsStatus::failure(ECANCELED, "copy");
+        }
+    };
+
+    AioContext aio(slotCount);
+    if (!aio.valid()) {
+        // One chunk at a time, still around the page cache
+        DirectSlot& slot = slots[0];
+        while (next < end && status) {
+            slot.offset = next;
+            slot.length = static_cast<size_t>(std::min<uint64_t>(CopyEngine::CHUNK_SIZE, end - next));
+            ssize_t n;
+            do {
+                n = ::pread(in, slot.buffer.data(), slot.length, static_cast<off_t>(next));
+            } while (n < 0 && errno == EINTR);
+            if (n < 0) {
+                return FsStatus::failure(errno, "read source");
+            }
+            if (static_cast<size_t>(n) != slot.length) {
+                return FsStatus::failure(EIO, "source shrank during copy");
+            }
+            if (!writeAllAt(out, slot.buffer.data(), slot.length, next)) {
+                return FsStatus::failure(errno, "write destination");
+            }
+            completed(slot);
+            next += slot.length;
+        }
+        return status;
+    }
+
+    unsigned inFlight = 0;
+    auto submit = [&](DirectSlot& slot, bool write) {
+        std::memset(&slot.request, 0, sizeof(slot.request));
+        slot.request.aio_data = reinterpret_cast<uint64_t>(&slot);
+        slot.request.aio_lio_opcode = write ? IOCB_CMD_PWRITE : IOCB_CMD_PREAD;
+        slot.request.aio_fildes = static_cast<uint32_t>(write ? out : in);
+        slot.request.aio_buf = reinterpret_cast<uint64_t>(slot.buffer.data());
+        slot.request.aio_nbytes = slot.length;
+        slot.request.aio_offset = static_cast<int64_t>(slot.offset);
+        slot.writing = write;
+        if (const int code = aio.submit(&slot.request)) {
+            status = FsStatus::failure(code, write ? "submit write" : "submit read");
+            return;
+        }
+        ++inFlight;
+    };
+    auto readNext = [&](DirectSlot& slot) {
+        if (next < end && status) {
+            slot.offset = next;
+            slot.length = static_cast<size_t>(std::min<uint64_t>(CopyEngine::CHUNK_SIZE, end - next));
+            next += slot.length;
+            submit(slot, false);
+        }
+    };
+
+    for (unsigned i = 0; i < slotCount; ++i) {
+        readNext(slots[i]);
+    }
+    // A chunk that was read is written from the same buffer, a buffer that
+    // was written reads the next chunk. After a failure nothing new is
+    // submitted and what is in flight drains
+    io_event events[CopyEngine::DIRECT_QUEUE_DEPTH];
+    while (inFlight > 0) {
+        const long count = aio.wait(events, static_cast<long>(slotCount));
+        if (count < 0) {
+            return FsStatus::failure(errno, "io_getevents");   // ~AioContext waits for the rest
+        }
+        for (long i = 0; i < count; ++i) {
+            DirectSlot& slot = *reinterpret_cast<DirectSlot*>(events[i].data);
+            --inFlight;
+            const int64_t result = events[i].res;
+            if (!status) {
+                continue;
+            }
+            if (result < 0) {
+                status = FsStatus::failure(static_cast<int>(-result), slot.writing ? "write destination" : "read source");
+            } else if (static_cast<uint64_t>(result) != slot.length) {
+                status = FsStatus::failure(EIO, slot.writing ? "short write" : "source shrank during copy");
+            } else if (!slot.writing) {
+                submit(slot, true);
+            } else {
+                completed(slot);
+                readNext(slot);
+            }
+        }
+    }
+    return status;
+}
+
+static std::atomic<uint64_t>& directThresholdValue() {
+    static std::atomic<uint64_t> threshold{[] {
+        const char* megabytes = std::getenv("FM_COPY_DIRECT_MB");
+        return megabytes ? std::strtoull(megabytes, nullptr, 10) * 1024 * 1024
+                         : CopyEngine::DEFAULT_DIRECT_THRESHOLD;
+    }()};
+    return threshold;
+}
+
+// Opens the source (a regular file) and creates the destination with its
+// permission bits, `size` gets the size of the source
+static FsStatus openCopy(const fs::path& source, const fs::path& destination, bool overwrite,
+                         FdGuard& in, FdGuard& out, uint64_t& size) {
+    in.fd = ::open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in.fd < 0) {
+        return FsStatus::failure(errno, "open source");
+    }
+    struct stat st {};
+    if (::fstat(in.fd, &st) != 0) {
+        return FsStatus::failure(errno, "stat source");
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return FsStatus::failure(EINVAL, "not a regular file");
+    }
+    size = static_cast<uint64_t>(st.st_size);
+    ::posix_fadvise(in.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    // Truncated only once it is known not to be the source: "a" onto "./a"
+    // or a hard link of it would otherwise empty the file being copied
+    const int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (overwrite ? 0 : O_EXCL);
+    out.fd = ::open(destination.c_str(), flags, st.st_mode & 07777);
+    if (out.fd < 0) {
+        return FsStatus::failure(errno, "open destination");
+    }
+    struct stat target {};
+    if (::fstat(out.fd, &target) != 0) {
+        return FsStatus::failure(errno, "stat destination");
+    }
+    if (target.st_dev == st.st_dev && target.st_ino == st.st_ino) {
+        return FsStatus::failure(EINVAL, "source and destination are the same file");
+    }
+    if (target.st_size != 0 && ::ftruncate(out.fd, 0) != 0) {
+        return FsStatus::failure(errno, "truncate destination");
+    }
+    return {};
+}
+
+FsStatus CopyEngine::copyFile(const fs::path& source, const fs::path& destination,
+                              bool overwrite, const Progress& progress, TransferMode mode) {
+    static const MetricId metric = Metrics::registerOperation("copy.file");
+    MetricsScope scope(metric);
+
+    FdGuard in{-1};
+    FdGuard out{-1};
+    uint64_t size = 0;
+    const FsStatus opened = openCopy(source, destination, overwrite, in, out, size);
+    if (!opened) {
+        scope.fail();
+        return opened;
+    }
+
+    // From here on a failure leaves no half-written destination behind
+    auto fail = [&](int code, const char* context) {
+        ::close(out.fd);
+        out.fd = -1;
+        ::unlink(destination.c_str());
+        scope.fail();
+        return FsStatus::failure(code, context);
+    };
+
+    if (mode == TransferMode::AUTO) {
+        const uint64_t threshold = directThreshold();
+        mode = threshold != 0 && size >= threshold ? TransferMode::DIRECT : TransferMode::BUFFERED;
+#ifdef FICLONE
+        // Same filesystem with reflinks (btrfs, XFS): the extents are shared
+        // and no data moves at all, better than any way of copying it
+        if (mode == TransferMode::DIRECT && ::ioctl(out.fd, FICLONE, in.fd) == 0) {
+            scope.addBytes(size);
+            if (progress) {
+                progress(size);   // done already, nothing left to stop
+            }
+            mode = TransferMode::BUFFERED;
+            ::lseek(in.fd, 0, SEEK_END);
+            ::lseek(out.fd, 0, SEEK_END);
+        }
+#endif
+    }
+
+    // The aligned part around the page cache, the buffered loop below does
+    // the tail (and whatever was appended to the source meanwhile)
+    bool preallocated = false;
+    if (mode == TransferMode::DIRECT) {
+        uint64_t copied = 0;
+        if (setDirect(in.fd, true) && setDirect(out.fd, true)) {
+            static const MetricId directMetric = Metrics::registerOperation("copy.direct");
+            MetricsScope directScope(directMetric);
+            const uint64_t aligned = size / DIRECT_ALIGNMENT * DIRECT_ALIGNMENT;
+            preallocated = aligned > 0 && ::fallocate(out.fd, 0, 0, static_cast<off_t>(size)) == 0;
+            const FsStatus status = transferDirect(in.fd, out.fd, aligned, progress, directScope, copied);
+            if (!status) {
+                directScope.fail();
+                // Flag accepted, I/O refused before anything was written: buffered from the start
+                if (status.code() != EINVAL || copied != 0) {
+                    return fail(status.code(), status.context());
+                }
+            }
+        }
+        if (!setDirect(in.fd, false) || !setDirect(out.fd, false)) {
+            return fail(errno, "clear O_DIRECT");
+        }
+        scope.addBytes(copied);
+        ::lseek(in.fd, static_cast<off_t>(copied), SEEK_SET);
+        ::lseek(out.fd, static_cast<off_t>(copied), SEEK_SET);
+    }
+
+    bool useCopyFileRange = true;
+    std::unique_ptr<char[]> buffer;
+    while (true) {
+        ssize_t n = -1;
+        if (useCopyFileRange) {
+            n = ::copy_file_range(in.fd, nullptr, out.fd, nullptr, CHUNK_SIZE, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL || errno == EOPNOTSUPP)) {
+                useCopyFileRange = false;
+                continue;
+            }
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+        } else {
+            if (!buffer) {
+                buffer.reset(new char[CHUNK_SIZE]);
+            }
+            n = copyChunkReadWrite(in.fd, out.fd, buffer.get(), CHUNK_SIZE);
+        }
+        if (n < 0) {
+            return fail(errno, "copy");
+        }
+        if (n == 0) {
+            break;
+        }
+        scope.addBytes(static_cast<uint64_t>(n));
+        if (progress && !progress(static_cast<uint64_t>(n))) {
+            return fail(ECANCELED, "copy");
+        }
+    }
+
+    // The source may have shrunk below the preallocated size
+    if (preallocated) {
+        const off_t end = ::lseek(out.fd, 0, SEEK_CUR);
+        if (end < 0 || ::ftruncate(out.fd, end) != 0) {
+            return fail(errno, "truncate destination");
+        }
+    }
+
+    if (::close(out.fd) != 0) {
+        out.fd = -1;
+        ::unlink(destination.c_str());
+        scope.fail();
+        return FsStatus::failure(errno, "close destination");
+    }
+    out.fd = -1;
+    return {};
+}
+
+uint64_t CopyEngine::directThreshold() {
+    return directThresholdValue().load(std::memory_order_relaxed);
+}
+
+void CopyEngine::setDirectThreshold(uint64_t bytes) {
+    directThresholdValue().store(bytes, std::memory_order_relaxed);
+}
+
+BufferPool& CopyEngine::bufferPool() {
+    // Leaked, copies on other threads may still return buffers at exit
+    static BufferPool* pool = new BufferPool(CHUNK_SIZE, 2 * DIRECT_QUEUE_DEPTH);
+    return *pool;
+}
+
+FsResult<uint64_t> CopyEngine::copyVerified(const fs::path& source, const fs::path& destination, bool overwrite,
+                                            VerifyMode mode, const Progress& progress) {
+    static const MetricId metric = Metrics::registerOperation("copy.verified");
+    MetricsScope scope(metric);
+
+    FdGuard in{-1};
+    FdGuard out{-1};
+    uint64_t size = 0;
+    const FsStatus opened = openCopy(source, destination, overwrite, in, out, size);
+    if (!opened) {
+        scope.fail();
+        return FsResult<uint64_t>::failure(opened.code(), opened.context());
+    }
+
+    FdGuard check{-1};
+    auto fail = [&](int code, const char* context) {
+        ::close(out.fd);
+        out.fd = -1;
+        ::unlink(destination.c_str());
+        scope.fail();
+        return FsResult<uint64_t>::failure(code, context);
+    };
+
+    // Aligned so the same buffer serves the O_DIRECT read back
+    BufferPool::Buffer buffer = bufferPool().acquire();
+    if (!buffer) {
+        return fail(ENOMEM, "copy buffer");
+    }
+
+    // Read once, hashed and written from the same buffer
+    Xxh64 copied;
+    uint64_t total = 0;
+    while (true) {
+        const ssize_t n = ::read(in.fd, buffer.data(), CHUNK_SIZE);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return fail(errno, "read source");
+        }
+        if (n == 0) {
+            break;
+        }
+        copied.update(buffer.data(), static_cast<size_t>(n));
+        for (ssize_t written = 0; written < n;) {
+            const ssize_t w = ::write(out.fd, buffer.data() + written, static_cast<size_t>(n - written));
+            if (w < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                return fail(errno, "write destination");
+            }
+            written += w;
+        }
+        total += static_cast<uint64_t>(n);
+        scope.addBytes(static_cast<uint64_t>(n));
+        if (progress && !progress(static_cast<uint64_t>(n))) {
+            return fail(ECANCELED, "copy");
+        }
+    }
+
+    // On disk before it is evicted or bypassed, otherwise the read back
+    // could only ever see the page cache
+    if (::fdatasync(out.fd) != 0) {
+        return fail(errno, "fdatasync destination");
+    }
+
+    bool direct = mode == VerifyMode::DIRECT;
+    auto openCheck = [&]() {
+        if (direct) {
+            check.fd = ::open(destination.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+            if (check.fd >= 0 || errno != EINVAL) {
+                return;
+            }
+            direct = false;   // tmpfs and some FUSE filesystems have no O_DIRECT
+        }
+        check.fd = ::open(destination.c_str(), O_RDONLY | O_CLOEXEC);
+        if (check.fd >= 0) {
+            ::posix_fadvise(check.fd, 0, 0, POSIX_FADV_DONTNEED);
+            ::posix_fadvise(check.fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        }
+    };
+    openCheck();
+    if (check.fd < 0) {
+        return fail(errno, "open destination for verify");
+    }
+
+    Xxh64 readBack;
+    uint64_t offset = 0;
+    while (true) {
+        const ssize_t n = ::pread(check.fd, buffer.data(), CHUNK_SIZE, static_cast<off_t>(offset));
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno == EINVAL && direct && offset == 0) {
+                // Accepted at open, refused at read: fall back to the evicted read
+                ::close(check.fd);
+                direct = false;
+                openCheck();
+                if (check.fd < 0) {
+                    return fail(errno, "open destination for verify");
+                }
+                continue;
+            }
+            return fail(errno, "read destination");
+        }
+        if (n == 0) {
+            break;
+        }
+        readBack.update(buffer.data(), static_cast<size_t>(n));
+        offset += static_cast<uint64_t>(n);
+        if (progress && !progress(0)) {
+            return fail(ECANCELED, "verify");
+        }
+    }
+
+    const uint64_t digest = copied.digest();
+    if (offset != total || readBack.digest() != digest) {
+        return fail(EIO, "verify");
+    }
+
+    if (::close(out.fd) != 0) {
+        out.fd = -1;
+        ::unlink(destination.c_str());
+        scope.fail();
+        return FsResult<uint64_t>::failure(errno, "close destination");
+    }
+    out.fd = -1;
+    return digest;
+}
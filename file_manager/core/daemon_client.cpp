@@ -0,0 +1,133 @@
+#include "daemon_client.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+DaemonClient::~DaemonClient() {
+    close();
+}
+
+FsStatus DaemonClient::connect(const std::string& socketPath) {
+    close();
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        return FsStatus::failure(ENAMETOOLONG, "socket path");
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return FsStatus::failure(errno, "socket");
+    }
+    if (::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const int error = errno;
+        ::close(fd);
+        return FsStatus::failure(error, "connect");
+    }
+    fd_ = fd;
+    return {};
+}
+
+void DaemonClient::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    output_.clear();
+    input_.clear();
+    inputOffset_ = 0;
+    rejected_.clear();
+}
+
+uint32_t DaemonClient::send(fmd::Opcode opcode, std::vector<std::string> args) {
+    fmd::Request request;
+    request.id = nextId_++;
+    request.opcode = opcode;
+    request.args = std::move(args);
+    if (!fmd::encodeRequest(output_, request)) {
+        fmd::Response refused;
+        refused.id = request.id;
+        refused.status = fmd::Status::BAD_REQUEST;
+        refused.error = E2BIG;
+        rejected_.push_back(std::move(refused));
+    }
+    return request.id;
+}
+
+FsStatus DaemonClient::flush() {
+    size_t offset = 0;
+    while (offset < output_.size()) {
+        const ssize_t sent = ::send(fd_, output_.data() + offset, output_.size() - offset, MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const int error = errno;
+            output_.clear();
+            return FsStatus::failure(error, "send");
+        }
+        offset += static_cast<size_t>(sent);
+    }
+    output_.clear();
+    return {};
+}
+
+FsResult<fmd::Response> DaemonClient::receive() {
+    if (!rejected_.empty()) {
+        fmd::Response refused = std::move(rejected_.front());
+        rejected_.pop_front();
+        return refused;
+    }
+    if (fd_ < 0) {
+        return FsResult<fmd::Response>::failure(ENOTCONN, "receive");
+    }
+    if (!output_.empty()) {
+        const FsStatus flushed = flush();
+        if (!flushed) {
+            return FsResult<fmd::Response>::failure(flushed.code(), flushed.context());
+        }
+    }
+    while (true) {
+        fmd::Response response;
+        size_t consumed = 0;
+        const fmd::Parse parse = fmd::decodeResponse(input_.data() + inputOffset_, input_.size() - inputOffset_,
+                                                     response, consumed);
+        if (parse == fmd::Parse::COMPLETE) {
+            inputOffset_ += consumed;
+            if (inputOffset_ == input_.size()) {
+                input_.clear();
+                inputOffset_ = 0;
+            }
+            return response;
+        }
+        if (parse == fmd::Parse::INVALID) {
+            return FsResult<fmd::Response>::failure(EPROTO, "receive");
+        }
+
+        if (inputOffset_ > 0) {
+            input_.erase(0, inputOffset_);
+            inputOffset_ = 0;
+        }
+        char buffer[64 * 1024];
+        const ssize_t got = ::read(fd_, buffer, sizeof(buffer));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return FsResult<fmd::Response>::failure(errno, "read");
+        }
+        if (got == 0) {
+            return FsResult<fmd::Response>::failure(ECONNRESET, "read");
+        }
+        input_.append(buffer, static_cast<size_t>(got));
+    }
+}
+
+FsResult<fmd::Response> DaemonClient::call(fmd::Opcode opcode, std::vector<std::string> args) {
+    send(opcode, std::move(args));
+    return receive();
+}
@@ -0,0 +1,230 @@
+#include "daemon_protocol.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+namespace fmd {
+
+namespace {
+
+// Bytes of the fixed part of a frame after the length field
+constexpr size_t REQUEST_HEADER = 4 + 1 + 1;
+constexpr size_t RESPONSE_HEADER = 4 + 1 + 4 + 4;
+constexpr size_t ITEM_HEADER = 1 + 4;
+
+template<typename T>
+void put(std::string& out, T value) {
+    out.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// Sequential reader over one frame, fails instead of reading past the end
+class Reader {
+public:
+    Reader(const char* data, size_t size) : data_(data), end_(data + size) {}
+
+    template<typename T>
+    bool get(T& value) {
+        if (static_cast<size_t>(end_ - data_) < sizeof(T)) {
+            return false;
+        }
+        std::memcpy(&value, data_, sizeof(T));
+        data_ += sizeof(T);
+        return true;
+    }
+
+    bool getString(std::string& value) {
+        uint32_t length = 0;
+        if (!get(length) || static_cast<size_t>(end_ - data_) < length) {
+            return false;
+        }
+        value.assign(data_, length);
+        data_ += length;
+        return true;
+    }
+
+    bool atEnd() const { return data_ == end_; }
+
+private:
+    const char* data_;
+    const char* end_;
+};
+
+// Splits off the length prefix; COMPLETE leaves the frame body in `body`/`bodySize`
+Parse frameOf(const char* data, size_t size, size_t minimum, const char*& body, uint32_t& bodySize) {
+    if (size < sizeof(uint32_t)) {
+        return Parse::INCOMPLETE;
+    }
+    std::memcpy(&bodySize, data, sizeof(bodySize));
+    if (bodySize > MAX_FRAME || bodySize < minimum) {
+        return Parse::INVALID;
+    }
+    if (size - sizeof(uint32_t) < bodySize) {
+        return Parse::INCOMPLETE;
+    }
+    body = data + sizeof(uint32_t);
+    return Parse::COMPLETE;
+}
+
+// Writes the final length into the placeholder at `start`
+void patchLength(std::string& out, size_t start) {
+    const uint32_t length = static_cast<uint32_t>(out.size() - start - sizeof(uint32_t));
+    std::memcpy(&out[start], &length, sizeof(length));
+}
+
+} // namespace
+
+size_t responseLength(size_t items, size_t valueBytes) {
+    return RESPONSE_HEADER + items * ITEM_HEADER + valueBytes;
+}
+
+bool encodeRequest(std::string& out, const Request& request) {
+    if (request.args.size() > MAX_ARGS) {
+        return false;
+    }
+    size_t length = REQUEST_HEADER;
+    for (const auto& arg : request.args) {
+        length += sizeof(uint32_t) + arg.size();
+    }
+    if (length > MAX_FRAME) {
+        return false;
+    }
+    const size_t start = out.size();
+    put<uint32_t>(out, 0);
+    put<uint32_t>(out, request.id);
+    put<uint8_t>(out, static_cast<uint8_t>(request.opcode));
+    put<uint8_t>(out, static_cast<uint8_t>(request.args.size()));
+    for (const auto& arg : request.args) {
+        put<uint32_t>(out, static_cast<uint32_t>(arg.size()));
+        out += arg;
+    }
+    patchLength(out, start);
+    return true;
+}
+
+void encodeResponse(std::string& out, const Response& response) {
+    ResponseWriter writer(out, response.id, response.status, response.error);
+    for (const auto& item : response.items) {
+        writer.add(item.tag, item.value);
+    }
+    writer.finish();
+}
+
+ResponseWriter::ResponseWriter(std::string& out, uint32_t id, Status status, int32_t error)
+    : out_(out), start_(out.size()), id_(id)
+{
+    put<uint32_t>(out_, 0);
+    put<uint32_t>(out_, id);
+    put<uint8_t>(out_, static_cast<uint8_t>(status));
+    put<int32_t>(out_, error);
+    countOffset_ = out_.size();
+    put<uint32_t>(out_, 0);
+    cursor_ = out_.size();
+}
+
+void ResponseWriter::reserve(size_t items, size_t valueBytes) {
+    const size_t needed = cursor_ + items * ITEM_HEADER + valueBytes;
+    if (out_.size() < needed) {
+        out_.resize(needed);
+    }
+}
+
+void ResponseWriter::add(uint8_t tag, std::string_view value) {
+    // Runs once per directory entry: plain stores, no append() bookkeeping
+    const size_t needed = ITEM_HEADER + value.size();
+    if (out_.size() - cursor_ < needed) {
+        out_.resize(std::max(cursor_ + needed, out_.size() * 2));
+    }
+    char* item = &out_[cursor_];
+    const uint32_t length = static_cast<uint32_t>(value.size());
+    item[0] = static_cast<char>(tag);
+    std::memcpy(item + 1, &length, sizeof(length));
+    std::memcpy(item + ITEM_HEADER, value.data(), value.size());
+    cursor_ += needed;
+    ++count_;
+}
+
+void ResponseWriter::finish() {
+    if (cursor_ - start_ - sizeof(uint32_t) > MAX_FRAME) {
+        // The client would drop the connection on it: an error it can read
+        out_.resize(start_);
+        ResponseWriter(out_, id_, Status::FAILED, EFBIG).finish();
+        return;
+    }
+    out_.resize(cursor_);
+    std::memcpy(&out_[countOffset_], &count_, sizeof(count_));
+    patchLength(out_, start_);
+}
+
+Parse decodeRequest(const char* data, size_t size, Request& out, size_t& consumed) {
+    const char* body = nullptr;
+    uint32_t bodySize = 0;
+    const Parse frame = frameOf(data, size, REQUEST_HEADER, body, bodySize);
+    if (frame != Parse::COMPLETE) {
+        return frame;
+    }
+
+    Reader reader(body, bodySize);
+    uint8_t opcode = 0;
+    uint8_t argc = 0;
+    reader.get(out.id);
+    reader.get(opcode);
+    reader.get(argc);
+    out.opcode = static_cast<Opcode>(opcode);
+    out.args.resize(argc);
+    for (auto& arg : out.args) {
+        if (!reader.getString(arg)) {
+            return Parse::INVALID;
+        }
+    }
+    if (!reader.atEnd()) {
+        return Parse::INVALID;
+    }
+    consumed = sizeof(uint32_t) + bodySize;
+    return Parse::COMPLETE;
+}
+
+Parse decodeResponse(const char* data, size_t size, Response& out, size_t& consumed) {
+    const char* body = nullptr;
+    uint32_t bodySize = 0;
+    const Parse frame = frameOf(data, size, RESPONSE_HEADER, body, bodySize);
+    if (frame != Parse::COMPLETE) {
+        return frame;
+    }
+
+    Reader reader(body, bodySize);
+    uint8_t status = 0;
+    uint32_t count = 0;
+    reader.get(out.id);
+    reader.get(status);
+    reader.get(out.error);
+    reader.get(count);
+    out.status = static_cast<Status>(status);
+    // A larger count than fits is a corrupt frame
+    if (count > bodySize / ITEM_HEADER) {
+        return Parse::INVALID;
+    }
+    out.items.resize(count);
+    for (auto& item : out.items) {
+        if (!reader.get(item.tag) || !reader.getString(item.value)) {
+            return Parse::INVALID;
+        }
+    }
+    if (!reader.atEnd()) {
+        return Parse::INVALID;
+    }
+    consumed = sizeof(uint32_t) + bodySize;
+    return Parse::COMPLETE;
+}
+
+std::string defaultSocketPath() {
+    const char* runtime = std::getenv("XDG_RUNTIME_DIR");
+    if (runtime && *runtime) {
+        return std::string(runtime) + "/file_manager.sock";
+    }
+    return "/tmp/file_manager-" + std::to_string(::getuid()) + ".sock";
+}
+
+} // namespace fmd
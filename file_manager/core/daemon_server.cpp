@@ -0,0 +1,575 @@
+#include "daemon_server.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <optional>
+#include <sched.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "binary_log.hpp"
+#include "directory_listing.hpp"
+#include "error_handler.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+
+// epoll tags of the two non-client descriptors, client tags are their serials
+static constexpr uint64_t LISTEN_TAG = 0;
+static constexpr uint64_t WAKE_TAG = UINT64_MAX;
+
+// Bytes read from a client per readiness, keeps one busy client from starving the rest
+static constexpr size_t READ_CHUNK = 64 * 1024;
+
+// Entries enumerated per getdents64 batch when a listing is not cached
+static constexpr size_t LIST_CHUNK = 4096;
+
+// Listing response encoded straight from the name blob, no per-entry strings
+// A listing too big for one frame is refused with EFBIG before encoding
+static void encodeListing(std::string& out, uint32_t id, const DirectoryListing& listing) {
+    if (fmd::responseLength(listing.size(), listing.nameBytes()) > fmd::MAX_FRAME) {
+        fmd::ResponseWriter(out, id, fmd::Status::FAILED, EFBIG).finish();
+        return;
+    }
+    fmd::ResponseWriter writer(out, id);
+    writer.reserve(listing.size(), listing.nameBytes());
+    for (size_t row = 0; row < listing.size(); ++row) {
+        writer.add(static_cast<uint8_t>(listing.type(row)), listing.name(row));
+    }
+    writer.finish();
+}
+
+// Response without items
+static void encodeStatus(std::string& out, uint32_t id, fmd::Status status, int error = 0) {
+    fmd::ResponseWriter(out, id, status, error).finish();
+}
+
+// Working directory of the calling thread only, the previous one is restored
+// when destroyed. The first use on a thread gives it its own filesystem
+// context (unshare CLONE_FS), so the event loop and the other workers keep
+// the daemon's
+class ScopedWorkingDirectory {
+public:
+    explicit ScopedWorkingDirectory(const std::string& directory) {
+        thread_local const int unshared = ::unshare(CLONE_FS) == 0 ? 0 : errno;
+        if (unshared != 0) {
+            error_ = unshared;
+            return;
+        }
+        previous_ = ::open(".", O_PATH | O_DIRECTORY | O_CLOEXEC);
+        if (previous_ < 0 || ::chdir(directory.c_str()) != 0) {
+            error_ = errno;
+        }
+    }
+    ~ScopedWorkingDirectory() {
+        if (previous_ >= 0) {
+            [[maybe_unused]] const int restored = ::fchdir(previous_);
+            ::close(previous_);
+        }
+    }
+    int error() const { return error_; }
+
+    ScopedWorkingDirectory(const ScopedWorkingDirectory&) = delete;
+    ScopedWorkingDirectory& operator=(const ScopedWorkingDirectory&) = delete;
+
+private:
+    int previous_ = -1;
+    int error_ = 0;
+};
+
+DaemonServer::DaemonServer(PluginManager& plugins, DirectoryCache& cache, OperationScheduler& scheduler)
+    : plugins_(plugins), cache_(cache), scheduler_(scheduler)
+{
+}
+
+DaemonServer::~DaemonServer() {
+    while (!connections_.empty()) {
+        close(*connections_.begin()->second);
+    }
+    // Submitted jobs post to the eventfd, it has to outlive them
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_.wait(lock, [this] { return outstanding_ == 0; });
+    }
+    if (listenFd_ >= 0) {
+        ::close(listenFd_);
+        ::unlink(socketPath_.c_str());
+    }
+    if (epollFd_ >= 0) {
+        ::close(epollFd_);
+    }
+    if (eventFd_ >= 0) {
+        ::close(eventFd_);
+    }
+}
+
+FsStatus DaemonServer::listen(const std::string& socketPath) {
+    sockaddr_un address {};
+    address.sun_family = AF_UNIX;
+    if (socketPath.empty() || socketPath.size() >= sizeof(address.sun_path)) {
+        return FsStatus::failure(ENAMETOOLONG, "socket path");
+    }
+    std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+    const int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        return FsStatus::failure(errno, "socket");
+    }
+    auto* generic = reinterpret_cast<const sockaddr*>(&address);
+    if (::bind(fd, generic, sizeof(address)) != 0) {
+        if (errno != EADDRINUSE) {
+            const int error = errno;
+            ::close(fd);
+            return FsStatus::failure(error, "bind");
+        }
+        // Taken: replace it only if nobody is accepting on it any more
+        const int probe = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        const bool alive = probe >= 0 && ::connect(probe, generic, sizeof(address)) == 0;
+        if (probe >= 0) {
+            ::close(probe);
+        }
+        if (alive || ::unlink(socketPath.c_str()) != 0 || ::bind(fd, generic, sizeof(address)) != 0) {
+            ::close(fd);
+            return FsStatus::failure(EADDRINUSE, "bind");
+        }
+    }
+    // Operations run with the daemon's rights, so only its user may connect
+    ::chmod(socketPath.c_str(), S_IRUSR | S_IWUSR);
+    if (::listen(fd, SOMAXCONN) != 0) {
+        const int error = errno;
+        ::close(fd);
+        ::unlink(socketPath.c_str());
+        return FsStatus::failure(error, "listen");
+    }
+
+    epollFd_ = ::epoll_create1(EPOLL_CLOEXEC);
+    eventFd_ = ::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (epollFd_ < 0 || eventFd_ < 0) {
+        const int error = errno;
+        ::close(fd);
+        ::unlink(socketPath.c_str());
+        return FsStatus::failure(error, "epoll");
+    }
+    listenFd_ = fd;
+    socketPath_ = socketPath;
+
+    epoll_event event {};
+    event.events = EPOLLIN;
+    event.data.u64 = LISTEN_TAG;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event);
+    event.data.u64 = WAKE_TAG;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, eventFd_, &event);
+    return {};
+}
+
+void DaemonServer::run() {
+    if (epollFd_ < 0) {
+        return;
+    }
+    epoll_event events[256];
+    while (!stopping_.load(std::memory_order_relaxed)) {
+        const int count = ::epoll_wait(epollFd_, events, 256, -1);
+        if (count < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            FM_ERROR("Daemon event loop failed: ", std::strerror(errno));
+            break;
+        }
+        for (int i = 0; i < count; ++i) {
+            const uint64_t tag = events[i].data.u64;
+            if (tag == LISTEN_TAG) {
+                accept();
+                continue;
+            }
+            if (tag == WAKE_TAG) {
+                uint64_t ignored = 0;
+                while (::read(eventFd_, &ignored, sizeof(ignored)) > 0) {}
+                drainCompletions();
+                continue;
+            }
+            auto it = connections_.find(tag);
+            if (it == connections_.end()) {
+                continue;   // closed earlier in this batch
+            }
+            Connection& connection = *it->second;
+            const uint32_t ready = events[i].events;
+            if ((ready & (EPOLLERR | EPOLLHUP)) && !(ready & EPOLLIN)) {
+                close(connection);
+                continue;
+            }
+            if ((ready & EPOLLIN) && !readFrom(connection)) {
+                continue;
+            }
+            if (ready & EPOLLOUT) {
+                if (flush(connection)) {
+                    updateEvents(connection);
+                }
+            }
+        }
+    }
+}
+
+void DaemonServer::stop() {
+    stopping_.store(true, std::memory_order_relaxed);
+    if (eventFd_ >= 0) {
+        const uint64_t one = 1;
+        [[maybe_unused]] const ssize_t written = ::write(eventFd_, &one, sizeof(one));
+    }
+}
+
+// PRIVATE METHODS
+
+void DaemonServer::accept() {
+    while (true) {
+        const int fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EMFILE || errno == ENFILE) {
+                // Level triggered: would wake up again at once, wait for a client to leave
+                FM_WARNING("Daemon out of file descriptors, not accepting until a client disconnects");
+                ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, listenFd_, nullptr);
+                acceptPaused_ = true;
+            }
+            return;   // EAGAIN, or a client that gave up before being accepted
+        }
+        auto connection = std::make_unique<Connection>();
+        connection->fd = fd;
+        connection->serial = nextSerial_++;
+        connection->events = EPOLLIN;
+
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u64 = connection->serial;
+        if (::epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &event) != 0) {
+            ::close(fd);
+            continue;
+        }
+        connections_.emplace(connection->serial, std::move(connection));
+        clientCount_.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+bool DaemonServer::readFrom(Connection& connection) {
+    char buffer[READ_CHUNK];
+    const ssize_t got = ::read(connection.fd, buffer, sizeof(buffer));
+    if (got < 0) {
+        if (errno == EAGAIN || errno == EINTR) {
+            return true;
+        }
+        close(connection);
+        return false;
+    }
+    if (got == 0) {
+        connection.endOfInput = true;
+    } else {
+        // Parsed frames are dropped in bulk, not after every request
+        if (connection.inputOffset == connection.input.size()) {
+            connection.input.clear();
+            connection.inputOffset = 0;
+        } else if (connection.inputOffset >= READ_CHUNK) {
+            connection.input.erase(0, connection.inputOffset);
+            connection.inputOffset = 0;
+        }
+        connection.input.append(buffer, static_cast<size_t>(got));
+    }
+    return processInput(connection);
+}
+
+bool DaemonServer::processInput(Connection& connection) {
+    while (connection.inFlight < MAX_IN_FLIGHT &&
+           connection.output.size() - connection.outputOffset < MAX_PENDING_OUTPUT) {
+        fmd::Request request;
+        size_t consumed = 0;
+        const fmd::Parse parse = fmd::decodeRequest(connection.input.data() + connection.inputOffset,
+                                                    connection.input.size() - connection.inputOffset,
+                                                    request, consumed);
+        if (parse == fmd::Parse::INCOMPLETE) {
+            break;
+        }
+        if (parse == fmd::Parse::INVALID) {
+            FM_WARNING("Daemon client sent a malformed frame, disconnecting");
+            close(connection);
+            return false;
+        }
+        connection.inputOffset += consumed;
+        dispatch(connection, request);
+    }
+    if (!flush(connection)) {
+        return false;
+    }
+    updateEvents(connection);
+    return true;
+}
+
+void DaemonServer::dispatch(Connection& connection, fmd::Request& request) {
+    requestCount_.fetch_add(1, std::memory_order_relaxed);
+    if (requestLog_) {
+        // Raw values only, the loop thread does not format text per request
+        FM_BLOG(*requestLog_, ErrorSeverity::INFO, "Request {} from client {}: opcode {}, {} arguments, first {}",
+                request.id, connection.serial, request.opcode, request.args.size(),
+                request.args.empty() ? std::string_view() : std::string_view(request.args[0]));
+    }
+
+    switch (request.opcode) {
+        case fmd::Opcode::PING:
+            encodeStatus(connection.output, request.id, fmd::Status::OK);
+            return;
+        case fmd::Opcode::STATS: {
+            fmd::Response response = stats();
+            response.id = request.id;
+            fmd::encodeResponse(connection.output, response);
+            return;
+        }
+        case fmd::Opcode::LIST: {
+            if (request.args.size() != 1 || request.args[0].empty() || request.args[0][0] != '/') {
+                encodeStatus(connection.output, request.id, fmd::Status::BAD_REQUEST, EINVAL);
+                return;
+            }
+            // A current cached listing costs one stat(), answered right here
+            if (auto listing = cache_.find(request.args[0])) {
+                encodeListing(connection.output, request.id, *listing);
+                return;
+            }
+            const std::string path = std::move(request.args[0]);
+            submit(connection, request.id, path, [this, path](uint32_t id, std::string& frame) {
+                listDirectory(path, id, frame);
+            });
+            return;
+        }
+        case fmd::Opcode::EXECUTE:
+        case fmd::Opcode::EXECUTE_IN: {
+            // EXECUTE_IN: the client's working directory comes first
+            std::string directory;
+            if (request.opcode == fmd::Opcode::EXECUTE_IN) {
+                if (request.args.empty() || request.args[0].empty() || request.args[0][0] != '/') {
+                    encodeStatus(connection.output, request.id, fmd::Status::BAD_REQUEST, EINVAL);
+                    return;
+                }
+                directory = std::move(request.args[0]);
+                request.args.erase(request.args.begin());
+            }
+            if (request.args.empty()) {
+                encodeStatus(connection.output, request.id, fmd::Status::BAD_REQUEST, EINVAL);
+                return;
+            }
+            // Queued on the device of the last argument: the destination of a
+            // copy or move, the target of everything else
+            std::string device = request.args.size() > 1 ? request.args.back() : std::string(".");
+            if (!directory.empty() && device[0] != '/') {
+                device = directory + '/' + device;
+            }
+            submit(connection, request.id, device,
+                   [this, directory, args = std::move(request.args)](uint32_t id, std::string& frame) {
+                std::optional<ScopedWorkingDirectory> inDirectory;
+                if (!directory.empty()) {
+                    inDirectory.emplace(directory);
+                    if (const int error = inDirectory->error()) {
+                        encodeStatus(frame, id, fmd::Status::FAILED, error);
+                        return;
+                    }
+                }
+                const std::vector<std::string> operationArgs(args.begin() + 1, args.end());
+                const bool ok = plugins_.executeOperation(args[0], operationArgs);
+                encodeStatus(frame, id, ok ? fmd::Status::OK : fmd::Status::FAILED);
+            });
+            return;
+        }
+    }
+    encodeStatus(connection.output, request.id, fmd::Status::BAD_REQUEST, ENOSYS);
+}
+
+void DaemonServer::submit(Connection& connection, uint32_t id, const std::string& devicePath,
+                          std::function<void(uint32_t id, std::string& frame)> work) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++outstanding_;
+    }
+    ++connection.inFlight;
+
+    const uint64_t serial = connection.serial;
+    try {
+        scheduler_.submit(devicePath, [this, serial, id, work = std::move(work)] {
+            std::string frame;
+            try {
+                work(id, frame);
+            } catch (const std::exception& e) {
+                FM_ERROR("Daemon request failed: ", e.what());
+                frame.clear();
+                encodeStatus(frame, id, fmd::Status::FAILED);
+            }
+            complete(serial, std::move(frame));
+            return true;
+        }, JobPriority::NORMAL);
+    } catch (const std::exception&) {
+        // The scheduler is shutting down
+        --connection.inFlight;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --outstanding_;
+        }
+        encodeStatus(connection.output, id, fmd::Status::FAILED, ESHUTDOWN);
+    }
+}
+
+void DaemonServer::complete(uint64_t serial, std::string frame) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        completions_.push_back({serial, std::move(frame)});
+    }
+    const uint64_t one = 1;
+    [[maybe_unused]] const ssize_t written = ::write(eventFd_, &one, sizeof(one));
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    --outstanding_;
+    idle_.notify_all();
+}
+
+void DaemonServer::drainCompletions() {
+    std::vector<Completion> done;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        done.swap(completions_);
+    }
+    std::vector<uint64_t> touched;
+    for (auto& completion : done) {
+        auto it = connections_.find(completion.serial);
+        if (it == connections_.end()) {
+            continue;   // the client left before its answer was ready
+        }
+        Connection& connection = *it->second;
+        --connection.inFlight;
+        connection.output += completion.frame;
+        if (!connection.touched) {
+            connection.touched = true;
+            touched.push_back(connection.serial);
+        }
+    }
+    // One write per client for the whole batch; frames held back by
+    // MAX_IN_FLIGHT can be dispatched now
+    for (const uint64_t serial : touched) {
+        auto it = connections_.find(serial);
+        if (it != connections_.end()) {
+            it->second->touched = false;
+            processInput(*it->second);
+        }
+    }
+}
+
+bool DaemonServer::flush(Connection& connection) {
+    while (connection.outputOffset < connection.output.size()) {
+        const ssize_t sent = ::send(connection.fd, connection.output.data() + connection.outputOffset,
+                                    connection.output.size() - connection.outputOffset, MSG_NOSIGNAL);
+        if (sent > 0) {
+            connection.outputOffset += static_cast<size_t>(sent);
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno == EAGAIN) {
+            break;
+        } else {
+            close(connection);
+            return false;
+        }
+    }
+    if (connection.outputOffset == connection.output.size()) {
+        connection.output.clear();
+        connection.outputOffset = 0;
+        if (connection.endOfInput && connection.inFlight == 0) {
+            close(connection);   // everything the client asked for is answered
+            return false;
+        }
+    } else if (connection.outputOffset >= MAX_PENDING_OUTPUT) {
+        connection.output.erase(0, connection.outputOffset);
+        connection.outputOffset = 0;
+    }
+    return true;
+}
+
+void DaemonServer::updateEvents(Connection& connection) {
+    uint32_t wanted = 0;
+    if (!connection.endOfInput && connection.inFlight < MAX_IN_FLIGHT &&
+        connection.output.size() - connection.outputOffset < MAX_PENDING_OUTPUT) {
+        wanted |= EPOLLIN;
+    }
+    if (connection.outputOffset < connection.output.size()) {
+        wanted |= EPOLLOUT;
+    }
+    if (wanted == connection.events) {
+        return;
+    }
+    epoll_event event {};
+    event.events = wanted;
+    event.data.u64 = connection.serial;
+    ::epoll_ctl(epollFd_, EPOLL_CTL_MOD, connection.fd, &event);
+    connection.events = wanted;
+}
+
+void DaemonServer::close(Connection& connection) {
+    ::epoll_ctl(epollFd_, EPOLL_CTL_DEL, connection.fd, nullptr);
+    ::close(connection.fd);
+    clientCount_.fetch_sub(1, std::memory_order_relaxed);
+    if (acceptPaused_) {
+        epoll_event event {};
+        event.events = EPOLLIN;
+        event.data.u64 = LISTEN_TAG;
+        ::epoll_ctl(epollFd_, EPOLL_CTL_ADD, listenFd_, &event);
+        acceptPaused_ = false;
+    }
+    connections_.erase(connection.serial);   // destroys `connection`
+}
+
+void DaemonServer::listDirectory(const std::string& path, uint32_t id, std::string& frame) {
+    static const MetricId metric = Metrics::registerOperation("daemon.list");
+    TraceScope trace("daemon", "listDirectory");
+    if (trace.active()) {
+        trace.setDetail(path);
+    }
+    MetricsScope scope(metric);
+
+    // Another request may have filled the cache while this one was queued
+    std::shared_ptr<const DirectoryListing> listing = cache_.find(path);
+    if (!listing) {
+        DirectoryEnumerator enumerator;
+        const FsStatus opened = enumerator.open(path);
+        if (!opened) {
+            scope.fail();
+            encodeStatus(frame, id, fmd::Status::FAILED, opened.code());
+            return;
+        }
+        const int64_t stamp = DirectoryCache::modificationStamp(enumerator.fd());
+        auto fresh = std::make_shared<DirectoryListing>();
+        while (true) {
+            const auto added = enumerator.next(*fresh, LIST_CHUNK);
+            if (!added) {
+                scope.fail();
+                encodeStatus(frame, id, fmd::Status::FAILED, added.code());
+                return;
+            }
+            if (added.value() == 0) {
+                break;
+            }
+        }
+        cache_.insert(path, fresh, stamp);
+        listing = std::move(fresh);
+    }
+    scope.addEntries(listing->size());
+    encodeListing(frame, id, *listing);
+}
+
+fmd::Response DaemonServer::stats() const {
+    fmd::Response response;
+    auto add = [&response](const char* key, uint64_t value) {
+        response.items.push_back({0, std::string(key) + "=" + std::to_string(value)});
+    };
+    add("clients", clientCount());
+    add("requests", requestCount());
+    add("plugins", plugins_.pluginCount());
+    add("cache.entries", cache_.size());
+    add("cache.bytes", cache_.memoryUsage());
+    add("cache.hits", cache_.hits());
+    add("cache.misses", cache_.misses());
+    return response;
+}
@@ -0,0 +1,172 @@
+#include "directory_cache.hpp"
+#include "metrics.hpp"
+#include <sys/stat.h>
+
+static int64_t stampOf(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+DirectoryCache& DirectoryCache::instance() {
+    static DirectoryCache* cache = new DirectoryCache();   // leaked, used until exit
+    return *cache;
+}
+
+DirectoryCache::DirectoryCache(size_t budgetBytes)
+    : budget_(budgetBytes)
+{
+}
+
+std::shared_ptr<const DirectoryListing> DirectoryCache::find(const std::string& path) {
+    std::shared_ptr<const DirectoryListing> listing;
+    int64_t stamp = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it == index_.end()) {
+            ++misses_;
+            return nullptr;
+        }
+        listing = it->second->listing;
+        stamp = it->second->stamp;
+    }
+
+    // stat() outside the lock, a slow filesystem must not stall other lookups
+    if (modificationStamp(path) != stamp) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it != index_.end() && it->second->listing == listing) {
+            eraseEntry(it->second);
+        }
+        ++misses_;
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        entries_.splice(entries_.begin(), entries_, it->second);
+    }
+    ++hits_;
+    return listing;
+}
+
+bool DirectoryCache::contains(const std::string& path) {
+    int64_t stamp = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = index_.find(path);
+        if (it == index_.end()) {
+            return false;
+        }
+        stamp = it->second->stamp;
+    }
+    return modificationStamp(path) == stamp;
+}
+
+void DirectoryCache::insert(const std::string& path, std::shared_ptr<const DirectoryListing> listing, int64_t stamp) {
+    if (!listing || stamp < 0) {
+        return;
+    }
+    // Writing to a file does not touch its directory's mtime, so cached
+    // sizes and mtimes would go stale unnoticed
+    if (listing->anyMetadata()) {
+        auto namesOnly = std::make_shared<DirectoryListing>(*listing);
+        namesOnly->clearMetadata();
+        listing = std::move(namesOnly);
+    }
+    const size_t bytes = listing->memoryUsage() + path.size() + sizeof(Entry);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        eraseEntry(it->second);
+    }
+    if (bytes > budget_) {
+        return;
+    }
+    entries_.push_front(Entry{path, std::move(listing), stamp, bytes});
+    index_[path] = entries_.begin();
+    usage_ += bytes;
+    evictToBudget();
+
+    if (Metrics::isEnabled()) {
+        Metrics::setGauge("directory_cache.bytes", static_cast<double>(usage_));
+        Metrics::setGauge("directory_cache.entries", static_cast<double>(entries_.size()));
+    }
+}
+
+void DirectoryCache::remove(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = index_.find(path);
+    if (it != index_.end()) {
+        eraseEntry(it->second);
+    }
+}
+
+void DirectoryCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    index_.clear();
+    usage_ = 0;
+}
+
+void DirectoryCache::setBudget(size_t budgetBytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = budgetBytes;
+    evictToBudget();
+}
+
+size_t DirectoryCache::budget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+size_t DirectoryCache::memoryUsage() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return usage_;
+}
+
+size_t DirectoryCache::size() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return entries_.size();
+}
+
+uint64_t DirectoryCache::hits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hits_;
+}
+
+uint64_t DirectoryCache::misses() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return misses_;
+}
+
+int64_t DirectoryCache::modificationStamp(const std::string& path) {
+    struct stat st {};
+    if (::stat(path.c_str(), &st) != 0) {
+        return -1;
+    }
+    return stampOf(st);
+}
+
+int64_t DirectoryCache::modificationStamp(int directoryFd) {
+    struct stat st {};
+    if (::fstat(directoryFd, &st) != 0) {
+        return -1;
+    }
+    return stampOf(st);
+}
+
+// PRIVATE METHODS
+
+void DirectoryCache::evictToBudget() {
+    while (usage_ > budget_ && !entries_.empty()) {
+        eraseEntry(std::prev(entries_.end()));
+    }
+}
+
+void DirectoryCache::eraseEntry(EntryList::iterator it) {
+    usage_ -= it->bytes;
+    index_.erase(it->path);
+    entries_.erase(it);
+}
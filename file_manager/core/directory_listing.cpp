@@ -0,0 +1,206 @@
+#include "directory_listing.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// getdents64 buffer, large enough for a few thousand entries per syscall
+static constexpr size_t ENUMERATE_BUFFER_SIZE = 256 * 1024;
+
+// Layout the kernel uses for getdents64 (glibc only exposes it since 2.30)
+struct LinuxDirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static EntryType typeFromDirent(unsigned char type) {
+    switch (type) {
+        case DT_REG: return EntryType::FILE;
+        case DT_DIR: return EntryType::DIRECTORY;
+        case DT_LNK: return EntryType::SYMLINK;
+        case DT_UNKNOWN: return EntryType::UNKNOWN;
+        default: return EntryType::OTHER;
+    }
+}
+
+static EntryType typeFromMode(mode_t mode) {
+    if (S_ISREG(mode)) return EntryType::FILE;
+    if (S_ISDIR(mode)) return EntryType::DIRECTORY;
+    if (S_ISLNK(mode)) return EntryType::SYMLINK;
+    return EntryType::OTHER;
+}
+
+// =======================
+// DirectoryListing Implementation
+// =======================
+
+void DirectoryListing::append(std::string_view name, EntryType type) {
+    names_.append(name.data(), name.size());
+    nameOffsets_.push_back(static_cast<uint32_t>(names_.size()));
+    types_.push_back(type);
+    metaState_.push_back(META_MISSING);
+    sizes_.push_back(0);
+    mtimes_.push_back(0);
+}
+
+void DirectoryListing::append(const DirectoryListing& other) {
+    const uint32_t base = static_cast<uint32_t>(names_.size());
+    names_ += other.names_;
+    nameOffsets_.reserve(nameOffsets_.size() + other.size());
+    for (size_t i = 1; i < other.nameOffsets_.size(); ++i) {
+        nameOffsets_.push_back(base + other.nameOffsets_[i]);
+    }
+    types_.insert(types_.end(), other.types_.begin(), other.types_.end());
+    metaState_.insert(metaState_.end(), other.metaState_.begin(), other.metaState_.end());
+    sizes_.insert(sizes_.end(), other.sizes_.begin(), other.sizes_.end());
+    mtimes_.insert(mtimes_.end(), other.mtimes_.begin(), other.mtimes_.end());
+}
+
+void DirectoryListing::clear() {
+    names_.clear();
+    nameOffsets_.assign(1, 0);
+    types_.clear();
+    metaState_.clear();
+    sizes_.clear();
+    mtimes_.clear();
+}
+
+void DirectoryListing::reserve(size_t rows, size_t nameBytes) {
+    names_.reserve(nameBytes);
+    nameOffsets_.reserve(rows + 1);
+    types_.reserve(rows);
+    metaState_.reserve(rows);
+    sizes_.reserve(rows);
+    mtimes_.reserve(rows);
+}
+
+void DirectoryListing::setMetadata(size_t row, uint64_t size, int64_t mtime, EntryType type) {
+    sizes_[row] = size;
+    mtimes_[row] = mtime;
+    metaState_[row] = META_LOADED;
+    if (types_[row] == EntryType::UNKNOWN) {
+        types_[row] = type;
+    }
+}
+
+void DirectoryListing::setMetadataFailed(size_t row) {
+    metaState_[row] = META_FAILED;
+}
+
+void DirectoryListing::clearMetadata() {
+    metaState_.assign(metaState_.size(), META_MISSING);
+    sizes_.assign(sizes_.size(), 0);
+    mtimes_.assign(mtimes_.size(), 0);
+}
+
+bool DirectoryListing::anyMetadata() const {
+    return std::any_of(metaState_.begin(), metaState_.end(), [](uint8_t state) { return state != META_MISSING; });
+}
+
+void DirectoryListing::loadMetadata(int directoryFd, size_t begin, size_t end) {
+    static const MetricId metric = Metrics::registerOperation("listing.loadMetadata");
+    MetricsScope scope(metric);
+
+    std::string name;
+    for (size_t row = begin; row < end && row < size(); ++row) {
+        if (hasMetadata(row)) {
+            continue;
+        }
+        name.assign(this->name(row));   // needs a terminating NUL
+        struct stat st {};
+        if (::fstatat(directoryFd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            setMetadataFailed(row);
+            continue;
+        }
+        setMetadata(row, static_cast<uint64_t>(st.st_size), static_cast<int64_t>(st.st_mtime), typeFromMode(st.st_mode));
+        scope.addEntries(1);
+    }
+}
+
+size_t DirectoryListing::memoryUsage() const {
+    return names_.capacity() +
+           nameOffsets_.capacity() * sizeof(uint32_t) +
+           types_.capacity() * sizeof(EntryType) +
+           metaState_.capacity() +
+           sizes_.capacity() * sizeof(uint64_t) +
+           mtimes_.capacity() * sizeof(int64_t);
+}
+
+// =======================
+// DirectoryEnumerator Implementation
+// =======================
+
+DirectoryEnumerator::~DirectoryEnumerator() {
+    close();
+}
+
+FsStatus DirectoryEnumerator::open(const std::string& path) {
+    return openAt(AT_FDCWD, path, true);
+}
+
+FsStatus DirectoryEnumerator::openAt(int directoryFd, const std::string& name, bool followSymlinks) {
+    close();
+    fd_ = ::openat(directoryFd, name.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC | (followSymlinks ? 0 : O_NOFOLLOW));
+    if (fd_ < 0) {
+        return FsStatus::failure(errno, "opendir");
+    }
+    buffer_.resize(ENUMERATE_BUFFER_SIZE);
+    bufferPos_ = bufferEnd_ = 0;
+    finished_ = false;
+    return {};
+}
+
+FsResult<size_t> DirectoryEnumerator::next(DirectoryListing& out, size_t maxEntries) {
+    static const MetricId metric = Metrics::registerOperation("listing.enumerate");
+    MetricsScope scope(metric);
+
+    size_t added = 0;
+    while (added < maxEntries) {
+        if (bufferPos_ >= bufferEnd_) {
+            if (finished_ || fd_ < 0) {
+                break;
+            }
+            const long n = ::syscall(SYS_getdents64, fd_, buffer_.data(), buffer_.size());
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                scope.fail();
+                return FsResult<size_t>::failure(errno, "getdents64");
+            }
+            if (n == 0) {
+                finished_ = true;
+                break;
+            }
+            bufferPos_ = 0;
+            bufferEnd_ = static_cast<size_t>(n);
+        }
+
+        const auto* entry = reinterpret_cast<const LinuxDirent64*>(buffer_.data() + bufferPos_);
+        bufferPos_ += entry->d_reclen;
+
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+            continue;
+        }
+        out.append(std::string_view(name, std::strlen(name)), typeFromDirent(entry->d_type));
+        ++added;
+    }
+    scope.addEntries(added);
+    return added;
+}
+
+void DirectoryEnumerator::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+}
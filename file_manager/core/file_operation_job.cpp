@@ -0,0 +1,431 @@
+#include "file_operation_job.hpp"
+#include "copy_engine.hpp"
+#include "io_priority.hpp"
+#include "tracer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static bool isFinal(JobState state) {
+    return state == JobState::COMPLETED || state == JobState::FAILED || state == JobState::CANCELLED;
+}
+
+// Entries of a directory, collected up front so removing them is safe
+static std::vector<fs::path> childrenOf(const fs::path& directory, std::error_code& ec) {
+    std::vector<fs::path> children;
+    for (fs::directory_iterator it(directory, ec), end; !ec && it != end; it.increment(ec)) {
+        children.push_back(it->path());
+    }
+    return children;
+}
+
+// "report.txt" -> "report (2).txt", directories keep their full name: "photos (2)"
+static fs::path numberedName(const fs::path& name, bool directory, int number) {
+    const std::string suffix = " (" + std::to_string(number) + ")";
+    if (directory || !name.has_extension() || name.stem().empty()) {
+        return name.string() + suffix;
+    }
+    return name.stem().string() + suffix + name.extension().string();
+}
+
+std::shared_ptr<FileOperationJob> FileOperationJob::create(FileOperationKind kind, std::vector<fs::path> sources,
+                                                           fs::path destination, ConflictPolicy conflicts) {
+    return std::shared_ptr<FileOperationJob>(
+        new FileOperationJob(kind, std::move(sources), std::move(destination), conflicts));
+}
+
+FileOperationJob::FileOperationJob(FileOperationKind kind, std::vector<fs::path> sources, fs::path destination,
+                                   ConflictPolicy conflicts)
+    : kind_(kind),
+      sources_(std::move(sources)),
+      destination_(std::move(destination)),
+      conflicts_(conflicts)
+{
+}
+
+void FileOperationJob::start(OperationScheduler& scheduler) {
+    // The device that is written to decides the queue
+    fs::path device = kind_ == FileOperationKind::REMOVE || kind_ == FileOperationKind::TRASH || destination_.empty()
+                          ? (sources_.empty() ? fs::path(".") : sources_.front())
+                          : destination_;
+    auto self = shared_from_this();
+    std::future<bool> result = scheduler.submit(device, [self] {
+        self->run();
+        return self->state() == JobState::COMPLETED;
+    }, priority_);
+
+    // A scheduler that is shutting down refuses the job right away
+    if (result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            result.get();
+        } catch (const std::exception& e) {
+            fail(std::string("Not started: ") + e.what());
+            finish(JobState::FAILED);
+        }
+    }
+}
+
+void FileOperationJob::run() {
+    if (cancelled_ || isFinal(state())) {
+        finish(JobState::CANCELLED);
+        return;
+    }
+    TraceScope trace("job", "FileOperationJob::run");
+    std::optional<ScopedIoPriority> idle;
+    if (limiter_ && limiter_->limits().idleIo) {
+        idle.emplace(IoPriorityClass::IDLE);
+    }
+
+    // Totals first, so progress and ETA mean something. A same-filesystem
+    // move or a trash is a rename per source and needs no scan.
+    setState(JobState::SCANNING);
+    if (kind_ == FileOperationKind::MOVE || kind_ == FileOperationKind::TRASH) {
+        filesTotal_ = sources_.size();
+    } else {
+        for (const auto& source : sources_) {
+            if (!checkpoint()) {
+                break;
+            }
+            countTree(source);
+        }
+    }
+    setState(JobState::RUNNING);
+
+    bool ok = true;
+    for (const auto& source : sources_) {
+        if (!checkpoint()) {
+            break;
+        }
+        if (kind_ == FileOperationKind::REMOVE) {
+            ok = removeTree(source, true);
+        } else if (kind_ == FileOperationKind::TRASH) {
+            ok = trashOne(source);
+        } else {
+            std::error_code ec;
+            const fs::path from = fs::weakly_canonical(source, ec);
+            const fs::path into = fs::weakly_canonical(destination_, ec);
+            const auto [mismatch, rest] = std::mismatch(from.begin(), from.end(), into.begin(), into.end());
+            (void)rest;
+            if (mismatch == from.end()) {
+                ok = fail("Cannot " + std::string(kind_ == FileOperationKind::COPY ? "copy" : "move") +
+                          " a folder into itself: " + source.string());
+            } else if (kind_ == FileOperationKind::MOVE && from.parent_path() == into) {
+                filesDone_.fetch_add(1, std::memory_order_relaxed);   // already there
+            } else {
+                fs::path target;
+                ok = targetFor(source, target) &&
+                     (kind_ == FileOperationKind::COPY ? copyTree(source, target) : moveOne(source, target));
+            }
+        }
+        if (!ok) {
+            break;
+        }
+    }
+
+    if (cancelled_) {
+        finish(JobState::CANCELLED);
+    } else {
+        finish(ok ? JobState::COMPLETED : JobState::FAILED);
+    }
+}
+
+void FileOperationJob::pause() {
+    paused_ = true;
+}
+
+void FileOperationJob::resume() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        paused_ = false;
+    }
+    changed_.notify_all();
+}
+
+void FileOperationJob::cancel() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        cancelled_ = true;
+        // Not picked up by a worker yet: done right away
+        int queued = static_cast<int>(JobState::QUEUED);
+        state_.compare_exchange_strong(queued, static_cast<int>(JobState::CANCELLED));
+    }
+    changed_.notify_all();
+    if (limiter_) {
+        limiter_->wake();   // a throttled worker sees the cancel now
+    }
+}
+
+JobProgress FileOperationJob::progress() const {
+    JobProgress progress;
+    progress.state = state();
+    progress.bytesDone = bytesDone_.load(std::memory_order_relaxed);
+    progress.bytesTotal = bytesTotal_.load(std::memory_order_relaxed);
+    progress.filesDone = filesDone_.load(std::memory_order_relaxed);
+    progress.filesTotal = filesTotal_.load(std::memory_order_relaxed);
+    std::lock_guard<std::mutex> lock(mutex_);
+    progress.currentFile = currentFile_;
+    progress.error = error_;
+    return progress;
+}
+
+bool FileOperationJob::finished() const {
+    return isFinal(state());
+}
+
+void FileOperationJob::wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    changed_.wait(lock, [this] { return finished(); });
+}
+
+std::vector<TrashEntry> FileOperationJob::trashed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return trashed_;
+}
+
+// PRIVATE METHODS
+
+void FileOperationJob::countTree(const fs::path& path) {
+    if (!throttle(0, 1)) {
+        return;
+    }
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return;   // reported when the work phase gets there
+    }
+    filesTotal_.fetch_add(1, std::memory_order_relaxed);
+    if (S_ISREG(st.st_mode)) {
+        bytesTotal_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+    } else if (S_ISDIR(st.st_mode)) {
+        std::error_code ec;
+        for (fs::directory_iterator it(path, ec), end; !ec && it != end; it.increment(ec)) {
+            if (cancelled_) {
+                return;
+            }
+            countTree(it->path());
+        }
+    }
+}
+
+bool FileOperationJob::copyTree(const fs::path& source, const fs::path& target) {
+    if (!throttle(0, 1) || !checkpoint()) {
+        return false;
+    }
+    struct stat st {};
+    if (::lstat(source.c_str(), &st) != 0) {
+        return fail(FsStatus::failure(errno, "lstat"), source);
+    }
+    setCurrentFile(source);
+
+    // Overwriting a file with itself (a copy into its own folder, or onto a
+    // hard link of it) would truncate it: it is already there, skip it.
+    // Directories fall through to the merge, which skips each child
+    struct stat present {};
+    if (conflicts_ == ConflictPolicy::OVERWRITE && !S_ISDIR(st.st_mode) &&
+        ::lstat(target.c_str(), &present) == 0 &&
+        present.st_dev == st.st_dev && present.st_ino == st.st_ino) {
+        if (S_ISREG(st.st_mode)) {
+            bytesDone_.fetch_add(static_cast<uint64_t>(st.st_size), std::memory_order_relaxed);
+        }
+        filesDone_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    if (S_ISDIR(st.st_mode)) {
+        if (::mkdir(target.c_str(), (st.st_mode & 07777) | S_IRWXU) != 0) {
+            struct stat existing {};
+            const bool merge = errno == EEXIST && conflicts_ == ConflictPolicy::OVERWRITE &&
+                               ::stat(target.c_str(), &existing) == 0 && S_ISDIR(existing.st_mode);
+            if (!merge) {
+                return fail(FsStatus::failure(errno, "mkdir"), target);
+            }
+        }
+        filesDone_.fetch_add(1, std::memory_order_relaxed);
+        std::error_code ec;
+        for (const auto& child : childrenOf(source, ec)) {
+            if (!copyTree(child, target / child.filename())) {
+                return false;
+            }
+        }
+        if (ec) {
+            return fail(FsStatus::failure(ec.value(), "readdir"), source);
+        }
+        return true;
+    }
+
+    if (S_ISREG(st.st_mode)) {
+        const FsStatus status = CopyEngine::copyFile(source, target, conflicts_ == ConflictPolicy::OVERWRITE,
+            [this](uint64_t bytes) {
+                bytesDone_.fetch_add(bytes, std::memory_order_relaxed);
+                return throttle(bytes, 0) && checkpoint();
+            });
+        if (!status) {
+            return cancelled_ ? false : fail(status, source);
+        }
+    } else if (S_ISLNK(st.st_mode)) {
+        std::error_code ec;
+        const fs::path link = fs::read_symlink(source, ec);
+        if (ec) {
+            return fail(FsStatus::failure(ec.value(), "readlink"), source);
+        }
+        if (conflicts_ == ConflictPolicy::OVERWRITE) {
+            ::unlink(target.c_str());
+        }
+        if (::symlink(link.c_str(), target.c_str()) != 0) {
+            return fail(FsStatus::failure(errno, "symlink"), target);
+        }
+    }
+    // Devices, fifos and sockets are skipped, like most file managers do
+    filesDone_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FileOperationJob::removeTree(const fs::path& path, bool countProgress) {
+    if (!throttle(0, 1) || !checkpoint()) {
+        return false;
+    }
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return fail(FsStatus::failure(errno, "lstat"), path);
+    }
+    setCurrentFile(path);
+
+    if (S_ISDIR(st.st_mode)) {
+        std::error_code ec;
+        for (const auto& child : childrenOf(path, ec)) {
+            if (!removeTree(child, countProgress)) {
+                return false;
+            }
+        }
+        if (ec) {
+            return fail(FsStatus::failure(ec.value(), "readdir"), path);
+        }
+        if (::rmdir(path.c_str()) != 0) {
+            return fail(FsStatus::failure(errno, "rmdir"), path);
+        }
+    } else if (::unlink(path.c_str()) != 0) {
+        return fail(FsStatus::failure(errno, "unlink"), path);
+    }
+    if (countProgress) {
+        filesDone_.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+bool FileOperationJob::moveOne(const fs::path& source, const fs::path& target) {
+    if (!throttle(0, 1)) {
+        return false;
+    }
+    setCurrentFile(source);
+    if (::rename(source.c_str(), target.c_str()) == 0) {
+        filesDone_.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+    if (errno != EXDEV) {
+        return fail(FsStatus::failure(errno, "rename"), source);
+    }
+
+    // Other filesystem: copy, then remove the source. The source was counted
+    // as one file, replace that by its real totals.
+    filesTotal_.fetch_sub(1, std::memory_order_relaxed);
+    setState(JobState::SCANNING);
+    countTree(source);
+    setState(JobState::RUNNING);
+    return copyTree(source, target) && removeTree(source, false);
+}
+
+bool FileOperationJob::trashOne(const fs::path& source) {
+    if (!throttle(0, 1)) {
+        return false;
+    }
+    setCurrentFile(source);
+    FsResult<TrashEntry> entry = TrashManager::instance().trash(source.string());
+    if (!entry) {
+        return fail(FsStatus::failure(entry.code(), "move to trash"), source);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        trashed_.push_back(entry.value());
+    }
+    filesDone_.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+bool FileOperationJob::targetFor(const fs::path& source, fs::path& target) {
+    fs::path name = source.filename();
+    if (name.empty()) {
+        name = source.parent_path().filename();   // "dir/"
+    }
+    target = destination_ / name;
+
+    struct stat st {};
+    if (::lstat(target.c_str(), &st) != 0) {
+        return true;
+    }
+    switch (conflicts_) {
+        case ConflictPolicy::OVERWRITE:
+            return true;
+        case ConflictPolicy::FAIL:
+            return fail(FsStatus::failure(EEXIST, "target"), target);
+        case ConflictPolicy::RENAME: {
+            struct stat sourceStat {};
+            const bool directory = ::lstat(source.c_str(), &sourceStat) == 0 && S_ISDIR(sourceStat.st_mode);
+            for (int number = 2; ; ++number) {
+                target = destination_ / numberedName(name, directory, number);
+                if (::lstat(target.c_str(), &st) != 0) {
+                    return true;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+bool FileOperationJob::checkpoint() {
+    if (cancelled_) {
+        return false;
+    }
+    if (paused_) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        const JobState before = state();
+        state_.store(static_cast<int>(JobState::PAUSED), std::memory_order_release);
+        changed_.wait(lock, [this] { return !paused_ || cancelled_; });
+        state_.store(static_cast<int>(before), std::memory_order_release);
+    }
+    return !cancelled_;
+}
+
+bool FileOperationJob::throttle(uint64_t bytes, uint64_t ops) {
+    return !limiter_ || limiter_->acquire(bytes, ops, [this] { return cancelled_.load(); });
+}
+
+void FileOperationJob::setState(JobState state) {
+    state_.store(static_cast<int>(state), std::memory_order_release);
+}
+
+void FileOperationJob::setCurrentFile(const fs::path& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    currentFile_ = path.string();
+}
+
+bool FileOperationJob::fail(const FsStatus& status, const fs::path& path) {
+    return fail(status.message() + " (" + path.string() + ")");
+}
+
+bool FileOperationJob::fail(const std::string& message) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (error_.empty()) {
+        error_ = message;
+    }
+    return false;
+}
+
+void FileOperationJob::finish(JobState state) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        state_.store(static_cast<int>(state), std::memory_order_release);
+    }
+    changed_.notify_all();
+}
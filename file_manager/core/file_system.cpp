@@ -1,67 +1,71 @@
 #include "file_system.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+#include "workload_recorder.hpp"
+#include <chrono>
 #include <fstream>
 #include <iostream>
 #include <system_error>
+#include <cerrno>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 namespace fs = std::filesystem;
 
 //These are all in filesystem Library
 
 // Check if a file or directory exists
+// Errors (e.g. permission denied on a parent) count as "does not exist"
 bool FileSystem::exists(const fs::path& path) {
-    return fs::exists(path);
+    return tryExists(path).valueOr(false);
 }
 
 // Check if a path is a directory
 bool FileSystem::isDirectory(const fs::path& path) {
-    return fs::is_directory(path);
+    return tryIsDirectory(path).valueOr(false);
 }
 
 // Check if a path is a regular file
 bool FileSystem::isFile(const fs::path& path) {
-    return fs::is_regular_file(path);
+    return tryIsFile(path).valueOr(false);
 }
 
 // List contents of a directory
 std::vector<fs::directory_entry> FileSystem::listDirectory(const fs::path& path) {
-    std::vector<fs::directory_entry> entries;
-    try {
-        // Ensure the path exists and is a directory
-        if (fs::exists(path) && fs::is_directory(path)) {
-            for (const auto& entry : fs::directory_iterator(path)) {
-                entries.push_back(entry);
-            }
+    auto result = tryListDirectory(path);
+    if (!result) {
+        // A missing path or a plain file just gives an empty listing
+        if (result.code() != ENOENT && result.code() != ENOTDIR) {
+            std::cerr << "Error listing directory: " << result.message() << " " << path << std::endl;
         }
-    } catch (const fs::filesystem_error& e) {
-        std::cerr << "Error listing directory: " << e.what() << std::endl;
+        return {};
     }
-    return entries;
+    return std::move(result).value();
 }
 
 //For Creating Directories
 //Returns true if successful
 bool FileSystem::createDirectory(const fs::path& path) {
-    std::error_code ec;     //variable for storing error
-
-    //Create_directories used for creating directories again and again
-    //until final complete path is created
-
-    bool result = fs::create_directory(path,ec)>0;
-    if (ec) {
-        std::cerr << "Error creating directory: " << ec.message() << std::endl;
+    auto result = tryCreateDirectory(path);
+    if (!result) {
+        std::cerr << "Error creating directory: " << result.message() << std::endl;
+        return false;
     }
-    return result;
+    return result.value();
 }
 
 //For removing file or directory
 //returns true if successful
 bool FileSystem::remove(const fs::path& path) {
-    std::error_code ec;
-    bool result = fs::remove_all(path,ec)>0;
-    if (ec) {
-        std::cerr << "Error removing path: " << ec.message() << std::endl;
+    auto result = tryRemove(path);
+    if (!result) {
+        std::cerr << "Error removing path: " << result.message() << std::endl;
+        return false;
     }
-    return result;
+    return result.value() > 0;
 }
 
 //For copying file from one path to another
@@ -69,28 +73,211 @@ bool FileSystem::remove(const fs::path& path) {
 //and overwrite variable to decide whether to override the file if already present or not
 //returns true if successful
 bool FileSystem::copy(const fs::path& source, const fs::path& destination, bool overwrite) {
+    auto result = tryCopy(source, destination, overwrite);
+    if (!result) {
+        std::cerr<<"Error Copying: "<<result.message()<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool FileSystem::move(const fs::path& source, const fs::path& destination, bool overwrite) {
+    auto result = tryMove(source, destination, overwrite);
+    if (!result) {
+        std::cerr<<"Error moving: "<<result.message()<<std::endl;
+        return false;
+    }
+    return true;
+}
+
+//get file size :returns optional to handle errors
+//Optional is used because we dont want this function to throw errors
+//We return size when successful otherwise we return nullopt which means no value present
+std::optional<uintmax_t> FileSystem::fileSize(const fs::path& path) {
+    auto result = tryFileSize(path);
+    if (!result) {
+        std::cerr << "Error getting file size: " << result.message() << std::endl;
+        return std::nullopt;
+    }
+    return result.value();
+}
+
+// Get last modified time of a file
+std::optional<fs::file_time_type> FileSystem::lastWriteTime(const fs::path& path) {
+    auto result = tryLastWriteTime(path);
+    if (!result) {
+        std::cerr << "Error getting last write time: " << result.message() << std::endl;
+        return std::nullopt;
+    }
+    return result.value();
+}
+
+//Read contents of a file and return as string
+std::optional<std::string> FileSystem::readFile(const fs::path& path) {
+    auto result = tryReadFile(path);
+    if (!result) {
+        std::cerr << "Error opening file for reading " << path << std::endl;
+        return std::nullopt;
+    }
+    return std::move(result).value();
+}
+
+bool FileSystem::writeFile(const fs::path& path, const std::string& content) {
+    auto result = tryWriteFile(path, content);
+    if (!result) {
+        std::cerr << "Error opening file for writing " << path << std::endl;
+        return false;
+    }
+    return true;
+}
+
+// =======================
+// Exception-free API
+// =======================
+// Plain syscalls where they are enough, std::filesystem with an error_code
+// where it does real work (recursive copy/remove). On POSIX the value of a
+// system error_code is the errno, so both report the same kind of code.
+// The *Impl functions do the work, the FileSystem::try* entry points at the
+// end of the file add metrics around them.
+
+// stat() a path, a missing path is not an error
+static FsResult<bool> statType(const char* path, mode_t type) {
+    struct stat st {};
+    if (::stat(path, &st) != 0) {
+        if (errno == ENOENT || errno == ENOTDIR) {
+            return false;
+        }
+        return FsResult<bool>::failure(errno, "stat");
+    }
+    return type == 0 || (st.st_mode & S_IFMT) == type;
+}
+
+static FsResult<bool> existsImpl(const char* path) {
+    return statType(path, 0);
+}
+
+static FsResult<bool> isDirectoryImpl(const char* path) {
+    return statType(path, S_IFDIR);
+}
+
+static FsResult<bool> isFileImpl(const char* path) {
+    return statType(path, S_IFREG);
+}
+
+static FsResult<std::vector<fs::directory_entry>> listDirectoryImpl(const fs::path& path) {
+    std::error_code ec;
+    fs::directory_iterator it(path, ec);
+    if (ec) {
+        return FsResult<std::vector<fs::directory_entry>>::failure(ec.value(), "opendir");
+    }
+    std::vector<fs::directory_entry> entries;
+    for (; it != fs::directory_iterator(); it.increment(ec)) {
+        entries.push_back(*it);
+    }
+    if (ec) {
+        return FsResult<std::vector<fs::directory_entry>>::failure(ec.value(), "readdir");
+    }
+    return entries;
+}
+
+// Same listing into `memory`: readdir() and one string per entry from the
+// resource, no fs::path or directory_entry
+static FsResult<std::pmr::vector<ListedEntry>> listDirectoryImpl(const char* path, std::pmr::memory_resource* memory) {
+    using Result = FsResult<std::pmr::vector<ListedEntry>>;
+    DIR* dir = ::opendir(path);
+    if (!dir) {
+        return Result::failure(errno, "opendir");
+    }
+    const size_t pathLength = std::strlen(path);
+    const bool needsSlash = pathLength > 0 && path[pathLength - 1] != '/';
+    std::pmr::vector<ListedEntry> entries(memory);
+    for (;;) {
+        errno = 0;
+        const dirent* entry = ::readdir(dir);
+        if (!entry) {
+            break;
+        }
+        const char* name = entry->d_name;
+        if (name[0] == '.' && (name[1] == 0 || (name[1] == '.' && name[2] == 0))) {
+            continue;
+        }
+        ListedEntry& listed = entries.emplace_back(ListedEntry{std::pmr::string(memory), fs::file_type::unknown});
+        const size_t nameLength = std::strlen(name);
+        listed.path.reserve(pathLength + 1 + nameLength);
+        listed.path.append(path, pathLength);
+        if (needsSlash) {
+            listed.path.push_back('/');
+        }
+        listed.path.append(name, nameLength);
+        mode_t mode = DTTOIF(entry->d_type);
+        struct stat st {};
+        if (entry->d_type == DT_UNKNOWN && ::fstatat(::dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+            mode = st.st_mode;
+        }
+        switch (mode & S_IFMT) {
+            case S_IFREG: listed.type = fs::file_type::regular; break;
+            case S_IFDIR: listed.type = fs::file_type::directory; break;
+            case S_IFLNK: listed.type = fs::file_type::symlink; break;
+            case S_IFBLK: listed.type = fs::file_type::block; break;
+            case S_IFCHR: listed.type = fs::file_type::character; break;
+            case S_IFIFO: listed.type = fs::file_type::fifo; break;
+            case S_IFSOCK: listed.type = fs::file_type::socket; break;
+            default: break;
+        }
+    }
+    const int error = errno;
+    ::closedir(dir);
+    if (error != 0) {
+        return Result::failure(error, "readdir");
+    }
+    return entries;
+}
+
+static FsResult<bool> createDirectoryImpl(const fs::path& path) {
+    if (::mkdir(path.c_str(), 0777) == 0) {
+        return true;
+    }
+    // Same as std::filesystem::create_directory: an existing directory is not an error
+    if (errno == EEXIST) {
+        struct stat st {};
+        if (::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+            return false;
+        }
+        return FsResult<bool>::failure(EEXIST, "mkdir");
+    }
+    return FsResult<bool>::failure(errno, "mkdir");
+}
+
+static FsResult<uintmax_t> removeImpl(const fs::path& path) {
+    std::error_code ec;
+    const uintmax_t removed = fs::remove_all(path, ec);
+    if (ec) {
+        return FsResult<uintmax_t>::failure(ec.value(), "remove_all");
+    }
+    return removed;
+}
+
+static FsStatus copyImpl(const fs::path& source, const fs::path& destination, bool overwrite) {
     std::error_code ec;
     //default copy behaviour from copy_options class in filesystem
-    fs::copy_options options=fs::copy_options::none;
+    fs::copy_options options = fs::copy_options::none;
     if (overwrite) {
-        options=fs::copy_options::overwrite_existing;
+        options = fs::copy_options::overwrite_existing;
     }
-    fs::copy(source,destination,options,ec);
+    fs::copy(source, destination, options, ec);
     if (ec) {
-        std::cerr<<"Error Copying: "<<ec.message()<<std::endl;
-        return false;
+        return FsStatus::failure(ec.value(), "copy");
     }
-    return true;
+    return {};
 }
 
-bool FileSystem::move(const fs::path& source, const fs::path& destination, bool overwrite) {
+static FsStatus moveImpl(const fs::path& source, const fs::path& destination, bool overwrite) {
     std::error_code ec;
     //if destination already exists and overwrite is true, remove the destination first
-    if (overwrite&&fs::exists(destination)) {
-        fs::remove_all(destination,ec);
+    if (overwrite && fs::exists(destination, ec)) {
+        fs::remove_all(destination, ec);
         if (ec) {
-            std::cerr<<"Error removing existing destination"<<ec.message()<<std::endl;
-            return false;
+            return FsStatus::failure(ec.value(), "remove existing destination");
         }
     }
     //In filesystem renaming is same as moving because in renaming we are
@@ -98,65 +285,349 @@ bool FileSystem::move(const fs::path& source, const fs::path& destination, bool
     //this is what moving basically is. We rename the path
     //If we want to move from one device to another we have to manually
     //copy the file and then remove from the origin
-    fs::rename(source,destination,ec);
+    fs::rename(source, destination, ec);
     if (ec) {
-        std::cerr<<"Error moving: "<<ec.message()<<std::endl;
-        return false;
+        return FsStatus::failure(ec.value(), "rename");
     }
-    return true;
+    return {};
 }
 
-//get file size :returns optional to handle errors
-//Optional is used because we dont want this function to throw errors
-//We return size when successful otherwise we return nullopt which means no value present
-std::optional<uintmax_t> FileSystem::fileSize(const fs::path& path) {
-    std::error_code ec;
-    auto size = fs::file_size(path, ec);
-    if (ec) {
-        std::cerr << "Error getting file size: " << ec.message() << std::endl;
-        return std::nullopt;
+static FsResult<uintmax_t> fileSizeImpl(const char* path) {
+    struct stat st {};
+    if (::stat(path, &st) != 0) {
+        return FsResult<uintmax_t>::failure(errno, "stat");
+    }
+    // Same rule as std::filesystem::file_size: only regular files have a size
+    if (S_ISDIR(st.st_mode)) {
+        return FsResult<uintmax_t>::failure(EISDIR, "file_size");
     }
-    return size;
+    if (!S_ISREG(st.st_mode)) {
+        return FsResult<uintmax_t>::failure(ENOTSUP, "file_size");
+    }
+    return static_cast<uintmax_t>(st.st_size);
 }
 
-// Get last modified time of a file
-std::optional<fs::file_time_type> FileSystem::lastWriteTime(const fs::path& path) {
+static FsResult<fs::file_time_type> lastWriteTimeImpl(const fs::path& path) {
     std::error_code ec;
     auto time = fs::last_write_time(path, ec);
     if (ec) {
-        std::cerr << "Error getting last write time: " << ec.message() << std::endl;
-        return std::nullopt;
+        return FsResult<fs::file_time_type>::failure(ec.value(), "last_write_time");
     }
     return time;
 }
 
-//Read contents of a file and return as string
-std::optional<std::string> FileSystem::readFile(const fs::path& path) {
-    //open the file in given path in binary mode
-    //this bitwise or guarantees read access
-    //so this line basically means file is opened for reading
-    //and it reads as binary
-    std::ifstream file(path, std::ios::in | std::ios::binary);
-    if (!file) {
-        std::cerr << "Error opening file for reading " << path << std::endl;
-        return std::nullopt;
+// lastWriteTimeImpl without fs::path: stat() and the file clock's offset
+// from the system clock. C++17 has no file_clock::from_sys; the offset is a
+// whole number of seconds (0 in libc++, the 1970-2174 shift in libstdc++),
+// so rounding one measurement gives it exactly.
+static FsResult<fs::file_time_type> lastWriteTimeImpl(const char* path) {
+    using namespace std::chrono;
+    static const seconds clockOffset = [] {
+        const auto fileNow = fs::file_time_type::clock::now().time_since_epoch();
+        const auto systemNow = system_clock::now().time_since_epoch();
+        return round<seconds>(duration_cast<nanoseconds>(fileNow) - duration_cast<nanoseconds>(systemNow));
+    }();
+    struct stat st {};
+    if (::stat(path, &st) != 0) {
+        return FsResult<fs::file_time_type>::failure(errno, "stat");
     }
-    //istreambuf_iterator<char>(file) reads the file byte by byte until end of file
-    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    const nanoseconds sinceEpoch = seconds(st.st_mtim.tv_sec) + nanoseconds(st.st_mtim.tv_nsec);
+    return fs::file_time_type(duration_cast<fs::file_time_type::duration>(sinceEpoch + clockOffset));
+}
+
+static FsResult<std::string> readFileImpl(const fs::path& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return FsResult<std::string>::failure(errno, "open");
+    }
+
+    // Size the string once from fstat, then read until EOF in case the file grows
+    std::string content;
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+        content.resize(static_cast<size_t>(st.st_size));
+    }
+    size_t used = 0;
+    while (true) {
+        if (used == content.size()) {
+            content.resize(content.empty() ? 4096 : content.size() * 2);
+        }
+        const ssize_t n = ::read(fd, &content[used], content.size() - used);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const int error = errno;
+            ::close(fd);
+            return FsResult<std::string>::failure(error, "read");
+        }
+        if (n == 0) {
+            break;
+        }
+        used += static_cast<size_t>(n);
+    }
+    ::close(fd);
+    content.resize(used);
     return content;
-    //we didnt need to close the file a our destructor will automatically
-    //destroy the object and close our file
 }
 
-bool FileSystem::writeFile(const fs::path& path, const std::string& content) {
-    std::ofstream file(path, std::ios::out | std::ios::binary);
-    if (!file) {
-        std::cerr << "Error opening file for writing " << path << std::endl;
-        return false;
+static FsStatus writeFileImpl(const fs::path& path, const std::string& content) {
+    const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        return FsStatus::failure(errno, "open");
     }
-    file.write(content.data(), content.size());
-    return file.good(); //means return true if write was success
+    const char* data = content.data();
+    size_t remaining = content.size();
+    while (remaining > 0) {
+        const ssize_t n = ::write(fd, data, remaining);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            const int error = errno;
+            ::close(fd);
+            return FsStatus::failure(error, "write");
+        }
+        data += n;
+        remaining -= static_cast<size_t>(n);
+    }
+    if (::close(fd) != 0) {
+        return FsStatus::failure(errno, "close");
+    }
+    return {};
+}
+
+// =======================
+// Instrumented entry points
+// =======================
+// Every call is recorded in Metrics under "fs.<name>", while tracing as an
+// "fs" span carrying the path, and while recording a workload as a
+// WorkloadRecord (see workload_recorder.hpp)
+
+// Metrics, trace span and workload record of one call
+class FsOp {
+public:
+    FsOp(MetricId metric, WorkloadOp op, const fs::path& path, const fs::path* destination = nullptr)
+        : FsOp(metric, op, std::string_view(path.native())) {
+        if (destination && workload_.active()) {
+            workload_.addArg(destination->string());
+        }
+    }
+
+    // The path is only copied while tracing or recording
+    FsOp(MetricId metric, WorkloadOp op, std::string_view path)
+        : metrics_(metric), trace_("fs", workloadOpName(op)), workload_(op) {
+        if (trace_.active()) {
+            trace_.setDetail(std::string(path));
+        }
+        if (workload_.active()) {
+            workload_.addArg(std::string(path));
+        }
+    }
+
+    // True if anyone wants the byte/entry counts (they may cost a syscall)
+    bool active() const { return metrics_.active() || workload_.active(); }
+
+    void fail(int code) {
+        metrics_.fail();
+        workload_.setResult(code);
+    }
+    void addBytes(uint64_t bytes) {
+        metrics_.addBytes(bytes);
+        workload_.setSize(bytes);
+    }
+    void addEntries(uint64_t entries) {
+        metrics_.addEntries(entries);
+        workload_.setSize(entries);
+    }
+    // Answer of exists/isDirectory/isFile and the result of fileSize, replay
+    // needs them to rebuild the tree (not counted as bytes moved)
+    void setAnswer(bool answer) { workload_.setSize(answer ? 1 : 0); }
+    void setSize(uint64_t size) { workload_.setSize(size); }
+    void setOverwrite(bool overwrite) { workload_.setFlags(overwrite ? WorkloadRecord::FLAG_OVERWRITE : 0); }
+
+private:
+    MetricsScope metrics_;
+    TraceScope trace_;
+    WorkloadScope workload_;
+};
+
+// Marks the call failed when the result is an error
+template<typename Result>
+static Result counted(FsOp& scope, Result result) {
+    if (!result) {
+        scope.fail(result.code());
+    }
+    return result;
 }
 
+// Same, for the yes/no queries
+static FsResult<bool> answered(FsOp& scope, FsResult<bool> result) {
+    if (!result) {
+        scope.fail(result.code());
+    } else {
+        scope.setAnswer(result.value());
+    }
+    return result;
+}
 
+FsResult<bool> FileSystem::tryExists(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.exists");
+    FsOp scope(metric, WorkloadOp::EXISTS, path);
+    return answered(scope, existsImpl(path.c_str()));
+}
+
+FsResult<bool> FileSystem::tryIsDirectory(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.isDirectory");
+    FsOp scope(metric, WorkloadOp::IS_DIRECTORY, path);
+    return answered(scope, isDirectoryImpl(path.c_str()));
+}
 
+FsResult<bool> FileSystem::tryIsFile(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.isFile");
+    FsOp scope(metric, WorkloadOp::IS_FILE, path);
+    return answered(scope, isFileImpl(path.c_str()));
+}
+
+FsResult<std::vector<fs::directory_entry>> FileSystem::tryListDirectory(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.listDirectory");
+    FsOp scope(metric, WorkloadOp::LIST_DIRECTORY, path);
+    auto result = counted(scope, listDirectoryImpl(path));
+    if (result) {
+        scope.addEntries(result.value().size());
+    }
+    return result;
+}
+
+FsResult<bool> FileSystem::tryCreateDirectory(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.createDirectory");
+    FsOp scope(metric, WorkloadOp::CREATE_DIRECTORY, path);
+    return counted(scope, createDirectoryImpl(path));
+}
+
+FsResult<uintmax_t> FileSystem::tryRemove(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.remove");
+    FsOp scope(metric, WorkloadOp::REMOVE, path);
+    auto result = counted(scope, removeImpl(path));
+    if (result) {
+        scope.addEntries(result.value());
+    }
+    return result;
+}
+
+FsStatus FileSystem::tryCopy(const fs::path& source, const fs::path& destination, bool overwrite) {
+    static const MetricId metric = Metrics::registerOperation("fs.copy");
+    FsOp scope(metric, WorkloadOp::COPY, source, &destination);
+    scope.setOverwrite(overwrite);
+    auto result = counted(scope, copyImpl(source, destination, overwrite));
+    // Throughput is only counted for single files, a tree would need a second walk
+    struct stat st {};
+    if (result && scope.active() && ::stat(source.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+        scope.addBytes(static_cast<uint64_t>(st.st_size));
+    }
+    return result;
+}
+
+FsStatus FileSystem::tryMove(const fs::path& source, const fs::path& destination, bool overwrite) {
+    static const MetricId metric = Metrics::registerOperation("fs.move");
+    FsOp scope(metric, WorkloadOp::MOVE, source, &destination);
+    scope.setOverwrite(overwrite);
+    return counted(scope, moveImpl(source, destination, overwrite));
+}
+
+FsResult<uintmax_t> FileSystem::tryFileSize(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.fileSize");
+    FsOp scope(metric, WorkloadOp::FILE_SIZE, path);
+    auto result = counted(scope, fileSizeImpl(path.c_str()));
+    if (result) {
+        scope.setSize(result.value());
+    }
+    return result;
+}
+
+FsResult<fs::file_time_type> FileSystem::tryLastWriteTime(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.lastWriteTime");
+    FsOp scope(metric, WorkloadOp::LAST_WRITE_TIME, path);
+    return counted(scope, lastWriteTimeImpl(path));
+}
+
+FsResult<std::string> FileSystem::tryReadFile(const fs::path& path) {
+    static const MetricId metric = Metrics::registerOperation("fs.readFile");
+    FsOp scope(metric, WorkloadOp::READ_FILE, path);
+    auto result = counted(scope, readFileImpl(path));
+    if (result) {
+        scope.addBytes(result.value().size());
+    }
+    return result;
+}
+
+FsStatus FileSystem::tryWriteFile(const fs::path& path, const std::string& content) {
+    static const MetricId metric = Metrics::registerOperation("fs.writeFile");
+    FsOp scope(metric, WorkloadOp::WRITE_FILE, path);
+    auto result = counted(scope, writeFileImpl(path, content));
+    if (result) {
+        scope.addBytes(content.size());
+    }
+    return result;
+}
+
+// --- std::pmr overloads ---
+// The path is copied NUL-terminated into `memory` for the syscall, paths up
+// to 15 bytes fit the string itself
+
+std::pmr::vector<ListedEntry> FileSystem::listDirectory(std::string_view path, std::pmr::memory_resource* memory) {
+    auto result = tryListDirectory(path, memory);
+    if (!result) {
+        if (result.code() != ENOENT && result.code() != ENOTDIR) {
+            std::cerr << "Error listing directory: " << result.message() << " " << path << std::endl;
+        }
+        return std::pmr::vector<ListedEntry>(memory);
+    }
+    return std::move(result).value();
+}
+
+FsResult<std::pmr::vector<ListedEntry>> FileSystem::tryListDirectory(std::string_view path,
+                                                                      std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.listDirectory");
+    FsOp scope(metric, WorkloadOp::LIST_DIRECTORY, path);
+    const std::pmr::string terminated(path, memory);
+    auto result = counted(scope, listDirectoryImpl(terminated.c_str(), memory));
+    if (result) {
+        scope.addEntries(result.value().size());
+    }
+    return result;
+}
+
+FsResult<bool> FileSystem::tryExists(std::string_view path, std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.exists");
+    FsOp scope(metric, WorkloadOp::EXISTS, path);
+    return answered(scope, existsImpl(std::pmr::string(path, memory).c_str()));
+}
+
+FsResult<bool> FileSystem::tryIsDirectory(std::string_view path, std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.isDirectory");
+    FsOp scope(metric, WorkloadOp::IS_DIRECTORY, path);
+    return answered(scope, isDirectoryImpl(std::pmr::string(path, memory).c_str()));
+}
+
+FsResult<bool> FileSystem::tryIsFile(std::string_view path, std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.isFile");
+    FsOp scope(metric, WorkloadOp::IS_FILE, path);
+    return answered(scope, isFileImpl(std::pmr::string(path, memory).c_str()));
+}
+
+FsResult<uintmax_t> FileSystem::tryFileSize(std::string_view path, std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.fileSize");
+    FsOp scope(metric, WorkloadOp::FILE_SIZE, path);
+    auto result = counted(scope, fileSizeImpl(std::pmr::string(path, memory).c_str()));
+    if (result) {
+        scope.setSize(result.value());
+    }
+    return result;
+}
+
+FsResult<fs::file_time_type> FileSystem::tryLastWriteTime(std::string_view path, std::pmr::memory_resource* memory) {
+    static const MetricId metric = Metrics::registerOperation("fs.lastWriteTime");
+    FsOp scope(metric, WorkloadOp::LAST_WRITE_TIME, path);
+    return counted(scope, lastWriteTimeImpl(std::pmr::string(path, memory).c_str()));
+}
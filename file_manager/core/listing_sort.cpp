@@ -0,0 +1,282 @@
+#include "listing_sort.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <thread>
+
+// Below these sizes one thread is faster than starting more
+static constexpr size_t PARALLEL_SORT_THRESHOLD = 32 * 1024;
+static constexpr size_t PARALLEL_FILTER_THRESHOLD = 64 * 1024;
+static constexpr unsigned MAX_THREADS = 16;
+
+static char foldChar(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+}
+
+static bool isDigit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static unsigned resolveThreads(unsigned requested) {
+    if (requested == 0) {
+        requested = std::max(1u, std::thread::hardware_concurrency());
+    }
+    return std::min(requested, MAX_THREADS);
+}
+
+// Runs task(i) for i in [0, count) on `count` threads (the caller runs the last one)
+template<typename Task>
+static void runParallel(size_t count, Task task) {
+    std::vector<std::thread> workers;
+    workers.reserve(count - 1);
+    for (size_t i = 0; i + 1 < count; ++i) {
+        workers.emplace_back(task, i);
+    }
+    task(count - 1);
+    for (auto& worker : workers) {
+        worker.join();
+    }
+}
+
+// Extension used by SortColumn::TYPE, empty for "name" and ".hidden"
+static std::string_view extensionOf(std::string_view name) {
+    const size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0) {
+        return {};
+    }
+    return name.substr(dot + 1);
+}
+
+static int compareFolded(std::string_view a, std::string_view b) {
+    const size_t n = std::min(a.size(), b.size());
+    for (size_t i = 0; i < n; ++i) {
+        const unsigned char ca = static_cast<unsigned char>(foldChar(a[i]));
+        const unsigned char cb = static_cast<unsigned char>(foldChar(b[i]));
+        if (ca != cb) {
+            return ca < cb ? -1 : 1;
+        }
+    }
+    return a.size() == b.size() ? 0 : (a.size() < b.size() ? -1 : 1);
+}
+
+template<typename T>
+static int compareValues(T a, T b) {
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+// =======================
+// SortKeys Implementation
+// =======================
+
+std::string SortKeys::naturalKey(std::string_view name) {
+    std::string key;
+    key.reserve(name.size() + 4);
+    size_t i = 0;
+    while (i < name.size()) {
+        if (!isDigit(name[i])) {
+            key += foldChar(name[i++]);
+            continue;
+        }
+        // Digit run: drop leading zeros (keep one for "0"), then length-prefix it
+        while (i + 1 < name.size() && name[i] == '0' && isDigit(name[i + 1])) {
+            ++i;
+        }
+        size_t end = i;
+        while (end < name.size() && isDigit(name[end])) {
+            ++end;
+        }
+        const size_t length = std::min<size_t>(end - i, 255);
+        key += '0';   // only digit runs produce '0' here, so runs compare against runs
+        key += static_cast<char>(length);
+        key.append(name.data() + i, end - i);
+        i = end;
+    }
+    return key;
+}
+
+void SortKeys::build(const DirectoryListing& listing) {
+    blob_.clear();
+    offsets_.assign(1, 0);
+    offsets_.reserve(listing.size() + 1);
+    for (size_t row = 0; row < listing.size(); ++row) {
+        blob_ += naturalKey(listing.name(row));
+        offsets_.push_back(static_cast<uint32_t>(blob_.size()));
+    }
+}
+
+// =======================
+// Sorting
+// =======================
+
+namespace {
+
+struct RowLess {
+    const DirectoryListing& listing;
+    const SortKeys& keys;
+    SortColumn column;
+    bool descending;
+
+    int compareColumn(uint32_t a, uint32_t b) const {
+        switch (column) {
+            case SortColumn::SIZE: return compareValues(listing.fileSize(a), listing.fileSize(b));
+            case SortColumn::DATE: return compareValues(listing.modifiedTime(a), listing.modifiedTime(b));
+            case SortColumn::TYPE: return compareFolded(extensionOf(listing.name(a)), extensionOf(listing.name(b)));
+            case SortColumn::NAME: break;
+        }
+        return 0;
+    }
+
+    bool operator()(uint32_t a, uint32_t b) const {
+        const bool directoryA = listing.isDirectory(a);
+        if (directoryA != listing.isDirectory(b)) {
+            return directoryA;
+        }
+        int result = compareColumn(a, b);
+        if (result == 0) {
+            result = keys.key(a).compare(keys.key(b));
+        }
+        if (result == 0) {
+            result = listing.name(a).compare(listing.name(b));   // "a01" vs "a1", "A" vs "a"
+        }
+        if (result != 0) {
+            return descending ? result > 0 : result < 0;
+        }
+        return a < b;
+    }
+};
+
+} // namespace
+
+std::vector<uint32_t> sortListing(const DirectoryListing& listing, const SortKeys& keys, const SortOptions& options) {
+    static const MetricId metric = Metrics::registerOperation("listing.sort");
+    MetricsScope scope(metric);
+
+    const size_t n = listing.size();
+    std::vector<uint32_t> rows(n);
+    for (size_t i = 0; i < n; ++i) {
+        rows[i] = static_cast<uint32_t>(i);
+    }
+    scope.addEntries(n);
+
+    const RowLess less{listing, keys, options.column, options.descending};
+    const unsigned threads = resolveThreads(options.threads);
+    auto cancelled = [&] { return options.cancelled && options.cancelled->load(std::memory_order_relaxed); };
+
+    if (threads == 1 || n < PARALLEL_SORT_THRESHOLD) {
+        std::sort(rows.begin(), rows.end(), less);
+        return cancelled() ? std::vector<uint32_t>() : rows;
+    }
+
+    // Sort one run per thread...
+    std::vector<size_t> bounds(threads + 1);
+    for (unsigned i = 0; i <= threads; ++i) {
+        bounds[i] = n * i / threads;
+    }
+    runParallel(threads, [&](size_t i) {
+        std::sort(rows.begin() + bounds[i], rows.begin() + bounds[i + 1], less);
+    });
+
+    // ...then merge neighbouring runs pairwise, each pass in parallel
+    std::vector<uint32_t> merged(n);
+    while (bounds.size() > 2) {
+        if (cancelled()) {
+            return {};
+        }
+        const size_t runs = bounds.size() - 1;
+        const size_t pairs = (runs + 1) / 2;
+        runParallel(pairs, [&](size_t pair) {
+            const size_t begin = bounds[2 * pair];
+            const size_t middle = bounds[std::min(2 * pair + 1, runs)];
+            const size_t end = bounds[std::min(2 * pair + 2, runs)];
+            std::merge(rows.begin() + begin, rows.begin() + middle,
+                       rows.begin() + middle, rows.begin() + end,
+                       merged.begin() + begin, less);
+        });
+        rows.swap(merged);
+
+        std::vector<size_t> next;
+        next.reserve(pairs + 1);
+        for (size_t i = 0; i < bounds.size(); i += 2) {
+            next.push_back(bounds[i]);
+        }
+        if (next.back() != n) {
+            next.push_back(n);
+        }
+        bounds.swap(next);
+    }
+    return cancelled() ? std::vector<uint32_t>() : rows;
+}
+
+// =======================
+// Filtering
+// =======================
+
+std::string foldCase(std::string_view text) {
+    std::string folded(text);
+    for (char& c : folded) {
+        c = foldChar(c);
+    }
+    return folded;
+}
+
+bool nameMatches(std::string_view name, std::string_view foldedPattern) {
+    if (foldedPattern.empty()) {
+        return true;
+    }
+    if (name.size() < foldedPattern.size()) {
+        return false;
+    }
+    const size_t last = name.size() - foldedPattern.size();
+    for (size_t start = 0; start <= last; ++start) {
+        if (foldChar(name[start]) != foldedPattern[0]) {
+            continue;
+        }
+        size_t i = 1;
+        while (i < foldedPattern.size() && foldChar(name[start + i]) == foldedPattern[i]) {
+            ++i;
+        }
+        if (i == foldedPattern.size()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+std::vector<uint32_t> filterRows(const DirectoryListing& listing, const std::vector<uint32_t>& candidates,
+                                 std::string_view foldedPattern, unsigned threads) {
+    static const MetricId metric = Metrics::registerOperation("listing.filter");
+    MetricsScope scope(metric);
+    scope.addEntries(candidates.size());
+
+    if (foldedPattern.empty()) {
+        return candidates;
+    }
+
+    auto filterRange = [&](size_t begin, size_t end, std::vector<uint32_t>& out) {
+        for (size_t i = begin; i < end; ++i) {
+            if (nameMatches(listing.name(candidates[i]), foldedPattern)) {
+                out.push_back(candidates[i]);
+            }
+        }
+    };
+
+    const size_t count = resolveThreads(threads);
+    std::vector<uint32_t> result;
+    if (count == 1 || candidates.size() < PARALLEL_FILTER_THRESHOLD) {
+        filterRange(0, candidates.size(), result);
+        return result;
+    }
+
+    std::vector<std::vector<uint32_t>> parts(count);
+    runParallel(count, [&](size_t i) {
+        filterRange(candidates.size() * i / count, candidates.size() * (i + 1) / count, parts[i]);
+    });
+    size_t total = 0;
+    for (const auto& part : parts) {
+        total += part.size();
+    }
+    result.reserve(total);
+    for (const auto& part : parts) {
+        result.insert(result.end(), part.begin(), part.end());
+    }
+    return result;
+}
@@ -0,0 +1,235 @@
+#include "operation_scheduler.hpp"
+#include "error_handler.hpp"
+#include "workload_recorder.hpp"
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <system_error>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>   // major() and minor()
+
+// Set on worker threads, used by run() to detect nested submissions
+static thread_local bool insideWorker = false;
+
+// Shared scheduler used by the GUI and the plugins
+OperationScheduler& OperationScheduler::instance() {
+    static OperationScheduler scheduler;
+    return scheduler;
+}
+
+OperationScheduler::OperationScheduler() = default;
+
+// Finishes queued jobs and joins all workers
+OperationScheduler::~OperationScheduler() {
+    shutdown();
+}
+
+std::future<bool> OperationScheduler::submit(const fs::path& path, Job job, JobPriority priority) {
+    auto promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> result = promise->get_future();
+
+    // stat() happens outside the lock, it can block on slow devices
+    const dev_t device = deviceOf(path);
+
+    // FileSystem calls of a job submitted from a recorded plugin call are
+    // part of that call, keep the workload recorder from recording them again
+    if (WorkloadScope::insideRecordedCall()) {
+        job = [inner = std::move(job)] {
+            WorkloadScope::Nested nested(true);
+            return inner();
+        };
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (stopping_) {
+        promise->set_exception(std::make_exception_ptr(
+            FileManagerException("Operation scheduler is shut down")));
+        return result;
+    }
+
+    DeviceQueue& queue = queueFor(device);
+    queue.jobs.push({priority, nextSequence_++, std::move(job), std::move(promise)});
+    ++pending_;
+
+    // Workers are started lazily, never more than the device limit
+    if (queue.workers.size() < queue.limit) {
+        queue.workers.emplace_back(&OperationScheduler::workerLoop, this, &queue);
+    }
+    queue.workAvailable.notify_one();
+    return result;
+}
+
+bool OperationScheduler::run(const fs::path& path, Job job, JobPriority priority) {
+    if (insideWorker) {
+        return job();
+    }
+    return submit(path, std::move(job), priority).get();
+}
+
+void OperationScheduler::setDeviceConcurrency(dev_t device, size_t limit) {
+    if (limit == 0) {
+        limit = 1;   // a device without workers would never drain
+    }
+    std::lock_guard<std::mutex> lock(mutex_);
+    DeviceQueue& queue = queueFor(device);
+    queue.limit = limit;
+
+    // Start the extra workers right away if jobs are already waiting
+    while (!stopping_ && queue.workers.size() < std::min(queue.limit, queue.jobs.size())) {
+        queue.workers.emplace_back(&OperationScheduler::workerLoop, this, &queue);
+    }
+    queue.workAvailable.notify_all();
+}
+
+size_t OperationScheduler::deviceConcurrency(dev_t device) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return queueFor(device).limit;
+}
+
+void OperationScheduler::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return pending_ == 0; });
+}
+
+void OperationScheduler::shutdown() {
+    std::vector<std::thread> workers;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+        for (auto& [device, queue] : devices_) {
+            queue->workAvailable.notify_all();
+            for (auto& worker : queue->workers) {
+                workers.push_back(std::move(worker));
+            }
+            queue->workers.clear();
+        }
+    }
+    // Join without the lock, workers need it to drain their queues
+    for (auto& worker : workers) {
+        if (worker.joinable()) {
+            worker.join();
+        }
+    }
+}
+
+// Device that holds the path, or of its nearest existing parent
+dev_t OperationScheduler::deviceOf(const fs::path& path) {
+    fs::path current = path.empty() ? fs::path(".") : path;
+    struct stat st {};
+    while (::stat(current.c_str(), &st) != 0) {
+        fs::path parent = current.parent_path();
+        if (parent.empty() || parent == current) {
+            // Nothing along the path exists, use the working directory
+            if (::stat(".", &st) != 0) {
+                return 0;
+            }
+            break;
+        }
+        current = parent;
+    }
+    return st.st_dev;
+}
+
+// Look up /sys/dev/block/<major>:<minor> to classify the device
+DeviceKind OperationScheduler::detectDeviceKind(dev_t device) {
+    // Major 0 is used for anonymous devices: tmpfs, overlayfs, NFS, btrfs subvolumes...
+    if (major(device) == 0) {
+        return DeviceKind::UNKNOWN;
+    }
+
+    std::error_code ec;
+    fs::path sysDir = fs::canonical("/sys/dev/block/" + std::to_string(major(device)) + ":" +
+                                    std::to_string(minor(device)), ec);
+    if (ec) {
+        return DeviceKind::UNKNOWN;
+    }
+
+    // Partitions have no queue of their own, the parent disk has it
+    if (fs::exists(sysDir / "partition", ec)) {
+        sysDir = sysDir.parent_path();
+    }
+
+    std::ifstream rotationalFile(sysDir / "queue" / "rotational");
+    int rotational = 0;
+    if (!(rotationalFile >> rotational)) {
+        return DeviceKind::UNKNOWN;
+    }
+    if (rotational != 0) {
+        return DeviceKind::ROTATIONAL;
+    }
+    if (sysDir.filename().string().rfind("nvme", 0) == 0) {
+        return DeviceKind::NVME;
+    }
+    return DeviceKind::SSD;
+}
+
+// Concurrency picked for each device kind
+size_t OperationScheduler::defaultConcurrency(DeviceKind kind) {
+    switch (kind) {
+        case DeviceKind::ROTATIONAL: return 1;   // keep the head moving sequentially
+        case DeviceKind::SSD:        return 4;
+        case DeviceKind::NVME:       return 8;
+        case DeviceKind::UNKNOWN:    return 2;
+    }
+    return 2;
+}
+
+// PRIVATE METHODS
+
+// Find or create the queue of a device (mutex_ must be held)
+OperationScheduler::DeviceQueue& OperationScheduler::queueFor(dev_t device) {
+    auto it = devices_.find(device);
+    if (it != devices_.end()) {
+        return *it->second;
+    }
+
+    auto queue = std::make_unique<DeviceQueue>();
+    queue->limit = defaultConcurrency(detectDeviceKind(device));
+    DeviceQueue& ref = *queue;
+    devices_.emplace(device, std::move(queue));
+    return ref;
+}
+
+// Worker loop for one device
+// Takes the best job as long as the device is below its limit
+void OperationScheduler::workerLoop(DeviceQueue* queue) {
+    insideWorker = true;
+    std::unique_lock<std::mutex> lock(mutex_);
+    while (true) {
+        queue->workAvailable.wait(lock, [&] {
+            return (!queue->jobs.empty() && queue->running < queue->limit) ||
+                   (stopping_ && queue->jobs.empty());
+        });
+        if (queue->jobs.empty()) {
+            return;   // stopping and nothing left to drain
+        }
+
+        // top() is const, but the element is popped right after so moving is safe
+        QueuedJob job = std::move(const_cast<QueuedJob&>(queue->jobs.top()));
+        queue->jobs.pop();
+        ++queue->running;
+        lock.unlock();
+
+        try {
+            const bool ok = job.job();
+            // Released before the waiter wakes: the callable may live in a
+            // plugin that is unloaded as soon as run() returns
+            job.job = nullptr;
+            job.promise->set_value(ok);
+        } catch (const std::exception& e) {
+            FM_ERROR("Scheduled operation failed: ", e.what());
+            job.job = nullptr;
+            job.promise->set_exception(std::current_exception());
+        } catch (...) {
+            FM_ERROR("Scheduled operation failed with unknown exception");
+            job.job = nullptr;
+            job.promise->set_exception(std::current_exception());
+        }
+
+        lock.lock();
+        --queue->running;
+        --pending_;
+        queue->workAvailable.notify_one();
+        idle_.notify_all();
+    }
+}
@@ -0,0 +1,500 @@
+#include "path_store.hpp"
+#include "io_priority.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <functional>
+#include <optional>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Names are copied into blocks of this size (longer ones get their own)
+static constexpr size_t ARENA_BLOCK_SIZE = 1024 * 1024;
+
+static constexpr uint32_t NO_NAME = UINT32_MAX;
+
+// Entries read per getdents64 batch
+static constexpr size_t SCAN_CHUNK = 4096;
+
+static size_t hashName(std::string_view name) {
+    return std::hash<std::string_view>{}(name);
+}
+
+// =======================
+// PathStore::Reader Implementation
+// =======================
+
+void PathStore::Reader::appendPath(PathId id, std::string& out) const {
+    // Length first, then the names are copied back to front into place
+    size_t length = 0;
+    PathId top = id;
+    for (PathId node = id; node != NONE; node = parent(node)) {
+        length += name(node).size() + (parent(node) == NONE ? 0 : 1);
+        top = node;
+    }
+    if (name(top).empty() && id == top) {
+        out += '/';   // the filesystem root itself
+        return;
+    }
+
+    const size_t start = out.size();
+    out.resize(start + length);
+    size_t position = start + length;
+    for (PathId node = id; node != NONE; node = parent(node)) {
+        const std::string_view part = name(node);
+        position -= part.size();
+        std::memcpy(&out[position], part.data(), part.size());
+        if (parent(node) != NONE) {
+            out[--position] = '/';
+        }
+    }
+}
+
+std::string PathStore::Reader::path(PathId id) const {
+    std::string out;
+    appendPath(id, out);
+    return out;
+}
+
+bool PathStore::Reader::isWithin(PathId id, PathId ancestor) const {
+    for (PathId node = id; node != NONE; node = parent(node)) {
+        if (node == ancestor) {
+            return true;
+        }
+    }
+    return false;
+}
+
+PathId PathStore::Reader::lookup(std::string_view path) const {
+    while (path.size() > 1 && path.back() == '/') {
+        path.remove_suffix(1);
+    }
+    for (const PathId root : store_.roots_) {
+        const std::string_view rootName = name(root);
+        std::string_view rest;
+        if (rootName.empty()) {   // "/"
+            if (path.empty() || path.front() != '/') {
+                continue;
+            }
+            rest = path.substr(1);
+        } else if (path == rootName) {
+            return root;
+        } else if (path.size() > rootName.size() && path.compare(0, rootName.size(), rootName) == 0 &&
+                   path[rootName.size()] == '/') {
+            rest = path.substr(rootName.size() + 1);
+        } else {
+            continue;
+        }
+
+        // One component at a time: the interned id of the name, then a scan
+        // of the children comparing ids
+        PathId node = root;
+        while (node != NONE && !rest.empty()) {
+            const size_t slash = rest.find('/');
+            const std::string_view component = rest.substr(0, slash);
+            rest = slash == std::string_view::npos ? std::string_view() : rest.substr(slash + 1);
+            if (component.empty() || component == ".") {
+                continue;
+            }
+            const uint32_t wanted = store_.findName(component);
+            PathId found = NONE;
+            if (wanted != NO_NAME) {
+                const PathId first = firstChild(node);
+                for (PathId child = first; child < first + childCount(node); ++child) {
+                    if (nameId(child) == wanted) {
+                        found = child;
+                        break;
+                    }
+                }
+            }
+            node = found;
+        }
+        if (node != NONE) {
+            return node;
+        }
+    }
+    return NONE;
+}
+
+// =======================
+// PathStore Implementation
+// =======================
+
+PathStore::PathStore() = default;
+PathStore::~PathStore() = default;
+
+// glibc's rwlock prefers readers: with Readers coming back to back the
+// scanner would never get the exclusive lock. Both sides take gate_ while
+// acquiring, so once a writer waits new readers queue behind it.
+std::shared_lock<std::shared_mutex> PathStore::sharedLock() const {
+    std::lock_guard<std::mutex> gate(gate_);
+    return std::shared_lock<std::shared_mutex>(mutex_);
+}
+
+std::unique_lock<std::shared_mutex> PathStore::exclusiveLock() {
+    std::lock_guard<std::mutex> gate(gate_);
+    return std::unique_lock<std::shared_mutex>(mutex_);
+}
+
+PathId PathStore::addRoot(std::string_view path, EntryType type, uint64_t size) {
+    while (!path.empty() && path.back() == '/') {
+        path.remove_suffix(1);   // "/" becomes "", see Reader::appendPath()
+    }
+    std::unique_lock<std::shared_mutex> lock = exclusiveLock();
+    const PathId id = addNode(NONE, intern(path), type, size);
+    if (id != NONE) {
+        roots_.push_back(id);
+    }
+    return id;
+}
+
+PathId PathStore::setChildren(PathId directory, const DirectoryListing& entries) {
+    std::unique_lock<std::shared_mutex> lock = exclusiveLock();
+    if (parents_.size() + entries.size() >= NONE) {
+        return NONE;
+    }
+    const PathId first = static_cast<PathId>(parents_.size());
+    for (size_t row = 0; row < entries.size(); ++row) {
+        const uint64_t size = entries.hasMetadata(row) && entries.metadataValid(row) ? entries.fileSize(row) : 0;
+        addNode(directory, intern(entries.name(row)), entries.type(row), size);
+    }
+    // Published last, readers never see a half-filled range
+    firstChildren_[directory] = first;
+    childCounts_[directory] = static_cast<uint32_t>(entries.size());
+    return first;
+}
+
+std::vector<PathId> PathStore::roots() const {
+    std::shared_lock<std::shared_mutex> lock = sharedLock();
+    return roots_;
+}
+
+size_t PathStore::size() const {
+    std::shared_lock<std::shared_mutex> lock = sharedLock();
+    return parents_.size();
+}
+
+std::string PathStore::path(PathId id) const {
+    return Reader(*this).path(id);
+}
+
+PathId PathStore::lookup(std::string_view path) const {
+    return Reader(*this).lookup(path);
+}
+
+uint64_t PathStore::subtreeSize(PathId root) const {
+    Reader reader(*this);
+    uint64_t total = 0;
+    reader.forEach(root, [&](PathId id) {
+        if (!reader.isDirectory(id)) {
+            total += reader.fileSize(id);
+        }
+        return true;
+    });
+    return total;
+}
+
+std::vector<PathId> PathStore::find(PathId root, const std::string& pattern) const {
+    Reader reader(*this);
+    // fnmatch() once per distinct name: -1 not tried yet, else the result
+    std::vector<int8_t> matches(names_.size(), -1);
+    std::vector<PathId> found;
+    reader.forEach(root, [&](PathId id) {
+        if (id != root) {
+            int8_t& match = matches[reader.nameId(id)];
+            if (match < 0) {
+                match = ::fnmatch(pattern.c_str(), reader.name(id).data(), 0) == 0 ? 1 : 0;
+            }
+            if (match) {
+                found.push_back(id);
+            }
+        }
+        return true;
+    });
+    return found;
+}
+
+size_t PathStore::nameCount() const {
+    std::shared_lock<std::shared_mutex> lock = sharedLock();
+    return names_.size();
+}
+
+size_t PathStore::nameBytes() const {
+    std::shared_lock<std::shared_mutex> lock = sharedLock();
+    return arenaBytes_;
+}
+
+size_t PathStore::memoryUsage() const {
+    std::shared_lock<std::shared_mutex> lock = sharedLock();
+    return parents_.capacity() * sizeof(PathId) +
+           nameIds_.capacity() * sizeof(uint32_t) +
+           types_.capacity() * sizeof(EntryType) +
+           sizes_.capacity() * sizeof(uint64_t) +
+           firstChildren_.capacity() * sizeof(PathId) +
+           childCounts_.capacity() * sizeof(uint32_t) +
+           names_.capacity() * sizeof(std::string_view) +
+           nameTable_.capacity() * sizeof(uint32_t) +
+           arenaAllocated_;
+}
+
+void PathStore::clear() {
+    std::unique_lock<std::shared_mutex> lock = exclusiveLock();
+    parents_.clear();
+    nameIds_.clear();
+    types_.clear();
+    sizes_.clear();
+    firstChildren_.clear();
+    childCounts_.clear();
+    roots_.clear();
+    blocks_.clear();
+    blockUsed_ = blockSize_ = arenaBytes_ = arenaAllocated_ = 0;
+    names_.clear();
+    nameTable_.clear();
+}
+
+// PRIVATE METHODS
+
+uint32_t PathStore::intern(std::string_view name) {
+    if ((names_.size() + 1) * 2 > nameTable_.size()) {
+        growNameTable();   // at most half full, probes stay short
+    }
+    const size_t mask = nameTable_.size() - 1;
+    size_t slot = hashName(name) & mask;
+    while (nameTable_[slot] != NO_NAME) {
+        if (names_[nameTable_[slot]] == name) {
+            return nameTable_[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    const size_t needed = name.size() + 1;
+    if (blocks_.empty() || blockUsed_ + needed > blockSize_) {
+        blockSize_ = std::max(ARENA_BLOCK_SIZE, needed);
+        blocks_.push_back(std::make_unique<char[]>(blockSize_));
+        arenaAllocated_ += blockSize_;
+        blockUsed_ = 0;
+    }
+    char* bytes = blocks_.back().get() + blockUsed_;
+    std::memcpy(bytes, name.data(), name.size());
+    bytes[name.size()] = '\0';
+    blockUsed_ += needed;
+    arenaBytes_ += needed;
+
+    const uint32_t id = static_cast<uint32_t>(names_.size());
+    names_.emplace_back(bytes, name.size());
+    nameTable_[slot] = id;
+    return id;
+}
+
+uint32_t PathStore::findName(std::string_view name) const {
+    if (nameTable_.empty()) {
+        return NO_NAME;
+    }
+    const size_t mask = nameTable_.size() - 1;
+    for (size_t slot = hashName(name) & mask; nameTable_[slot] != NO_NAME; slot = (slot + 1) & mask) {
+        if (names_[nameTable_[slot]] == name) {
+            return nameTable_[slot];
+        }
+    }
+    return NO_NAME;
+}
+
+void PathStore::growNameTable() {
+    std::vector<uint32_t> table(std::max<size_t>(1024, nameTable_.size() * 2), NO_NAME);
+    const size_t mask = table.size() - 1;
+    for (uint32_t id = 0; id < names_.size(); ++id) {
+        size_t slot = hashName(names_[id]) & mask;
+        while (table[slot] != NO_NAME) {
+            slot = (slot + 1) & mask;
+        }
+        table[slot] = id;
+    }
+    nameTable_.swap(table);
+}
+
+PathId PathStore::addNode(PathId parent, uint32_t nameId, EntryType type, uint64_t size) {
+    if (parents_.size() >= NONE) {
+        return NONE;
+    }
+    parents_.push_back(parent);
+    nameIds_.push_back(nameId);
+    types_.push_back(type);
+    sizes_.push_back(size);
+    firstChildren_.push_back(0);
+    childCounts_.push_back(0);
+    return static_cast<PathId>(parents_.size() - 1);
+}
+
+// =======================
+// TreeScanner Implementation
+// =======================
+
+TreeScanner::TreeScanner(PathStore& store)
+    : TreeScanner(store, Options{})
+{
+}
+
+TreeScanner::TreeScanner(PathStore& store, Options options)
+    : store_(store),
+      options_(options)
+{
+}
+
+FsResult<PathId> TreeScanner::scan(const std::string& root) {
+    static const MetricId metric = Metrics::registerOperation("tree.scan");
+    MetricsScope scope(metric);
+    TraceScope trace("tree", "TreeScanner::scan");
+    if (trace.active()) {
+        trace.setDetail(root);
+    }
+    std::optional<ScopedIoPriority> idle;
+    if (options_.limiter && options_.limiter->limits().idleIo) {
+        idle.emplace(IoPriorityClass::IDLE);
+    }
+
+    struct stat st {};
+    if (::stat(root.c_str(), &st) != 0) {
+        scope.fail();
+        return FsResult<PathId>::failure(errno, "stat");
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        return store_.addRoot(root, S_ISREG(st.st_mode) ? EntryType::FILE : EntryType::OTHER,
+                              static_cast<uint64_t>(st.st_size));
+    }
+    const dev_t device = st.st_dev;
+    const PathId rootId = store_.addRoot(root);
+    if (rootId == PathStore::NONE) {
+        scope.fail();
+        return FsResult<PathId>::failure(EOVERFLOW, "path store full");
+    }
+
+    // A directory still being descended: its descriptor (-1 below
+    // MAX_OPEN_DEPTH) and the child directories not visited yet
+    struct Frame {
+        int fd = -1;
+        std::vector<PathId> pending;
+    };
+    std::vector<Frame> stack;
+    DirectoryEnumerator enumerator;
+    DirectoryListing listing;
+    bool full = false;
+
+    // Lists the directory `enumerator` has open into the store
+    auto addDirectory = [&](PathId directory) {
+        if (options_.sameFilesystem && ::fstat(enumerator.fd(), &st) == 0 && st.st_dev != device) {
+            enumerator.close();
+            return;
+        }
+        listing.clear();
+        for (;;) {
+            FsResult<size_t> added = enumerator.next(listing, SCAN_CHUNK);
+            if (!added) {
+                errors_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+            if (added.value() == 0) {
+                break;
+            }
+        }
+        // readdir types are enough for walking, stat only what it left open
+        uint64_t ops = 1;
+        if (options_.metadata) {
+            listing.loadMetadata(enumerator.fd(), 0, listing.size());
+            ops += listing.size();
+        } else {
+            for (size_t row = 0; row < listing.size(); ++row) {
+                if (listing.type(row) == EntryType::UNKNOWN) {
+                    listing.loadMetadata(enumerator.fd(), row, row + 1);
+                    ++ops;
+                }
+            }
+        }
+        if (options_.limiter) {
+            options_.limiter->acquire(0, ops, [this] { return cancelled_.load(); });
+        }
+
+        const PathId first = store_.setChildren(directory, listing);
+        if (first == PathStore::NONE) {
+            full = true;
+            enumerator.close();
+            return;
+        }
+        directories_.fetch_add(1, std::memory_order_relaxed);
+        entries_.fetch_add(listing.size(), std::memory_order_relaxed);
+        scope.addEntries(listing.size());
+
+        Frame frame;
+        for (size_t row = listing.size(); row > 0; --row) {
+            if (listing.isDirectory(row - 1)) {
+                frame.pending.push_back(first + static_cast<PathId>(row - 1));
+            }
+        }
+        if (!frame.pending.empty()) {
+            frame.fd = stack.size() < MAX_OPEN_DEPTH ? ::dup(enumerator.fd()) : -1;
+            stack.push_back(std::move(frame));
+        }
+        enumerator.close();
+    };
+
+    if (FsStatus opened = enumerator.open(root); !opened) {
+        scope.fail();
+        return FsResult<PathId>::failure(opened.code(), "opendir");
+    }
+    addDirectory(rootId);
+
+    std::string name;
+    while (!stack.empty() && !cancelled_ && !full) {
+        Frame& top = stack.back();
+        if (top.pending.empty()) {
+            if (top.fd >= 0) {
+                ::close(top.fd);
+            }
+            stack.pop_back();
+            continue;
+        }
+        const PathId child = top.pending.back();
+        top.pending.pop_back();
+
+        FsStatus opened;
+        if (top.fd >= 0) {
+            {
+                PathStore::Reader reader(store_);
+                name.assign(reader.name(child));
+            }
+            opened = enumerator.openAt(top.fd, name);
+        } else {
+            opened = enumerator.open(store_.path(child));   // too deep for a descriptor per level
+        }
+        if (!opened) {
+            errors_.fetch_add(1, std::memory_order_relaxed);
+            continue;
+        }
+        addDirectory(child);
+    }
+
+    for (Frame& frame : stack) {
+        if (frame.fd >= 0) {
+            ::close(frame.fd);
+        }
+    }
+    if (full) {
+        scope.fail();
+        return FsResult<PathId>::failure(EOVERFLOW, "path store full");
+    }
+    if (cancelled_) {
+        scope.fail();
+        return FsResult<PathId>::failure(ECANCELED, "scan cancelled");
+    }
+    return rootId;
+}
+
+void TreeScanner::cancel() {
+    cancelled_ = true;
+    if (options_.limiter) {
+        options_.limiter->wake();
+    }
+}
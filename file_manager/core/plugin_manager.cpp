@@ -3,6 +3,8 @@
 #include <stdexcept>
 #include <system_error>
 #include "error_handler.hpp"
+#include "tracer.hpp"
+#include "workload_recorder.hpp"
 
 // Constructor: Can initialize required state (currently empty)
 PluginManager::PluginManager() {
@@ -40,6 +42,7 @@ void PluginManager::unloadPlugins() {
     }
     loadedPlugins_.clear();       // Clear Plugin List
     nameToPlugin_.clear();       // Clear name to pointer map
+    operationToPlugin_.clear();  // Clear operation to plugin map
 }
 
 //Function to return list of all pointers to all currently loaded plugin instances
@@ -69,6 +72,70 @@ size_t PluginManager::pluginCount() const {
     return loadedPlugins_.size();
 }
 
+// Dispatch an operation to the plugin registered for it
+bool PluginManager::executeOperation(const std::string& operation, const std::vector<std::string>& args) {
+    auto it = operationToPlugin_.find(operation);
+    if (it == operationToPlugin_.end()) {
+        FM_WARNING("No plugin provides operation: ", operation);
+        return false;
+    }
+    MetricsScope scope(it->second.metric);
+    TraceScope trace("plugin", "execute");
+    if (trace.active()) {
+        trace.setDetail(operation);
+    }
+    WorkloadScope workload(WorkloadOp::PLUGIN);
+    if (workload.active()) {
+        workload.addArg(operation);
+        for (const auto& arg : args) {
+            workload.addArg(arg);
+        }
+    }
+    const bool ok = it->second.plugin->execute(operation, args);
+    if (!ok) {
+        scope.fail();
+        workload.setResult(1);
+    }
+    return ok;
+}
+
+size_t PluginManager::executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                                   std::pmr::memory_resource* memory, std::vector<bool>& results) {
+    auto it = operationToPlugin_.find(operation);
+    if (it == operationToPlugin_.end()) {
+        FM_WARNING("No plugin provides operation: ", operation);
+        results.assign(calls.size(), false);
+        return 0;
+    }
+    if (WorkloadRecorder::isEnabled()) {
+        results.assign(calls.size(), false);
+        size_t succeeded = 0;
+        std::vector<std::string> args;
+        for (size_t i = 0; i < calls.size(); ++i) {
+            args.resize(calls[i].size());
+            for (size_t j = 0; j < args.size(); ++j) {
+                args[j].assign(calls[i][j].data(), calls[i][j].size());
+            }
+            results[i] = executeOperation(operation, args);
+            succeeded += results[i] ? 1 : 0;
+        }
+        return succeeded;
+    }
+    MetricsScope scope(it->second.metric);
+    TraceScope trace("plugin", "executeBatch");
+    if (trace.active()) {
+        trace.setDetail(operation + " x" + std::to_string(calls.size()));
+    }
+    const size_t succeeded = it->second.batch
+        ? it->second.batch->executeBatch(operation, calls, memory, results)
+        : executeEach(*it->second.plugin, operation, calls, results);
+    scope.addEntries(calls.size());
+    if (succeeded != calls.size()) {
+        scope.fail();
+    }
+    return succeeded;
+}
+
 // PRIVATE METHODS
 
 // Check if the file has shared library extension based on platform
@@ -84,6 +151,11 @@ bool PluginManager::is_shared_library(const std::filesystem::path& path) const{
 //according to operating system, register it into system
 // and handle failure clearly
 bool PluginManager::loadPluginFile(const std::filesystem::path& filePath) {
+    TraceScope trace("plugin", "loadPluginFile");
+    if (trace.active()) {
+        trace.setDetail(filePath.string());
+    }
+
     // Platform-specific way to load a shared library
     #ifdef _WIN32
         PluginHandle handle = LoadLibraryW(filePath.c_str());  // Windows
@@ -141,7 +213,22 @@ bool PluginManager::loadPluginFile(const std::filesystem::path& filePath) {
         });
 
         // Register name-to-pointer for fast access
-        nameToPlugin_[pluginName] = loadedPlugins_.back().instance.get();
+        IFileManagerPlugin* instance = loadedPlugins_.back().instance.get();
+        nameToPlugin_[pluginName] = instance;
+
+        // Optional batch side, plugins built before it existed don't export the symbol
+        using GetBatchPluginFunc = IBatchPlugin*(*)(IFileManagerPlugin*);
+        #ifdef _WIN32
+            auto getBatchFunc = reinterpret_cast<GetBatchPluginFunc>(GetProcAddress(handle, "get_batch_plugin"));
+        #else
+            auto getBatchFunc = reinterpret_cast<GetBatchPluginFunc>(dlsym(handle, "get_batch_plugin"));
+        #endif
+        IBatchPlugin* batch = getBatchFunc ? getBatchFunc(instance) : nullptr;
+
+        // Register its operations, an operation already provided by an earlier plugin is kept
+        for (const auto& operation : instance->operations()) {
+            operationToPlugin_.emplace(operation, OperationEntry{instance, batch, Metrics::registerOperation("plugin." + operation)});
+        }
 
         FM_INFO("Loaded plugin: ", pluginName, " (", filePath.filename().string(), ")");
         return true;
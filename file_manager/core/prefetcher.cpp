@@ -0,0 +1,155 @@
+#include "prefetcher.hpp"
+#include "io_priority.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+#include <algorithm>
+#include <chrono>
+#include <set>
+
+// Entries read per getdents64 batch, cancellation is checked in between
+static constexpr size_t PREFETCH_CHUNK = 4096;
+
+// Rows stat()ed between cancellation checks
+static constexpr size_t METADATA_SLICE = 256;
+
+Prefetcher::Prefetcher(DirectoryCache& cache, OperationScheduler& scheduler)
+    : cache_(cache),
+      scheduler_(scheduler)
+{
+}
+
+Prefetcher::~Prefetcher() {
+    cancelAll();
+    waitIdle();
+}
+
+void Prefetcher::setTargets(const std::vector<std::string>& paths) {
+    const std::set<std::string> wanted(paths.begin(), paths.end());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto it = requests_.begin(); it != requests_.end();) {
+        if (wanted.count(it->first)) {
+            ++it;
+        } else {
+            it->second->cancelled = true;   // the user moved away
+            it = requests_.erase(it);
+        }
+    }
+    for (const auto& path : wanted) {
+        startRequest(path);
+    }
+}
+
+void Prefetcher::prefetch(const std::string& path) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    startRequest(path);
+}
+
+void Prefetcher::cancelAll() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (auto& [path, request] : requests_) {
+        request->cancelled = true;
+    }
+    requests_.clear();
+}
+
+size_t Prefetcher::pending() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_.size();
+}
+
+void Prefetcher::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return running_ == 0; });
+}
+
+// PRIVATE METHODS
+
+void Prefetcher::startRequest(const std::string& path) {
+    if (path.empty() || requests_.count(path)) {
+        return;
+    }
+    auto request = std::make_shared<Request>();
+    requests_.emplace(path, request);
+    ++running_;
+
+    std::future<bool> result = scheduler_.submit(path, [this, path, request] {
+        run(path, request);
+        return true;
+    }, JobPriority::BACKGROUND);
+
+    // A job that never got queued (scheduler shut down) fails right away;
+    // jobs that ran never throw
+    if (result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            result.get();
+        } catch (...) {
+            requests_.erase(path);
+            --running_;
+            idle_.notify_all();
+        }
+    }
+}
+
+void Prefetcher::run(const std::string& path, const std::shared_ptr<Request>& request) {
+    static const MetricId metric = Metrics::registerOperation("prefetch.directory");
+
+    // Whatever happens, the request is done afterwards
+    struct Finish {
+        Prefetcher* self;
+        const std::string& path;
+        const std::shared_ptr<Request>& request;
+        ~Finish() {
+            std::lock_guard<std::mutex> lock(self->mutex_);
+            auto it = self->requests_.find(path);
+            if (it != self->requests_.end() && it->second == request) {
+                self->requests_.erase(it);
+            }
+            --self->running_;
+            self->idle_.notify_all();
+        }
+    } finish{this, path, request};
+
+    if (request->cancelled || cache_.contains(path)) {
+        return;
+    }
+
+    ScopedIoPriority idle(IoPriorityClass::IDLE);
+    TraceScope trace("prefetch", "Prefetcher::run");
+    if (trace.active()) {
+        trace.setDetail(path);
+    }
+    MetricsScope scope(metric);
+
+    DirectoryEnumerator enumerator;
+    if (!enumerator.open(path)) {
+        scope.fail();
+        return;
+    }
+    // Taken before reading, a change during enumeration makes the entry stale
+    const int64_t stamp = DirectoryCache::modificationStamp(enumerator.fd());
+
+    auto listing = std::make_shared<DirectoryListing>();
+    while (!request->cancelled) {
+        const auto added = enumerator.next(*listing, PREFETCH_CHUNK);
+        if (!added) {
+            scope.fail();
+            return;
+        }
+        if (added.value() == 0) {
+            break;
+        }
+    }
+
+    const size_t metadataRows = std::min(listing->size(), METADATA_ROWS);
+    for (size_t begin = 0; begin < metadataRows && !request->cancelled; begin += METADATA_SLICE) {
+        listing->loadMetadata(enumerator.fd(), begin, std::min(begin + METADATA_SLICE, metadataRows));
+    }
+    if (request->cancelled) {
+        return;
+    }
+
+    scope.addEntries(listing->size());
+    cache_.insert(path, std::move(listing), stamp);
+    completed_.fetch_add(1, std::memory_order_relaxed);
+}
@@ -0,0 +1,807 @@
+#include "trash_manager.hpp"
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <dirent.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "error_handler.hpp"
+#include "io_priority.hpp"
+#include "metrics.hpp"
+#include "tracer.hpp"
+
+namespace fs = std::filesystem;
+
+static constexpr char INFO_SUFFIX[] = ".trashinfo";
+
+// Info files younger than this may belong to a trash() between its two steps
+static constexpr int64_t INFO_GRACE_SECONDS = 60;
+
+// Pseudo filesystems never hold a trash directory, not worth a stat()
+static bool isPseudoFilesystem(const std::string& type) {
+    static const char* const types[] = {
+        "proc", "sysfs", "devpts", "cgroup", "cgroup2", "securityfs", "debugfs", "tracefs", "pstore",
+        "bpf", "mqueue", "hugetlbfs", "configfs", "fusectl", "autofs", "binfmt_misc", "nsfs", "efivarfs",
+    };
+    return std::find_if(std::begin(types), std::end(types),
+                        [&](const char* name) { return type == name; }) != std::end(types);
+}
+
+// "/a/b" -> "/a", "/a" -> "/"
+static std::string parentOf(const std::string& path) {
+    const size_t slash = path.rfind('/');
+    return slash == 0 || slash == std::string::npos ? "/" : path.substr(0, slash);
+}
+
+static std::string joinPath(const std::string& directory, const std::string& name) {
+    return directory == "/" ? "/" + name : directory + "/" + name;
+}
+
+static bool isAtOrBelow(const std::string& path, const std::string& root) {
+    return path == root || (path.size() > root.size() && path.compare(0, root.size(), root) == 0 &&
+                            (root == "/" || path[root.size()] == '/'));
+}
+
+// Absolute path of `path` with its parent resolved, the last component is
+// kept as is so trashing a symlink trashes the link
+static std::string absolutePath(std::string path) {
+    while (path.size() > 1 && path.back() == '/') {
+        path.pop_back();
+    }
+    std::error_code ec;
+    const fs::path absolute = fs::absolute(path, ec).lexically_normal();
+    if (ec || !absolute.has_filename()) {
+        return {};
+    }
+    fs::path parent = fs::weakly_canonical(absolute.parent_path(), ec);
+    if (ec) {
+        parent = absolute.parent_path();
+    }
+    return joinPath(parent.string(), absolute.filename().string());
+}
+
+// Directory only the owner can use, an existing one is fine
+static bool makePrivateDirectory(const std::string& path) {
+    return ::mkdir(path.c_str(), 0700) == 0 || errno == EEXIST;
+}
+
+// A directory owned by us and not a symlink, as the spec requires
+static bool isOwnDirectory(const std::string& path) {
+    struct stat st {};
+    return ::lstat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && st.st_uid == ::getuid();
+}
+
+// rename(2) that never replaces the target
+static int renameNoReplace(const std::string& from, const std::string& to) {
+    if (::renameat2(AT_FDCWD, from.c_str(), AT_FDCWD, to.c_str(), RENAME_NOREPLACE) == 0) {
+        return 0;
+    }
+    if (errno != EINVAL && errno != ENOSYS) {
+        return -1;
+    }
+    // Filesystem without RENAME_NOREPLACE: check, then rename
+    struct stat st {};
+    if (::lstat(to.c_str(), &st) == 0) {
+        errno = EEXIST;
+        return -1;
+    }
+    return ::rename(from.c_str(), to.c_str());
+}
+
+// Path= values are URL-escaped, '/' is kept
+static std::string encodePath(const std::string& path) {
+    static const char hex[] = "0123456789ABCDEF";
+    std::string encoded;
+    encoded.reserve(path.size());
+    for (unsigned char c : path) {
+        if (std::isalnum(c) || c == '/' || c == '-' || c == '_' || c == '.' || c == '~') {
+            encoded += static_cast<char>(c);
+        } else {
+            encoded += '%';
+            encoded += hex[c >> 4];
+            encoded += hex[c & 0xF];
+        }
+    }
+    return encoded;
+}
+
+static std::string decodePath(const std::string& text) {
+    std::string decoded;
+    decoded.reserve(text.size());
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '%' && i + 2 < text.size() && std::isxdigit(static_cast<unsigned char>(text[i + 1])) &&
+            std::isxdigit(static_cast<unsigned char>(text[i + 2]))) {
+            decoded += static_cast<char>(std::stoi(text.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            decoded += text[i];
+        }
+    }
+    return decoded;
+}
+
+// DeletionDate= is local time without a zone: 2025-03-14T09:26:53
+static std::string formatDate(int64_t seconds) {
+    const time_t time = static_cast<time_t>(seconds);
+    struct tm local {};
+    ::localtime_r(&time, &local);
+    char buffer[32];
+    std::strftime(buffer, sizeof(buffer), "%Y-%m-%dT%H:%M:%S", &local);
+    return buffer;
+}
+
+static bool parseDate(const std::string& text, int64_t& seconds) {
+    struct tm local {};
+    if (std::sscanf(text.c_str(), "%d-%d-%dT%d:%d:%d", &local.tm_year, &local.tm_mon, &local.tm_mday,
+                    &local.tm_hour, &local.tm_min, &local.tm_sec) != 6) {
+        return false;
+    }
+    local.tm_year -= 1900;
+    local.tm_mon -= 1;
+    local.tm_isdst = -1;
+    const time_t time = std::mktime(&local);
+    if (time == static_cast<time_t>(-1)) {
+        return false;
+    }
+    seconds = static_cast<int64_t>(time);
+    return true;
+}
+
+// Reads the [Trash Info] group, a relative Path= is relative to `topdir`
+static bool parseInfo(const std::string& file, const std::string& topdir, TrashEntry& entry) {
+    std::ifstream in(file);
+    if (!in) {
+        return false;
+    }
+    bool inGroup = false;
+    bool havePath = false;
+    bool haveDate = false;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (!line.empty() && line.front() == '[') {
+            inGroup = line == "[Trash Info]";
+        } else if (inGroup && line.compare(0, 5, "Path=") == 0) {
+            std::string path = decodePath(line.substr(5));
+            if (!path.empty() && path.front() != '/') {
+                if (topdir.empty()) {
+                    return false;
+                }
+                path = joinPath(topdir, path);
+            }
+            entry.originalPath = std::move(path);
+            havePath = true;
+        } else if (inGroup && line.compare(0, 13, "DeletionDate=") == 0) {
+            haveDate = parseDate(line.substr(13), entry.deletionTime);
+        }
+    }
+    return havePath && haveDate;
+}
+
+// Bytes `path` occupies on disk, a directory counts with everything below it
+static uint64_t treeSize(const std::string& path) {
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return 0;
+    }
+    uint64_t bytes = static_cast<uint64_t>(st.st_blocks) * 512;
+    if (S_ISDIR(st.st_mode)) {
+        if (DIR* dir = ::opendir(path.c_str())) {
+            while (const dirent* child = ::readdir(dir)) {
+                if (std::strcmp(child->d_name, ".") != 0 && std::strcmp(child->d_name, "..") != 0) {
+                    bytes += treeSize(path + "/" + child->d_name);
+                }
+            }
+            ::closedir(dir);
+        }
+    }
+    return bytes;
+}
+
+// Removes `path` and everything below it, adds the bytes freed to `bytes`.
+// Directories the user made read-only get write permission back first, they
+// are ours to delete. With a `limiter`, each removal is charged as an op and
+// a throttled removal gives up with ECANCELED once `stopping` is set.
+static FsStatus removeTree(const std::string& path, uint64_t& bytes, RateLimiter* limiter = nullptr,
+                           const std::atomic<bool>* stopping = nullptr) {
+    if (limiter && !limiter->acquire(0, 1, [stopping] { return stopping && stopping->load(); })) {
+        return FsStatus::failure(ECANCELED, "purge stopped");
+    }
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        return errno == ENOENT ? FsStatus() : FsStatus::failure(errno, "lstat");
+    }
+    bytes += static_cast<uint64_t>(st.st_blocks) * 512;
+    if (!S_ISDIR(st.st_mode)) {
+        return ::unlink(path.c_str()) == 0 || errno == ENOENT ? FsStatus() : FsStatus::failure(errno, "unlink");
+    }
+    if ((st.st_mode & S_IRWXU) != S_IRWXU) {
+        ::chmod(path.c_str(), (st.st_mode & 07777) | S_IRWXU);
+    }
+    DIR* dir = ::opendir(path.c_str());
+    if (!dir) {
+        return FsStatus::failure(errno, "opendir");
+    }
+    std::vector<std::string> children;
+    while (const dirent* child = ::readdir(dir)) {
+        if (std::strcmp(child->d_name, ".") != 0 && std::strcmp(child->d_name, "..") != 0) {
+            children.push_back(path + "/" + child->d_name);
+        }
+    }
+    ::closedir(dir);
+    for (const auto& child : children) {
+        if (FsStatus status = removeTree(child, bytes, limiter, stopping); !status) {
+            return status;
+        }
+    }
+    return ::rmdir(path.c_str()) == 0 || errno == ENOENT ? FsStatus() : FsStatus::failure(errno, "rmdir");
+}
+
+TrashManager& TrashManager::instance() {
+    static TrashManager* manager = [] {
+        auto* created = new TrashManager(); // leaked, used until exit
+        created->setLimits(limitsFromEnvironment());
+        created->setRateLimiter(RateLimiter::background());
+        return created;
+    }();
+    return *manager;
+}
+
+std::string TrashManager::defaultHomeTrash() {
+    const char* dataHome = std::getenv("XDG_DATA_HOME");
+    if (dataHome && dataHome[0] == '/') {
+        return std::string(dataHome) + "/Trash";
+    }
+    const char* home = std::getenv("HOME");
+    if (!home || !home[0]) {
+        const passwd* user = ::getpwuid(::getuid());
+        home = user ? user->pw_dir : "/tmp";
+    }
+    return std::string(home) + "/.local/share/Trash";
+}
+
+TrashLimits TrashManager::limitsFromEnvironment() {
+    TrashLimits limits;
+    if (const char* megabytes = std::getenv("FM_TRASH_MAX_MB")) {
+        limits.maxBytes = std::strtoull(megabytes, nullptr, 10) * 1024 * 1024;
+    }
+    if (const char* days = std::getenv("FM_TRASH_MAX_DAYS")) {
+        const double value = std::strtod(days, nullptr);
+        if (value > 0) {
+            limits.maxAge = std::chrono::seconds(static_cast<int64_t>(value * 86400));
+        }
+    }
+    return limits;
+}
+
+TrashManager::TrashManager(std::string homeTrash, bool scanMounts, OperationScheduler& scheduler)
+    : homeTrash_(std::move(homeTrash)),
+      scanMounts_(scanMounts),
+      scheduler_(scheduler)
+{
+}
+
+TrashManager::~TrashManager() {
+    stopping_ = true;
+    if (std::shared_ptr<RateLimiter> limiter = rateLimiter()) {
+        limiter->wake();
+    }
+    waitIdle();
+}
+
+FsResult<TrashEntry> TrashManager::trash(const std::string& path) {
+    static const MetricId metric = Metrics::registerOperation("trash.move");
+    MetricsScope scope(metric);
+    TraceScope trace("trash", "TrashManager::trash");
+    if (trace.active()) {
+        trace.setDetail(path);
+    }
+
+    struct stat st {};
+    if (::lstat(path.c_str(), &st) != 0) {
+        scope.fail();
+        return FsResult<TrashEntry>::failure(errno, "lstat");
+    }
+    const std::string absolute = absolutePath(path);
+    const std::string base = absolute.empty() ? std::string() : absolute.substr(absolute.rfind('/') + 1);
+    if (base.empty() || base == "." || base == "..") {
+        scope.fail();
+        return FsResult<TrashEntry>::failure(EINVAL, "trash path");
+    }
+
+    std::string topdir;
+    FsResult<std::string> directory = trashDirectoryFor(absolute, st.st_dev, topdir);
+    if (!directory) {
+        scope.fail();
+        return FsResult<TrashEntry>::failure(directory.code(), "no trash directory on this filesystem");
+    }
+    if (isAtOrBelow(absolute, directory.value()) || isAtOrBelow(directory.value(), absolute)) {
+        scope.fail();
+        return FsResult<TrashEntry>::failure(EINVAL, "path is part of the trash");
+    }
+
+    TrashEntry entry;
+    entry.trashDirectory = directory.value();
+    entry.originalPath = absolute;
+    entry.deletionTime = static_cast<int64_t>(std::time(nullptr));
+
+    // The home trash records absolute paths, a topdir trash paths below its topdir
+    const std::string recorded = topdir.empty() ? absolute
+                                 : topdir == "/" ? absolute.substr(1)
+                                                 : absolute.substr(topdir.size() + 1);
+    const std::string info = "[Trash Info]\nPath=" + encodePath(recorded) +
+                             "\nDeletionDate=" + formatDate(entry.deletionTime) + "\n";
+
+    // Room for ".<number>.trashinfo" within NAME_MAX
+    const std::string stem = base.substr(0, std::min<size_t>(base.size(), NAME_MAX - sizeof(INFO_SUFFIX) - 8));
+
+    // The info file is claimed first (O_EXCL picks a free name even with
+    // other file managers trashing into the same directory), then the rename
+    for (int number = 1;; ++number) {
+        if (number > 100000) {
+            scope.fail();
+            return FsResult<TrashEntry>::failure(EEXIST, "trash name");
+        }
+        entry.name = number == 1 ? stem : stem + "." + std::to_string(number);
+
+        const std::string infoPath = entry.infoPath();
+        const int fd = ::open(infoPath.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+        if (fd < 0) {
+            if (errno == EEXIST) {
+                continue;
+            }
+            scope.fail();
+            return FsResult<TrashEntry>::failure(errno, "create trashinfo");
+        }
+        const bool written = ::write(fd, info.data(), info.size()) == static_cast<ssize_t>(info.size());
+        const int writeError = errno;
+        ::close(fd);
+        if (!written) {
+            ::unlink(infoPath.c_str());
+            scope.fail();
+            return FsResult<TrashEntry>::failure(writeError ? writeError : EIO, "write trashinfo");
+        }
+
+        if (renameNoReplace(absolute, entry.filesPath()) == 0) {
+            break;
+        }
+        const int error = errno;
+        ::unlink(infoPath.c_str());
+        if (error != EEXIST) {   // EEXIST: an orphan in files/, try the next name
+            scope.fail();
+            return FsResult<TrashEntry>::failure(error, "rename into trash");
+        }
+    }
+
+    trashed_.fetch_add(1, std::memory_order_relaxed);
+    scope.addEntries(1);
+
+    bool limited;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        used_.insert(entry.trashDirectory);
+        limited = limits_.maxBytes || limits_.maxAge.count();
+    }
+    if (limited) {
+        startPurge(entry.trashDirectory, false);
+    }
+    return entry;
+}
+
+FsStatus TrashManager::restore(const TrashEntry& entry) {
+    TraceScope trace("trash", "TrashManager::restore");
+    if (trace.active()) {
+        trace.setDetail(entry.originalPath);
+    }
+
+    const std::string from = entry.filesPath();
+    struct stat st {};
+    if (::lstat(from.c_str(), &st) != 0) {
+        return FsStatus::failure(errno, "lstat");
+    }
+    std::error_code ec;
+    fs::create_directories(parentOf(entry.originalPath), ec);
+    if (ec) {
+        return FsStatus::failure(ec.value(), "create parent directories");
+    }
+    if (renameNoReplace(from, entry.originalPath) != 0) {
+        return FsStatus::failure(errno, "rename out of trash");
+    }
+    ::unlink(entry.infoPath().c_str());
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    sizes_.erase(from + "@" + std::to_string(entry.deletionTime));
+    return {};
+}
+
+FsResult<TrashEntry> TrashManager::lastTrashed(const std::string& originalPath) const {
+    const std::string absolute = absolutePath(originalPath);
+    const std::vector<TrashEntry> entries = list();
+    for (auto it = entries.rbegin(); it != entries.rend(); ++it) {
+        if (it->originalPath == absolute) {
+            return *it;
+        }
+    }
+    return FsResult<TrashEntry>::failure(ENOENT, "not in trash");
+}
+
+std::vector<TrashEntry> TrashManager::list() const {
+    std::vector<TrashEntry> entries;
+    for (const auto& directory : trashDirectories()) {
+        std::vector<TrashEntry> found = entriesOf(directory);
+        entries.insert(entries.end(), std::make_move_iterator(found.begin()), std::make_move_iterator(found.end()));
+    }
+    std::stable_sort(entries.begin(), entries.end(), [](const TrashEntry& a, const TrashEntry& b) {
+        return a.deletionTime < b.deletionTime;
+    });
+    return entries;
+}
+
+FsStatus TrashManager::erase(const TrashEntry& entry) {
+    uint64_t bytes = 0;
+    return eraseEntry(entry, bytes);
+}
+
+void TrashManager::setLimits(const TrashLimits& limits) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limits_ = limits;
+}
+
+TrashLimits TrashManager::limits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limits_;
+}
+
+void TrashManager::setRateLimiter(std::shared_ptr<RateLimiter> limiter) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    limiter_ = std::move(limiter);
+}
+
+std::shared_ptr<RateLimiter> TrashManager::rateLimiter() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return limiter_;
+}
+
+void TrashManager::schedulePurge(bool everything) {
+    startPurge({}, everything);
+}
+
+size_t TrashManager::purge(bool everything) {
+    size_t removed = 0;
+    for (const auto& directory : trashDirectories()) {
+        removed += purgeDirectory(directory, everything);
+    }
+    return removed;
+}
+
+void TrashManager::waitIdle() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    idle_.wait(lock, [this] { return running_ == 0; });
+}
+
+// PRIVATE METHODS
+
+FsStatus TrashManager::eraseEntry(const TrashEntry& entry, uint64_t& bytes, RateLimiter* limiter) {
+    // Info first: a crash in between leaves an orphan tree the next purge
+    // removes, never an entry whose files are half gone
+    if (::unlink(entry.infoPath().c_str()) != 0 && errno != ENOENT) {
+        return FsStatus::failure(errno, "unlink trashinfo");
+    }
+    const std::string files = entry.filesPath();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sizes_.erase(files + "@" + std::to_string(entry.deletionTime));
+    }
+    return removeTree(files, bytes, limiter, &stopping_);
+}
+
+FsResult<std::string> TrashManager::trashDirectoryFor(const std::string& path, dev_t device, std::string& topdir) {
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    auto known = devices_.find(device);
+    if (known != devices_.end() && isOwnDirectory(known->second.first + "/info")) {
+        topdir = known->second.second;
+        return known->second.first;
+    }
+
+    // Same filesystem as the home trash
+    std::error_code ec;
+    fs::create_directories(parentOf(homeTrash_), ec);
+    struct stat st {};
+    if (makePrivateDirectory(homeTrash_) && makePrivateDirectory(homeTrash_ + "/files") &&
+        makePrivateDirectory(homeTrash_ + "/info") && ::stat(homeTrash_.c_str(), &st) == 0 &&
+        st.st_dev == device) {
+        topdir.clear();
+        devices_[device] = {homeTrash_, topdir};
+        return homeTrash_;
+    }
+
+    // The top directory of the mount `path` is on
+    std::string top = parentOf(path);
+    while (top != "/") {
+        const std::string parent = parentOf(top);
+        if (::stat(parent.c_str(), &st) != 0 || st.st_dev != device) {
+            break;
+        }
+        top = parent;
+    }
+
+    const std::string uid = std::to_string(::getuid());
+    std::vector<std::string> candidates;
+    // $topdir/.Trash set up by an admin: a real directory with the sticky bit
+    const std::string shared = joinPath(top, ".Trash");
+    if (::lstat(shared.c_str(), &st) == 0 && S_ISDIR(st.st_mode) && (st.st_mode & S_ISVTX)) {
+        candidates.push_back(shared + "/" + uid);
+    }
+    candidates.push_back(joinPath(top, ".Trash-" + uid));
+
+    for (const auto& candidate : candidates) {
+        if (makePrivateDirectory(candidate) && isOwnDirectory(candidate) &&
+            makePrivateDirectory(candidate + "/files") && makePrivateDirectory(candidate + "/info") &&
+            ::stat(candidate.c_str(), &st) == 0 && st.st_dev == device) {
+            topdir = top;
+            devices_[device] = {candidate, topdir};
+            return candidate;
+        }
+    }
+    return FsResult<std::string>::failure(EXDEV, "no trash directory on this filesystem");
+}
+
+std::vector<std::string> TrashManager::trashDirectories() const {
+    std::vector<std::string> directories{homeTrash_};
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        directories.insert(directories.end(), used_.begin(), used_.end());
+    }
+    if (scanMounts_) {
+        const std::string uid = std::to_string(::getuid());
+        std::ifstream mounts("/proc/self/mounts");
+        std::string device, mountPoint, type, rest;
+        while (mounts >> device >> mountPoint >> type && std::getline(mounts, rest)) {
+            if (isPseudoFilesystem(type)) {
+                continue;
+            }
+            // Spaces and tabs in mount points are octal escapes: \040
+            std::string decoded;
+            for (size_t i = 0; i < mountPoint.size(); ++i) {
+                if (mountPoint[i] == '\\' && i + 3 < mountPoint.size()) {
+                    decoded += static_cast<char>(std::stoi(mountPoint.substr(i + 1, 3), nullptr, 8));
+                    i += 3;
+                } else {
+                    decoded += mountPoint[i];
+                }
+            }
+            for (const auto& candidate : {joinPath(decoded, ".Trash/" + uid), joinPath(decoded, ".Trash-" + uid)}) {
+                if (isOwnDirectory(candidate + "/info")) {
+                    directories.push_back(candidate);
+                }
+            }
+        }
+    }
+
+    std::sort(directories.begin(), directories.end());
+    directories.erase(std::unique(directories.begin(), directories.end()), directories.end());
+    return directories;
+}
+
+std::vector<TrashEntry> TrashManager::entriesOf(const std::string& directory) const {
+    // A topdir trash records paths relative to its topdir:
+    // $topdir/.Trash-$uid or $topdir/.Trash/$uid
+    std::string topdir;
+    if (directory != homeTrash_) {
+        const std::string parent = parentOf(directory);
+        topdir = directory.compare(parent.size() + (parent == "/" ? 0 : 1), 7, ".Trash-") == 0
+                     ? parent
+                     : parentOf(parent);
+    }
+
+    // Sorted by deletion time, then by when the info file was written, so
+    // entries of the same second keep their order
+    std::vector<std::pair<std::pair<int64_t, int64_t>, TrashEntry>> found;
+    const std::string infoDirectory = directory + "/info";
+    DIR* dir = ::opendir(infoDirectory.c_str());
+    if (!dir) {
+        return {};
+    }
+    const size_t suffix = sizeof(INFO_SUFFIX) - 1;
+    while (const dirent* child = ::readdir(dir)) {
+        const std::string file = child->d_name;
+        if (file.size() <= suffix || file.compare(file.size() - suffix, suffix, INFO_SUFFIX) != 0) {
+            continue;
+        }
+        TrashEntry entry;
+        entry.trashDirectory = directory;
+        entry.name = file.substr(0, file.size() - suffix);
+        if (!parseInfo(infoDirectory + "/" + file, topdir, entry)) {
+            continue;
+        }
+        struct stat st {};
+        int64_t written = 0;
+        if (::stat((infoDirectory + "/" + file).c_str(), &st) == 0) {
+            written = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+        }
+        found.push_back({{entry.deletionTime, written}, std::move(entry)});
+    }
+    ::closedir(dir);
+
+    std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    std::vector<TrashEntry> entries;
+    entries.reserve(found.size());
+    for (auto& item : found) {
+        entries.push_back(std::move(item.second));
+    }
+    return entries;
+}
+
+size_t TrashManager::purgeDirectory(const std::string& directory, bool everything) {
+    static const MetricId metric = Metrics::registerOperation("trash.purge");
+    MetricsScope scope(metric);
+    TraceScope trace("trash", "TrashManager::purge");
+    if (trace.active()) {
+        trace.setDetail(directory);
+    }
+
+    const TrashLimits limits = this->limits();
+    const std::shared_ptr<RateLimiter> limiter = rateLimiter();
+    const int64_t now = static_cast<int64_t>(std::time(nullptr));
+    size_t removed = 0;
+
+    // Orphans: trees without an info file (a crash in erase(), another
+    // program's half-finished trash) and info files without a tree
+    std::vector<TrashEntry> entries = entriesOf(directory);
+    std::vector<std::string> infoNames;
+    if (DIR* dir = ::opendir((directory + "/info").c_str())) {
+        while (const dirent* child = ::readdir(dir)) {
+            infoNames.emplace_back(child->d_name);
+        }
+        ::closedir(dir);
+    }
+    std::sort(infoNames.begin(), infoNames.end());
+    if (DIR* dir = ::opendir((directory + "/files").c_str())) {
+        std::vector<std::string> orphans;
+        while (const dirent* child = ::readdir(dir)) {
+            const std::string name = child->d_name;
+            if (name != "." && name != ".." &&
+                !std::binary_search(infoNames.begin(), infoNames.end(), name + INFO_SUFFIX)) {
+                orphans.push_back(directory + "/files/" + name);
+            }
+        }
+        ::closedir(dir);
+        for (const auto& orphan : orphans) {
+            if (stopping_) {
+                return removed;
+            }
+            uint64_t bytes = 0;
+            if (removeTree(orphan, bytes, limiter.get(), &stopping_)) {
+                ++removed;
+            }
+        }
+    }
+    entries.erase(std::remove_if(entries.begin(), entries.end(), [&](const TrashEntry& entry) {
+        struct stat st {};
+        if (::lstat(entry.filesPath().c_str(), &st) == 0) {
+            return false;
+        }
+        if (::stat(entry.infoPath().c_str(), &st) == 0 && now - st.st_mtim.tv_sec > INFO_GRACE_SECONDS) {
+            ::unlink(entry.infoPath().c_str());
+        }
+        return true;
+    }), entries.end());
+
+    uint64_t total = 0;
+    if (limits.maxBytes && !everything) {
+        for (const auto& entry : entries) {
+            if (stopping_) {
+                return removed;
+            }
+            total += entrySize(entry);
+        }
+    }
+
+    // Oldest first: expired entries, then whatever keeps the directory over
+    // its size limit
+    for (const auto& entry : entries) {
+        if (stopping_) {
+            break;
+        }
+        const bool expired = everything ||
+                             (limits.maxAge.count() && now - entry.deletionTime >= limits.maxAge.count());
+        const bool overLimit = limits.maxBytes && total > limits.maxBytes;
+        if (!expired && !overLimit) {
+            break;   // everything after is newer
+        }
+        uint64_t size = 0;
+        if (FsStatus status = eraseEntry(entry, size, limiter.get()); !status) {
+            if (status.code() == ECANCELED) {
+                break;   // stopping, the rest of the tree goes with the orphans next time
+            }
+            FM_WARNING("Failed to purge ", entry.filesPath(), " from the trash: ", status.message());
+            scope.fail();
+            continue;
+        }
+        ++removed;
+        total -= std::min(total, size);
+        purged_.fetch_add(1, std::memory_order_relaxed);
+        purgedBytes_.fetch_add(size, std::memory_order_relaxed);
+        scope.addBytes(size);
+    }
+    scope.addEntries(removed);
+    return removed;
+}
+
+uint64_t TrashManager::entrySize(const TrashEntry& entry) {
+    const std::string key = entry.filesPath() + "@" + std::to_string(entry.deletionTime);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = sizes_.find(key);
+        if (it != sizes_.end()) {
+            return it->second;
+        }
+    }
+    const uint64_t size = treeSize(entry.filesPath());
+    std::lock_guard<std::mutex> lock(mutex_);
+    sizes_[key] = size;
+    return size;
+}
+
+void TrashManager::startPurge(const std::string& directory, bool everything) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    // A purge of the same directory that has not started yet covers this one
+    auto [queued, inserted] = queued_.emplace(directory, everything);
+    if (!inserted) {
+        queued->second = queued->second || everything;
+        return;
+    }
+    ++running_;
+
+    std::future<bool> result = scheduler_.submit(directory.empty() ? homeTrash_ : directory, [this, directory] {
+        // Whatever happens, the purge is done afterwards
+        struct Finish {
+            TrashManager* self;
+            ~Finish() {
+                std::lock_guard<std::mutex> lock(self->mutex_);
+                --self->running_;
+                self->idle_.notify_all();
+            }
+        } finish{this};
+
+        bool all;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = queued_.find(directory);
+            all = it->second;
+            queued_.erase(it);
+        }
+        if (stopping_) {
+            return true;
+        }
+        ScopedIoPriority idle(IoPriorityClass::IDLE);
+        if (directory.empty()) {
+            purge(all);
+        } else {
+            purgeDirectory(directory, all);
+        }
+        return true;
+    }, JobPriority::BACKGROUND);
+
+    // A job that never got queued (scheduler shut down) fails right away
+    if (result.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        try {
+            result.get();
+        } catch (...) {
+            queued_.erase(directory);
+            --running_;
+            idle_.notify_all();
+        }
+    }
+}
@@ -0,0 +1,441 @@
+#include "type_detector.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <iterator>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct TypeInfo {
+    const char* mime;
+    const char* description;
+};
+
+// Indexed by FileType
+constexpr TypeInfo TYPE_INFO[] = {
+    {"application/octet-stream", "File"},
+    {"inode/directory", "Folder"},
+    {"application/x-zerosize", "Empty File"},
+    {"text/plain", "Text Document"},
+    {"application/octet-stream", "Binary File"},
+    {"image/png", "PNG Image"},
+    {"image/jpeg", "JPEG Image"},
+    {"image/gif", "GIF Image"},
+    {"image/webp", "WebP Image"},
+    {"image/bmp", "BMP Image"},
+    {"image/tiff", "TIFF Image"},
+    {"image/vnd.microsoft.icon", "Windows Icon"},
+    {"image/svg+xml", "SVG Image"},
+    {"application/pdf", "PDF Document"},
+    {"application/postscript", "PostScript Document"},
+    {"text/html", "HTML Document"},
+    {"application/xml", "XML Document"},
+    {"application/json", "JSON Document"},
+    {"text/markdown", "Markdown Document"},
+    {"application/rtf", "RTF Document"},
+    {"application/vnd.oasis.opendocument", "OpenDocument File"},
+    {"application/vnd.openxmlformats-officedocument", "Office Document"},
+    {"application/zip", "ZIP Archive"},
+    {"application/gzip", "Gzip Archive"},
+    {"application/x-bzip2", "Bzip2 Archive"},
+    {"application/x-xz", "XZ Archive"},
+    {"application/zstd", "Zstandard Archive"},
+    {"application/x-7z-compressed", "7-Zip Archive"},
+    {"application/vnd.rar", "RAR Archive"},
+    {"application/x-tar", "Tar Archive"},
+    {"audio/mpeg", "MP3 Audio"},
+    {"audio/ogg", "Ogg Media"},
+    {"audio/flac", "FLAC Audio"},
+    {"audio/wav", "WAV Audio"},
+    {"video/mp4", "MP4 Video"},
+    {"video/x-matroska", "Matroska Video"},
+    {"video/x-msvideo", "AVI Video"},
+    {"application/x-executable", "Executable"},
+    {"application/x-shellscript", "Shell Script"},
+    {"text/x-python", "Python Script"},
+    {"text/x-csrc", "C Source"},
+    {"text/x-c++src", "C++ Source"},
+    {"text/x-chdr", "C/C++ Header"},
+    {"application/vnd.sqlite3", "SQLite Database"},
+    {"font/ttf", "TrueType Font"},
+    {"font/otf", "OpenType Font"},
+};
+static_assert(sizeof(TYPE_INFO) / sizeof(TYPE_INFO[0]) == static_cast<size_t>(FileType::COUNT),
+              "TYPE_INFO must have one entry per FileType");
+
+// Lower case, without the dot
+constexpr std::pair<const char*, FileType> EXTENSIONS[] = {
+    {"7z", FileType::SEVEN_ZIP}, {"avi", FileType::AVI}, {"bash", FileType::SHELL_SCRIPT},
+    {"bmp", FileType::BMP}, {"bz2", FileType::BZIP2}, {"c", FileType::C_SOURCE},
+    {"cc", FileType::CPP_SOURCE}, {"cpp", FileType::CPP_SOURCE}, {"cxx", FileType::CPP_SOURCE},
+    {"docx", FileType::OFFICE_XML}, {"eps", FileType::POSTSCRIPT}, {"flac", FileType::FLAC},
+    {"gif", FileType::GIF}, {"gz", FileType::GZIP}, {"h", FileType::C_HEADER},
+    {"hh", FileType::C_HEADER}, {"hpp", FileType::C_HEADER}, {"htm", FileType::HTML},
+    {"html", FileType::HTML}, {"ico", FileType::ICO}, {"jpeg", FileType::JPEG},
+    {"jpg", FileType::JPEG}, {"json", FileType::JSON}, {"log", FileType::TEXT},
+    {"m4a", FileType::MP4}, {"m4v", FileType::MP4}, {"markdown", FileType::MARKDOWN},
+    {"md", FileType::MARKDOWN}, {"mkv", FileType::MATROSKA}, {"mp3", FileType::MP3},
+    {"mp4", FileType::MP4}, {"odp", FileType::OPEN_DOCUMENT}, {"ods", FileType::OPEN_DOCUMENT},
+    {"odt", FileType::OPEN_DOCUMENT}, {"oga", FileType::OGG}, {"ogg", FileType::OGG},
+    {"ogv", FileType::OGG}, {"otf", FileType::FONT_OTF}, {"pdf", FileType::PDF},
+    {"png", FileType::PNG}, {"pptx", FileType::OFFICE_XML}, {"ps", FileType::POSTSCRIPT},
+    {"py", FileType::PYTHON}, {"rar", FileType::RAR}, {"rtf", FileType::RTF},
+    {"sh", FileType::SHELL_SCRIPT}, {"sqlite", FileType::SQLITE}, {"sqlite3", FileType::SQLITE},
+    {"svg", FileType::SVG}, {"tar", FileType::TAR}, {"tif", FileType::TIFF},
+    {"tiff", FileType::TIFF}, {"ttf", FileType::FONT_TTF}, {"txt", FileType::TEXT},
+    {"wav", FileType::WAV}, {"webp", FileType::WEBP}, {"xlsx", FileType::OFFICE_XML},
+    {"xml", FileType::XML}, {"xz", FileType::XZ}, {"zip", FileType::ZIP},
+    {"zst", FileType::ZSTD},
+};
+
+// Longest extension in the table, longer ones are not looked up
+constexpr size_t MAX_EXTENSION = 8;
+
+// Magic number: `bytes` at `offset`
+struct Signature {
+    FileType type;
+    uint16_t offset;
+    const char* bytes;
+    uint8_t length;          // at most 16
+    const char* mask;        // per byte: 'x' exact, '?' anything, else a bit mask; nullptr = all exact
+};
+
+// More specific signatures first, the first match wins
+const Signature SIGNATURES[] = {
+    {FileType::PNG, 0, "\x89PNG\r\n\x1a\n", 8, nullptr},
+    {FileType::JPEG, 0, "\xff\xd8\xff", 3, nullptr},
+    {FileType::GIF, 0, "GIF8", 4, nullptr},
+    {FileType::WEBP, 0, "RIFF\0\0\0\0WEBP", 12, "xxxx????xxxx"},
+    {FileType::WAV, 0, "RIFF\0\0\0\0WAVE", 12, "xxxx????xxxx"},
+    {FileType::AVI, 0, "RIFF\0\0\0\0AVI ", 12, "xxxx????xxxx"},
+    {FileType::TIFF, 0, "II*\0", 4, nullptr},
+    {FileType::TIFF, 0, "MM\0*", 4, nullptr},
+    {FileType::ICO, 0, "\0\0\1\0", 4, nullptr},
+    {FileType::PDF, 0, "%PDF-", 5, nullptr},
+    {FileType::POSTSCRIPT, 0, "%!PS", 4, nullptr},
+    {FileType::RTF, 0, "{\\rtf", 5, nullptr},
+    // Zip based documents are told apart by refineZip()
+    {FileType::ZIP, 0, "PK\3\4", 4, nullptr},
+    {FileType::GZIP, 0, "\x1f\x8b", 2, nullptr},
+    {FileType::BZIP2, 0, "BZh", 3, nullptr},
+    {FileType::XZ, 0, "\xfd" "7zXZ\0", 6, nullptr},
+    {FileType::ZSTD, 0, "\x28\xb5\x2f\xfd", 4, nullptr},
+    {FileType::SEVEN_ZIP, 0, "7z\xbc\xaf\x27\x1c", 6, nullptr},
+    {FileType::RAR, 0, "Rar!\x1a\x07", 6, nullptr},
+    {FileType::TAR, 257, "ustar", 5, nullptr},
+    {FileType::MP3, 0, "ID3", 3, nullptr},
+    {FileType::OGG, 0, "OggS", 4, nullptr},
+    {FileType::FLAC, 0, "fLaC", 4, nullptr},
+    {FileType::MP4, 4, "ftyp", 4, nullptr},
+    {FileType::MATROSKA, 0, "\x1a\x45\xdf\xa3", 4, nullptr},
+    {FileType::ELF, 0, "\x7f" "ELF", 4, nullptr},
+    {FileType::SQLITE, 0, "SQLite format 3\0", 16, nullptr},
+    {FileType::FONT_TTF, 0, "\0\1\0\0\0", 5, nullptr},
+    {FileType::FONT_OTF, 0, "OTTO", 4, nullptr},
+    // MPEG audio frame sync without an ID3 tag: 11 set bits
+    {FileType::MP3, 0, "\xff\xe0", 2, "x\xe0"},
+};
+
+// A signature as two 64-bit words: (data & mask) == value
+struct CompiledSignature {
+    FileType type;
+    uint16_t end;            // offset + length, the data must reach this far
+    uint16_t offset;
+    uint64_t value[2];
+    uint64_t mask[2];
+};
+
+std::vector<CompiledSignature> compileSignatures() {
+    std::vector<CompiledSignature> compiled;
+    for (const Signature& signature : SIGNATURES) {
+        unsigned char value[16] = {};
+        unsigned char mask[16] = {};
+        for (size_t i = 0; i < signature.length; ++i) {
+            unsigned char byteMask = 0xff;
+            if (signature.mask) {
+                const char m = signature.mask[i];
+                byteMask = m == '?' ? 0x00 : m == 'x' ? 0xff : static_cast<unsigned char>(m);
+            }
+            mask[i] = byteMask;
+            value[i] = static_cast<unsigned char>(signature.bytes[i]) & byteMask;
+        }
+        CompiledSignature entry {};
+        entry.type = signature.type;
+        entry.offset = signature.offset;
+        entry.end = static_cast<uint16_t>(signature.offset + signature.length);
+        std::memcpy(entry.value, value, sizeof(value));
+        std::memcpy(entry.mask, mask, sizeof(mask));
+        compiled.push_back(entry);
+    }
+    return compiled;
+}
+
+const std::vector<CompiledSignature>& signatures() {
+    static const std::vector<CompiledSignature> compiled = compileSignatures();
+    return compiled;
+}
+
+bool startsWith(std::string_view text, std::string_view prefix) {
+    return text.size() >= prefix.size() && text.compare(0, prefix.size(), prefix) == 0;
+}
+
+bool startsWithFolded(std::string_view text, std::string_view lowerPrefix) {
+    if (text.size() < lowerPrefix.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < lowerPrefix.size(); ++i) {
+        char c = text[i];
+        if (c >= 'A' && c <= 'Z') {
+            c = static_cast<char>(c - 'A' + 'a');
+        }
+        if (c != lowerPrefix[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Zip archives that are really documents
+FileType refineZip(std::string_view data) {
+    // The first entry's name follows the 30 byte local file header
+    if (data.size() > 30) {
+        const std::string_view entry = data.substr(30);
+        if (startsWith(entry, "mimetypeapplication/vnd.oasis.opendocument")) {
+            return FileType::OPEN_DOCUMENT;
+        }
+        if (startsWith(entry, "[Content_Types].xml") || startsWith(entry, "docProps/") ||
+            startsWith(entry, "word/") || startsWith(entry, "xl/") || startsWith(entry, "ppt/")) {
+            return FileType::OFFICE_XML;
+        }
+    }
+    return FileType::ZIP;
+}
+
+// Text by its first token, TEXT if nothing stands out
+FileType classifyText(std::string_view text) {
+    if (startsWith(text, "#!")) {
+        const std::string_view line = text.substr(0, text.find('\n'));
+        return line.find("python") != std::string_view::npos ? FileType::PYTHON : FileType::SHELL_SCRIPT;
+    }
+    size_t start = 0;
+    while (start < text.size() && (text[start] == ' ' || text[start] == '\t' || text[start] == '\r' ||
+                                   text[start] == '\n')) {
+        ++start;
+    }
+    text.remove_prefix(start);
+    if (startsWith(text, "\xef\xbb\xbf")) {   // UTF-8 byte order mark
+        text.remove_prefix(3);
+    }
+    if (startsWithFolded(text, "<!doctype html") || startsWithFolded(text, "<html")) {
+        return FileType::HTML;
+    }
+    if (startsWith(text, "<svg") ||
+        (startsWith(text, "<?xml") && text.find("<svg") != std::string_view::npos)) {
+        return FileType::SVG;
+    }
+    if (startsWith(text, "<?xml")) {
+        return FileType::XML;
+    }
+    if (startsWith(text, "{\"") || startsWith(text, "[{") || startsWith(text, "{\n") || startsWith(text, "[\n")) {
+        return FileType::JSON;
+    }
+    return FileType::TEXT;
+}
+
+// No NUL bytes and hardly any control characters; bytes >= 0x80 count as text (UTF-8)
+bool looksLikeText(const unsigned char* data, size_t size) {
+    size_t control = 0;
+    for (size_t i = 0; i < size; ++i) {
+        const unsigned char c = data[i];
+        if (c == 0) {
+            return false;
+        }
+        if (c < 0x20 && c != '\t' && c != '\n' && c != '\r' && c != '\f' && c != '\b' && c != 0x1b) {
+            ++control;
+        }
+    }
+    return control * 32 <= size;
+}
+
+int64_t stampOf(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+} // namespace
+
+TypeDetector& TypeDetector::instance() {
+    static TypeDetector* detector = new TypeDetector();   // leaked, used until exit
+    return *detector;
+}
+
+TypeDetector::TypeDetector(size_t capacity)
+    : capacity_(capacity)
+{
+}
+
+FileType TypeDetector::fromExtension(std::string_view name) {
+    static const std::unordered_map<std::string_view, FileType> table(std::begin(EXTENSIONS), std::end(EXTENSIONS));
+
+    const size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos || dot == 0 || name.size() - dot - 1 > MAX_EXTENSION) {
+        return FileType::UNKNOWN;   // no extension, or a dot file like ".bashrc"
+    }
+    char lower[MAX_EXTENSION];
+    const size_t length = name.size() - dot - 1;
+    for (size_t i = 0; i < length; ++i) {
+        const char c = name[dot + 1 + i];
+        lower[i] = c >= 'A' && c <= 'Z' ? static_cast<char>(c - 'A' + 'a') : c;
+    }
+    auto it = table.find(std::string_view(lower, length));
+    return it == table.end() ? FileType::UNKNOWN : it->second;
+}
+
+FileType TypeDetector::fromContent(const unsigned char* data, size_t size) {
+    if (size == 0) {
+        return FileType::EMPTY;
+    }
+    size = std::min(size, SNIFF_BYTES);
+
+    // Zero padded so every signature can load two full words
+    unsigned char buffer[SNIFF_BYTES + 16] = {};
+    std::memcpy(buffer, data, size);
+
+    for (const CompiledSignature& signature : signatures()) {
+        if (signature.end > size) {
+            continue;
+        }
+        uint64_t words[2];
+        std::memcpy(words, buffer + signature.offset, sizeof(words));
+        if (((words[0] & signature.mask[0]) ^ signature.value[0]) |
+            ((words[1] & signature.mask[1]) ^ signature.value[1])) {
+            continue;
+        }
+        if (signature.type == FileType::ZIP) {
+            return refineZip(std::string_view(reinterpret_cast<const char*>(buffer), size));
+        }
+        return signature.type;
+    }
+
+    if (looksLikeText(buffer, size)) {
+        return classifyText(std::string_view(reinterpret_cast<const char*>(buffer), size));
+    }
+    return FileType::BINARY;
+}
+
+FileType TypeDetector::detect(int directoryFd, const std::string& name) {
+    const FileType byName = fromExtension(name);
+    if (byName != FileType::UNKNOWN) {
+        return byName;
+    }
+
+    struct stat st {};
+    if (::fstatat(directoryFd, name.c_str(), &st, 0) != 0) {
+        return FileType::UNKNOWN;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return FileType::DIRECTORY;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        return FileType::UNKNOWN;   // never open devices or fifos
+    }
+    if (st.st_size == 0) {
+        return FileType::EMPTY;
+    }
+
+    FileType type = FileType::UNKNOWN;
+    if (lookup({st.st_dev, st.st_ino}, stampOf(st), static_cast<uint64_t>(st.st_size), type)) {
+        cacheHits_.fetch_add(1, std::memory_order_relaxed);
+        return type;
+    }
+
+    static const MetricId metric = Metrics::registerOperation("type.sniff");
+    MetricsScope scope(metric);
+
+    const int fd = ::openat(directoryFd, name.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        scope.fail();
+        return FileType::UNKNOWN;
+    }
+    // The file may have been replaced since the fstatat(), key by what was read
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        ::close(fd);
+        scope.fail();
+        return FileType::UNKNOWN;
+    }
+    unsigned char prefix[SNIFF_BYTES];
+    ssize_t bytes;
+    do {
+        bytes = ::pread(fd, prefix, sizeof(prefix), 0);
+    } while (bytes < 0 && errno == EINTR);
+    ::close(fd);
+    if (bytes < 0) {
+        scope.fail();
+        return FileType::UNKNOWN;
+    }
+    contentReads_.fetch_add(1, std::memory_order_relaxed);
+    scope.addBytes(static_cast<uint64_t>(bytes));
+
+    type = fromContent(prefix, static_cast<size_t>(bytes));
+    store({st.st_dev, st.st_ino}, {stampOf(st), static_cast<uint64_t>(st.st_size), type});
+    return type;
+}
+
+FileType TypeDetector::detect(const std::string& path) {
+    return detect(AT_FDCWD, path);
+}
+
+std::string_view TypeDetector::mimeType(FileType type) {
+    const size_t index = static_cast<size_t>(type);
+    return index < static_cast<size_t>(FileType::COUNT) ? TYPE_INFO[index].mime : TYPE_INFO[0].mime;
+}
+
+std::string_view TypeDetector::description(FileType type) {
+    const size_t index = static_cast<size_t>(type);
+    return index < static_cast<size_t>(FileType::COUNT) ? TYPE_INFO[index].description : TYPE_INFO[0].description;
+}
+
+void TypeDetector::clearCache() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    current_.clear();
+    previous_.clear();
+}
+
+size_t TypeDetector::cacheSize() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return current_.size() + previous_.size();
+}
+
+// PRIVATE METHODS
+
+bool TypeDetector::lookup(const Key& key, int64_t mtime, uint64_t size, FileType& type) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto it = current_.find(key);
+    if (it == current_.end()) {
+        auto old = previous_.find(key);
+        if (old == previous_.end()) {
+            return false;
+        }
+        // Still in use, keep it through the next generation change
+        it = current_.insert_or_assign(key, old->second).first;
+        previous_.erase(old);
+    }
+    if (it->second.mtime != mtime || it->second.size != size) {
+        return false;   // changed since it was sniffed, store() replaces it
+    }
+    type = it->second.type;
+    return true;
+}
+
+void TypeDetector::store(const Key& key, const Entry& entry) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (current_.size() >= capacity_ / 2 && !current_.count(key)) {
+        previous_ = std::move(current_);
+        current_ = Map();
+    }
+    current_.insert_or_assign(key, entry);
+}
@@ -0,0 +1,799 @@
+#include "gui/directory_model.hpp"
+
+#include <QCoreApplication>
+#include <QDateTime>
+#include <QFileInfo>
+#include <QLocale>
+#include <QPointer>
+#include <QThreadPool>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <unordered_set>
+
+#include "core/directory_cache.hpp"
+#include "core/listing_sort.hpp"
+#include "core/type_detector.hpp"
+#include "utilities/tracer.hpp"
+
+// The first chunk is small so the view has rows to paint almost at once,
+// later chunks are larger to keep the number of model signals down
+static constexpr size_t FIRST_CHUNK_ENTRIES = 1024;
+static constexpr size_t CHUNK_ENTRIES = 16384;
+
+// Rows stat()ed by one background job
+static constexpr size_t METADATA_BATCH = 512;
+
+// Rows waiting for metadata beyond this are dropped (the view scrolled past them)
+static constexpr size_t MAX_PENDING_ROWS = 4 * METADATA_BATCH;
+
+// Entries added or removed reload the directory once changes pause this long
+static constexpr int RELOAD_DELAY_MS = 500;
+
+static SortColumn sortColumnOf(int column) {
+    switch (column) {
+        case DirectoryModel::SizeColumn: return SortColumn::SIZE;
+        case DirectoryModel::TypeColumn: return SortColumn::TYPE;
+        case DirectoryModel::DateColumn: return SortColumn::DATE;
+        default: return SortColumn::NAME;
+    }
+}
+
+// Runs `func` on the GUI thread if the model still exists
+// Posted to the application object, so a model deleted in the meantime is
+// never touched (the QPointer is only read on the GUI thread)
+template<typename Func>
+static void postToModel(const QPointer<DirectoryModel>& model, Func func) {
+    QMetaObject::invokeMethod(QCoreApplication::instance(), [model, func]() mutable {
+        if (model) {
+            func(model.data());
+        }
+    }, Qt::QueuedConnection);
+}
+
+DirectoryModel::DirectoryModel(QObject* parent)
+    : QAbstractTableModel(parent)
+{
+    m_folderIcon = m_iconProvider.icon(QFileIconProvider::Folder);
+    m_fileIcon = m_iconProvider.icon(QFileIconProvider::File);
+
+    // data() only notes which rows lack metadata, they are fetched together
+    // once the view has finished painting
+    m_metadataTimer.setSingleShot(true);
+    m_metadataTimer.setInterval(0);
+    connect(&m_metadataTimer, &QTimer::timeout, this, &DirectoryModel::flushMetadataRequests);
+
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(RELOAD_DELAY_MS);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &DirectoryModel::reload);
+}
+
+DirectoryModel::~DirectoryModel() {
+    watchDirectory(QString());
+    if (m_context) {
+        m_context->cancelled = true;
+    }
+    if (m_arrangeContext) {
+        m_arrangeContext->cancelled = true;
+    }
+}
+
+void DirectoryModel::setDirectory(const QString& path) {
+    TraceScope trace("gui", "DirectoryModel::setDirectory");
+
+    if (m_context) {
+        m_context->cancelled = true;   // stop the previous load
+    }
+    if (m_arrangeContext) {
+        m_arrangeContext->cancelled = true;
+        m_arrangeContext.reset();
+    }
+    if (m_thumbnails) {
+        m_thumbnails->setWanted({});   // nothing of the old directory is on screen any more
+    }
+
+    beginResetModel();
+    m_directory = path;
+    m_listing.clear();
+    m_order.clear();
+    m_rows.clear();
+    m_viewRowOf.clear();
+    m_filter.clear();
+    m_appliedFilter.clear();
+    m_resortPending = false;
+    m_metadataRequested.clear();
+    m_sniffedTypes.clear();
+    m_thumbnailRows.clear();
+    m_pendingRows.clear();
+    m_reloadTimer.stop();
+    ++m_generation;
+    ++m_arrangeSerial;
+    endResetModel();
+    watchDirectory(path);
+
+    m_loadTimer.start();
+    const std::string directory = path.toStdString();
+
+    // Prefetched or visited before: no readdir at all
+    if (auto cached = DirectoryCache::instance().find(directory)) {
+        showCachedListing(*cached);
+        return;
+    }
+
+    m_loading = true;
+    auto context = std::make_shared<LoadContext>();
+    m_context = context;
+    const quint64 generation = m_generation;
+    const QPointer<DirectoryModel> self(this);
+
+    QThreadPool::globalInstance()->start([self, context, generation, directory]() {
+        DirectoryEnumerator enumerator;
+        const FsStatus opened = enumerator.open(directory);
+        if (!opened) {
+            const QString message = QString::fromStdString(opened.message());
+            postToModel(self, [generation, message](DirectoryModel* model) {
+                model->finishLoading(generation, false, message);
+            });
+            return;
+        }
+        context->stamp = DirectoryCache::modificationStamp(enumerator.fd());
+
+        size_t chunkSize = FIRST_CHUNK_ENTRIES;
+        while (!context->cancelled) {
+            auto chunk = std::make_shared<DirectoryListing>();
+            const auto added = enumerator.next(*chunk, chunkSize);
+            if (!added) {
+                const QString message = QString::fromStdString(added.message());
+                postToModel(self, [generation, message](DirectoryModel* model) {
+                    model->finishLoading(generation, false, message);
+                });
+                return;
+            }
+            if (added.value() == 0) {
+                break;
+            }
+            postToModel(self, [generation, chunk](DirectoryModel* model) {
+                model->appendChunk(generation, chunk);
+            });
+            chunkSize = CHUNK_ENTRIES;
+        }
+        postToModel(self, [generation](DirectoryModel* model) {
+            model->finishLoading(generation, true, QString());
+        });
+    });
+}
+
+QString DirectoryModel::filePath(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QString();
+    }
+    const std::string_view name = m_listing.name(static_cast<size_t>(listingRow(index.row())));
+    return m_directory + QLatin1Char('/') + QString::fromUtf8(name.data(), static_cast<int>(name.size()));
+}
+
+bool DirectoryModel::isDir(const QModelIndex& index) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return false;
+    }
+    const size_t row = static_cast<size_t>(listingRow(index.row()));
+    if (m_listing.type(row) == EntryType::SYMLINK || m_listing.type(row) == EntryType::UNKNOWN) {
+        return QFileInfo(filePath(index)).isDir();   // follow the link, like QFileSystemModel
+    }
+    return m_listing.isDirectory(row);
+}
+
+int DirectoryModel::rowCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : static_cast<int>(m_rows.size());
+}
+
+int DirectoryModel::columnCount(const QModelIndex& parent) const {
+    return parent.isValid() ? 0 : ColumnCount;
+}
+
+QVariant DirectoryModel::data(const QModelIndex& index, int role) const {
+    if (!index.isValid() || index.row() >= rowCount()) {
+        return QVariant();
+    }
+    const size_t row = static_cast<size_t>(listingRow(index.row()));
+    const EntryType type = m_listing.type(row);
+
+    if (role == Qt::DecorationRole && index.column() == NameColumn) {
+        if (type == EntryType::DIRECTORY) {
+            return m_folderIcon;
+        }
+        const FileType fileType = fileTypeOf(row);
+        if (m_thumbnails && ThumbnailService::canThumbnail(fileType)) {
+            const qint64 mtime = m_listing.metadataValid(row) ? m_listing.modifiedTime(row) : -1;
+            const QIcon thumbnail = m_thumbnails->cached(filePath(index), mtime);
+            if (!thumbnail.isNull()) {
+                return thumbnail;
+            }
+        }
+        return iconFor(fileType);
+    }
+    if (role == Qt::TextAlignmentRole && index.column() == SizeColumn) {
+        return QVariant::fromValue(Qt::AlignRight | Qt::AlignVCenter);
+    }
+    if (role != Qt::DisplayRole) {
+        return QVariant();
+    }
+
+    const std::string_view name = m_listing.name(row);
+    if (index.column() == NameColumn) {
+        return QString::fromUtf8(name.data(), static_cast<int>(name.size()));
+    }
+
+    // Everything else may need a stat(), the type column a sniff even when
+    // a sort already loaded the metadata
+    requestMetadata(static_cast<int>(row));
+    if (!m_listing.hasMetadata(row) && (index.column() != TypeColumn || type == EntryType::UNKNOWN)) {
+        return QVariant();
+    }
+
+    switch (index.column()) {
+        case SizeColumn:
+            if (type == EntryType::DIRECTORY || !m_listing.metadataValid(row)) {
+                return QVariant();
+            }
+            return QLocale().formattedDataSize(static_cast<qint64>(m_listing.fileSize(row)));
+        case TypeColumn: {
+            if (type == EntryType::DIRECTORY) return tr("Folder");
+            if (type == EntryType::SYMLINK) return tr("Symlink");
+            if (type == EntryType::OTHER) return tr("Special File");
+            const FileType fileType = fileTypeOf(row);
+            if (fileType != FileType::UNKNOWN && fileType != FileType::BINARY) {
+                const std::string_view description = TypeDetector::description(fileType);
+                return QString::fromUtf8(description.data(), static_cast<int>(description.size()));
+            }
+            const size_t dot = name.rfind('.');
+            if (dot == std::string_view::npos || dot == 0) {
+                return tr("File");
+            }
+            const std::string_view suffix = name.substr(dot + 1);
+            return tr("%1 File").arg(QString::fromUtf8(suffix.data(), static_cast<int>(suffix.size())).toUpper());
+        }
+        case DateColumn:
+            if (!m_listing.metadataValid(row)) {
+                return QVariant();
+            }
+            return QDateTime::fromSecsSinceEpoch(m_listing.modifiedTime(row)).toString(QStringLiteral("yyyy-MM-dd hh:mm"));
+        default:
+            return QVariant();
+    }
+}
+
+QVariant DirectoryModel::headerData(int section, Qt::Orientation orientation, int role) const {
+    if (orientation != Qt::Horizontal || role != Qt::DisplayRole) {
+        return QAbstractTableModel::headerData(section, orientation, role);
+    }
+    switch (section) {
+        case NameColumn: return tr("Name");
+        case SizeColumn: return tr("Size");
+        case TypeColumn: return tr("Type");
+        case DateColumn: return tr("Date Modified");
+        default: return QVariant();
+    }
+}
+
+void DirectoryModel::sort(int column, Qt::SortOrder order) {
+    m_sortColumn = column;
+    m_sortOrder = order;
+    startArrange(true);
+}
+
+void DirectoryModel::setNameFilter(const QString& text) {
+    if (text == m_filter) {
+        return;
+    }
+    m_filter = text;
+    startArrange(false);
+}
+
+void DirectoryModel::fetchMetadata(int first, int last) {
+    for (int viewRow = std::max(first, 0); viewRow <= last && viewRow < rowCount(); ++viewRow) {
+        requestMetadata(listingRow(viewRow));
+    }
+}
+
+void DirectoryModel::setThumbnailService(ThumbnailService* service) {
+    if (m_thumbnails) {
+        disconnect(m_thumbnails, nullptr, this, nullptr);
+    }
+    m_thumbnails = service;
+    m_thumbnailRows.clear();
+    if (m_thumbnails) {
+        connect(m_thumbnails, &ThumbnailService::thumbnailReady, this, &DirectoryModel::thumbnailReady);
+    }
+}
+
+void DirectoryModel::requestThumbnails(int first, int last) {
+    if (!m_thumbnails) {
+        return;
+    }
+    QStringList paths;
+    QList<qint64> mtimes;
+    QHash<QString, uint32_t> rows;
+    for (int viewRow = std::max(first, 0); viewRow <= last && viewRow < rowCount(); ++viewRow) {
+        const uint32_t row = m_rows[static_cast<size_t>(viewRow)];
+        if (m_listing.isDirectory(row)) {
+            continue;
+        }
+        if (ThumbnailService::canThumbnail(TypeDetector::fromExtension(m_listing.name(row)))) {
+            const std::string_view view = m_listing.name(row);
+            const QString name = QString::fromUtf8(view.data(), static_cast<int>(view.size()));
+            rows.insert(name, row);
+            paths << m_directory + QLatin1Char('/') + name;
+            mtimes << (m_listing.metadataValid(row) ? m_listing.modifiedTime(row) : -1);
+        }
+    }
+    m_thumbnailRows = std::move(rows);
+    m_thumbnails->setWanted(paths, mtimes);   // cancels whatever scrolled out of range
+}
+
+// PRIVATE METHODS
+
+void DirectoryModel::watchDirectory(const QString& path) {
+    ChangeFeed& feed = ChangeFeed::instance();
+    if (m_subscription) {
+        feed.unsubscribe(m_subscription);
+        m_subscription = 0;
+    }
+    // Event paths have their symlinks resolved
+    const std::string directory = path.isEmpty() ? std::string() : QFileInfo(path).canonicalFilePath().toStdString();
+    if (directory != m_watchedDirectory) {   // a reload keeps its watch
+        if (!m_watchedDirectory.empty()) {
+            feed.unwatch(m_watchedDirectory);
+            m_watchedDirectory.clear();
+        }
+        if (directory.empty() || !feed.watch(directory, false)) {
+            return;   // no live updates, the view still works
+        }
+        m_watchedDirectory = directory;
+    }
+    if (directory.empty()) {
+        return;
+    }
+
+    // Runs on the feed thread: sorts the batch into "reload" or "these rows"
+    const QPointer<DirectoryModel> self(this);
+    const quint64 generation = m_generation;
+    const std::string prefix = directory == "/" ? directory : directory + '/';
+    m_subscription = feed.subscribe(directory, [self, generation, prefix](const std::vector<ChangeEvent>& events) {
+        const auto childName = [&prefix](const std::string& path) -> std::string {
+            if (path.size() <= prefix.size() || path.compare(0, prefix.size(), prefix) != 0 ||
+                path.find('/', prefix.size()) != std::string::npos) {
+                return {};
+            }
+            return path.substr(prefix.size());
+        };
+        bool structural = false;
+        std::vector<std::string> modified;
+        for (const auto& event : events) {
+            std::string name = childName(event.path);
+            const bool entry = !name.empty() || !childName(event.oldPath).empty();
+            if (!entry) {
+                // The directory itself or one above it was removed, renamed or
+                // rescanned; deeper changes do not show in this view
+                const bool below = event.path.compare(0, prefix.size(), prefix) == 0;
+                structural = structural || (!below && (event.kind == ChangeKind::DELETED ||
+                                                       event.kind == ChangeKind::RENAMED ||
+                                                       event.kind == ChangeKind::RESCAN));
+            } else if (event.kind == ChangeKind::MODIFIED || event.kind == ChangeKind::ATTRIBUTES) {
+                modified.push_back(std::move(name));
+            } else {
+                structural = true;
+            }
+        }
+        if (structural || !modified.empty()) {
+            postToModel(self, [generation, structural, modified](DirectoryModel* model) {
+                model->directoryChanged(generation, structural, modified);
+            });
+        }
+    });
+}
+
+void DirectoryModel::directoryChanged(quint64 generation, bool structural, const std::vector<std::string>& modifiedNames) {
+    if (generation != m_generation) {
+        return;
+    }
+    if (structural) {
+        if (!m_reloadTimer.isActive()) {
+            m_reloadTimer.start();
+        }
+        return;
+    }
+    // Size, date and type come from the next stat(), the row stays in place
+    std::unordered_set<std::string_view> names(modifiedNames.begin(), modifiedNames.end());
+    for (size_t row = 0; row < m_listing.size() && !names.empty(); ++row) {
+        if (names.erase(m_listing.name(row))) {
+            m_metadataRequested[row] = 0;
+            requestMetadata(static_cast<int>(row));
+        }
+    }
+}
+
+void DirectoryModel::reload() {
+    TraceScope trace("gui", "DirectoryModel::reload");
+    // Same directory, same sort column and filter; the cached listing is stale
+    // even if the directory mtime says otherwise (only file contents changed)
+    const QString filter = m_filter;
+    DirectoryCache::instance().remove(m_directory.toStdString());
+    setDirectory(m_directory);
+    if (!filter.isEmpty()) {
+        setNameFilter(filter);
+    }
+}
+
+void DirectoryModel::appendChunk(quint64 generation, const std::shared_ptr<DirectoryListing>& chunk) {
+    if (generation != m_generation || chunk->empty()) {
+        return;   // belongs to a directory we already left
+    }
+    TraceScope trace("gui", "DirectoryModel::appendChunk");
+
+    // New rows go to the end until the listing is sorted again (see finishLoading)
+    const uint32_t base = static_cast<uint32_t>(m_listing.size());
+    std::vector<uint32_t> visible;
+    for (uint32_t i = 0; i < chunk->size(); ++i) {
+        m_order.push_back(base + i);
+        if (nameMatches(chunk->name(i), m_appliedFilter)) {
+            visible.push_back(base + i);
+        }
+    }
+    m_listing.append(*chunk);
+    m_metadataRequested.resize(m_listing.size(), 0);
+    m_sniffedTypes.resize(m_listing.size(), FileType::UNKNOWN);
+    m_viewRowOf.resize(m_listing.size(), -1);
+    if (visible.empty()) {
+        return;
+    }
+
+    const int first = rowCount();
+    beginInsertRows(QModelIndex(), first, first + static_cast<int>(visible.size()) - 1);
+    for (uint32_t row : visible) {
+        m_viewRowOf[row] = static_cast<int32_t>(m_rows.size());
+        m_rows.push_back(row);
+    }
+    endInsertRows();
+}
+
+void DirectoryModel::finishLoading(quint64 generation, bool ok, const QString& message) {
+    if (generation != m_generation) {
+        return;
+    }
+    m_loading = false;
+    if (m_sortColumn >= 0 && !m_listing.empty()) {
+        startArrange(true);   // rows that arrived while loading are unsorted
+    }
+    if (ok) {
+        // Going back here later is instant while the directory is unchanged
+        DirectoryCache::instance().insert(m_directory.toStdString(),
+                                          std::make_shared<DirectoryListing>(m_listing), m_context->stamp);
+        emit loadingFinished(static_cast<qint64>(m_listing.size()), m_loadTimer.elapsed());
+    } else {
+        emit loadingFailed(message);
+    }
+}
+
+void DirectoryModel::showCachedListing(const DirectoryListing& cached) {
+    TraceScope trace("gui", "DirectoryModel::showCachedListing");
+    m_context = std::make_shared<LoadContext>();   // for the metadata jobs
+    m_loading = false;
+    m_listing = cached;   // names and types only, data() stat()s the visible rows again
+    m_order.resize(m_listing.size());
+    for (uint32_t row = 0; row < m_order.size(); ++row) {
+        m_order[row] = row;
+    }
+    m_metadataRequested.assign(m_listing.size(), 0);
+    m_sniffedTypes.assign(m_listing.size(), FileType::UNKNOWN);
+    m_viewRowOf.assign(m_listing.size(), -1);
+
+    if (m_sortColumn >= 0 && !m_listing.empty()) {
+        // Rows appear once sorted (a few ms), instead of jumping around on screen
+        startArrange(true);
+    } else if (!m_listing.empty()) {
+        beginInsertRows(QModelIndex(), 0, static_cast<int>(m_order.size()) - 1);
+        m_rows = m_order;
+        rebuildViewRows();
+        endInsertRows();
+    }
+    emit loadingFinished(static_cast<qint64>(m_listing.size()), m_loadTimer.elapsed());
+}
+
+void DirectoryModel::thumbnailReady(const QString& path) {
+    const int slash = path.lastIndexOf('/');
+    if (path.left(slash) != m_directory) {
+        return;   // from a directory left since
+    }
+    auto it = m_thumbnailRows.constFind(path.mid(slash + 1));
+    if (it == m_thumbnailRows.constEnd()) {
+        return;
+    }
+    const int viewRow = m_viewRowOf[it.value()];
+    if (viewRow >= 0) {
+        emit dataChanged(index(viewRow, NameColumn), index(viewRow, NameColumn), {Qt::DecorationRole});
+    }
+}
+
+FileType DirectoryModel::fileTypeOf(size_t row) const {
+    const FileType byName = TypeDetector::fromExtension(m_listing.name(row));
+    return byName != FileType::UNKNOWN ? byName : m_sniffedTypes[row];
+}
+
+QIcon DirectoryModel::iconFor(FileType type) const {
+    const size_t index = static_cast<size_t>(type);
+    if (m_typeIcons.empty()) {
+        m_typeIcons.resize(static_cast<size_t>(FileType::COUNT));
+    }
+    if (m_typeIcons[index].isNull()) {
+        // Theme icon named after the MIME type ("image/png" -> "image-png"),
+        // then the generic one for its media type, then the plain file icon
+        const std::string_view mimeType = TypeDetector::mimeType(type);
+        QString mime = QString::fromLatin1(mimeType.data(), static_cast<int>(mimeType.size()));
+        const QString generic = type == FileType::ELF || type == FileType::SHELL_SCRIPT
+                                    ? QStringLiteral("application-x-executable")
+                                    : mime.section('/', 0, 0) + QStringLiteral("-x-generic");
+        m_typeIcons[index] = type == FileType::UNKNOWN || type == FileType::BINARY
+                                 ? m_fileIcon
+                                 : QIcon::fromTheme(mime.replace('/', '-'), QIcon::fromTheme(generic, m_fileIcon));
+    }
+    return m_typeIcons[index];
+}
+
+void DirectoryModel::requestMetadata(int row) const {
+    if (m_metadataRequested[static_cast<size_t>(row)]) {
+        return;
+    }
+    m_pendingRows.push_back(row);
+    if (!m_metadataTimer.isActive()) {
+        m_metadataTimer.start();
+    }
+}
+
+void DirectoryModel::flushMetadataRequests() {
+    if (m_pendingRows.empty()) {
+        return;
+    }
+
+    // Newest requests are what the view shows now, older ones may be long scrolled away
+    if (m_pendingRows.size() > MAX_PENDING_ROWS) {
+        m_pendingRows.erase(m_pendingRows.begin(), m_pendingRows.end() - MAX_PENDING_ROWS);
+    }
+    std::sort(m_pendingRows.begin(), m_pendingRows.end());
+    m_pendingRows.erase(std::unique(m_pendingRows.begin(), m_pendingRows.end()), m_pendingRows.end());
+
+    // Copy the names into small listings, the jobs must not touch m_listing
+    // while more chunks are appended
+    const quint64 generation = m_generation;
+    const std::string directory = m_directory.toStdString();
+    const QPointer<DirectoryModel> self(this);
+    const std::shared_ptr<LoadContext> context = m_context;
+
+    auto flushBatch = [&](std::vector<int>& rows, std::shared_ptr<DirectoryListing>& batch) {
+        QThreadPool::globalInstance()->start([self, context, generation, directory, rows, batch]() {
+            if (context->cancelled) {
+                return;
+            }
+            const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd < 0) {
+                return;
+            }
+            batch->loadMetadata(fd, 0, batch->size());
+
+            // Files the extension says nothing about are sniffed; the
+            // detector's inode cache makes this free on later visits
+            std::vector<FileType> sniffed(batch->size(), FileType::UNKNOWN);
+            std::string name;
+            for (size_t i = 0; i < batch->size() && !context->cancelled; ++i) {
+                if (batch->type(i) == EntryType::FILE && batch->metadataValid(i) &&
+                    TypeDetector::fromExtension(batch->name(i)) == FileType::UNKNOWN) {
+                    name.assign(batch->name(i));
+                    sniffed[i] = TypeDetector::instance().detect(fd, name);
+                }
+            }
+            ::close(fd);
+
+            postToModel(self, [generation, rows, batch, sniffed](DirectoryModel* model) {
+                model->applyMetadata(generation, rows, *batch, sniffed);
+            });
+        });
+        rows.clear();
+        batch = std::make_shared<DirectoryListing>();
+    };
+
+    std::vector<int> rows;
+    auto batch = std::make_shared<DirectoryListing>();
+    for (int row : m_pendingRows) {
+        const size_t index = static_cast<size_t>(row);
+        if (index >= m_listing.size() || m_metadataRequested[index]) {
+            continue;
+        }
+        m_metadataRequested[index] = 1;
+        rows.push_back(row);
+        batch->append(m_listing.name(index), m_listing.type(index));
+        if (rows.size() == METADATA_BATCH) {
+            flushBatch(rows, batch);
+        }
+    }
+    if (!rows.empty()) {
+        flushBatch(rows, batch);
+    }
+    m_pendingRows.clear();
+}
+
+void DirectoryModel::applyMetadata(quint64 generation, const std::vector<int>& rows, const DirectoryListing& batch,
+                                   const std::vector<FileType>& sniffed) {
+    if (generation != m_generation || rows.empty()) {
+        return;
+    }
+    for (size_t i = 0; i < rows.size(); ++i) {
+        const size_t row = static_cast<size_t>(rows[i]);
+        m_sniffedTypes[row] = sniffed[i];
+        if (batch.metadataValid(i)) {
+            m_listing.setMetadata(row, batch.fileSize(i), batch.modifiedTime(i), batch.type(i));
+        } else {
+            m_listing.setMetadataFailed(row);
+        }
+    }
+
+    // Thumbnails wanted before the mtime was known, or made before the file changed
+    if (m_thumbnails && !m_thumbnailRows.isEmpty()) {
+        for (int row : rows) {
+            const size_t index = static_cast<size_t>(row);
+            if (!m_listing.metadataValid(index)) {
+                continue;
+            }
+            const std::string_view view = m_listing.name(index);
+            const QString name = QString::fromUtf8(view.data(), static_cast<int>(view.size()));
+            if (m_thumbnailRows.contains(name)) {
+                m_thumbnails->refresh(m_directory + QLatin1Char('/') + name, m_listing.modifiedTime(index));
+            }
+        }
+    }
+
+    // One signal covering the batch's visible rows
+    int first = -1;
+    int last = -1;
+    for (int row : rows) {
+        const int viewRow = m_viewRowOf[static_cast<size_t>(row)];
+        if (viewRow >= 0) {
+            first = first < 0 ? viewRow : std::min(first, viewRow);
+            last = std::max(last, viewRow);
+        }
+    }
+    if (first >= 0) {
+        emit dataChanged(index(first, 0), index(last, ColumnCount - 1));
+    }
+}
+
+void DirectoryModel::startArrange(bool resort) {
+    if (m_arrangeContext) {
+        m_arrangeContext->cancelled = true;   // a newer sort/filter wins
+    }
+    // A filter job cancelling a sort job has to do the sort as well
+    resort = resort || m_resortPending;
+    m_resortPending = resort;
+    auto context = std::make_shared<LoadContext>();
+    m_arrangeContext = context;
+    const quint64 serial = ++m_arrangeSerial;
+
+    const std::string pattern = foldCase(m_filter.toStdString());
+    // Narrowing the filter (typing more) only needs to look at what is shown now
+    std::vector<uint32_t> candidates;
+    if (!resort) {
+        const bool narrowing = pattern.find(m_appliedFilter) != std::string::npos;
+        candidates = narrowing ? m_rows : m_order;
+    }
+
+    // The job works on a copy, m_listing keeps changing while it runs
+    auto snapshot = std::make_shared<DirectoryListing>(m_listing);
+    const SortColumn column = sortColumnOf(m_sortColumn);
+    const bool descending = m_sortOrder == Qt::DescendingOrder;
+    const std::string directory = m_directory.toStdString();
+    const QPointer<DirectoryModel> self(this);
+
+    QThreadPool::globalInstance()->start([=, candidates = std::move(candidates)]() mutable {
+        TraceScope trace("gui", resort ? "DirectoryModel::sort" : "DirectoryModel::filter");
+        std::vector<uint32_t> order;
+        if (resort) {
+            // Size and date need every row's metadata, the others at least
+            // the types readdir did not report (directories sort first)
+            const int fd = ::open(directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            if (fd >= 0) {
+                if (column == SortColumn::SIZE || column == SortColumn::DATE) {
+                    snapshot->loadMetadata(fd, 0, snapshot->size());
+                } else {
+                    for (size_t row = 0; row < snapshot->size(); ++row) {
+                        if (snapshot->type(row) == EntryType::UNKNOWN) {
+                            snapshot->loadMetadata(fd, row, row + 1);
+                        }
+                    }
+                }
+                ::close(fd);
+            }
+            if (context->cancelled) {
+                return;
+            }
+
+            SortOptions options;
+            options.column = column;
+            options.descending = descending;
+            options.cancelled = &context->cancelled;
+            order = sortListing(*snapshot, SortKeys(*snapshot), options);
+            if (context->cancelled) {
+                return;
+            }
+        }
+        std::vector<uint32_t> rows = filterRows(*snapshot, resort ? order : candidates, pattern);
+        if (context->cancelled) {
+            return;
+        }
+
+        postToModel(self, [serial, resort, order = std::move(order), rows = std::move(rows), pattern, snapshot](DirectoryModel* model) mutable {
+            model->applyArrangement(serial, resort, order, rows, pattern, *snapshot);
+        });
+    });
+}
+
+void DirectoryModel::applyArrangement(quint64 serial, bool resort, std::vector<uint32_t>& order,
+                                      std::vector<uint32_t>& rows, const std::string& pattern, const DirectoryListing& snapshot) {
+    if (serial != m_arrangeSerial) {
+        return;   // superseded, or the directory changed
+    }
+    TraceScope trace("gui", "DirectoryModel::applyArrangement");
+
+    // Keep metadata the job had to load for sorting
+    const size_t known = snapshot.size();
+    for (size_t row = 0; row < known; ++row) {
+        if (snapshot.hasMetadata(row) && !m_listing.hasMetadata(row)) {
+            if (snapshot.metadataValid(row)) {
+                m_listing.setMetadata(row, snapshot.fileSize(row), snapshot.modifiedTime(row), snapshot.type(row));
+            } else {
+                m_listing.setMetadataFailed(row);
+            }
+        }
+    }
+
+    // Rows appended after the snapshot go to the end, in arrival order
+    for (size_t row = known; row < m_listing.size(); ++row) {
+        if (resort) {
+            order.push_back(static_cast<uint32_t>(row));
+        }
+        if (nameMatches(m_listing.name(row), pattern)) {
+            rows.push_back(static_cast<uint32_t>(row));
+        }
+    }
+
+    // Swap in the new arrangement in one layout change, keeping the
+    // selection and current index on the same files
+    emit layoutAboutToBeChanged();
+    const QModelIndexList before = persistentIndexList();
+    std::vector<int> listingRows;
+    listingRows.reserve(static_cast<size_t>(before.size()));
+    for (const QModelIndex& index : before) {
+        listingRows.push_back(listingRow(index.row()));
+    }
+
+    if (resort) {
+        m_order.swap(order);
+        m_resortPending = false;
+    }
+    m_rows.swap(rows);
+    m_appliedFilter = pattern;
+    rebuildViewRows();
+
+    QModelIndexList after;
+    after.reserve(before.size());
+    for (int i = 0; i < before.size(); ++i) {
+        const int viewRow = m_viewRowOf[static_cast<size_t>(listingRows[static_cast<size_t>(i)])];
+        after.append(viewRow >= 0 ? index(viewRow, before[i].column()) : QModelIndex());
+    }
+    changePersistentIndexList(before, after);
+    emit layoutChanged();
+}
+
+void DirectoryModel::rebuildViewRows() {
+    m_viewRowOf.assign(m_listing.size(), -1);
+    for (size_t i = 0; i < m_rows.size(); ++i) {
+        m_viewRowOf[m_rows[i]] = static_cast<int32_t>(i);
+    }
+}
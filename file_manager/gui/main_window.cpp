@@ -2,9 +2,31 @@
 #include "ui_mainwindow.h" // The header file generated from mainwindow.ui
 
 #include <QTreeWidgetItem>
+#include <QCoreApplication>
 #include <QDir>
+#include <QFileInfo>
 #include <QDesktopServices>
+#include <QHeaderView>
+#include <QMenu>
+#include <QMessageBox>
+#include <QScrollBar>
+#include <QStatusBar>
+#include <QTimer>
 #include <QUrl>
+#include "core/trash_manager.hpp"
+#include "utilities/startup_timer.hpp"
+#include "utilities/tracer.hpp"
+
+// $XDG_STATE_HOME/file_manager/file_manager.log, else under ~/.local/state,
+// not the working directory the application happened to be started in
+static QString logFilePath() {
+    const QByteArray stateHome = qgetenv("XDG_STATE_HOME");
+    const QString base = stateHome.startsWith('/') ? QString::fromLocal8Bit(stateHome)
+                                                   : QDir::homePath() + QStringLiteral("/.local/state");
+    const QString directory = base + QStringLiteral("/file_manager");
+    QDir().mkpath(directory);
+    return directory + QStringLiteral("/file_manager.log");
+}
 
 MainWindow::MainWindow(QWidget* parent)
     : QMainWindow(parent),
@@ -19,6 +41,11 @@ MainWindow::MainWindow(QWidget* parent)
 
     setupModels();
     setupConnections();
+    setupFileActions();
+
+    // Only the initial directory is listed now; logger and plugins are set
+    // up once the window has painted (see eventFilter)
+    ui->fileTableView->viewport()->installEventFilter(this);
 
     // Set initial path to Home
     navigateToPath(QDir::homePath());
@@ -26,20 +53,89 @@ MainWindow::MainWindow(QWidget* parent)
 
 MainWindow::~MainWindow()
 {
+    if (m_logger) {
+        ErrorHandler::instance().setErrorCallback(nullptr);   // the logger goes away below
+    }
     delete ui;
 }
 
+bool MainWindow::eventFilter(QObject* watched, QEvent* event) {
+    if (!m_firstPaintSeen && event->type() == QEvent::Paint && watched == ui->fileTableView->viewport()) {
+        m_firstPaintSeen = true;
+        StartupTimer::mark("first_paint");
+        ui->fileTableView->viewport()->removeEventFilter(this);
+        // Runs once the event queue is empty, after this paint has reached the screen
+        QTimer::singleShot(0, this, &MainWindow::initializeDeferred);
+    }
+    return QMainWindow::eventFilter(watched, event);
+}
+
+void MainWindow::initializeDeferred() {
+    TraceScope trace("gui", "initializeDeferred");
+
+    // Route error and info messages into the log file from now on,
+    // earlier ones only went to stderr
+    m_logger = std::make_unique<Logger>(logFilePath().toStdString(), AsyncLogOptions{});
+    Logger* logger = m_logger.get();
+    ErrorHandler::instance().setErrorCallback([logger](ErrorSeverity severity, const std::string& message) {
+        logger->log(severity, message);
+    });
+
+    // Plugins are installed next to bin/
+    m_pluginManager = std::make_unique<PluginManager>();
+    const QString pluginDirectory = QCoreApplication::applicationDirPath() + "/../plugins";
+    if (QDir(pluginDirectory).exists()) {
+        m_pluginManager->loadPlugins(QDir(pluginDirectory).absolutePath().toStdString());
+    }
+
+    // Prefetching competes with the initial listing, start it afterwards
+    m_prefetcher = std::make_unique<Prefetcher>();
+    updatePrefetchTargets();
+
+    // Expired trash and leftovers of crashed deletes, at idle I/O priority
+    TrashManager::instance().schedulePurge();
+
+    // Previews too: decoding images is the last thing the first frame needs
+    m_thumbnailService = new ThumbnailService(this);
+    m_directoryModel->setThumbnailService(m_thumbnailService);
+    fetchVisibleMetadata();
+
+    StartupTimer::mark("deferred_init");
+    m_deferredDone = true;
+    reportStartupIfReady();
+}
+
+// Interactive = first paint done, initial directory listed, deferred init done
+void MainWindow::reportStartupIfReady() {
+    if (m_startupReported || !m_deferredDone || !m_initialListingDone) {
+        return;
+    }
+    m_startupReported = true;
+    StartupTimer::mark("interactive");
+    FM_INFO("Startup: ", StartupTimer::summary());
+}
+
 void MainWindow::setupModels() {
-    m_fileSystemModel = new QFileSystemModel(this);
-    m_fileSystemModel->setRootPath(""); // Allow viewing the whole filesystem
-    m_fileSystemModel->setFilter(QDir::AllEntries | QDir::NoDotAndDotDot);
+    m_directoryModel = new DirectoryModel(this);
+
+    // Type-to-filter box above the table
+    m_filterEdit = new QLineEdit(this);
+    m_filterEdit->setPlaceholderText(tr("Filter by name"));
+    m_filterEdit->setClearButtonEnabled(true);
+    ui->verticalLayout_2->insertWidget(0, m_filterEdit);
 
-    ui->fileTableView->setModel(m_fileSystemModel);
+    ui->fileTableView->setModel(m_directoryModel);
 
     // Set table view properties
     ui->fileTableView->setSelectionBehavior(QAbstractItemView::SelectRows);
+    // Header clicks end up in DirectoryModel::sort(), which sorts off the GUI thread
     ui->fileTableView->setSortingEnabled(true);
-    ui->fileTableView->sortByColumn(0, Qt::AscendingOrder);
+    ui->fileTableView->sortByColumn(DirectoryModel::NameColumn, Qt::AscendingOrder);
+    // Fixed row heights: the view never measures rows, which matters with 500k of them
+    ui->fileTableView->verticalHeader()->setSectionResizeMode(QHeaderView::Fixed);
+    ui->fileTableView->verticalHeader()->setDefaultSectionSize(ui->fileTableView->fontMetrics().height() + 6);
+    // Needed for entered(), which drives hover prefetching
+    ui->fileTableView->setMouseTracking(true);
 }
 
 void MainWindow::setupConnections() {
@@ -50,15 +146,224 @@ void MainWindow::setupConnections() {
 
     connect(ui->fileTableView, &QTableView::doubleClicked, this, &MainWindow::on_fileTableView_doubleClicked);
     connect(ui->navigationTreeWidget, &QTreeWidget::itemClicked, this, &MainWindow::on_navigationTreeWidget_itemClicked);
+
+    connect(m_filterEdit, &QLineEdit::textChanged, m_directoryModel, &DirectoryModel::setNameFilter);
+
+    // Stat the rows that scroll into view, before the view asks for them row by row
+    connect(ui->fileTableView->verticalScrollBar(), &QScrollBar::valueChanged, this, &MainWindow::fetchVisibleMetadata);
+    // Rows arriving, sorting and filtering change what is visible without scrolling
+    m_visibleFetchTimer = new QTimer(this);
+    m_visibleFetchTimer->setSingleShot(true);
+    m_visibleFetchTimer->setInterval(0);
+    connect(m_visibleFetchTimer, &QTimer::timeout, this, &MainWindow::fetchVisibleMetadata);
+    connect(m_directoryModel, &QAbstractItemModel::rowsInserted, this, &MainWindow::scheduleVisibleFetch);
+    connect(m_directoryModel, &QAbstractItemModel::layoutChanged, this, &MainWindow::scheduleVisibleFetch);
+    connect(m_directoryModel, &QAbstractItemModel::modelReset, this, &MainWindow::scheduleVisibleFetch);
+    // Folders the user hovers or selects are likely the next navigation
+    connect(ui->fileTableView, &QTableView::entered, this, [this](const QModelIndex& index) {
+        m_hoveredDirectory = m_directoryModel->isDir(index) ? m_directoryModel->filePath(index) : QString();
+        updatePrefetchTargets();
+    });
+    connect(ui->fileTableView->selectionModel(), &QItemSelectionModel::currentChanged, this, [this](const QModelIndex& current) {
+        m_selectedDirectory = m_directoryModel->isDir(current) ? m_directoryModel->filePath(current) : QString();
+        updatePrefetchTargets();
+    });
+
+    connect(m_directoryModel, &DirectoryModel::loadingFinished, this, [this](qint64 entries, qint64 milliseconds) {
+        statusBar()->showMessage(tr("%1 items (listed in %2 ms)").arg(entries).arg(milliseconds));
+        if (!m_initialListingDone) {
+            m_initialListingDone = true;
+            StartupTimer::mark("initial_listing");
+            reportStartupIfReady();
+        }
+    });
+    connect(m_directoryModel, &DirectoryModel::loadingFailed, this, [this](const QString& message) {
+        statusBar()->showMessage(tr("Cannot list directory: %1").arg(message));
+        if (!m_initialListingDone) {
+            m_initialListingDone = true;   // failed, but the window is usable
+            reportStartupIfReady();
+        }
+    });
+}
+
+void MainWindow::setupFileActions() {
+    m_operationsPanel = new OperationsPanel(this);
+    addDockWidget(Qt::BottomDockWidgetArea, m_operationsPanel);
+    m_operationsPanel->hide();   // shown by the first job
+
+    auto* copyAction = new QAction(tr("Copy"), this);
+    copyAction->setShortcut(QKeySequence::Copy);
+    connect(copyAction, &QAction::triggered, this, [this] { copySelection(false); });
+
+    auto* cutAction = new QAction(tr("Cut"), this);
+    cutAction->setShortcut(QKeySequence::Cut);
+    connect(cutAction, &QAction::triggered, this, [this] { copySelection(true); });
+
+    auto* pasteAction = new QAction(tr("Paste"), this);
+    pasteAction->setShortcut(QKeySequence::Paste);
+    connect(pasteAction, &QAction::triggered, this, &MainWindow::pasteIntoCurrentDirectory);
+
+    auto* trashAction = new QAction(tr("Move to Trash"), this);
+    trashAction->setShortcut(QKeySequence::Delete);
+    connect(trashAction, &QAction::triggered, this, &MainWindow::trashSelection);
+
+    auto* deleteAction = new QAction(tr("Delete Permanently"), this);
+    deleteAction->setShortcut(QKeySequence(Qt::SHIFT | Qt::Key_Delete));
+    connect(deleteAction, &QAction::triggered, this, &MainWindow::deleteSelection);
+
+    auto* undoAction = new QAction(tr("Undo Move to Trash"), this);
+    undoAction->setShortcut(QKeySequence::Undo);
+    connect(undoAction, &QAction::triggered, this, &MainWindow::undoTrash);
+
+    // Shortcuts only while the table has focus, the filter box keeps its own
+    const QList<QAction*> actions{copyAction, cutAction, pasteAction, trashAction, deleteAction, undoAction};
+    for (QAction* action : actions) {
+        action->setShortcutContext(Qt::WidgetWithChildrenShortcut);
+        ui->fileTableView->addAction(action);
+    }
+
+    ui->fileTableView->setContextMenuPolicy(Qt::CustomContextMenu);
+    connect(ui->fileTableView, &QWidget::customContextMenuRequested, this, [this, actions](const QPoint& position) {
+        QMenu menu(this);
+        menu.addActions(actions);
+        menu.exec(ui->fileTableView->viewport()->mapToGlobal(position));
+    });
+
+    // Show what a finished job changed if it is the folder on screen
+    connect(m_operationsPanel, &OperationsPanel::jobFinished, this, [this](const QStringList& directories, bool ok) {
+        const QString current = QDir(m_directoryModel->directory()).absolutePath();
+        for (const QString& directory : directories) {
+            if (QDir(directory).absolutePath() == current) {
+                m_directoryModel->setDirectory(m_directoryModel->directory());
+                break;
+            }
+        }
+        if (!ok) {
+            m_operationsPanel->show();   // keep the error visible
+        }
+    });
+}
+
+QStringList MainWindow::selectedPaths() const {
+    QStringList paths;
+    const QModelIndexList rows = ui->fileTableView->selectionModel()->selectedRows(DirectoryModel::NameColumn);
+    for (const QModelIndex& index : rows) {
+        paths << m_directoryModel->filePath(index);
+    }
+    return paths;
+}
+
+void MainWindow::copySelection(bool cut) {
+    const QStringList paths = selectedPaths();
+    if (paths.isEmpty()) return;
+
+    m_clipboardPaths = paths;
+    m_clipboardCut = cut;
+    statusBar()->showMessage(cut ? tr("%n item(s) cut", "", paths.size())
+                                 : tr("%n item(s) copied", "", paths.size()));
+}
+
+void MainWindow::pasteIntoCurrentDirectory() {
+    if (m_clipboardPaths.isEmpty()) return;
+
+    std::vector<fs::path> sources;
+    for (const QString& path : m_clipboardPaths) {
+        sources.emplace_back(path.toStdString());
+    }
+    const QString destination = m_directoryModel->directory();
+    const FileOperationKind kind = m_clipboardCut ? FileOperationKind::MOVE : FileOperationKind::COPY;
+    const QString title = (m_clipboardCut ? tr("Moving %n item(s) to %1", "", m_clipboardPaths.size())
+                                          : tr("Copying %n item(s) to %1", "", m_clipboardPaths.size()))
+                              .arg(destination);
+
+    m_operationsPanel->addJob(FileOperationJob::create(kind, std::move(sources), destination.toStdString()), title);
+
+    // A cut is pasted once, the sources are gone afterwards
+    if (m_clipboardCut) {
+        m_clipboardPaths.clear();
+        m_clipboardCut = false;
+    }
+}
+
+void MainWindow::trashSelection() {
+    const QStringList paths = selectedPaths();
+    if (paths.isEmpty()) return;
+
+    // One rename per item and undoable, so no confirmation
+    std::vector<fs::path> sources;
+    for (const QString& path : paths) {
+        sources.emplace_back(path.toStdString());
+    }
+    m_lastTrashJob = FileOperationJob::create(FileOperationKind::TRASH, std::move(sources));
+    m_operationsPanel->addJob(m_lastTrashJob, tr("Moving %n item(s) to the trash", "", paths.size()));
+}
+
+void MainWindow::undoTrash() {
+    if (!m_lastTrashJob || !m_lastTrashJob->finished()) return;
+
+    const std::vector<TrashEntry> entries = m_lastTrashJob->trashed();
+    m_lastTrashJob.reset();
+
+    const QString current = QDir(m_directoryModel->directory()).absolutePath();
+    int restored = 0;
+    bool reload = false;
+    QStringList failures;
+    for (const TrashEntry& entry : entries) {
+        const QString original = QString::fromStdString(entry.originalPath);
+        if (FsStatus status = TrashManager::instance().restore(entry); !status) {
+            failures << tr("%1: %2").arg(original, QString::fromStdString(status.message()));
+            continue;
+        }
+        ++restored;
+        reload = reload || QFileInfo(original).absolutePath() == current;
+    }
+
+    if (reload) {
+        m_directoryModel->setDirectory(m_directoryModel->directory());
+    }
+    statusBar()->showMessage(tr("%n item(s) restored from the trash", "", restored));
+    if (!failures.isEmpty()) {
+        QMessageBox::warning(this, tr("Undo Move to Trash"),
+                             tr("Could not restore:\n%1").arg(failures.join(QLatin1Char('\n'))));
+    }
+}
+
+void MainWindow::deleteSelection() {
+    const QStringList paths = selectedPaths();
+    if (paths.isEmpty()) return;
+
+    const QString question = paths.size() == 1
+        ? tr("Permanently delete \"%1\"?").arg(QFileInfo(paths.front()).fileName())
+        : tr("Permanently delete %n items?", "", paths.size());
+    if (QMessageBox::question(this, tr("Delete"), question) != QMessageBox::Yes) {
+        return;
+    }
+
+    std::vector<fs::path> sources;
+    for (const QString& path : paths) {
+        sources.emplace_back(path.toStdString());
+    }
+    m_operationsPanel->addJob(FileOperationJob::create(FileOperationKind::REMOVE, std::move(sources)),
+                              tr("Deleting %n item(s)", "", paths.size()));
 }
 
 void MainWindow::navigateToPath(const QString& path) {
+    TraceScope trace("gui", "navigateToPath");
+    if (trace.active()) {
+        trace.setDetail(path.toStdString());
+    }
+
     if (path.isEmpty()) return;
 
     QDir dir(path);
     if (!dir.exists()) return;
 
-    ui->fileTableView->setRootIndex(m_fileSystemModel->index(path));
+    {
+        const QSignalBlocker blocker(m_filterEdit);   // setDirectory() drops the filter itself
+        m_filterEdit->clear();
+    }
+    statusBar()->showMessage(tr("Loading..."));
+    m_directoryModel->setDirectory(path);
     setWindowTitle(path);
 
     // Add to history
@@ -72,11 +377,58 @@ void MainWindow::navigateToPath(const QString& path) {
 
     ui->actionBack->setEnabled(m_historyIndex > 0);
     ui->actionForward->setEnabled(m_historyIndex < m_history.size() - 1);
+
+    m_hoveredDirectory.clear();
+    m_selectedDirectory.clear();
+    updatePrefetchTargets();
+}
+
+void MainWindow::updatePrefetchTargets() {
+    if (!m_prefetcher) return;   // not started yet
+
+    std::vector<std::string> targets;
+    auto add = [&targets](const QString& path) {
+        if (!path.isEmpty()) {
+            targets.push_back(path.toStdString());
+        }
+    };
+    add(m_hoveredDirectory);
+    add(m_selectedDirectory);
+
+    // Back/forward neighbours and the parent
+    if (m_historyIndex > 0) add(m_history[m_historyIndex - 1]);
+    if (m_historyIndex >= 0 && m_historyIndex < m_history.size() - 1) add(m_history[m_historyIndex + 1]);
+    QDir parent(m_directoryModel->directory());
+    if (parent.cdUp()) add(parent.path());
+
+    // Anything not in the list any more (the mouse moved on) is cancelled
+    m_prefetcher->setTargets(targets);
+}
+
+void MainWindow::fetchVisibleMetadata() {
+    const int first = ui->fileTableView->rowAt(0);
+    if (first < 0) return;
+
+    int last = ui->fileTableView->rowAt(ui->fileTableView->viewport()->height() - 1);
+    if (last < 0) last = m_directoryModel->rowCount() - 1;
+    m_directoryModel->fetchMetadata(first, last);
+
+    // Thumbnails for the visible rows first, then a page in each direction
+    // so short scrolls find them ready; anything further away is cancelled
+    const int page = last - first + 1;
+    m_directoryModel->requestThumbnails(first, last);
+    m_directoryModel->requestThumbnails(qMax(0, first - page), last + page);
+}
+
+void MainWindow::scheduleVisibleFetch() {
+    if (!m_visibleFetchTimer->isActive()) {
+        m_visibleFetchTimer->start();
+    }
 }
 
 void MainWindow::on_fileTableView_doubleClicked(const QModelIndex &index) {
-    const QString path = m_fileSystemModel->filePath(index);
-    if (m_fileSystemModel->isDir(index)) {
+    const QString path = m_directoryModel->filePath(index);
+    if (m_directoryModel->isDir(index)) {
         navigateToPath(path);
     } else {
         QDesktopServices::openUrl(QUrl::fromLocalFile(path));
@@ -99,9 +451,7 @@ void MainWindow::on_navigationTreeWidget_itemClicked(QTreeWidgetItem *item, int
 }
 
 void MainWindow::on_actionUp_triggered() {
-    QModelIndex currentRootIndex = ui->fileTableView->rootIndex();
-    QString currentPath = m_fileSystemModel->filePath(currentRootIndex);
-    QDir dir(currentPath);
+    QDir dir(m_directoryModel->directory());
     if (dir.cdUp()) {
         navigateToPath(dir.path());
     }
@@ -0,0 +1,243 @@
+#include "gui/operations_panel.hpp"
+
+#include <QHBoxLayout>
+#include <QLabel>
+#include <QLocale>
+#include <QProgressBar>
+#include <QPushButton>
+#include <QScrollArea>
+#include <QVBoxLayout>
+#include <algorithm>
+#include <set>
+
+// ~30 UI updates per second at most, whatever the jobs are doing
+static constexpr int TICK_MS = 33;
+
+// Time constant of the rate smoothing
+static constexpr double RATE_WINDOW_MS = 1000.0;
+
+static QString formatDuration(qint64 seconds) {
+    const qint64 hours = seconds / 3600;
+    const QString minutesSeconds = QStringLiteral("%1:%2")
+        .arg(hours ? (seconds / 60) % 60 : seconds / 60, hours ? 2 : 1, 10, QChar('0'))
+        .arg(seconds % 60, 2, 10, QChar('0'));
+    return hours ? QStringLiteral("%1:%2").arg(hours).arg(minutesSeconds) : minutesSeconds;
+}
+
+OperationsPanel::OperationsPanel(QWidget* parent)
+    : QDockWidget(tr("Operations"), parent)
+{
+    setObjectName("operationsPanel");
+
+    auto* scroll = new QScrollArea(this);
+    scroll->setWidgetResizable(true);
+    m_container = new QWidget(scroll);
+    auto* layout = new QVBoxLayout(m_container);
+    m_rowsLayout = new QVBoxLayout();
+    layout->addLayout(m_rowsLayout);
+    layout->addStretch();
+
+    auto* clear = new QPushButton(tr("Clear finished"), m_container);
+    connect(clear, &QPushButton::clicked, this, &OperationsPanel::clearFinished);
+    layout->addWidget(clear, 0, Qt::AlignRight);
+
+    scroll->setWidget(m_container);
+    setWidget(scroll);
+
+    m_timer.setInterval(TICK_MS);
+    connect(&m_timer, &QTimer::timeout, this, &OperationsPanel::tick);
+    m_clock.start();
+}
+
+OperationsPanel::~OperationsPanel() {
+    // Jobs write into the user's folders, do not leave them running unseen.
+    // A cancelled copy removes its partial file.
+    for (auto& row : m_rows) {
+        row->job->cancel();
+    }
+    for (auto& row : m_rows) {
+        row->job->wait();
+    }
+}
+
+void OperationsPanel::addJob(const std::shared_ptr<FileOperationJob>& job, const QString& title) {
+    auto row = std::make_unique<Row>();
+    row->job = job;
+    row->lastMs = m_clock.elapsed();
+
+    row->widget = new QWidget(m_container);
+    auto* layout = new QHBoxLayout(row->widget);
+    layout->setContentsMargins(0, 0, 0, 0);
+    auto* text = new QVBoxLayout();
+    row->title = new QLabel(title, row->widget);
+    row->bar = new QProgressBar(row->widget);
+    row->bar->setRange(0, 0);   // busy until the scan has totals
+    row->stats = new QLabel(tr("Queued"), row->widget);
+    text->addWidget(row->title);
+    text->addWidget(row->bar);
+    text->addWidget(row->stats);
+    layout->addLayout(text, 1);
+
+    row->pause = new QPushButton(tr("Pause"), row->widget);
+    row->cancel = new QPushButton(tr("Cancel"), row->widget);
+    layout->addWidget(row->pause);
+    layout->addWidget(row->cancel);
+
+    Row* raw = row.get();
+    connect(row->pause, &QPushButton::clicked, this, [raw] {
+        raw->paused = !raw->paused;
+        if (raw->paused) {
+            raw->job->pause();
+        } else {
+            raw->job->resume();
+        }
+        raw->pause->setText(raw->paused ? tr("Resume") : tr("Pause"));
+    });
+    connect(row->cancel, &QPushButton::clicked, this, [raw] {
+        raw->job->cancel();
+        raw->cancel->setEnabled(false);
+    });
+
+    m_rowsLayout->addWidget(row->widget);
+    m_rows.push_back(std::move(row));
+    show();
+
+    // The user is watching this one: ahead of prefetches and trash purges,
+    // but still held to the host's I/O budget (FM_IO_MAX_MBPS, FM_IO_MAX_OPS)
+    job->setPriority(JobPriority::INTERACTIVE);
+    if (!job->rateLimiter()) {
+        job->setRateLimiter(RateLimiter::background());
+    }
+    job->start();
+    if (!m_timer.isActive()) {
+        m_timer.start();
+    }
+}
+
+bool OperationsPanel::hasActiveJobs() const {
+    for (const auto& row : m_rows) {
+        if (!row->done) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// PRIVATE METHODS
+
+void OperationsPanel::tick() {
+    const qint64 now = m_clock.elapsed();
+    for (auto& row : m_rows) {
+        if (!row->done) {
+            updateRow(*row, now);
+        }
+    }
+    if (!hasActiveJobs()) {
+        m_timer.stop();
+    }
+}
+
+void OperationsPanel::updateRow(Row& row, qint64 nowMs) {
+    const JobProgress progress = row.job->progress();
+
+    // Rates from the counter deltas since the last tick; paused time is skipped
+    const qint64 elapsed = nowMs - row.lastMs;
+    if (progress.state == JobState::RUNNING && elapsed > 0) {
+        const double alpha = elapsed / (elapsed + RATE_WINDOW_MS);
+        const double bytesRate = (progress.bytesDone - row.lastBytes) * 1000.0 / elapsed;
+        const double filesRate = (progress.filesDone - row.lastFiles) * 1000.0 / elapsed;
+        row.bytesPerSecond += alpha * (bytesRate - row.bytesPerSecond);
+        row.filesPerSecond += alpha * (filesRate - row.filesPerSecond);
+    }
+    row.lastMs = nowMs;
+    row.lastBytes = progress.bytesDone;
+    row.lastFiles = progress.filesDone;
+
+    // Percent by bytes when there are any, by files otherwise
+    if (progress.state != JobState::QUEUED && progress.state != JobState::SCANNING) {
+        const uint64_t done = progress.bytesTotal ? progress.bytesDone : progress.filesDone;
+        const uint64_t total = progress.bytesTotal ? progress.bytesTotal : progress.filesTotal;
+        row.bar->setRange(0, 1000);
+        row.bar->setValue(total ? static_cast<int>(done * 1000 / total) : 0);
+    }
+    if (!progress.currentFile.empty()) {
+        row.title->setToolTip(QString::fromStdString(progress.currentFile));
+    }
+    row.stats->setText(formatStats(row, progress));
+
+    if (!row.job->finished()) {
+        return;
+    }
+    row.done = true;
+    row.pause->setEnabled(false);
+    row.cancel->setEnabled(false);
+    if (progress.state == JobState::COMPLETED) {
+        row.bar->setRange(0, 1);
+        row.bar->setValue(1);
+    }
+    emit jobFinished(affectedDirectories(*row.job), progress.state == JobState::COMPLETED);
+}
+
+void OperationsPanel::clearFinished() {
+    for (auto it = m_rows.begin(); it != m_rows.end();) {
+        if ((*it)->done) {
+            (*it)->widget->deleteLater();
+            it = m_rows.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+QString OperationsPanel::formatStats(const Row& row, const JobProgress& progress) {
+    const QLocale locale;
+    switch (progress.state) {
+        case JobState::QUEUED:
+            return tr("Queued");
+        case JobState::SCANNING:
+            return tr("Counting... %1 files, %2").arg(progress.filesTotal)
+                .arg(locale.formattedDataSize(static_cast<qint64>(progress.bytesTotal)));
+        case JobState::PAUSED:
+            return tr("Paused, %1 of %2 files").arg(progress.filesDone).arg(progress.filesTotal);
+        case JobState::COMPLETED:
+            return tr("Done, %1 files, %2").arg(progress.filesDone)
+                .arg(locale.formattedDataSize(static_cast<qint64>(progress.bytesDone)));
+        case JobState::FAILED:
+            return tr("Failed: %1").arg(QString::fromStdString(progress.error));
+        case JobState::CANCELLED:
+            return tr("Cancelled");
+        case JobState::RUNNING:
+            break;
+    }
+
+    QStringList parts;
+    if (progress.bytesTotal) {
+        parts << tr("%1/s").arg(locale.formattedDataSize(static_cast<qint64>(row.bytesPerSecond)));
+    }
+    parts << tr("%1 files/s").arg(row.filesPerSecond, 0, 'f', 0);
+
+    // ETA from whichever rate the job is measured in
+    double remaining = -1;
+    if (progress.bytesTotal && row.bytesPerSecond > 1) {
+        remaining = (progress.bytesTotal - std::min(progress.bytesDone, progress.bytesTotal)) / row.bytesPerSecond;
+    } else if (!progress.bytesTotal && row.filesPerSecond > 0.01) {
+        remaining = (progress.filesTotal - std::min(progress.filesDone, progress.filesTotal)) / row.filesPerSecond;
+    }
+    if (remaining >= 0) {
+        parts << tr("ETA %1").arg(formatDuration(static_cast<qint64>(remaining + 0.5)));
+    }
+    return parts.join(QStringLiteral(" · "));
+}
+
+QStringList OperationsPanel::affectedDirectories(const FileOperationJob& job) {
+    std::set<QString> directories;
+    if (job.kind() != FileOperationKind::COPY) {
+        for (const auto& source : job.sources()) {
+            directories.insert(QString::fromStdString(source.parent_path().string()));
+        }
+    }
+    if (job.kind() != FileOperationKind::REMOVE && job.kind() != FileOperationKind::TRASH) {
+        directories.insert(QString::fromStdString(job.destination().string()));
+    }
+    return QStringList(directories.begin(), directories.end());
+}
@@ -0,0 +1,261 @@
+#include "gui/thumbnail_service.hpp"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+#include <QImageReader>
+#include <QPixmap>
+#include <QSet>
+#include <QStandardPaths>
+#include <QThread>
+#include <QUrl>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "utilities/metrics.hpp"
+#include "utilities/tracer.hpp"
+
+// Decoded thumbnails kept as pixmaps, in KiB
+static constexpr int MEMORY_BUDGET_KIB = 64 * 1024;
+
+// Larger files are not decoded, a 200 MB TIFF would stall a worker for seconds
+static constexpr qint64 MAX_SOURCE_BYTES = 64 * 1024 * 1024;
+
+// Subdirectory of fail/ for this application, as the spec asks
+static const char* const FAIL_DIRECTORY = "fail/file_manager";
+
+namespace {
+
+struct Result {
+    QImage image;
+    qint64 mtime = -1;
+    bool cancelled = false;
+};
+
+QByteArray uriOf(const QString& path) {
+    return QUrl::fromLocalFile(path).toEncoded();
+}
+
+QString md5Name(const QByteArray& uri) {
+    return QString::fromLatin1(QCryptographicHash::hash(uri, QCryptographicHash::Md5).toHex()) +
+           QStringLiteral(".png");
+}
+
+// A cached PNG is valid if it was made from this URI at this mtime
+QImage readCached(const QString& file, const QByteArray& uri, qint64 mtime, bool& exists) {
+    QImageReader reader(file, "png");
+    exists = reader.canRead();
+    if (!exists || reader.text(QStringLiteral("Thumb::URI")).toUtf8() != uri ||
+        reader.text(QStringLiteral("Thumb::MTime")) != QString::number(mtime)) {
+        exists = false;
+        return QImage();
+    }
+    return reader.read();
+}
+
+// Written to a temporary file and renamed, readers never see half a PNG
+void writeCached(const QString& file, QImage image, const QByteArray& uri, qint64 mtime, qint64 size) {
+    const QString directory = QFileInfo(file).path();
+    if (!QDir().mkpath(directory)) {
+        return;
+    }
+    QFile::setPermissions(directory, QFileDevice::ReadOwner | QFileDevice::WriteOwner | QFileDevice::ExeOwner);
+
+    image.setText(QStringLiteral("Thumb::URI"), QString::fromUtf8(uri));
+    image.setText(QStringLiteral("Thumb::MTime"), QString::number(mtime));
+    image.setText(QStringLiteral("Thumb::Size"), QString::number(size));
+    image.setText(QStringLiteral("Software"), QStringLiteral("file_manager"));
+
+    const QString temporary = file + QStringLiteral(".%1.tmp").arg(::getpid());
+    if (!image.save(temporary, "png")) {
+        QFile::remove(temporary);
+        return;
+    }
+    QFile::setPermissions(temporary, QFileDevice::ReadOwner | QFileDevice::WriteOwner);
+    if (::rename(QFile::encodeName(temporary).constData(), QFile::encodeName(file).constData()) != 0) {
+        QFile::remove(temporary);
+    }
+}
+
+// Runs on a worker: cached thumbnail, or decode + downscale + store
+Result loadOrGenerate(const QString& path, const std::atomic<bool>& cancelled) {
+    static const MetricId metric = Metrics::registerOperation("thumbnail.generate");
+
+    Result result;
+    if (cancelled) {
+        result.cancelled = true;
+        return result;
+    }
+    struct stat st {};
+    if (::stat(QFile::encodeName(path).constData(), &st) != 0 || !S_ISREG(st.st_mode)) {
+        return result;
+    }
+    result.mtime = static_cast<qint64>(st.st_mtime);
+
+    const QByteArray uri = uriOf(path);
+    const QString name = md5Name(uri);
+    const QString normal = ThumbnailService::cacheDirectory() + QStringLiteral("/normal/") + name;
+    const QString failed = ThumbnailService::cacheDirectory() + QLatin1Char('/') + QLatin1String(FAIL_DIRECTORY) +
+                           QLatin1Char('/') + name;
+
+    bool exists = false;
+    result.image = readCached(normal, uri, result.mtime, exists);
+    if (!result.image.isNull()) {
+        return result;
+    }
+    readCached(failed, uri, result.mtime, exists);
+    if (exists || st.st_size > MAX_SOURCE_BYTES) {
+        return result;   // known to fail
+    }
+    if (cancelled) {
+        result.cancelled = true;
+        return result;
+    }
+
+    TraceScope trace("thumbnail", "generate");
+    if (trace.active()) {
+        trace.setDetail(path.toStdString());
+    }
+    MetricsScope scope(metric);
+    scope.addBytes(static_cast<uint64_t>(st.st_size));
+
+    QImageReader reader(path);
+    reader.setAutoTransform(true);
+    const QSize size = reader.size();
+    const QSize bounds(ThumbnailService::THUMBNAIL_SIZE, ThumbnailService::THUMBNAIL_SIZE);
+    if (size.isValid() && (size.width() > bounds.width() || size.height() > bounds.height())) {
+        // Lets the JPEG decoder skip most of the work (DCT scaling)
+        reader.setScaledSize(size.scaled(bounds, Qt::KeepAspectRatio));
+    }
+    QImage image = reader.read();
+    if (image.isNull()) {
+        scope.fail();
+        QImage marker(1, 1, QImage::Format_ARGB32);
+        marker.fill(Qt::transparent);
+        writeCached(failed, marker, uri, result.mtime, st.st_size);
+        return result;
+    }
+    if (image.width() > bounds.width() || image.height() > bounds.height()) {
+        image = image.scaled(bounds, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+    }
+    writeCached(normal, image, uri, result.mtime, st.st_size);
+    result.image = image;
+    return result;
+}
+
+} // namespace
+
+ThumbnailService::ThumbnailService(QObject* parent)
+    : QObject(parent)
+{
+    // Bounded: decoding is CPU heavy and must leave cores for the UI and listing
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+    m_cache.setMaxCost(MEMORY_BUDGET_KIB);
+}
+
+ThumbnailService::~ThumbnailService() {
+    for (auto& request : m_requests) {
+        request->cancelled = true;
+    }
+    m_pool.clear();
+    m_pool.waitForDone();
+}
+
+bool ThumbnailService::canThumbnail(FileType type) {
+    switch (type) {
+        case FileType::PNG:
+        case FileType::JPEG:
+        case FileType::GIF:
+        case FileType::WEBP:
+        case FileType::BMP:
+        case FileType::TIFF:
+        case FileType::ICO:
+        case FileType::SVG:
+            return true;
+        default:
+            return false;
+    }
+}
+
+void ThumbnailService::setWanted(const QStringList& paths, const QList<qint64>& mtimes) {
+    const QSet<QString> wanted(paths.begin(), paths.end());
+    for (auto it = m_requests.begin(); it != m_requests.end();) {
+        if (wanted.contains(it.key())) {
+            ++it;
+        } else {
+            it.value()->cancelled = true;   // scrolled away
+            it = m_requests.erase(it);
+        }
+    }
+    for (int i = 0; i < paths.size(); ++i) {
+        const qint64 mtime = i < mtimes.size() ? mtimes[i] : -1;
+        if (!m_requests.contains(paths[i]) && !isCurrent(paths[i], mtime)) {
+            start(paths[i]);
+        }
+    }
+}
+
+void ThumbnailService::refresh(const QString& path, qint64 mtime) {
+    if (!m_requests.contains(path) && !isCurrent(path, mtime)) {
+        start(path);
+    }
+}
+
+QIcon ThumbnailService::cached(const QString& path, qint64 mtime) const {
+    const Entry* entry = m_cache.object(path);
+    if (!entry || (mtime >= 0 && entry->mtime != mtime)) {
+        return QIcon();
+    }
+    return entry->icon;
+}
+
+QString ThumbnailService::cacheDirectory() {
+    return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + QStringLiteral("/thumbnails");
+}
+
+QString ThumbnailService::thumbnailPath(const QString& path) {
+    return cacheDirectory() + QStringLiteral("/normal/") + md5Name(uriOf(QFileInfo(path).absoluteFilePath()));
+}
+
+// PRIVATE METHODS
+
+bool ThumbnailService::isCurrent(const QString& path, qint64 mtime) const {
+    const Entry* entry = m_cache.object(path);
+    return entry && (mtime < 0 || entry->mtime == mtime);
+}
+
+void ThumbnailService::start(const QString& path) {
+    // Thumbnails of thumbnails would never end
+    if (path.startsWith(cacheDirectory() + QLatin1Char('/'))) {
+        return;
+    }
+    auto request = std::make_shared<Request>();
+    m_requests.insert(path, request);
+
+    m_pool.start([this, path, request] {
+        Result result = loadOrGenerate(path, request->cancelled);
+        if (result.cancelled) {
+            return;
+        }
+        // Context object `this`: dropped if the service is gone by then
+        QMetaObject::invokeMethod(this, [this, path, request, result] {
+            finish(path, request, result.image, result.mtime);
+        }, Qt::QueuedConnection);
+    });
+}
+
+void ThumbnailService::finish(const QString& path, const std::shared_ptr<Request>& request, const QImage& image,
+                              qint64 mtime) {
+    auto it = m_requests.find(path);
+    if (it != m_requests.end() && it.value() == request) {
+        m_requests.erase(it);
+    }
+
+    // Failures are remembered too, so the view does not ask again
+    auto* entry = new Entry{image.isNull() ? QIcon() : QIcon(QPixmap::fromImage(image)), mtime};
+    const int cost = qMax(1, static_cast<int>(image.sizeInBytes() / 1024));
+    m_cache.insert(path, entry, cost);
+    emit thumbnailReady(path);
+}
@@ -0,0 +1,259 @@
+#include "binary_log.hpp"
+#include <cerrno>
+#include <chrono>
+#include <ctime>
+#include <iostream>
+#include <sstream>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Buffered bytes that trigger a write() on their own
+static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+
+// Process-wide table of format strings, index = format ID
+static std::mutex& formatMutex() {
+    static std::mutex mutex;
+    return mutex;
+}
+
+static std::vector<std::string>& formatTable() {
+    static std::vector<std::string> formats;
+    return formats;
+}
+
+// =======================
+// BinaryLogSink Implementation
+// =======================
+
+// Opens (or creates) the file in append mode
+BinaryLogSink::BinaryLogSink(const std::string& filename) {
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        std::cerr << "Failed to open binary log file: " << filename << std::endl;
+        return;
+    }
+
+    // A new file starts with the magic, every sink starts a new session
+    // because format IDs are only valid inside the process that assigned them
+    struct stat st {};
+    if (::fstat(fd_, &st) == 0 && st.st_size == 0) {
+        buffer_.append(binlog::MAGIC, sizeof(binlog::MAGIC));
+    }
+    buffer_.push_back(static_cast<char>(binlog::TAG_SESSION));
+    flushLocked();
+}
+
+BinaryLogSink::~BinaryLogSink() {
+    if (fd_ >= 0) {
+        flushLocked();
+        ::close(fd_);
+    }
+}
+
+// Assigns a process-wide ID to a static format string
+uint16_t BinaryLogSink::registerFormat(const char* format) {
+    std::lock_guard<std::mutex> lock(formatMutex());
+    auto& formats = formatTable();
+    if (formats.size() >= UINT16_MAX) {
+        FM_THROW("Too many binary log format strings");
+    }
+    formats.emplace_back(format);
+    return static_cast<uint16_t>(formats.size() - 1);
+}
+
+// Same signature as Logger::log, the whole message becomes one string argument
+void BinaryLogSink::log(ErrorSeverity severity, const std::string& message) {
+    static const uint16_t messageFormatId = registerFormat("{}");
+    write(severity, messageFormatId, message);
+}
+
+void BinaryLogSink::flush() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushLocked();
+}
+
+// PRIVATE METHODS
+
+void BinaryLogSink::beginEvent(ErrorSeverity severity, uint16_t formatId, uint8_t argCount) {
+    // Define the format string the first time this file sees its ID
+    if (formatId >= formatWritten_.size()) {
+        formatWritten_.resize(formatId + 1, false);
+    }
+    if (!formatWritten_[formatId]) {
+        std::string format;
+        {
+            std::lock_guard<std::mutex> lock(formatMutex());
+            format = formatTable()[formatId];
+        }
+        buffer_.push_back(static_cast<char>(binlog::TAG_FORMAT));
+        appendRaw(formatId);
+        appendRaw(static_cast<uint16_t>(format.size()));
+        buffer_.append(format);
+        formatWritten_[formatId] = true;
+    }
+
+    const auto now = std::chrono::system_clock::now().time_since_epoch();
+    buffer_.push_back(static_cast<char>(binlog::TAG_EVENT));
+    appendRaw(static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(now).count()));
+    appendRaw(static_cast<uint8_t>(severity));
+    appendRaw(formatId);
+    appendRaw(argCount);
+}
+
+void BinaryLogSink::endEvent(ErrorSeverity severity) {
+    // Errors go out right away so they survive a crash that follows them
+    if (buffer_.size() >= FLUSH_THRESHOLD || severity >= ErrorSeverity::ERROR) {
+        flushLocked();
+    }
+}
+
+// One write() for the whole buffer, retried on partial writes and EINTR
+void BinaryLogSink::flushLocked() {
+    if (fd_ < 0) {
+        buffer_.clear();
+        return;
+    }
+    const char* data = buffer_.data();
+    size_t size = buffer_.size();
+    while (size > 0) {
+        const ssize_t n = ::write(fd_, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+    buffer_.clear();
+}
+
+// =======================
+// BinaryLogReader Implementation
+// =======================
+
+BinaryLogReader::BinaryLogReader(const std::string& filename)
+    : in_(filename, std::ios::in | std::ios::binary) {
+    char magic[sizeof(binlog::MAGIC)] = {};
+    valid_ = in_.read(magic, sizeof(magic)) &&
+             std::memcmp(magic, binlog::MAGIC, sizeof(magic)) == 0;
+}
+
+// Reads the next event, skipping format definitions
+bool BinaryLogReader::next(BinaryLogEvent& event) {
+    if (!valid_) {
+        return false;
+    }
+
+    uint8_t tag = 0;
+    while (readRaw(tag)) {
+        if (tag == binlog::TAG_SESSION) {
+            formats_.clear();
+            continue;
+        }
+
+        if (tag == binlog::TAG_FORMAT) {
+            uint16_t id = 0;
+            uint16_t length = 0;
+            std::string format;
+            if (!readRaw(id) || !readRaw(length) || !readString(format, length)) {
+                return false;
+            }
+            if (id >= formats_.size()) {
+                formats_.resize(id + 1);
+            }
+            formats_[id] = std::move(format);
+            continue;
+        }
+
+        if (tag != binlog::TAG_EVENT) {
+            return false;   // corrupt file, nothing after this point can be trusted
+        }
+
+        uint8_t severity = 0;
+        uint16_t formatId = 0;
+        uint8_t argCount = 0;
+        if (!readRaw(event.timeNs) || !readRaw(severity) || !readRaw(formatId) || !readRaw(argCount)) {
+            return false;
+        }
+        event.severity = static_cast<ErrorSeverity>(severity);
+
+        // Render the arguments first, then substitute them into the format
+        std::vector<std::string> args;
+        args.reserve(argCount);
+        for (uint8_t i = 0; i < argCount; ++i) {
+            uint8_t type = 0;
+            if (!readRaw(type)) {
+                return false;
+            }
+            switch (type) {
+                case binlog::ARG_INT64: {
+                    int64_t value = 0;
+                    if (!readRaw(value)) return false;
+                    args.push_back(std::to_string(value));
+                    break;
+                }
+                case binlog::ARG_UINT64: {
+                    uint64_t value = 0;
+                    if (!readRaw(value)) return false;
+                    args.push_back(std::to_string(value));
+                    break;
+                }
+                case binlog::ARG_DOUBLE: {
+                    double value = 0;
+                    if (!readRaw(value)) return false;
+                    std::ostringstream oss;   // same rendering as the FM_* text macros
+                    oss << value;
+                    args.push_back(oss.str());
+                    break;
+                }
+                case binlog::ARG_STRING: {
+                    uint32_t length = 0;
+                    std::string text;
+                    if (!readRaw(length) || !readString(text, length)) return false;
+                    args.push_back(std::move(text));
+                    break;
+                }
+                default:
+                    return false;
+            }
+        }
+
+        const std::string unknown = "<unknown format " + std::to_string(formatId) + ">";
+        const std::string& format = formatId < formats_.size() ? formats_[formatId] : unknown;
+
+        event.message.clear();
+        size_t nextArg = 0;
+        for (size_t i = 0; i < format.size(); ++i) {
+            if (format[i] == '{' && i + 1 < format.size() && format[i + 1] == '}' && nextArg < args.size()) {
+                event.message += args[nextArg++];
+                ++i;
+            } else {
+                event.message.push_back(format[i]);
+            }
+        }
+        // Arguments without a placeholder are appended so nothing is lost
+        for (; nextArg < args.size(); ++nextArg) {
+            event.message += " " + args[nextArg];
+        }
+        return true;
+    }
+    return false;
+}
+
+// Renders an event the same way the text Logger writes it
+std::string BinaryLogReader::toText(const BinaryLogEvent& event) {
+    const std::time_t seconds = static_cast<std::time_t>(event.timeNs / 1000000000ULL);
+    std::tm tm {};
+    localtime_r(&seconds, &tm);
+    char timestamp[32];
+    std::strftime(timestamp, sizeof(timestamp), "%Y-%m-%d %H:%M:%S", &tm);
+    return std::string("[") + timestamp + "] [" + severityName(event.severity) + "] " + event.message;
+}
+
+bool BinaryLogReader::readString(std::string& text, size_t length) {
+    text.resize(length);
+    return length == 0 || static_cast<bool>(in_.read(&text[0], static_cast<std::streamsize>(length)));
+}
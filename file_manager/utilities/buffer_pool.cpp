@@ -0,0 +1,131 @@
+#include "buffer_pool.hpp"
+#include <cstdint>
+#include <sys/mman.h>
+
+BufferPool::Buffer::Buffer(Buffer&& other) noexcept
+    : pool_(other.pool_),
+      data_(other.data_)
+{
+    other.pool_ = nullptr;
+    other.data_ = nullptr;
+}
+
+BufferPool::Buffer& BufferPool::Buffer::operator=(Buffer&& other) noexcept {
+    if (this != &other) {
+        if (data_) {
+            pool_->release(data_);
+        }
+        pool_ = other.pool_;
+        data_ = other.data_;
+        other.pool_ = nullptr;
+        other.data_ = nullptr;
+    }
+    return *this;
+}
+
+BufferPool::Buffer::~Buffer() {
+    if (data_) {
+        pool_->release(data_);
+    }
+}
+
+BufferPool::BufferPool(size_t bufferSize, size_t maxIdle)
+    : bufferSize_((bufferSize + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE),
+      maxIdle_(maxIdle)
+{
+}
+
+BufferPool::~BufferPool() {
+    for (char* data : idle_) {
+        unmap(data);
+    }
+}
+
+BufferPool::Buffer BufferPool::acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!idle_.empty()) {
+            char* data = idle_.back();
+            idle_.pop_back();
+            return Buffer(this, data);
+        }
+    }
+    char* data = map();
+    return data ? Buffer(this, data) : Buffer();
+}
+
+size_t BufferPool::idleCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return idle_.size();
+}
+
+size_t BufferPool::mappedCount() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return mapped_;
+}
+
+// PRIVATE METHODS
+
+char* BufferPool::map() {
+    bool tryHugetlb;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        tryHugetlb = !hugetlbFailed_;
+    }
+#ifdef MAP_HUGETLB
+    if (tryHugetlb) {
+        void* p = ::mmap(nullptr, bufferSize_, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (p != MAP_FAILED) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ++mapped_;
+            return static_cast<char*>(p);
+        }
+        std::lock_guard<std::mutex> lock(mutex_);
+        hugetlbFailed_ = true;   // ENOMEM with no pages reserved, the usual case
+    }
+#else
+    (void)tryHugetlb;
+#endif
+
+    // Normal pages, over-mapped by a huge page and trimmed to a huge page
+    // boundary so transparent huge pages can back the whole buffer
+    const size_t length = bufferSize_ + HUGE_PAGE_SIZE;
+    void* p = ::mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+        return nullptr;
+    }
+    char* const start = static_cast<char*>(p);
+    const uintptr_t address = reinterpret_cast<uintptr_t>(start);
+    char* const data = start + ((HUGE_PAGE_SIZE - address % HUGE_PAGE_SIZE) % HUGE_PAGE_SIZE);
+    if (data > start) {
+        ::munmap(start, static_cast<size_t>(data - start));
+    }
+    char* const end = data + bufferSize_;
+    if (end < start + length) {
+        ::munmap(end, static_cast<size_t>(start + length - end));
+    }
+#ifdef MADV_HUGEPAGE
+    ::madvise(data, bufferSize_, MADV_HUGEPAGE);
+#endif
+    std::lock_guard<std::mutex> lock(mutex_);
+    ++mapped_;
+    return data;
+}
+
+void BufferPool::release(char* data) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (idle_.size() < maxIdle_) {
+            idle_.push_back(data);
+            return;
+        }
+    }
+    unmap(data);
+}
+
+void BufferPool::unmap(char* data) {
+    ::munmap(data, bufferSize_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    --mapped_;
+}
@@ -49,6 +49,9 @@ ErrorHandler& ErrorHandler::instance() {
     return instance;
 }
 
+// Runtime log level filter, INFO and above by default
+std::atomic<int> ErrorHandler::minimumSeverity_{static_cast<int>(ErrorSeverity::INFO)};
+
 // Private constructor
 ErrorHandler::ErrorHandler() = default;
 ErrorHandler::~ErrorHandler() = default;
@@ -64,12 +67,7 @@ void ErrorHandler::setErrorCallback(ErrorCallback callback) {
 void ErrorHandler::logError(ErrorSeverity severity, const std::string& message) {
     std::lock_guard<std::mutex> lock(mutex_);
 
-    const char* severityStr = "";
-    switch (severity) {
-        case ErrorSeverity::WARNING: severityStr = "WARNING"; break;
-        case ErrorSeverity::ERROR: severityStr = "ERROR"; break;
-        case ErrorSeverity::CRITICAL: severityStr = "CRITICAL"; break;
-    }
+    const char* severityStr = severityName(severity);
 
     // Default logging to stderr
     std::cerr << "[" << severityStr << "] " << message << std::endl;
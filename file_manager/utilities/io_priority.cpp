@@ -0,0 +1,31 @@
+#include "io_priority.hpp"
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// glibc has no wrappers, values from linux/ioprio.h
+static constexpr int IOPRIO_WHO_PROCESS = 1;
+static constexpr int IOPRIO_CLASS_SHIFT = 13;
+
+// With IOPRIO_WHO_PROCESS and who = 0 the calls apply to the calling thread only
+static int ioprioGet() {
+    return static_cast<int>(::syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+}
+
+static bool ioprioSet(int value) {
+    return ::syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, value) == 0;
+}
+
+ScopedIoPriority::ScopedIoPriority(IoPriorityClass priorityClass, int level) {
+    previous_ = ioprioGet();
+    if (previous_ < 0) {
+        return;
+    }
+    const int value = (static_cast<int>(priorityClass) << IOPRIO_CLASS_SHIFT) | (level & 7);
+    applied_ = ioprioSet(value);
+}
+
+ScopedIoPriority::~ScopedIoPriority() {
+    if (applied_) {
+        ioprioSet(previous_);
+    }
+}
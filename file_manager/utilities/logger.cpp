@@ -3,6 +3,97 @@
 #include <iomanip>
 #include <chrono>
 #include <ctime>
+#include <cerrno>
+#include <cstring>
+#include <csignal>
+#include <iterator>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Loggers that asked to be flushed when the process crashes
+static constexpr size_t MAX_CRASH_LOGGERS = 8;
+static std::atomic<Logger*> crashLoggers[MAX_CRASH_LOGGERS];
+
+// Signals the crash handler takes, and what was installed for them before
+static constexpr int CRASH_SIGNALS[] = {SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT};
+static struct sigaction previousActions[std::size(CRASH_SIGNALS)];
+static std::once_flag crashHandlerInstalled;
+
+// The multi-producer single-consumer ring itself
+// Positions only ever grow, slot = position & mask
+struct Logger::Ring {
+    std::unique_ptr<Slot[]> slots;
+    size_t mask = 0;
+    alignas(64) std::atomic<size_t> enqueuePos{0};   // shared by all producers
+    alignas(64) std::atomic<size_t> dequeuePos{0};   // written by the writer thread only
+};
+
+// Label written after the timestamp
+static const char* severityLabel(ErrorSeverity severity) {
+    switch (severity) {
+    case ErrorSeverity::DEBUG:
+        return "[DEBUG] ";
+    case ErrorSeverity::INFO:
+        return "[INFO] ";
+    case ErrorSeverity::WARNING:
+        return "[WARNING] ";
+    case ErrorSeverity::ERROR:
+        return "[ERROR] ";
+    case ErrorSeverity::CRITICAL:
+        return "[CRITICAL] ";
+    }
+    return "";
+}
+
+// Formats "[YYYY-mm-dd HH:MM:SS] " into buffer, returns its length
+// localtime_r is used instead of std::localtime, which shares a static buffer between threads
+static size_t formatTimePrefix(std::time_t time, char* buffer, size_t size) {
+    std::tm tm {};
+    localtime_r(&time, &tm);
+    return std::strftime(buffer, size, "[%Y-%m-%d %H:%M:%S] ", &tm);
+}
+
+// Same as formatTimePrefix for a fixed UTC offset, async-signal-safe:
+// localtime_r and strftime may take the time zone lock and read tz files
+static size_t formatTimePrefixRaw(std::time_t time, long utcOffset, char* buffer) {
+    const int64_t local = static_cast<int64_t>(time) + utcOffset;
+    int64_t days = local / 86400;
+    int64_t seconds = local % 86400;
+    if (seconds < 0) {
+        seconds += 86400;
+        --days;
+    }
+    // Civil date from days since 1970-01-01 (Howard Hinnant's days_from_civil, inverted)
+    days += 719468;
+    const int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    const int64_t dayOfEra = days - era * 146097;
+    const int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+    const int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+    const int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+    const int day = static_cast<int>(dayOfYear - (153 * monthIndex + 2) / 5 + 1);
+    const int month = static_cast<int>(monthIndex < 10 ? monthIndex + 3 : monthIndex - 9);
+    const int year = static_cast<int>(yearOfEra + era * 400 + (month <= 2 ? 1 : 0));
+
+    const auto put = [](char* out, int value, int digits) {
+        for (int i = digits - 1; i >= 0; --i) {
+            out[i] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    };
+    char* out = buffer;
+    *out++ = '[';
+    put(out, year, 4); out += 4; *out++ = '-';
+    put(out, month, 2); out += 2; *out++ = '-';
+    put(out, day, 2); out += 2; *out++ = ' ';
+    put(out, static_cast<int>(seconds / 3600), 2); out += 2; *out++ = ':';
+    put(out, static_cast<int>(seconds / 60 % 60), 2); out += 2; *out++ = ':';
+    put(out, static_cast<int>(seconds % 60), 2); out += 2;
+    *out++ = ']';
+    *out++ = ' ';
+    return static_cast<size_t>(out - buffer);
+}
 
 // Constructor that opens the log file
 Logger::Logger(const std::string& filename)
@@ -14,8 +105,59 @@ Logger::Logger(const std::string& filename)
     }
 }
 
+// Constructor for the asynchronous mode
+// The file is written with plain write() calls, so it is opened with open()
+Logger::Logger(const std::string& filename, const AsyncLogOptions& options)
+    : ring_(std::make_unique<Ring>()), options_(options)
+{
+    fd_ = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        // fallback to stderr, same as the synchronous mode
+        std::cerr << "Failed to open log file: " << filename << std::endl;
+    }
+
+    // Round the capacity up to a power of two so slots can be found with a mask
+    size_t capacity = 2;
+    while (capacity < options_.capacity) {
+        capacity <<= 1;
+    }
+    // The crash path cannot ask the time zone database, a DST switch while
+    // the logger lives shifts its timestamps by an hour
+    const std::time_t now = std::time(nullptr);
+    std::tm tm {};
+    localtime_r(&now, &tm);
+    utcOffset_ = tm.tm_gmtoff;
+
+    ring_->slots = std::make_unique<Slot[]>(capacity);
+    ring_->mask = capacity - 1;
+    for (size_t i = 0; i < capacity; ++i) {
+        ring_->slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+
+    writer_ = std::thread(&Logger::writerLoop, this);
+}
+
 // Destructor closes the file
 Logger::~Logger() {
+    if (ring_) {
+        // unregister from the crash handler before anything is torn down
+        for (auto& slot : crashLoggers) {
+            Logger* expected = this;
+            slot.compare_exchange_strong(expected, nullptr);
+        }
+
+        stop_.store(true);
+        {
+            std::lock_guard<std::mutex> lock(wakeMutex_);
+        }
+        wake_.notify_one();
+        if (writer_.joinable()) {
+            writer_.join();   // the writer drains the ring before it exits
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+        }
+    }
     if (logFile.is_open()) {
         logFile.close();
     }
@@ -23,36 +165,282 @@ Logger::~Logger() {
 
 // Logs the message with time and severity
 void Logger::log(ErrorSeverity severity, const std::string& message) {
-    std::lock_guard<std::mutex> lock(mutex_);
-
-    std::ostringstream logStream;
-
-    // get current time
-    auto now = std::chrono::system_clock::now();
-    auto t = std::chrono::system_clock::to_time_t(now);
-    logStream << "[" << std::put_time(std::localtime(&t), "%Y-%m-%d %H:%M:%S") << "] ";
+    const std::time_t now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
-    // add severity label
-    switch (severity) {
-    case ErrorSeverity::WARNING:
-        logStream << "[WARNING] ";
-        break;
-    case ErrorSeverity::ERROR:
-        logStream << "[ERROR] ";
-        break;
-    case ErrorSeverity::CRITICAL:
-        logStream << "[CRITICAL] ";
-        break;
+    if (ring_) {
+        Record record{now, severity, message};
+        if (tryPush(record)) {
+            return;
+        }
+        if (options_.overflow != OverflowPolicy::BLOCK) {
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        // BLOCK: keep waking the writer until a slot frees up
+        for (int attempt = 0; !tryPush(record); ++attempt) {
+            wake_.notify_one();
+            if (attempt < 16) {
+                std::this_thread::yield();
+            } else {
+                std::this_thread::sleep_for(std::chrono::microseconds(50));
+            }
+        }
+        return;
     }
 
-    // add message and newline
-    logStream << message << std::endl;
+    std::lock_guard<std::mutex> lock(mutex_);
+
+    std::string line;
+    appendRecord(line, now, severity, message);
 
     // write to file or fallback to cerr
     if (logFile.is_open()) {
-        logFile << logStream.str();
+        logFile << line;
         logFile.flush();
     } else {
-        std::cerr << logStream.str();
+        std::cerr << line;
+    }
+}
+
+// Waits until every record logged before this call is in the file
+void Logger::flush() {
+    if (!ring_) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (logFile.is_open()) {
+            logFile.flush();
+        }
+        return;
+    }
+
+    const size_t target = ring_->enqueuePos.load(std::memory_order_acquire);
+    std::unique_lock<std::mutex> lock(wakeMutex_);
+    while (written_.load(std::memory_order_acquire) < target) {
+        wake_.notify_one();
+        flushed_.wait_for(lock, std::chrono::milliseconds(10));
+    }
+}
+
+// Number of records thrown away because the ring buffer was full
+uint64_t Logger::droppedCount() const {
+    return dropped_.load(std::memory_order_relaxed);
+}
+
+// Register this logger with the crash signal handlers
+void Logger::installCrashHandler() {
+    if (!ring_) {
+        return;   // synchronous loggers flush every line already
+    }
+    for (auto& slot : crashLoggers) {
+        Logger* expected = nullptr;
+        if (slot.load() == this || slot.compare_exchange_strong(expected, this)) {
+            break;
+        }
+    }
+
+    // Once per process: a second logger must not save our own handler as the previous one
+    std::call_once(crashHandlerInstalled, [] {
+        struct sigaction action {};
+        action.sa_handler = &Logger::crashSignalHandler;
+        sigemptyset(&action.sa_mask);
+        for (size_t i = 0; i < std::size(CRASH_SIGNALS); ++i) {
+            sigaction(CRASH_SIGNALS[i], &action, &previousActions[i]);
+        }
+    });
+}
+
+// PRIVATE METHODS
+
+// Builds "[YYYY-mm-dd HH:MM:SS] [SEVERITY] message\n"
+void Logger::appendRecord(std::string& out, std::time_t time, ErrorSeverity severity,
+                          const std::string& message) {
+    // reformat the date only when the second changes
+    if (time != cachedSecond_) {
+        cachedPrefixLength_ = formatTimePrefix(time, cachedPrefix_, sizeof(cachedPrefix_));
+        cachedSecond_ = time;
+    }
+    out.append(cachedPrefix_, cachedPrefixLength_);
+    out.append(severityLabel(severity));
+    out.append(message);
+    out.push_back('\n');
+}
+
+// Producer side: claim a position with a CAS, fill the slot, then publish it
+bool Logger::tryPush(Record& record) {
+    Ring& ring = *ring_;
+    size_t pos = ring.enqueuePos.load(std::memory_order_relaxed);
+    Slot* slot = nullptr;
+    while (true) {
+        slot = &ring.slots[pos & ring.mask];
+        const size_t sequence = slot->sequence.load(std::memory_order_acquire);
+        const intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+        if (diff == 0) {
+            if (ring.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            return false;   // full
+        } else {
+            pos = ring.enqueuePos.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->record = std::move(record);
+    slot->sequence.store(pos + 1, std::memory_order_release);
+
+    // Only wake the writer when the ring is filling up, otherwise it
+    // picks the record up on its next flush interval
+    if (writerSleeping_.load(std::memory_order_relaxed) &&
+        pos - ring.dequeuePos.load(std::memory_order_relaxed) > (ring.mask + 1) * 3 / 4) {
+        wake_.notify_one();
+    }
+    return true;
+}
+
+// Consumer side: only the writer thread (or the crash handler) calls this
+bool Logger::tryPop(Record& record) {
+    Ring& ring = *ring_;
+    const size_t pos = ring.dequeuePos.load(std::memory_order_relaxed);
+    Slot& slot = ring.slots[pos & ring.mask];
+    if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+        return false;   // empty, or the producer has not published yet
+    }
+    record = std::move(slot.record);
+    slot.sequence.store(pos + ring.mask + 1, std::memory_order_release);
+    ring.dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    return true;
+}
+
+// Background thread: drain the ring into one buffer and write it in one go
+void Logger::writerLoop() {
+    static constexpr size_t MAX_BATCH = 4096;
+    std::string batch;
+    batch.reserve(64 * 1024);
+    Record record;
+
+    while (true) {
+        // taken so the crash handler never drains at the same time
+        while (draining_.exchange(true, std::memory_order_acquire)) {
+            std::this_thread::yield();
+        }
+
+        size_t count = 0;
+        while (count < MAX_BATCH && tryPop(record)) {
+            appendRecord(batch, record.time, record.severity, record.message);
+            ++count;
+        }
+
+        if (options_.overflow == OverflowPolicy::COUNT) {
+            const uint64_t dropped = dropped_.load(std::memory_order_relaxed);
+            const uint64_t reported = droppedReported_.load(std::memory_order_relaxed);
+            if (dropped != reported) {
+                appendRecord(batch, std::time(nullptr), ErrorSeverity::WARNING,
+                             std::to_string(dropped - reported) + " log messages dropped (buffer full)");
+                droppedReported_.store(dropped, std::memory_order_relaxed);
+            }
+        }
+
+        if (!batch.empty()) {
+            writeAll(batch.data(), batch.size());
+            batch.clear();
+        }
+        written_.store(ring_->dequeuePos.load(std::memory_order_relaxed), std::memory_order_release);
+        draining_.store(false, std::memory_order_release);
+
+        if (count > 0) {
+            flushed_.notify_all();
+            continue;   // more may be waiting, keep draining without sleeping
+        }
+        if (stop_.load()) {
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(wakeMutex_);
+        writerSleeping_.store(true, std::memory_order_relaxed);
+        wake_.wait_for(lock, options_.flushInterval);
+        writerSleeping_.store(false, std::memory_order_relaxed);
+    }
+    flushed_.notify_all();
+}
+
+// write() until everything is out, retrying on partial writes and EINTR
+void Logger::writeAll(const char* data, size_t size) {
+    const int fd = fd_ >= 0 ? fd_ : STDERR_FILENO;
+    while (size > 0) {
+        const ssize_t n = ::write(fd, data, size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;   // nothing sensible left to do, the log itself is failing
+        }
+        data += n;
+        size -= static_cast<size_t>(n);
+    }
+}
+
+// Called from the signal handler: write the queued records without
+// allocating, one writev() per record straight from the ring slots
+void Logger::drainForCrash() {
+    // Wait a little for the writer to finish its batch. If it does not let
+    // go, it is still popping records and draining alongside it would write
+    // records twice or free slots it is reading, so its queue is given up.
+    // The writer itself crashing cannot be waited for, nothing else drains then.
+    const bool writerCrashed = writer_.get_id() == std::this_thread::get_id();
+    bool acquired = false;
+    for (int i = 0; i < 100 && !writerCrashed; ++i) {
+        if (!draining_.exchange(true, std::memory_order_acquire)) {
+            acquired = true;
+            break;
+        }
+        struct timespec pause {0, 1000000};
+        nanosleep(&pause, nullptr);
+    }
+    if (!writerCrashed && !acquired) {
+        return;
+    }
+
+    Ring& ring = *ring_;
+    const int fd = fd_ >= 0 ? fd_ : STDERR_FILENO;
+    while (true) {
+        const size_t pos = ring.dequeuePos.load(std::memory_order_relaxed);
+        Slot& slot = ring.slots[pos & ring.mask];
+        if (slot.sequence.load(std::memory_order_acquire) != pos + 1) {
+            break;
+        }
+        char prefix[32];
+        const size_t prefixLength = formatTimePrefixRaw(slot.record.time, utcOffset_, prefix);
+        const char* label = severityLabel(slot.record.severity);
+        struct iovec parts[4] = {
+            {prefix, prefixLength},
+            {const_cast<char*>(label), std::strlen(label)},
+            {const_cast<char*>(slot.record.message.data()), slot.record.message.size()},
+            {const_cast<char*>("\n"), 1},
+        };
+        ::writev(fd, parts, 4);
+        slot.sequence.store(pos + ring.mask + 1, std::memory_order_release);
+        ring.dequeuePos.store(pos + 1, std::memory_order_relaxed);
+    }
+    ::fsync(fd);
+    if (acquired) {
+        draining_.store(false, std::memory_order_release);   // a previous handler may resume the process
+    }
+}
+
+// Drain every registered logger, then hand the signal to whoever had it before
+void Logger::crashSignalHandler(int signal) {
+    for (auto& slot : crashLoggers) {
+        Logger* logger = slot.load();
+        if (logger) {
+            logger->drainForCrash();
+        }
+    }
+    // The signal is blocked while this runs, so the re-raised one reaches the
+    // restored action (the default one terminates) once this handler returns
+    for (size_t i = 0; i < std::size(CRASH_SIGNALS); ++i) {
+        if (CRASH_SIGNALS[i] == signal) {
+            sigaction(signal, &previousActions[i], nullptr);
+            break;
+        }
     }
+    ::raise(signal);
 }
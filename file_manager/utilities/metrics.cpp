@@ -0,0 +1,348 @@
+#include "metrics.hpp"
+#include <condition_variable>
+#include <cstdio>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+std::atomic<bool> Metrics::enabled_{false};
+
+// Upper limit of distinct operation names
+static constexpr size_t MAX_OPERATIONS = 256;
+
+// Counters of one operation in one thread
+// Only the owning thread writes them, snapshots read them concurrently,
+// so relaxed loads and stores are enough (no read-modify-write needed)
+struct OpCounters {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> errors;
+    std::atomic<uint64_t> bytes;
+    std::atomic<uint64_t> entries;
+    std::atomic<uint64_t> totalNs;
+    std::atomic<uint64_t> buckets[LatencyBuckets::COUNT];
+};
+
+// All counters of one thread, allocated per operation on first use
+struct ThreadShard {
+    std::atomic<OpCounters*> ops[MAX_OPERATIONS];
+};
+
+// Process-wide state
+// Allocated once and never destroyed: threads can still exit (and retire
+// their shard) while static destructors run
+struct MetricsRegistry {
+    std::mutex mutex;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, MetricId> ids;
+    std::vector<ThreadShard*> shards;                   // shards of running threads
+    std::vector<Metrics::OperationStats> retired;       // totals of exited threads
+    std::map<std::string, double> gauges;
+
+    // periodic dump
+    std::thread dumper;
+    std::condition_variable dumpWake;
+    bool dumpStop = false;
+};
+
+static MetricsRegistry& registry() {
+    static MetricsRegistry* instance = new MetricsRegistry();
+    return *instance;
+}
+
+// Adds one thread's counters into a snapshot
+static void addInto(Metrics::OperationStats& stats, const OpCounters& counters) {
+    stats.count += counters.count.load(std::memory_order_relaxed);
+    stats.errors += counters.errors.load(std::memory_order_relaxed);
+    stats.bytes += counters.bytes.load(std::memory_order_relaxed);
+    stats.entries += counters.entries.load(std::memory_order_relaxed);
+    stats.totalNs += counters.totalNs.load(std::memory_order_relaxed);
+    for (unsigned i = 0; i < LatencyBuckets::COUNT; ++i) {
+        stats.buckets[i] += counters.buckets[i].load(std::memory_order_relaxed);
+    }
+}
+
+// Same for the retired totals, which are plain integers
+static void addRetired(Metrics::OperationStats& stats, const Metrics::OperationStats& retired) {
+    stats.count += retired.count;
+    stats.errors += retired.errors;
+    stats.bytes += retired.bytes;
+    stats.entries += retired.entries;
+    stats.totalNs += retired.totalNs;
+    for (unsigned i = 0; i < LatencyBuckets::COUNT; ++i) {
+        stats.buckets[i] += retired.buckets[i];
+    }
+}
+
+// Folds the shard of an exiting thread into the retired totals
+static void retireShard(ThreadShard* shard) {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (size_t id = 0; id < MAX_OPERATIONS; ++id) {
+        OpCounters* counters = shard->ops[id].load(std::memory_order_acquire);
+        if (counters) {
+            if (reg.retired.size() <= id) {
+                reg.retired.resize(id + 1);
+            }
+            addInto(reg.retired[id], *counters);
+            delete counters;
+        }
+    }
+    for (auto it = reg.shards.begin(); it != reg.shards.end(); ++it) {
+        if (*it == shard) {
+            reg.shards.erase(it);
+            break;
+        }
+    }
+    delete shard;
+}
+
+// Owns the shard of the current thread and retires it when the thread exits
+struct ShardOwner {
+    ThreadShard* shard = nullptr;
+    ~ShardOwner() {
+        if (shard) {
+            retireShard(shard);
+        }
+    }
+};
+
+static thread_local ShardOwner shardOwner;
+
+static ThreadShard& localShard() {
+    if (!shardOwner.shard) {
+        shardOwner.shard = new ThreadShard();   // value-initialised: all pointers null
+        MetricsRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.shards.push_back(shardOwner.shard);
+    }
+    return *shardOwner.shard;
+}
+
+// Single writer, so a load + store is enough and much cheaper than fetch_add
+static inline void bump(std::atomic<uint64_t>& counter, uint64_t value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+}
+
+// =======================
+// Metrics Implementation
+// =======================
+
+uint64_t Metrics::OperationStats::percentile(double fraction) const {
+    if (count == 0) {
+        return 0;
+    }
+    const uint64_t target = static_cast<uint64_t>(fraction * static_cast<double>(count) + 0.5);
+    uint64_t seen = 0;
+    for (unsigned i = 0; i < LatencyBuckets::COUNT; ++i) {
+        seen += buckets[i];
+        if (seen >= target && seen > 0) {
+            return LatencyBuckets::upperBound(i);
+        }
+    }
+    return LatencyBuckets::upperBound(LatencyBuckets::COUNT - 1);
+}
+
+MetricId Metrics::registerOperation(const std::string& name) {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    auto it = reg.ids.find(name);
+    if (it != reg.ids.end()) {
+        return it->second;
+    }
+    // Past the limit everything lands on the last ID instead of failing
+    const MetricId id = static_cast<MetricId>(std::min(reg.names.size(), MAX_OPERATIONS - 1));
+    if (reg.names.size() < MAX_OPERATIONS) {
+        reg.names.push_back(name);
+    }
+    reg.ids.emplace(name, id);
+    return id;
+}
+
+void Metrics::record(MetricId id, uint64_t latencyNs, bool failed, uint64_t bytes, uint64_t entries) {
+    if (id >= MAX_OPERATIONS) {
+        return;
+    }
+    ThreadShard& shard = localShard();
+    OpCounters* counters = shard.ops[id].load(std::memory_order_relaxed);
+    if (!counters) {
+        counters = new OpCounters();   // value-initialised: all counters zero
+        shard.ops[id].store(counters, std::memory_order_release);
+    }
+    bump(counters->count, 1);
+    bump(counters->totalNs, latencyNs);
+    bump(counters->buckets[LatencyBuckets::indexOf(latencyNs)], 1);
+    if (failed) {
+        bump(counters->errors, 1);
+    }
+    if (bytes) {
+        bump(counters->bytes, bytes);
+    }
+    if (entries) {
+        bump(counters->entries, entries);
+    }
+}
+
+void Metrics::setGauge(const std::string& name, double value) {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.gauges[name] = value;
+}
+
+std::vector<Metrics::OperationStats> Metrics::snapshot() {
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+
+    std::vector<OperationStats> stats(reg.names.size());
+    for (size_t id = 0; id < stats.size(); ++id) {
+        stats[id].name = reg.names[id];
+        if (id < reg.retired.size()) {
+            addRetired(stats[id], reg.retired[id]);
+        }
+    }
+    for (ThreadShard* shard : reg.shards) {
+        for (size_t id = 0; id < stats.size(); ++id) {
+            OpCounters* counters = shard->ops[id].load(std::memory_order_acquire);
+            if (counters) {
+                addInto(stats[id], *counters);
+            }
+        }
+    }
+    return stats;
+}
+
+// Escape a label value for the Prometheus text format
+static std::string escapeLabel(const std::string& value) {
+    std::string escaped;
+    for (char c : value) {
+        if (c == '\\' || c == '"') {
+            escaped.push_back('\\');
+            escaped.push_back(c);
+        } else if (c == '\n') {
+            escaped += "\\n";
+        } else {
+            escaped.push_back(c);
+        }
+    }
+    return escaped;
+}
+
+std::string Metrics::toPrometheus(const std::vector<OperationStats>& stats) {
+    // Prometheus buckets are coarser than ours, one per decade from 1us to 10s
+    static const uint64_t bucketBoundsNs[] = {
+        1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL, 10000000000ULL
+    };
+    static const char* bucketLabels[] = {"1e-06", "1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10"};
+
+    std::ostringstream out;
+    out << "# HELP fm_operation_duration_seconds Latency of file manager operations\n"
+        << "# TYPE fm_operation_duration_seconds histogram\n";
+    for (const auto& op : stats) {
+        if (op.count == 0) {
+            continue;
+        }
+        const std::string label = "op=\"" + escapeLabel(op.name) + "\"";
+        unsigned hdrIndex = 0;
+        uint64_t cumulative = 0;
+        for (size_t b = 0; b < sizeof(bucketBoundsNs) / sizeof(bucketBoundsNs[0]); ++b) {
+            while (hdrIndex < LatencyBuckets::COUNT && LatencyBuckets::upperBound(hdrIndex) <= bucketBoundsNs[b]) {
+                cumulative += op.buckets[hdrIndex++];
+            }
+            out << "fm_operation_duration_seconds_bucket{" << label << ",le=\"" << bucketLabels[b] << "\"} "
+                << cumulative << "\n";
+        }
+        out << "fm_operation_duration_seconds_bucket{" << label << ",le=\"+Inf\"} " << op.count << "\n"
+            << "fm_operation_duration_seconds_sum{" << label << "} " << static_cast<double>(op.totalNs) / 1e9 << "\n"
+            << "fm_operation_duration_seconds_count{" << label << "} " << op.count << "\n";
+    }
+
+    out << "# HELP fm_operation_latency_seconds Latency percentiles from the full resolution histogram\n"
+        << "# TYPE fm_operation_latency_seconds gauge\n";
+    for (const auto& op : stats) {
+        if (op.count == 0) {
+            continue;
+        }
+        for (double quantile : {0.5, 0.9, 0.99, 0.999}) {
+            out << "fm_operation_latency_seconds{op=\"" << escapeLabel(op.name) << "\",quantile=\"" << quantile
+                << "\"} " << static_cast<double>(op.percentile(quantile)) / 1e9 << "\n";
+        }
+    }
+
+    const struct { const char* name; const char* help; uint64_t Metrics::OperationStats::*field; } counters[] = {
+        {"fm_operation_errors_total", "Failed calls", &OperationStats::errors},
+        {"fm_operation_bytes_total", "Bytes read, written or moved", &OperationStats::bytes},
+        {"fm_operation_entries_total", "Directory entries visited", &OperationStats::entries},
+    };
+    for (const auto& counter : counters) {
+        out << "# HELP " << counter.name << " " << counter.help << "\n"
+            << "# TYPE " << counter.name << " counter\n";
+        for (const auto& op : stats) {
+            if (op.count != 0) {
+                out << counter.name << "{op=\"" << escapeLabel(op.name) << "\"} " << op.*counter.field << "\n";
+            }
+        }
+    }
+
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (!reg.gauges.empty()) {
+        out << "# HELP fm_gauge Values reported by subsystems\n"
+            << "# TYPE fm_gauge gauge\n";
+        for (const auto& [name, value] : reg.gauges) {
+            out << "fm_gauge{name=\"" << escapeLabel(name) << "\"} " << value << "\n";
+        }
+    }
+    return out.str();
+}
+
+bool Metrics::writePrometheus(const std::string& path) {
+    const std::string temporary = path + ".tmp";
+    {
+        std::ofstream out(temporary, std::ios::out | std::ios::trunc);
+        if (!out) {
+            return false;
+        }
+        out << toPrometheus(snapshot());
+        if (!out) {
+            return false;
+        }
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
+
+void Metrics::startPeriodicDump(const std::string& path, std::chrono::milliseconds interval) {
+    stopPeriodicDump();
+    MetricsRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    reg.dumpStop = false;
+    reg.dumper = std::thread([path, interval] {
+        MetricsRegistry& r = registry();
+        while (true) {
+            {
+                std::unique_lock<std::mutex> wait(r.mutex);
+                if (r.dumpWake.wait_for(wait, interval, [&r] { return r.dumpStop; })) {
+                    break;
+                }
+            }
+            writePrometheus(path);
+        }
+        writePrometheus(path);   // final values on shutdown
+    });
+}
+
+void Metrics::stopPeriodicDump() {
+    MetricsRegistry& reg = registry();
+    std::thread dumper;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.dumpStop = true;
+        dumper = std::move(reg.dumper);
+    }
+    reg.dumpWake.notify_all();
+    if (dumper.joinable()) {
+        dumper.join();
+    }
+}
@@ -0,0 +1,187 @@
+#include "rate_limiter.hpp"
+#include "metrics.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+static double secondsOf(RateLimiter::Clock::duration duration) {
+    return std::chrono::duration<double>(duration).count();
+}
+
+RateLimiter::RateLimiter(std::string name, RateLimits limits)
+    : name_(std::move(name)),
+      refilled_(Clock::now()),
+      windowStart_(refilled_)
+{
+    setLimits(limits);
+}
+
+RateLimits RateLimiter::limitsFromEnvironment() {
+    RateLimits limits;
+    if (const char* megabytes = std::getenv("FM_IO_MAX_MBPS")) {
+        limits.bytesPerSecond = static_cast<uint64_t>(std::strtod(megabytes, nullptr) * 1024 * 1024);
+    }
+    if (const char* ops = std::getenv("FM_IO_MAX_OPS")) {
+        limits.opsPerSecond = std::strtoull(ops, nullptr, 10);
+    }
+    if (const char* idle = std::getenv("FM_IO_IDLE")) {
+        limits.idleIo = std::strcmp(idle, "1") == 0;
+    }
+    return limits;
+}
+
+std::shared_ptr<RateLimiter> RateLimiter::background() {
+    static const std::shared_ptr<RateLimiter> limiter =
+        std::make_shared<RateLimiter>("background", limitsFromEnvironment());
+    return limiter;
+}
+
+void RateLimiter::setLimits(const RateLimits& limits) {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        refill(Clock::now());   // the time so far at the old rates
+        bytes_.rate = limits.bytesPerSecond;
+        ops_.rate = limits.opsPerSecond;
+        idleIo_ = limits.idleIo;
+        // Debt stays, it is paid off at the new rate; credit above the new burst goes
+        bytes_.refill(0);
+        ops_.refill(0);
+        ++generation_;
+    }
+    changed_.notify_all();
+    if (Metrics::isEnabled()) {
+        Metrics::setGauge("rate_limiter." + name_ + ".bytes_limit", static_cast<double>(limits.bytesPerSecond));
+        Metrics::setGauge("rate_limiter." + name_ + ".ops_limit", static_cast<double>(limits.opsPerSecond));
+    }
+}
+
+RateLimits RateLimiter::limits() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    RateLimits limits;
+    limits.bytesPerSecond = bytes_.rate;
+    limits.opsPerSecond = ops_.rate;
+    limits.idleIo = idleIo_;
+    return limits;
+}
+
+bool RateLimiter::acquire(uint64_t bytes, uint64_t ops, const std::function<bool()>& stop) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    Clock::time_point now = Clock::now();
+    for (;;) {
+        if (stop && stop()) {
+            return false;
+        }
+        refill(now);
+        const double debt = std::max(bytes_.debtSeconds(), ops_.debtSeconds());
+        if (debt <= 0) {
+            break;
+        }
+        const uint64_t generation = generation_;
+        const Clock::time_point until = now + std::chrono::duration_cast<Clock::duration>(
+                                                  std::chrono::duration<double>(debt));
+        changed_.wait_until(lock, until, [&] { return generation_ != generation; });
+        const Clock::time_point woke = Clock::now();
+        waited_ += woke - now;
+        now = woke;
+    }
+
+    bytes_.charge(bytes);
+    ops_.charge(ops);
+    totalBytes_ += bytes;
+    totalOps_ += ops;
+    windowBytes_ += bytes;
+    windowOps_ += ops;
+    measure(now);
+    return true;
+}
+
+void RateLimiter::wake() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++generation_;
+    }
+    changed_.notify_all();
+}
+
+double RateLimiter::bytesRate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rateOf(bytesRate_, windowBytes_, Clock::now());
+}
+
+double RateLimiter::opsRate() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return rateOf(opsRate_, windowOps_, Clock::now());
+}
+
+uint64_t RateLimiter::totalBytes() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totalBytes_;
+}
+
+uint64_t RateLimiter::totalOps() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return totalOps_;
+}
+
+RateLimiter::Clock::duration RateLimiter::totalWait() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return waited_;
+}
+
+// PRIVATE METHODS
+
+void RateLimiter::Bucket::refill(double seconds) {
+    if (rate == 0) {
+        tokens = 0;   // unlimited: no credit, no debt
+        return;
+    }
+    const double capacity = static_cast<double>(rate) * secondsOf(BURST);
+    tokens = std::min(tokens + static_cast<double>(rate) * seconds, capacity);
+}
+
+void RateLimiter::Bucket::charge(uint64_t amount) {
+    if (rate != 0) {
+        tokens -= static_cast<double>(amount);
+    }
+}
+
+double RateLimiter::Bucket::debtSeconds() const {
+    return tokens < 0 ? -tokens / static_cast<double>(rate) : 0;
+}
+
+void RateLimiter::refill(Clock::time_point now) {
+    if (now <= refilled_) {
+        return;
+    }
+    const double seconds = secondsOf(now - refilled_);
+    refilled_ = now;
+    bytes_.refill(seconds);
+    ops_.refill(seconds);
+}
+
+void RateLimiter::measure(Clock::time_point now) {
+    if (now - windowStart_ < MEASURE_INTERVAL) {
+        return;
+    }
+    const double seconds = secondsOf(now - windowStart_);
+    bytesRate_ = static_cast<double>(windowBytes_) / seconds;
+    opsRate_ = static_cast<double>(windowOps_) / seconds;
+    windowStart_ = now;
+    windowBytes_ = 0;
+    windowOps_ = 0;
+    if (Metrics::isEnabled()) {
+        Metrics::setGauge("rate_limiter." + name_ + ".bytes_per_second", bytesRate_);
+        Metrics::setGauge("rate_limiter." + name_ + ".ops_per_second", opsRate_);
+        Metrics::setGauge("rate_limiter." + name_ + ".bytes_limit", static_cast<double>(bytes_.rate));
+        Metrics::setGauge("rate_limiter." + name_ + ".ops_limit", static_cast<double>(ops_.rate));
+    }
+}
+
+// The last full interval, unless the current one is already longer (nothing
+// was charged for a while) and tells more
+double RateLimiter::rateOf(double current, uint64_t window, Clock::time_point now) const {
+    if (now - windowStart_ < MEASURE_INTERVAL) {
+        return current;
+    }
+    return static_cast<double>(window) / secondsOf(now - windowStart_);
+}
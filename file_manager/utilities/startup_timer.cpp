@@ -0,0 +1,86 @@
+#include "startup_timer.hpp"
+#include "metrics.hpp"
+#include <cstdio>
+#include <ctime>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+std::chrono::steady_clock::time_point StartupTimer::start_ = std::chrono::steady_clock::now();
+double StartupTimer::beforeMainMs_ = -1;
+std::vector<std::pair<std::string, double>> StartupTimer::milestones_;
+
+// Process age in milliseconds: field 22 of /proc/self/stat is the start
+// time in clock ticks since boot, compared against CLOCK_BOOTTIME
+static double processAgeMs() {
+    std::ifstream file("/proc/self/stat");
+    std::string stat;
+    if (!std::getline(file, stat)) {
+        return -1;
+    }
+    // The command name (field 2) may contain spaces, count fields after its ')'
+    const size_t close = stat.rfind(')');
+    if (close == std::string::npos) {
+        return -1;
+    }
+    std::istringstream fields(stat.substr(close + 2));
+    std::string field;
+    unsigned long long startTicks = 0;
+    for (int index = 3; fields >> field; ++index) {
+        if (index == 22) {
+            startTicks = std::stoull(field);
+            break;
+        }
+    }
+    const long ticksPerSecond = ::sysconf(_SC_CLK_TCK);
+    struct timespec now {};
+    if (startTicks == 0 || ticksPerSecond <= 0 || ::clock_gettime(CLOCK_BOOTTIME, &now) != 0) {
+        return -1;
+    }
+    const double nowMs = static_cast<double>(now.tv_sec) * 1000.0 + static_cast<double>(now.tv_nsec) / 1e6;
+    return nowMs - static_cast<double>(startTicks) * 1000.0 / static_cast<double>(ticksPerSecond);
+}
+
+void StartupTimer::begin() {
+    start_ = std::chrono::steady_clock::now();
+    beforeMainMs_ = processAgeMs();
+    milestones_.clear();
+}
+
+void StartupTimer::mark(const std::string& name) {
+    if (milestone(name) >= 0) {
+        return;
+    }
+    const double ms = elapsedMs();
+    milestones_.emplace_back(name, ms);
+    if (Metrics::isEnabled()) {
+        Metrics::setGauge("startup." + name + "_ms", ms);
+    }
+}
+
+double StartupTimer::milestone(const std::string& name) {
+    for (const auto& [milestoneName, ms] : milestones_) {
+        if (milestoneName == name) {
+            return ms;
+        }
+    }
+    return -1;
+}
+
+double StartupTimer::elapsedMs() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_).count();
+}
+
+std::string StartupTimer::summary() {
+    std::string text;
+    char buffer[64];
+    for (const auto& [name, ms] : milestones_) {
+        std::snprintf(buffer, sizeof(buffer), "%.1f ms", ms);
+        text += (text.empty() ? "" : ", ") + name + " " + buffer;
+    }
+    if (beforeMainMs_ >= 0) {
+        std::snprintf(buffer, sizeof(buffer), " (+%.0f ms before main)", beforeMainMs_);
+        text += buffer;
+    }
+    return text;
+}
@@ -0,0 +1,213 @@
+#include "tracer.hpp"
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+std::atomic<bool> Tracer::enabled_{false};
+
+// One finished span
+struct TraceEvent {
+    const char* category;
+    const char* name;
+    int64_t startNs;
+    int64_t durationNs;
+    std::string detail;
+};
+
+// Spans of one thread
+// The mutex is only contended while a trace file is being written
+struct ThreadTraceBuffer {
+    std::mutex mutex;
+    std::vector<TraceEvent> events;
+    std::string name;
+    long tid = 0;
+    uint64_t dropped = 0;
+};
+
+// Process-wide state, never destroyed (threads may record during exit)
+struct TraceRegistry {
+    std::mutex mutex;
+    std::vector<std::shared_ptr<ThreadTraceBuffer>> buffers;
+    std::string path;
+    std::chrono::steady_clock::time_point origin = std::chrono::steady_clock::now();
+};
+
+static TraceRegistry& registry() {
+    static TraceRegistry* instance = new TraceRegistry();
+    return *instance;
+}
+
+// The registry keeps the buffer alive after the thread exits
+static thread_local std::shared_ptr<ThreadTraceBuffer> localBuffer;
+
+static ThreadTraceBuffer& threadBuffer() {
+    if (!localBuffer) {
+        localBuffer = std::make_shared<ThreadTraceBuffer>();
+        localBuffer->tid = static_cast<long>(::syscall(SYS_gettid));
+        TraceRegistry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.buffers.push_back(localBuffer);
+    }
+    return *localBuffer;
+}
+
+// Escape a string for a JSON string literal
+static void writeJsonString(std::ostream& out, const std::string& text) {
+    out << '"';
+    for (unsigned char c : text) {
+        switch (c) {
+            case '"': out << "\\\""; break;
+            case '\\': out << "\\\\"; break;
+            case '\n': out << "\\n"; break;
+            case '\t': out << "\\t"; break;
+            default:
+                if (c < 0x20) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out << escaped;
+                } else {
+                    out << static_cast<char>(c);
+                }
+        }
+    }
+    out << '"';
+}
+
+// =======================
+// Tracer Implementation
+// =======================
+
+void Tracer::start(const std::string& path) {
+    TraceRegistry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.path = path;
+        reg.origin = std::chrono::steady_clock::now();
+    }
+    enabled_.store(true, std::memory_order_relaxed);
+}
+
+bool Tracer::stop() {
+    enabled_.store(false, std::memory_order_relaxed);
+    TraceRegistry& reg = registry();
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        path = reg.path;
+    }
+    const bool written = path.empty() || writeJson(path);
+
+    // Clear everything, and forget the buffers of threads that have exited
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    for (auto it = reg.buffers.begin(); it != reg.buffers.end();) {
+        {
+            std::lock_guard<std::mutex> bufferLock((*it)->mutex);
+            (*it)->events.clear();
+            (*it)->dropped = 0;
+        }
+        if (it->use_count() == 1) {
+            it = reg.buffers.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    reg.path.clear();
+    return written;
+}
+
+void Tracer::setThreadName(const std::string& name) {
+    ThreadTraceBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    buffer.name = name;
+}
+
+void Tracer::record(const char* category, const char* name,
+                    std::chrono::steady_clock::time_point start,
+                    std::chrono::steady_clock::time_point end,
+                    std::string detail) {
+    ThreadTraceBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(buffer.mutex);
+    if (buffer.events.size() >= MAX_EVENTS_PER_THREAD) {
+        ++buffer.dropped;
+        return;
+    }
+    buffer.events.push_back({
+        category,
+        name,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start.time_since_epoch()).count(),
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count(),
+        std::move(detail)
+    });
+}
+
+uint64_t Tracer::droppedCount() {
+    TraceRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    uint64_t dropped = 0;
+    for (const auto& buffer : reg.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        dropped += buffer->dropped;
+    }
+    return dropped;
+}
+
+// Trace-event format: one "X" (complete) event per span, timestamps in
+// microseconds since start(), plus "M" metadata events for thread names
+bool Tracer::writeJson(const std::string& path) {
+    const std::string temporary = path + ".tmp";
+    std::ofstream out(temporary, std::ios::out | std::ios::trunc);
+    if (!out) {
+        return false;
+    }
+
+    TraceRegistry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    const int64_t originNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        reg.origin.time_since_epoch()).count();
+    const long pid = static_cast<long>(::getpid());
+
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    char number[64];
+    for (const auto& buffer : reg.buffers) {
+        std::lock_guard<std::mutex> bufferLock(buffer->mutex);
+        if (!buffer->name.empty()) {
+            out << (first ? "" : ",\n")
+                << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":" << pid << ",\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":";
+            writeJsonString(out, buffer->name);
+            out << "}}";
+            first = false;
+        }
+        for (const auto& event : buffer->events) {
+            if (event.startNs < originNs) {
+                continue;   // started before tracing was switched on
+            }
+            out << (first ? "" : ",\n") << "{\"name\":";
+            writeJsonString(out, event.name);
+            out << ",\"cat\":";
+            writeJsonString(out, event.category);
+            std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.startNs - originNs) / 1000.0);
+            out << ",\"ph\":\"X\",\"ts\":" << number;
+            std::snprintf(number, sizeof(number), "%.3f", static_cast<double>(event.durationNs) / 1000.0);
+            out << ",\"dur\":" << number << ",\"pid\":" << pid << ",\"tid\":" << buffer->tid;
+            if (!event.detail.empty()) {
+                out << ",\"args\":{\"detail\":";
+                writeJsonString(out, event.detail);
+                out << "}";
+            }
+            out << "}";
+            first = false;
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out) {
+        return false;
+    }
+    return std::rename(temporary.c_str(), path.c_str()) == 0;
+}
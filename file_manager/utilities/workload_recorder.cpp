@@ -0,0 +1,288 @@
+#include "workload_recorder.hpp"
+#include <cstring>
+#include <filesystem>
+#include <iostream>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+std::atomic<bool> WorkloadRecorder::enabled_{false};
+
+// Buffered bytes that trigger a write on their own
+static constexpr size_t FLUSH_THRESHOLD = 64 * 1024;
+
+// Recording state, every record goes through one mutex: recording is a
+// diagnostic mode and the encoded record is only a few bytes
+struct RecorderState {
+    std::mutex mutex;
+    std::ofstream out;
+    std::string buffer;
+    std::unordered_map<std::string, uint64_t> stringIds;
+    std::unordered_map<std::thread::id, uint32_t> threadIds;
+    std::chrono::steady_clock::time_point origin;
+    uint64_t lastStartNs = 0;
+};
+
+static RecorderState& state() {
+    static RecorderState* instance = new RecorderState();
+    return *instance;
+}
+
+// Calls in progress on this thread, only the outermost one is recorded
+static thread_local int scopeDepth = 0;
+
+static void appendVarint(std::string& buffer, uint64_t value) {
+    while (value >= 0x80) {
+        buffer.push_back(static_cast<char>((value & 0x7F) | 0x80));
+        value >>= 7;
+    }
+    buffer.push_back(static_cast<char>(value));
+}
+
+// Start times of different threads can go backwards, so deltas are signed
+static uint64_t zigzag(int64_t value) {
+    return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value) {
+    return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static void flushLocked(RecorderState& s) {
+    s.out.write(s.buffer.data(), static_cast<std::streamsize>(s.buffer.size()));
+    s.buffer.clear();
+}
+
+const char* workloadOpName(WorkloadOp op) {
+    switch (op) {
+        case WorkloadOp::EXISTS: return "exists";
+        case WorkloadOp::IS_DIRECTORY: return "isDirectory";
+        case WorkloadOp::IS_FILE: return "isFile";
+        case WorkloadOp::LIST_DIRECTORY: return "listDirectory";
+        case WorkloadOp::CREATE_DIRECTORY: return "createDirectory";
+        case WorkloadOp::REMOVE: return "remove";
+        case WorkloadOp::COPY: return "copy";
+        case WorkloadOp::MOVE: return "move";
+        case WorkloadOp::FILE_SIZE: return "fileSize";
+        case WorkloadOp::LAST_WRITE_TIME: return "lastWriteTime";
+        case WorkloadOp::READ_FILE: return "readFile";
+        case WorkloadOp::WRITE_FILE: return "writeFile";
+        case WorkloadOp::PLUGIN: return "plugin";
+        default: return "unknown";
+    }
+}
+
+// =======================
+// WorkloadRecorder Implementation
+// =======================
+
+bool WorkloadRecorder::start(const std::string& path) {
+    stop();
+    RecorderState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    s.out.open(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if (!s.out) {
+        std::cerr << "Failed to open workload trace file: " << path << std::endl;
+        return false;
+    }
+    s.buffer.assign(workload::MAGIC, sizeof(workload::MAGIC));
+    std::error_code ec;
+    const std::string cwd = std::filesystem::current_path(ec).string();
+    s.buffer.push_back(static_cast<char>(workload::TAG_CWD));
+    appendVarint(s.buffer, cwd.size());
+    s.buffer.append(cwd);
+    s.stringIds.clear();
+    s.threadIds.clear();
+    s.origin = std::chrono::steady_clock::now();
+    s.lastStartNs = 0;
+    enabled_.store(true, std::memory_order_relaxed);
+    return true;
+}
+
+void WorkloadRecorder::stop() {
+    enabled_.store(false, std::memory_order_relaxed);
+    RecorderState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (s.out.is_open()) {
+        flushLocked(s);
+        s.out.close();
+    }
+}
+
+void WorkloadRecorder::record(WorkloadRecord& record, std::chrono::steady_clock::time_point start) {
+    RecorderState& s = state();
+    std::lock_guard<std::mutex> lock(s.mutex);
+    if (!s.out.is_open()) {
+        return;   // stopped while the call was running
+    }
+
+    // Define strings the first time they are used
+    if (record.args.size() > UINT8_MAX) {
+        record.args.resize(UINT8_MAX);
+    }
+    std::vector<uint64_t> argIds;
+    argIds.reserve(record.args.size());
+    for (const auto& arg : record.args) {
+        auto [it, inserted] = s.stringIds.emplace(arg, s.stringIds.size());
+        if (inserted) {
+            s.buffer.push_back(static_cast<char>(workload::TAG_PATH));
+            appendVarint(s.buffer, it->second);
+            appendVarint(s.buffer, arg.size());
+            s.buffer.append(arg);
+        }
+        argIds.push_back(it->second);
+    }
+
+    const uint32_t thread = s.threadIds.emplace(std::this_thread::get_id(),
+                                                static_cast<uint32_t>(s.threadIds.size())).first->second;
+    const uint64_t startNs = start > s.origin ? static_cast<uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(start - s.origin).count()) : 0;
+
+    s.buffer.push_back(static_cast<char>(workload::TAG_OP));
+    s.buffer.push_back(static_cast<char>(record.op));
+    appendVarint(s.buffer, thread);
+    appendVarint(s.buffer, zigzag(static_cast<int64_t>(startNs) - static_cast<int64_t>(s.lastStartNs)));
+    appendVarint(s.buffer, record.latencyNs);
+    appendVarint(s.buffer, static_cast<uint64_t>(record.result));
+    appendVarint(s.buffer, record.size);
+    s.buffer.push_back(static_cast<char>(record.flags));
+    s.buffer.push_back(static_cast<char>(argIds.size()));
+    for (uint64_t id : argIds) {
+        appendVarint(s.buffer, id);
+    }
+    s.lastStartNs = startNs;
+
+    if (s.buffer.size() >= FLUSH_THRESHOLD) {
+        flushLocked(s);
+    }
+}
+
+// =======================
+// WorkloadScope Implementation
+// =======================
+
+void WorkloadScope::begin(WorkloadOp op) {
+    active_ = scopeDepth++ == 0;
+    if (active_) {
+        record_.op = op;
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+void WorkloadScope::end() {
+    --scopeDepth;
+    if (active_) {
+        record_.latencyNs = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - start_).count());
+        WorkloadRecorder::record(record_, start_);
+    }
+}
+
+bool WorkloadScope::insideRecordedCall() {
+    return scopeDepth > 0;
+}
+
+WorkloadScope::Nested::Nested(bool nested) : nested_(nested) {
+    if (nested_) {
+        ++scopeDepth;
+    }
+}
+
+WorkloadScope::Nested::~Nested() {
+    if (nested_) {
+        --scopeDepth;
+    }
+}
+
+// =======================
+// WorkloadTraceReader Implementation
+// =======================
+
+WorkloadTraceReader::WorkloadTraceReader(const std::string& path)
+    : in_(path, std::ios::in | std::ios::binary) {
+    char magic[sizeof(workload::MAGIC)] = {};
+    valid_ = in_.read(magic, sizeof(magic)) &&
+             std::memcmp(magic, workload::MAGIC, sizeof(magic)) == 0;
+}
+
+bool WorkloadTraceReader::next(WorkloadRecord& record) {
+    if (!valid_) {
+        return false;
+    }
+
+    char tag = 0;
+    while (in_.get(tag)) {
+        if (tag == workload::TAG_PATH) {
+            uint64_t id = 0;
+            uint64_t length = 0;
+            if (!readVarint(id) || !readVarint(length) || length > (1u << 20)) {
+                return false;
+            }
+            std::string text(length, '\0');
+            if (length && !in_.read(&text[0], static_cast<std::streamsize>(length))) {
+                return false;
+            }
+            if (id >= strings_.size()) {
+                strings_.resize(id + 1);
+            }
+            strings_[id] = std::move(text);
+            continue;
+        }
+
+        if (tag == workload::TAG_CWD) {
+            uint64_t length = 0;
+            if (!readVarint(length) || length > (1u << 20)) {
+                return false;
+            }
+            workingDirectory_.assign(length, '\0');
+            if (length && !in_.read(&workingDirectory_[0], static_cast<std::streamsize>(length))) {
+                return false;
+            }
+            continue;
+        }
+
+        if (tag != workload::TAG_OP) {
+            return false;   // corrupt file
+        }
+
+        char op = 0;
+        char flags = 0;
+        char argc = 0;
+        uint64_t thread = 0, delta = 0, result = 0;
+        if (!in_.get(op) || !readVarint(thread) || !readVarint(delta) || !readVarint(record.latencyNs) ||
+            !readVarint(result) || !readVarint(record.size) || !in_.get(flags) || !in_.get(argc)) {
+            return false;
+        }
+        record.op = static_cast<WorkloadOp>(op);
+        record.thread = static_cast<uint32_t>(thread);
+        lastStartNs_ = static_cast<uint64_t>(static_cast<int64_t>(lastStartNs_) + unzigzag(delta));
+        record.startNs = lastStartNs_;
+        record.result = static_cast<int>(result);
+        record.flags = static_cast<uint8_t>(flags);
+        record.args.clear();
+        for (int i = 0; i < static_cast<unsigned char>(argc); ++i) {
+            uint64_t id = 0;
+            if (!readVarint(id)) {
+                return false;
+            }
+            record.args.push_back(id < strings_.size() ? strings_[id] : std::string());
+        }
+        return true;
+    }
+    return false;
+}
+
+bool WorkloadTraceReader::readVarint(uint64_t& value) {
+    value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        char byte = 0;
+        if (!in_.get(byte)) {
+            return false;
+        }
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,141 @@
+#include "xxhash64.hpp"
+#include <algorithm>
+#include <cstring>
+
+static constexpr uint64_t PRIME1 = 0x9E3779B185EBCA87ULL;
+static constexpr uint64_t PRIME2 = 0xC2B2AE3D27D4EB4FULL;
+static constexpr uint64_t PRIME3 = 0x165667B19E3779F9ULL;
+static constexpr uint64_t PRIME4 = 0x85EBCA77C2B2AE63ULL;
+static constexpr uint64_t PRIME5 = 0x27D4EB2F165667C5ULL;
+
+static inline uint64_t rotl(uint64_t value, int bits) {
+    return (value << bits) | (value >> (64 - bits));
+}
+
+// Little-endian loads; memcpy compiles to a plain load on x86 and arm64
+static inline uint64_t read64(const unsigned char* p) {
+    uint64_t value;
+    std::memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap64(value);
+#endif
+    return value;
+}
+
+static inline uint32_t read32(const unsigned char* p) {
+    uint32_t value;
+    std::memcpy(&value, p, sizeof(value));
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    value = __builtin_bswap32(value);
+#endif
+    return value;
+}
+
+static inline uint64_t round(uint64_t accumulator, uint64_t input) {
+    accumulator += input * PRIME2;
+    accumulator = rotl(accumulator, 31);
+    return accumulator * PRIME1;
+}
+
+static inline uint64_t mergeRound(uint64_t hash, uint64_t accumulator) {
+    hash ^= round(0, accumulator);
+    return hash * PRIME1 + PRIME4;
+}
+
+// One 32-byte stripe into the four lanes
+static inline void consumeStripe(uint64_t* lanes, const unsigned char* p) {
+    lanes[0] = round(lanes[0], read64(p));
+    lanes[1] = round(lanes[1], read64(p + 8));
+    lanes[2] = round(lanes[2], read64(p + 16));
+    lanes[3] = round(lanes[3], read64(p + 24));
+}
+
+void Xxh64::reset(uint64_t seed) {
+    seed_ = seed;
+    accumulators_[0] = seed + PRIME1 + PRIME2;
+    accumulators_[1] = seed + PRIME2;
+    accumulators_[2] = seed;
+    accumulators_[3] = seed - PRIME1;
+    totalLength_ = 0;
+    pendingSize_ = 0;
+}
+
+void Xxh64::update(const void* data, size_t size) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    totalLength_ += size;
+
+    if (pendingSize_ > 0) {
+        const size_t take = std::min(size, sizeof(pending_) - pendingSize_);
+        std::memcpy(pending_ + pendingSize_, p, take);
+        pendingSize_ += take;
+        p += take;
+        size -= take;
+        if (pendingSize_ < sizeof(pending_)) {
+            return;
+        }
+        consumeStripe(accumulators_, pending_);
+        pendingSize_ = 0;
+    }
+
+    // Whole stripes straight from the input, the lanes kept in registers
+    if (size >= 32) {
+        uint64_t lanes[4] = {accumulators_[0], accumulators_[1], accumulators_[2], accumulators_[3]};
+        const unsigned char* const last = p + size - 32;
+        do {
+            consumeStripe(lanes, p);
+            p += 32;
+        } while (p <= last);
+        size = static_cast<size_t>(last + 32 - p);
+        std::memcpy(accumulators_, lanes, sizeof(lanes));
+    }
+
+    if (size > 0) {
+        std::memcpy(pending_, p, size);
+        pendingSize_ = size;
+    }
+}
+
+uint64_t Xxh64::digest() const {
+    uint64_t hash;
+    if (totalLength_ >= 32) {
+        hash = rotl(accumulators_[0], 1) + rotl(accumulators_[1], 7) +
+               rotl(accumulators_[2], 12) + rotl(accumulators_[3], 18);
+        for (uint64_t accumulator : accumulators_) {
+            hash = mergeRound(hash, accumulator);
+        }
+    } else {
+        hash = seed_ + PRIME5;
+    }
+    hash += totalLength_;
+
+    const unsigned char* p = pending_;
+    size_t size = pendingSize_;
+    for (; size >= 8; p += 8, size -= 8) {
+        hash ^= round(0, read64(p));
+        hash = rotl(hash, 27) * PRIME1 + PRIME4;
+    }
+    if (size >= 4) {
+        hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+        hash = rotl(hash, 23) * PRIME2 + PRIME3;
+        p += 4;
+        size -= 4;
+    }
+    for (; size > 0; ++p, --size) {
+        hash ^= (*p) * PRIME5;
+        hash = rotl(hash, 11) * PRIME1;
+    }
+
+    // Avalanche
+    hash ^= hash >> 33;
+    hash *= PRIME2;
+    hash ^= hash >> 29;
+    hash *= PRIME3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+uint64_t Xxh64::hash(const void* data, size_t size, uint64_t seed) {
+    Xxh64 state(seed);
+    state.update(data, size);
+    return state.digest();
+}
@@ -0,0 +1,204 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "fs_result.hpp"
+
+// What happened to a path, after coalescing
+enum class ChangeKind : uint8_t {
+    CREATED,      // did not exist before the window
+    MODIFIED,     // contents written, or replaced by a new file of the same name
+    ATTRIBUTES,   // only metadata (mode, owner, times, xattrs) changed
+    DELETED,      // existed before the window and is gone
+    RENAMED,      // moved from `oldPath`, possibly modified as well
+    RESCAN        // events under `path` were lost, re-read the whole tree
+};
+
+struct ChangeEvent {
+    ChangeKind kind = ChangeKind::MODIFIED;
+    bool directory = false;
+    std::string path;
+    std::string oldPath;   // RENAMED only
+};
+
+// Folds the raw events of one time window into the net change per path
+//
+// - create + modify + close_write of a new file   -> one CREATED
+// - create then delete within the window           -> nothing
+// - delete then create (editor save by replace)    -> MODIFIED
+// - A -> B -> C                                    -> one RENAMED A -> C
+// - a renamed directory moves the pending events of its children with it
+// - anything below a CREATED, DELETED or RESCAN directory is dropped, the
+//   event of the directory itself says "read the whole subtree"
+//
+// Paths are absolute and normalized (no trailing '/'). Not thread-safe.
+class ChangeCoalescer {
+public:
+    enum class Raw : uint8_t { CREATE, MODIFY, ATTRIB, DELETE };
+
+    void add(Raw kind, const std::string& path, bool directory);
+    void rename(const std::string& from, const std::string& to, bool directory);
+    void rescan(const std::string& path);
+
+    // Paths with pending changes
+    size_t size() const { return index_.size() + rescans_.size(); }
+    bool empty() const { return size() == 0; }
+
+    // Net changes in order of first occurrence, resets the coalescer
+    std::vector<ChangeEvent> take();
+    void clear();
+
+private:
+    struct Pending {
+        std::string path;
+        std::string renamedFrom;   // original path if moved during the window
+        bool directory = false;
+        bool live = true;          // false once merged into another record
+        bool bornHere = false;     // first seen being created (or moved in)
+        bool exists = true;
+        bool replaced = false;     // deleted and created again
+        bool content = false;
+        bool attrib = false;
+    };
+
+    Pending& recordFor(const std::string& path, bool directory, bool& created);
+    void moveDescendants(const std::string& from, const std::string& to);
+
+    std::vector<Pending> records_;
+    std::unordered_map<std::string, size_t> index_;   // path -> live record
+    std::vector<std::string> rescans_;
+};
+
+// Change notifications for whole directory trees, coalesced and fanned out
+// to subscribers
+//
+// Two kernel interfaces are used:
+// - fanotify with a filesystem mark (FAN_MARK_FILESYSTEM, FAN_REPORT_DFID_NAME)
+//   costs one mark per filesystem however many directories it holds. Events
+//   carry a directory handle that is turned back into a path with
+//   open_by_handle_at(). Needs CAP_SYS_ADMIN and CAP_DAC_READ_SEARCH.
+// - inotify needs one watch per directory, counted against
+//   fs.inotify.max_user_watches. Used for roots fanotify cannot mark (no
+//   privileges, filesystems without file handles); ENOSPC is reported by
+//   watch() instead of silently watching half a tree.
+// Both feed the same ChangeCoalescer. The feed thread delivers one batch per
+// window, the window starts with the first event, so a steady storm still
+// gets a batch out every `window`.
+class ChangeFeed {
+public:
+    enum class Backend : uint8_t { NONE, FANOTIFY, INOTIFY };
+
+    using SubscriptionId = uint64_t;
+    // Called on the feed thread with the events at or below the subscribed
+    // prefix; must not block for long and must not (un)subscribe
+    using Callback = std::function<void(const std::vector<ChangeEvent>& events)>;
+
+    static constexpr std::chrono::milliseconds DEFAULT_WINDOW{200};
+
+    // Pending paths beyond this turn the window into a RESCAN of every root
+    static constexpr size_t MAX_PENDING = 100000;
+
+    // Feed shared by the GUI and the plugins
+    static ChangeFeed& instance();
+
+    explicit ChangeFeed(Backend preferred = Backend::FANOTIFY, std::chrono::milliseconds window = DEFAULT_WINDOW);
+    ~ChangeFeed();   // Stops the feed thread, pending events are dropped
+
+    // Starts reporting changes at or below `root` (only its direct entries if
+    // not `recursive`). Watching the same root again adds a reference.
+    // With inotify a recursive watch walks the tree, keep it off the GUI thread
+    FsStatus watch(const std::string& root, bool recursive = true);
+    void unwatch(const std::string& root);
+
+    // Events at or below `prefix` ("" = everything) go to `callback`
+    SubscriptionId subscribe(const std::string& prefix, Callback callback);
+    // Waits for a delivery in progress, the callback is not called afterwards
+    void unsubscribe(SubscriptionId id);
+
+    // Backend serving `root`, NONE if it is not watched
+    Backend backend(const std::string& root) const;
+
+    size_t inotifyWatches() const;
+    uint64_t rawEvents() const { return rawEvents_.load(std::memory_order_relaxed); }
+    uint64_t deliveredEvents() const { return deliveredEvents_.load(std::memory_order_relaxed); }
+    uint64_t overflows() const { return overflows_.load(std::memory_order_relaxed); }
+
+private:
+    struct Root {
+        std::string path;
+        bool recursive = true;
+        Backend backend = Backend::NONE;
+        std::string filesystem;   // fsid of a FANOTIFY root
+        size_t references = 0;
+    };
+
+    // A filesystem marked through fanotify
+    struct MarkedFilesystem {
+        int mountFd = -1;   // the first root on it, for open_by_handle_at
+        size_t roots = 0;
+    };
+
+    struct Subscription {
+        SubscriptionId id;
+        std::string prefix;
+        Callback callback;
+    };
+
+    // PRIVATE METHODS (mutex_ held unless noted)
+    bool markFilesystem(const std::string& root, std::string& filesystem);
+    void unmarkFilesystem(const std::string& root, const std::string& filesystem);
+    FsStatus addInotifyTree(const std::string& root, bool recursive, bool reportContents);
+    void removeInotifyWatches(const std::string& root);
+    void moveInotifyWatches(const std::string& from, const std::string& to);   // "" = moved out
+    bool isWatched(const std::string& path) const;
+    bool coversDirectory(const std::string& directory) const;   // needs an inotify watch
+
+    void run();           // feed thread, no lock
+    void readFanotify();  // no lock
+    void readInotify();   // no lock
+    void changed(uint32_t changes, const std::string& path, bool directory);
+    void renamed(const std::string& from, const std::string& to, bool directory);
+    void finishMoves();
+    void overflow(Backend backend);
+    void limitPending();
+    std::string directoryOfHandle(const std::string& key, int mountFd, void* handle);
+    void flush();   // takes mutex_ itself, delivers without it
+
+    const std::chrono::milliseconds window_;
+
+    mutable std::mutex mutex_;
+    std::vector<Root> roots_;
+    ChangeCoalescer coalescer_;
+
+    int fanotifyFd_ = -1;
+    uint64_t fanotifyMask_ = 0;
+    std::map<std::string, MarkedFilesystem> filesystems_;        // fsid bytes -> mark
+    std::unordered_map<std::string, std::string> handlePaths_;   // fsid + handle -> directory, per window
+
+    int inotifyFd_ = -1;
+    std::unordered_map<int, std::string> watchPaths_;   // wd -> directory
+    std::unordered_map<std::string, int> watchOf_;      // directory -> wd
+    // IN_MOVED_FROM waiting for the IN_MOVED_TO with the same cookie
+    std::unordered_map<uint32_t, std::pair<std::string, bool>> moves_;
+
+    int wakeFd_ = -1;
+    std::thread thread_;
+    std::atomic<bool> stopping_{false};
+
+    std::mutex subscribersMutex_;
+    std::vector<Subscription> subscribers_;
+    SubscriptionId nextSubscription_ = 1;
+
+    std::atomic<uint64_t> rawEvents_{0};
+    std::atomic<uint64_t> deliveredEvents_{0};
+    std::atomic<uint64_t> overflows_{0};
+};
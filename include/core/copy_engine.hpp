@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+
+#include "buffer_pool.hpp"
+#include "fs_result.hpp"
+
+namespace fs = std::filesystem;
+
+// Chunked copy of a single regular file
+//
+// Unlike FileSystem::copy the copy can report progress and be stopped between
+// chunks, which FileOperationJob needs for progress bars, pause and cancel on
+// multi-gigabyte files. Data moves with copy_file_range (in-kernel, reflinks
+// on filesystems that support it) and falls back to read/write when the
+// kernel refuses (different filesystems on old kernels, special files).
+//
+// Big files go around the page cache instead (TransferMode::DIRECT), so
+// copying a 100 GB image does not evict the working set of everything else
+// on the machine. Both files are switched to O_DIRECT and the aligned part
+// moves through DIRECT_QUEUE_DEPTH buffers from bufferPool() with native AIO:
+// while one chunk is written the next ones are already being read. The
+// destination is preallocated, so the writes do not extend the file one
+// by one. For the last partial block O_DIRECT is cleared again with fcntl
+// and the tail is copied through the page cache.
+class CopyEngine {
+public:
+    // Bytes per chunk, i.e. how often progress is called
+    static constexpr size_t CHUNK_SIZE = 4 * 1024 * 1024;
+
+    // Chunks a DIRECT copy has in flight at once
+    static constexpr unsigned DIRECT_QUEUE_DEPTH = 4;
+
+    // O_DIRECT wants buffers, offsets and lengths aligned to the logical
+    // block size of the device, at most 4 KiB in practice
+    static constexpr size_t DIRECT_ALIGNMENT = 4096;
+
+    // Files from this size on are copied DIRECT in AUTO mode
+    static constexpr uint64_t DEFAULT_DIRECT_THRESHOLD = 1ULL << 30;
+
+    // Called after every chunk with the bytes it copied, return false to stop
+    using Progress = std::function<bool(uint64_t bytes)>;
+
+    // How copyFile() moves the data
+    enum class TransferMode : uint8_t {
+        AUTO,       // a reflink or DIRECT from directThreshold() on, BUFFERED below
+        BUFFERED,   // through the page cache
+        DIRECT      // with O_DIRECT, BUFFERED where a filesystem refuses it
+    };
+
+    // Copies `source` to `destination`, which gets the source's permission bits
+    // Without `overwrite` an existing destination fails with EEXIST.
+    // A failed or stopped copy removes the partial destination; stopping
+    // returns ECANCELED.
+    static FsStatus copyFile(const fs::path& source, const fs::path& destination,
+                             bool overwrite, const Progress& progress = {},
+                             TransferMode mode = TransferMode::AUTO);
+
+    // Size from which AUTO copies DIRECT, DEFAULT_DIRECT_THRESHOLD unless
+    // FM_COPY_DIRECT_MB is set; 0 keeps AUTO buffered
+    static uint64_t directThreshold();
+    static void setDirectThreshold(uint64_t bytes);
+
+    // Aligned CHUNK_SIZE buffers of the DIRECT copies, kept across copies
+    static BufferPool& bufferPool();
+
+    // How copyVerified() reads the destination back
+    enum class VerifyMode : uint8_t {
+        DROP_CACHE,   // flushed and evicted from the page cache, then read normally
+        DIRECT        // read with O_DIRECT, DROP_CACHE where the filesystem refuses it
+    };
+
+    // Copies like copyFile() and checks the destination, returns the XXH64
+    // digest of the data
+    //
+    // Each chunk of the source is read once into a buffer, hashed there and
+    // written from it, then only the destination is read back and hashed:
+    // one copy plus one read instead of a copy and two hashing passes.
+    // Before the read back the destination is flushed (fdatasync) and either
+    // evicted from the page cache or read with O_DIRECT, so the check sees
+    // what the disk returns rather than the pages just written.
+    // A mismatch fails with EIO and, like any failed copy, removes the
+    // destination. `progress` gets the copied bytes, then 0 after every
+    // chunk read back so the check can be stopped too.
+    static FsResult<uint64_t> copyVerified(const fs::path& source, const fs::path& destination, bool overwrite,
+                                           VerifyMode mode = VerifyMode::DROP_CACHE, const Progress& progress = {});
+
+private:
+    CopyEngine() = delete;
+};
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+#include "daemon_protocol.hpp"
+#include "fs_result.hpp"
+
+// Blocking client for fm-daemon
+//
+// Requests are buffered by send() and written together on flush() or the
+// next receive(), so a batch of pipelined requests costs one write:
+//
+//   DaemonClient client;
+//   client.connect(fmd::defaultSocketPath());
+//   for (const auto& path : paths) client.send(fmd::Opcode::LIST, {path});
+//   for (size_t i = 0; i < paths.size(); ++i) auto response = client.receive();
+//
+// Not thread-safe, use one client per thread.
+class DaemonClient {
+public:
+    DaemonClient() = default;
+    ~DaemonClient();
+
+    FsStatus connect(const std::string& socketPath);
+    void close();
+    bool isConnected() const { return fd_ >= 0; }
+
+    // Queues a request, returns its id. One that cannot be encoded (see
+    // fmd::encodeRequest) is not sent: receive() answers it with
+    // BAD_REQUEST and E2BIG
+    uint32_t send(fmd::Opcode opcode, std::vector<std::string> args = {});
+
+    // Writes all queued requests
+    FsStatus flush();
+
+    // Next response, in the order the daemon finished them (match by id)
+    FsResult<fmd::Response> receive();
+
+    // send() + receive() for a client without other requests outstanding
+    FsResult<fmd::Response> call(fmd::Opcode opcode, std::vector<std::string> args = {});
+
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+private:
+    int fd_ = -1;
+    uint32_t nextId_ = 1;
+    std::string output_;
+    std::string input_;
+    size_t inputOffset_ = 0;
+    std::deque<fmd::Response> rejected_;   // answered locally by receive()
+};
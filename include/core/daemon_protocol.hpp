@@ -0,0 +1,107 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Wire format between fm-daemon and its clients (fm-cli --daemon, fm-daemon-load)
+//
+// A connection carries length-prefixed frames in both directions, integers in
+// host byte order (the socket is local). Clients may pipeline: any number of
+// requests can be sent without waiting, responses carry the request id and
+// can come back in a different order.
+//
+//   request   u32 length, u32 id, u8 opcode, u8 argc, argc x (u32 length, bytes)
+//   response  u32 length, u32 id, u8 status, i32 error, u32 count,
+//             count x (u8 tag, u32 length, bytes)
+//
+// `length` counts the bytes after the length field itself. The items of a
+// response are the entries of a listing (tag = EntryType) or "key=value"
+// lines for STATS (tag 0).
+namespace fmd {
+    // Frames above this are a protocol error, the connection is closed.
+    // A response that would not fit is sent as FAILED with EFBIG instead
+    constexpr uint32_t MAX_FRAME = 16 * 1024 * 1024;
+
+    // `length` of a response frame with `items` items holding `valueBytes` in all
+    size_t responseLength(size_t items, size_t valueBytes);
+
+    // The values go over the wire, only ever append new ones
+    enum class Opcode : uint8_t {
+        PING = 0,      // no args, answered at once
+        EXECUTE = 1,   // args: plugin operation, then its arguments
+        LIST = 2,      // args: directory; served from the listing cache when current
+        STATS = 3,     // no args, daemon counters as key=value items
+        EXECUTE_IN = 4   // args: absolute working directory, then as EXECUTE;
+                         // relative arguments resolve against that directory
+    };
+
+    enum class Status : uint8_t {
+        OK = 0,
+        FAILED = 1,        // the operation ran and failed, `error` holds errno if known
+        BAD_REQUEST = 2    // unknown opcode or wrong arguments
+    };
+
+    struct Request {
+        uint32_t id = 0;
+        Opcode opcode = Opcode::PING;
+        std::vector<std::string> args;
+    };
+
+    struct Item {
+        uint8_t tag = 0;
+        std::string value;
+    };
+
+    struct Response {
+        uint32_t id = 0;
+        Status status = Status::OK;
+        int32_t error = 0;
+        std::vector<Item> items;
+    };
+
+    enum class Parse {
+        COMPLETE,     // one frame decoded, `consumed` bytes used
+        INCOMPLETE,   // need more bytes
+        INVALID       // malformed, drop the connection
+    };
+
+    // Most arguments a request can carry, argc is one byte
+    constexpr size_t MAX_ARGS = 255;
+
+    // Appends an encoded frame to `out`. A request with more than MAX_ARGS
+    // arguments or above MAX_FRAME is not encoded: false, `out` untouched
+    bool encodeRequest(std::string& out, const Request& request);
+    void encodeResponse(std::string& out, const Response& response);
+
+    // Encodes a response item by item straight into `out`, for large
+    // listings where building a Response first would copy every name twice
+    // `out` is grown in large steps and written through a cursor, it must
+    // not be touched by anything else until finish()
+    class ResponseWriter {
+    public:
+        ResponseWriter(std::string& out, uint32_t id, Status status = Status::OK, int32_t error = 0);
+        void reserve(size_t items, size_t valueBytes);   // room for that much, optional
+        void add(uint8_t tag, std::string_view value);
+        // Trims `out`, patches length and count; call exactly once. A frame
+        // grown past MAX_FRAME is replaced by an item-less FAILED/EFBIG
+        void finish();
+
+    private:
+        std::string& out_;
+        size_t start_;
+        uint32_t id_;
+        size_t countOffset_;
+        size_t cursor_;      // end of the frame written so far, out_ may be longer
+        uint32_t count_ = 0;
+    };
+
+    // Decodes the first frame of `data`
+    Parse decodeRequest(const char* data, size_t size, Request& out, size_t& consumed);
+    Parse decodeResponse(const char* data, size_t size, Response& out, size_t& consumed);
+
+    // Default socket: $XDG_RUNTIME_DIR/file_manager.sock, else /tmp/file_manager-<uid>.sock
+    std::string defaultSocketPath();
+}
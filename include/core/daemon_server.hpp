@@ -0,0 +1,127 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "daemon_protocol.hpp"
+#include "directory_cache.hpp"
+#include "fs_result.hpp"
+#include "operation_scheduler.hpp"
+#include "plugin_manager.hpp"
+
+class BinaryLogSink;
+
+// Serves plugin operations and directory listings over a Unix domain socket
+//
+// Keeps what every short-lived process would rebuild resident: the loaded
+// plugins, the listing cache and the scheduler's device queues. One thread
+// runs an epoll loop over the listening socket, an eventfd and all client
+// sockets; it only parses frames and copies bytes. PING, STATS and cached
+// listings are answered on the loop, everything that touches the disk is
+// submitted to the OperationScheduler and its response is handed back
+// through the eventfd. A client with MAX_IN_FLIGHT requests outstanding, or
+// with too much unsent output, is not read from until it catches up.
+class DaemonServer {
+public:
+    // Requests of one client executing at the same time
+    static constexpr size_t MAX_IN_FLIGHT = 64;
+
+    // Unsent response bytes after which a client is no longer read from
+    static constexpr size_t MAX_PENDING_OUTPUT = 4 * 1024 * 1024;
+
+    explicit DaemonServer(PluginManager& plugins,
+                          DirectoryCache& cache = DirectoryCache::instance(),
+                          OperationScheduler& scheduler = OperationScheduler::instance());
+    ~DaemonServer();   // closes every socket, waits for submitted requests
+
+    // Binds and listens on `socketPath`; a stale socket file left by a
+    // crashed daemon is replaced, a live one gives EADDRINUSE
+    FsStatus listen(const std::string& socketPath);
+
+    // Event loop, returns after stop()
+    void run();
+
+    // Makes run() return; async-signal-safe, may be called from any thread
+    void stop();
+
+    // Writes one INFO record per request to `log` (FM_BLOG, see
+    // utilities/binary_log.hpp); nullptr turns it off. Set before run(),
+    // `log` must outlive the server
+    void setRequestLog(BinaryLogSink* log) { requestLog_ = log; }
+
+    size_t clientCount() const { return clientCount_.load(std::memory_order_relaxed); }
+    uint64_t requestCount() const { return requestCount_.load(std::memory_order_relaxed); }
+
+    DaemonServer(const DaemonServer&) = delete;
+    DaemonServer& operator=(const DaemonServer&) = delete;
+
+private:
+    struct Connection {
+        int fd = -1;
+        uint64_t serial = 0;        // never reused, unlike the fd
+        std::string input;
+        size_t inputOffset = 0;     // start of the unparsed bytes
+        std::string output;
+        size_t outputOffset = 0;    // start of the unsent bytes
+        size_t inFlight = 0;
+        uint32_t events = 0;        // currently registered with epoll
+        bool endOfInput = false;    // client shut down its side, close once answered
+        bool touched = false;       // got completions in this drainCompletions()
+    };
+
+    // A response finished on a scheduler thread
+    struct Completion {
+        uint64_t serial;
+        std::string frame;
+    };
+
+    // The methods returning bool return false if they closed the connection
+    void accept();
+    bool readFrom(Connection& connection);
+    bool processInput(Connection& connection);
+    void dispatch(Connection& connection, fmd::Request& request);
+    // `work` runs on the scheduler and appends the response frame for `id`
+    void submit(Connection& connection, uint32_t id, const std::string& devicePath,
+                std::function<void(uint32_t id, std::string& frame)> work);
+    void complete(uint64_t serial, std::string frame);   // scheduler threads
+    void drainCompletions();
+    bool flush(Connection& connection);
+    void updateEvents(Connection& connection);
+    void close(Connection& connection);
+
+    // Listing of `path` through the cache, encoded as the response to `id`
+    void listDirectory(const std::string& path, uint32_t id, std::string& frame);
+    fmd::Response stats() const;
+
+    PluginManager& plugins_;
+    DirectoryCache& cache_;
+    OperationScheduler& scheduler_;
+
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    int eventFd_ = -1;
+    std::string socketPath_;
+    std::atomic<bool> stopping_{false};
+    bool acceptPaused_ = false;   // out of file descriptors, resumed on the next close
+    BinaryLogSink* requestLog_ = nullptr;
+
+    // Loop thread only
+    std::unordered_map<uint64_t, std::unique_ptr<Connection>> connections_;   // by serial
+    uint64_t nextSerial_ = 1;
+
+    // Shared with the scheduler threads
+    std::mutex mutex_;
+    std::condition_variable idle_;
+    std::vector<Completion> completions_;
+    size_t outstanding_ = 0;
+
+    std::atomic<size_t> clientCount_{0};
+    std::atomic<uint64_t> requestCount_{0};
+};
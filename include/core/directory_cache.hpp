@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "directory_listing.hpp"
+
+// LRU cache of complete directory listings with a memory budget
+//
+// Filled by the Prefetcher and by the GUI after a full load, read when
+// navigating, so going back or into a prefetched folder needs no readdir.
+// Every entry remembers the directory's mtime at enumeration time; find()
+// drops entries whose directory changed since. That mtime only covers names
+// and types, so sizes and mtimes of the entries are not cached. Thread-safe.
+class DirectoryCache {
+public:
+    static constexpr size_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+    // Cache shared by the GUI and the prefetcher
+    static DirectoryCache& instance();
+
+    explicit DirectoryCache(size_t budgetBytes = DEFAULT_BUDGET);
+
+    // Cached listing of `path`, or nullptr if missing or out of date
+    std::shared_ptr<const DirectoryListing> find(const std::string& path);
+
+    // True if a current listing of `path` is cached (does not touch the LRU order)
+    bool contains(const std::string& path);
+
+    // Stores a listing without its metadata; `stamp` is modificationStamp()
+    // taken before enumerating
+    // Listings larger than the whole budget are not cached
+    void insert(const std::string& path, std::shared_ptr<const DirectoryListing> listing, int64_t stamp);
+
+    void remove(const std::string& path);
+    void clear();
+
+    // Evicts least recently used entries until the new budget is met
+    void setBudget(size_t budgetBytes);
+    size_t budget() const;
+
+    size_t memoryUsage() const;
+    size_t size() const;
+    uint64_t hits() const;
+    uint64_t misses() const;
+
+    // Directory mtime in nanoseconds, -1 if it cannot be stat()ed
+    static int64_t modificationStamp(const std::string& path);
+    static int64_t modificationStamp(int directoryFd);
+
+private:
+    struct Entry {
+        std::string path;
+        std::shared_ptr<const DirectoryListing> listing;
+        int64_t stamp;
+        size_t bytes;
+    };
+    using EntryList = std::list<Entry>;   // front = most recently used
+
+    // mutex_ must be held
+    void evictToBudget();
+    void eraseEntry(EntryList::iterator it);
+
+    mutable std::mutex mutex_;
+    EntryList entries_;
+    std::unordered_map<std::string, EntryList::iterator> index_;
+    size_t budget_;
+    size_t usage_ = 0;
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "fs_result.hpp"
+
+// Kind of a directory entry, as far as readdir knows it
+enum class EntryType : uint8_t {
+    UNKNOWN,    // the filesystem did not say, resolved by loadMetadata()
+    FILE,
+    DIRECTORY,
+    SYMLINK,
+    OTHER       // device, fifo, socket
+};
+
+// Compact columnar store of a directory's entries
+//
+// Names live back to back in one string, the other columns are flat arrays
+// indexed by row, so 500k entries are a handful of allocations instead of
+// 500k nodes. Sizes and modification times are filled lazily, usually only
+// for the rows somebody looks at.
+class DirectoryListing {
+public:
+    size_t size() const { return types_.size(); }
+    bool empty() const { return types_.empty(); }
+
+    std::string_view name(size_t row) const {
+        return std::string_view(names_.data() + nameOffsets_[row], nameOffsets_[row + 1] - nameOffsets_[row]);
+    }
+    EntryType type(size_t row) const { return types_[row]; }
+    size_t nameBytes() const { return names_.size(); }   // all names together
+    bool isDirectory(size_t row) const { return types_[row] == EntryType::DIRECTORY; }
+
+    void append(std::string_view name, EntryType type);
+
+    // Appends all rows of another listing (a chunk loaded in the background)
+    void append(const DirectoryListing& other);
+
+    void clear();
+    void reserve(size_t rows, size_t nameBytes);
+
+    // --- Metadata (lazy) ---
+
+    bool hasMetadata(size_t row) const { return metaState_[row] != META_MISSING; }
+    // False if stat() failed, e.g. the entry was deleted since the listing
+    bool metadataValid(size_t row) const { return metaState_[row] == META_LOADED; }
+    uint64_t fileSize(size_t row) const { return sizes_[row]; }
+    int64_t modifiedTime(size_t row) const { return mtimes_[row]; }   // seconds since the epoch
+
+    // Stores the result of a stat(), also resolves UNKNOWN types
+    void setMetadata(size_t row, uint64_t size, int64_t mtime, EntryType type);
+    void setMetadataFailed(size_t row);
+
+    // Forgets every size and mtime, they are loaded again on demand
+    // Types resolved by a stat() are kept, they change only with the name
+    void clearMetadata();
+    bool anyMetadata() const;
+
+    // stat()s rows [begin, end) relative to an open directory descriptor
+    void loadMetadata(int directoryFd, size_t begin, size_t end);
+
+    // Bytes held by the columns, for diagnostics and cache budgets
+    size_t memoryUsage() const;
+
+private:
+    enum : uint8_t { META_MISSING, META_LOADED, META_FAILED };
+
+    std::string names_;
+    std::vector<uint32_t> nameOffsets_ = {0};   // row i is names_[offsets[i], offsets[i + 1])
+    std::vector<EntryType> types_;
+    std::vector<uint8_t> metaState_;
+    std::vector<uint64_t> sizes_;
+    std::vector<int64_t> mtimes_;
+};
+
+// Reads a directory in chunks with getdents64 and large buffers
+// Skips "." and "..". Not thread-safe, one enumerator per thread.
+class DirectoryEnumerator {
+public:
+    DirectoryEnumerator() = default;
+    ~DirectoryEnumerator();
+
+    FsStatus open(const std::string& path);
+
+    // Opens `name` relative to an open directory; a symlink is not followed
+    // unless `followSymlinks`
+    FsStatus openAt(int directoryFd, const std::string& name, bool followSymlinks = false);
+
+    // Appends up to `maxEntries` entries, returns how many were added (0 at the end)
+    FsResult<size_t> next(DirectoryListing& out, size_t maxEntries);
+
+    // Descriptor of the open directory, for fstatat()
+    int fd() const { return fd_; }
+
+    void close();
+
+    DirectoryEnumerator(const DirectoryEnumerator&) = delete;
+    DirectoryEnumerator& operator=(const DirectoryEnumerator&) = delete;
+
+private:
+    int fd_ = -1;
+    std::vector<char> buffer_;
+    size_t bufferPos_ = 0;
+    size_t bufferEnd_ = 0;
+    bool finished_ = false;
+};
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "fs_result.hpp"
+#include "operation_scheduler.hpp"
+#include "rate_limiter.hpp"
+#include "trash_manager.hpp"
+
+namespace fs = std::filesystem;
+
+enum class FileOperationKind {
+    COPY,     // sources into the destination directory
+    MOVE,     // rename, or copy + delete across filesystems
+    REMOVE,   // sources, recursively
+    TRASH     // sources into the trash of their filesystem (TrashManager)
+};
+
+enum class JobState {
+    QUEUED,      // waiting for a scheduler slot
+    SCANNING,    // counting files and bytes
+    RUNNING,
+    PAUSED,
+    COMPLETED,
+    FAILED,
+    CANCELLED
+};
+
+// What to do when a copy/move target already exists
+enum class ConflictPolicy {
+    RENAME,      // pick "name (2).ext", "name (3).ext", ...
+    OVERWRITE,   // replace files, merge into directories
+    FAIL
+};
+
+// Snapshot of a job's progress, cheap enough to take 30 times a second
+struct JobProgress {
+    JobState state = JobState::QUEUED;
+    uint64_t bytesDone = 0;
+    uint64_t bytesTotal = 0;
+    uint64_t filesDone = 0;
+    uint64_t filesTotal = 0;
+    std::string currentFile;
+    std::string error;   // set when FAILED
+};
+
+// A copy, move, remove or trash of one or more paths, run off the calling thread
+//
+// The worker publishes progress through atomics after every file and every
+// CopyEngine chunk; readers poll progress() at their own pace, so a UI gets
+// the same number of updates whether a million small files or one big file
+// finish. Pause and cancel take effect at the next chunk or file.
+//
+// A job given a RateLimiter charges it every chunk it copies (bytes) and
+// every file it stats, creates, renames or removes (ops), and waits while
+// the limiter is over budget; one limiter can hold several jobs to a shared
+// budget.
+class FileOperationJob : public std::enable_shared_from_this<FileOperationJob> {
+public:
+    // `destination` is the target directory (ignored for REMOVE and TRASH)
+    static std::shared_ptr<FileOperationJob> create(FileOperationKind kind, std::vector<fs::path> sources,
+                                                    fs::path destination = {},
+                                                    ConflictPolicy conflicts = ConflictPolicy::RENAME);
+
+    // Queues the job on the scheduler queue of the device it writes to
+    void start(OperationScheduler& scheduler = OperationScheduler::instance());
+
+    // Queue priority used by start(), NORMAL unless set. Operations the user
+    // started from the window and is watching are INTERACTIVE
+    void setPriority(JobPriority priority) { priority_ = priority; }
+    JobPriority priority() const { return priority_; }
+
+    // Runs the job on the calling thread
+    void run();
+
+    // Throttles the job, set before start(). With RateLimits::idleIo the job
+    // also runs in the IDLE I/O class (read when the job starts)
+    void setRateLimiter(std::shared_ptr<RateLimiter> limiter) { limiter_ = std::move(limiter); }
+    const std::shared_ptr<RateLimiter>& rateLimiter() const { return limiter_; }
+
+    void pause();
+    void resume();
+    void cancel();
+
+    JobProgress progress() const;
+    JobState state() const { return static_cast<JobState>(state_.load(std::memory_order_acquire)); }
+    bool finished() const;
+
+    // Blocks until the job completed, failed or was cancelled
+    void wait();
+
+    FileOperationKind kind() const { return kind_; }
+    const std::vector<fs::path>& sources() const { return sources_; }
+    const fs::path& destination() const { return destination_; }
+
+    // Entries a TRASH job moved to the trash so far, for undo
+    std::vector<TrashEntry> trashed() const;
+
+    FileOperationJob(const FileOperationJob&) = delete;
+    FileOperationJob& operator=(const FileOperationJob&) = delete;
+
+private:
+    FileOperationJob(FileOperationKind kind, std::vector<fs::path> sources, fs::path destination,
+                     ConflictPolicy conflicts);
+
+    // Scan phase
+    void countTree(const fs::path& path);
+
+    // Work phase, each returns false on failure or cancellation
+    bool copyTree(const fs::path& source, const fs::path& target);
+    bool removeTree(const fs::path& path, bool countProgress);
+    bool moveOne(const fs::path& source, const fs::path& target);
+    bool trashOne(const fs::path& source);
+
+    // Target path for `source` inside the destination, honouring the conflict policy
+    bool targetFor(const fs::path& source, fs::path& target);
+
+    // Blocks while paused, false once cancelled
+    bool checkpoint();
+
+    // Charges the rate limiter, if any, false once cancelled
+    bool throttle(uint64_t bytes, uint64_t ops);
+
+    void setState(JobState state);
+    void setCurrentFile(const fs::path& path);
+    bool fail(const FsStatus& status, const fs::path& path);
+    bool fail(const std::string& message);
+    void finish(JobState state);
+
+    const FileOperationKind kind_;
+    const std::vector<fs::path> sources_;
+    const fs::path destination_;
+    const ConflictPolicy conflicts_;
+    JobPriority priority_ = JobPriority::NORMAL;
+    std::shared_ptr<RateLimiter> limiter_;
+
+    std::atomic<int> state_{static_cast<int>(JobState::QUEUED)};
+    std::atomic<bool> paused_{false};
+    std::atomic<bool> cancelled_{false};
+    std::atomic<uint64_t> bytesDone_{0};
+    std::atomic<uint64_t> bytesTotal_{0};
+    std::atomic<uint64_t> filesDone_{0};
+    std::atomic<uint64_t> filesTotal_{0};
+
+    mutable std::mutex mutex_;            // guards the strings and the pause/finish waits
+    std::condition_variable changed_;
+    std::string currentFile_;
+    std::string error_;
+    std::vector<TrashEntry> trashed_;
+};
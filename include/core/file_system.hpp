@@ -4,10 +4,24 @@
 #include<vector>
 #include <filesystem>    // For file and directory operations
 #include <optional>      // For std::optional, used when returning values that may not be available
+#include <memory_resource> // For the std::pmr overloads used by bulk operations
+#include <string_view>
+#include "fs_result.hpp" // For FsResult, used by the exception-free try* functions
 
 namespace fs=std::filesystem; //Alias for filesystem
 
 
+// One entry of a listing made with a caller's memory resource
+struct ListedEntry {
+    std::pmr::string path;                          // full path, allocated from the listing's resource
+    fs::file_type type = fs::file_type::unknown;    // as readdir reported it, lstat() if it did not
+
+    std::string_view name() const {
+        const size_t slash = path.rfind('/');
+        return std::string_view(path).substr(slash == std::pmr::string::npos ? 0 : slash + 1);
+    }
+};
+
 //These are just declarations
 //Implementation will be there in file_system.cpp
 class FileSystem {
@@ -54,6 +68,47 @@ public:
     // Overwrites the file if it already exists
     static bool writeFile(const fs::path& path, const std::string& content);
 
+    // Exception-free versions of the functions above
+    // They never throw, never print and never allocate on the error path:
+    // a failure is reported as an errno code plus a static context string.
+    // Logging the failure is left to the caller. The functions above are
+    // thin wrappers that print the error to std::cerr like before.
+
+    // A missing path is a successful `false`, only real errors (EACCES, ...) fail
+    static FsResult<bool> tryExists(const fs::path& path);
+    static FsResult<bool> tryIsDirectory(const fs::path& path);
+    static FsResult<bool> tryIsFile(const fs::path& path);
+
+    static FsResult<std::vector<fs::directory_entry>> tryListDirectory(const fs::path& path);
+
+    // true if the directory was created, false if it already existed
+    static FsResult<bool> tryCreateDirectory(const fs::path& path);
+
+    // Number of files and directories removed
+    static FsResult<uintmax_t> tryRemove(const fs::path& path);
+
+    static FsStatus tryCopy(const fs::path& source, const fs::path& destination, bool overwrite = false);
+    static FsStatus tryMove(const fs::path& source, const fs::path& destination, bool overwrite = false);
+    static FsResult<uintmax_t> tryFileSize(const fs::path& path);
+    static FsResult<fs::file_time_type> tryLastWriteTime(const fs::path& path);
+    static FsResult<std::string> tryReadFile(const fs::path& path);
+    static FsStatus tryWriteFile(const fs::path& path, const std::string& content);
+
+    // Allocator-aware versions for bulk work
+    // A bulk operation otherwise builds and frees a std::string or fs::path
+    // per entry. These take the path as a string_view and allocate every
+    // string (paths, their NUL-terminated copies) from `memory`, typically a
+    // std::pmr::monotonic_buffer_resource per operation released at once.
+    // Same errors, metrics and workload records as the functions above.
+    static std::pmr::vector<ListedEntry> listDirectory(std::string_view path, std::pmr::memory_resource* memory);
+    static FsResult<std::pmr::vector<ListedEntry>> tryListDirectory(std::string_view path,
+                                                                     std::pmr::memory_resource* memory);
+    static FsResult<bool> tryExists(std::string_view path, std::pmr::memory_resource* memory);
+    static FsResult<bool> tryIsDirectory(std::string_view path, std::pmr::memory_resource* memory);
+    static FsResult<bool> tryIsFile(std::string_view path, std::pmr::memory_resource* memory);
+    static FsResult<uintmax_t> tryFileSize(std::string_view path, std::pmr::memory_resource* memory);
+    static FsResult<fs::file_time_type> tryLastWriteTime(std::string_view path, std::pmr::memory_resource* memory);
+
 private:
     //We delete the object  to disallow anyone to create an object of this class
     //It is like a toolbox defined
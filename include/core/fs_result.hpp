@@ -0,0 +1,93 @@
+#pragma once
+
+#include <optional>
+#include <string>
+#include <system_error>
+#include <utility>
+
+// Result of an exception-free FileSystem call (FileSystem::try*)
+//
+// Unlike ErrorHandler::Result it never allocates on the error path: a failure
+// is an errno-style code plus an optional pointer to a static string naming the
+// step that failed ("open", "rename", ...). Nothing is printed or logged,
+// turning the failure into a message is the caller's decision (see message()).
+// T does not need to be default constructible.
+template<typename T>
+class FsResult {
+public:
+    // Success
+    FsResult(T value) : value_(std::move(value)) {}
+
+    // Failure, `context` must point to a string literal (it is not copied)
+    static FsResult failure(int code, const char* context = nullptr) {
+        return FsResult(code, context);
+    }
+
+    bool ok() const { return code_ == 0; }
+    explicit operator bool() const { return ok(); }
+
+    // errno value of the failure, 0 on success
+    int code() const { return code_; }
+
+    // Step that failed, or nullptr
+    const char* context() const { return context_; }
+
+    // Only valid when ok()
+    T& value() & { return *value_; }
+    const T& value() const& { return *value_; }
+    T&& value() && { return std::move(*value_); }
+
+    // The value, or `fallback` on failure
+    T valueOr(T fallback) const& { return ok() ? *value_ : std::move(fallback); }
+
+    // Human readable description such as "open: No such file or directory"
+    // Builds a string, so only call it when the error is actually reported
+    std::string message() const {
+        if (ok()) {
+            return {};
+        }
+        std::string text = std::generic_category().message(code_);
+        return context_ ? std::string(context_) + ": " + text : text;
+    }
+
+private:
+    FsResult(int code, const char* context) : code_(code), context_(context) {}
+
+    std::optional<T> value_;
+    int code_ = 0;
+    const char* context_ = nullptr;
+};
+
+// Result of a call that produces no value
+template<>
+class FsResult<void> {
+public:
+    FsResult() = default;
+
+    static FsResult failure(int code, const char* context = nullptr) {
+        FsResult result;
+        result.code_ = code;
+        result.context_ = context;
+        return result;
+    }
+
+    bool ok() const { return code_ == 0; }
+    explicit operator bool() const { return ok(); }
+    int code() const { return code_; }
+    const char* context() const { return context_; }
+
+    std::string message() const {
+        if (ok()) {
+            return {};
+        }
+        std::string text = std::generic_category().message(code_);
+        return context_ ? std::string(context_) + ": " + text : text;
+    }
+
+private:
+    int code_ = 0;
+    const char* context_ = nullptr;
+};
+
+// Shorthand for calls that only report success or failure
+using FsStatus = FsResult<void>;
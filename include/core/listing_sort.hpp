@@ -0,0 +1,69 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "directory_listing.hpp"
+
+// Column a listing is ordered by
+enum class SortColumn : uint8_t {
+    NAME,
+    SIZE,
+    TYPE,   // extension, then name
+    DATE
+};
+
+// Precomputed natural-sort keys of a listing's names
+//
+// A key is the name case-folded (ASCII) with every digit run replaced by
+// '0', its length and the digits without leading zeros, so a plain byte
+// compare puts "file2" before "File10". Keys are built once per sort and
+// stored like the listing itself: one blob plus offsets.
+class SortKeys {
+public:
+    SortKeys() = default;
+    explicit SortKeys(const DirectoryListing& listing) { build(listing); }
+
+    void build(const DirectoryListing& listing);
+
+    size_t size() const { return offsets_.size() - 1; }
+    std::string_view key(size_t row) const {
+        return std::string_view(blob_.data() + offsets_[row], offsets_[row + 1] - offsets_[row]);
+    }
+
+    // Natural-sort key of a single name
+    static std::string naturalKey(std::string_view name);
+
+private:
+    std::string blob_;
+    std::vector<uint32_t> offsets_ = {0};
+};
+
+struct SortOptions {
+    SortColumn column = SortColumn::NAME;
+    bool descending = false;
+    unsigned threads = 0;                          // 0 = hardware concurrency
+    const std::atomic<bool>* cancelled = nullptr;  // checked between merge passes
+};
+
+// Returns the rows of `listing` in sorted order
+// Directories always come first; ties are broken by name, then by row, so
+// the result does not depend on the thread count. SIZE and DATE use the
+// listing's metadata as is, rows without it sort as 0. Returns an empty
+// vector when cancelled.
+std::vector<uint32_t> sortListing(const DirectoryListing& listing, const SortKeys& keys, const SortOptions& options);
+
+// ASCII case-folds a filter pattern
+std::string foldCase(std::string_view text);
+
+// Keeps the `candidates` whose name contains `foldedPattern` (case-insensitive),
+// in their original order. Pass the previous result as candidates when the
+// pattern only grew, to filter incrementally.
+std::vector<uint32_t> filterRows(const DirectoryListing& listing, const std::vector<uint32_t>& candidates,
+                                 std::string_view foldedPattern, unsigned threads = 0);
+
+// True if `name` contains `foldedPattern`, ignoring ASCII case
+bool nameMatches(std::string_view name, std::string_view foldedPattern);
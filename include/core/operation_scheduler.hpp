@@ -0,0 +1,127 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+#include <sys/types.h>   // for dev_t
+
+namespace fs = std::filesystem;
+
+// Priority of a job submitted to the scheduler
+// Lower value runs first, so interactive GUI requests jump
+// ahead of bulk background work queued on the same device
+enum class JobPriority {
+    INTERACTIVE = 0,
+    NORMAL = 1,
+    BACKGROUND = 2
+};
+
+// Kind of storage backing a device, detected from sysfs
+enum class DeviceKind {
+    ROTATIONAL,   // spinning disk, parallel random I/O kills throughput
+    SSD,          // SATA/SAS solid state disk
+    NVME,         // NVMe drive with deep hardware queues
+    UNKNOWN       // virtual filesystems (tmpfs, overlay, network, ...)
+};
+
+// Central scheduler for file operations
+// Jobs are grouped by the device (st_dev) of the path they touch and
+// every device gets its own queue with its own concurrency limit, so a
+// slow HDD never blocks work on a fast SSD and an HDD is never hammered
+// with parallel random I/O
+class OperationScheduler {
+public:
+    // A job returns true on success, like IFileManagerPlugin::execute
+    using Job = std::function<bool()>;
+
+    // Shared scheduler used by the GUI and the plugins
+    static OperationScheduler& instance();
+
+    OperationScheduler();
+    ~OperationScheduler();   // Finishes queued jobs and joins all workers
+
+    // Queue a job on the device that holds `path`
+    // If the path does not exist yet (e.g. a copy destination) the nearest
+    // existing parent decides the device
+    // The future carries the job result, or the exception it threw
+    std::future<bool> submit(const fs::path& path, Job job,
+                             JobPriority priority = JobPriority::NORMAL);
+
+    // Submit a job and wait for its result
+    // Called from inside a scheduled job it runs inline instead, so a job that
+    // calls a plugin can never deadlock waiting for its own device slot
+    bool run(const fs::path& path, Job job, JobPriority priority = JobPriority::NORMAL);
+
+    // Override the automatically chosen concurrency of a device
+    void setDeviceConcurrency(dev_t device, size_t limit);
+
+    // Current concurrency limit of a device (detected on first use)
+    size_t deviceConcurrency(dev_t device);
+
+    // Block until every queued and running job has finished
+    void waitIdle();
+
+    // Stop accepting jobs, drain the queues and join the workers
+    void shutdown();
+
+    // Device that holds the path, or of its nearest existing parent
+    static dev_t deviceOf(const fs::path& path);
+
+    // Look up /sys/dev/block/<major>:<minor> to classify the device
+    static DeviceKind detectDeviceKind(dev_t device);
+
+    // Concurrency picked for each device kind
+    static size_t defaultConcurrency(DeviceKind kind);
+
+private:
+    struct QueuedJob {
+        JobPriority priority;
+        uint64_t sequence;   // keeps FIFO order within one priority
+        Job job;
+        std::shared_ptr<std::promise<bool>> promise;
+    };
+
+    // Orders the priority queue: highest priority first, then oldest first
+    struct JobOrder {
+        bool operator()(const QueuedJob& a, const QueuedJob& b) const {
+            if (a.priority != b.priority) {
+                return a.priority > b.priority;
+            }
+            return a.sequence > b.sequence;
+        }
+    };
+
+    // Everything belonging to one device
+    struct DeviceQueue {
+        std::priority_queue<QueuedJob, std::vector<QueuedJob>, JobOrder> jobs;
+        std::vector<std::thread> workers;
+        std::condition_variable workAvailable;   // signalled when a job is queued
+        size_t limit = 1;     // maximum jobs running at the same time
+        size_t running = 0;   // jobs running right now
+    };
+
+    // Worker loop for one device
+    void workerLoop(DeviceQueue* queue);
+
+    // Find or create the queue of a device (mutex_ must be held)
+    DeviceQueue& queueFor(dev_t device);
+
+    std::mutex mutex_;
+    std::condition_variable idle_;            // signalled when a job finishes
+    std::map<dev_t, std::unique_ptr<DeviceQueue>> devices_;
+    uint64_t nextSequence_ = 0;
+    size_t pending_ = 0;       // queued + running jobs over all devices
+    bool stopping_ = false;
+
+    // Disable copy and move semantics, workers keep pointers into this object
+    OperationScheduler(const OperationScheduler&) = delete;
+    OperationScheduler& operator=(const OperationScheduler&) = delete;
+};
@@ -0,0 +1,195 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "directory_listing.hpp"
+#include "fs_result.hpp"
+#include "rate_limiter.hpp"
+
+// Index of a node in a PathStore, stable for the lifetime of the store
+using PathId = uint32_t;
+
+// In-memory tree of paths for scans of millions of entries
+//
+// A node is a parent index, an interned name id, a type and a size in flat
+// columns (about 25 bytes), full paths are only built when asked for. Names
+// are interned once in an arena of fixed blocks: "src", "CMakeLists.txt" or
+// ".git" cost their bytes once however often they appear, and per-name work
+// (matching a pattern) runs once per distinct name. The entries of one
+// directory are stored next to each other, so children are a range and a
+// subtree is walked without any lookup.
+//
+// Nodes are only ever appended. Listing a directory again gives it a new
+// range of children, the old ones stay but are no longer reachable.
+//
+// Any number of threads can read while one scans: writers take the mutex
+// exclusively for each directory they add, readers share it. Single calls
+// lock on their own; a Reader holds the shared lock for a batch of calls.
+class PathStore {
+public:
+    static constexpr PathId NONE = UINT32_MAX;
+
+    class Reader {
+    public:
+        explicit Reader(const PathStore& store) : store_(store), lock_(store.sharedLock()) {}
+
+        size_t size() const { return store_.parents_.size(); }
+        PathId parent(PathId id) const { return store_.parents_[id]; }
+        uint32_t nameId(PathId id) const { return store_.nameIds_[id]; }
+        std::string_view name(PathId id) const { return store_.names_[store_.nameIds_[id]]; }
+        EntryType type(PathId id) const { return store_.types_[id]; }
+        bool isDirectory(PathId id) const { return store_.types_[id] == EntryType::DIRECTORY; }
+        uint64_t fileSize(PathId id) const { return store_.sizes_[id]; }
+
+        // Children are [firstChild, firstChild + childCount), none until the directory was listed
+        PathId firstChild(PathId id) const { return store_.firstChildren_[id]; }
+        uint32_t childCount(PathId id) const { return store_.childCounts_[id]; }
+
+        // Rebuilds the full path, appended to `out` so a loop can reuse one buffer
+        void appendPath(PathId id, std::string& out) const;
+        std::string path(PathId id) const;
+
+        // True if `id` is `ancestor` or below it, O(depth)
+        bool isWithin(PathId id, PathId ancestor) const;
+
+        // Node of an absolute path below one of the roots, NONE if not stored
+        PathId lookup(std::string_view path) const;
+
+        // Calls `visit(id)` for `root` and every node below it, parents before
+        // children; children of a directory are skipped if `visit` returns false
+        template <typename Visit>
+        void forEach(PathId root, Visit&& visit) const {
+            std::vector<PathId> stack{root};
+            while (!stack.empty()) {
+                const PathId id = stack.back();
+                stack.pop_back();
+                if (!visit(id)) {
+                    continue;
+                }
+                const uint32_t count = childCount(id);
+                for (uint32_t i = count; i > 0; --i) {
+                    stack.push_back(firstChild(id) + i - 1);
+                }
+            }
+        }
+
+    private:
+        const PathStore& store_;
+        std::shared_lock<std::shared_mutex> lock_;
+    };
+
+    PathStore();
+    ~PathStore();
+
+    // Adds the top of a tree, `path` is kept whole as its name
+    PathId addRoot(std::string_view path, EntryType type = EntryType::DIRECTORY, uint64_t size = 0);
+
+    // Makes the rows of `entries` the children of `directory` (sizes only for
+    // rows with metadata), returns the id of the first one
+    PathId setChildren(PathId directory, const DirectoryListing& entries);
+
+    std::vector<PathId> roots() const;
+
+    // Locking shortcuts for a single question
+    size_t size() const;
+    std::string path(PathId id) const;
+    PathId lookup(std::string_view path) const;
+
+    // Bytes of the files and symlinks at or below `root` (apparent sizes, a
+    // hard link is counted once per name)
+    uint64_t subtreeSize(PathId root) const;
+
+    // Nodes below `root` whose name matches the glob `pattern` (fnmatch)
+    std::vector<PathId> find(PathId root, const std::string& pattern) const;
+
+    size_t nameCount() const;
+    size_t nameBytes() const;   // arena bytes in use
+    size_t memoryUsage() const;
+
+    void clear();
+
+    PathStore(const PathStore&) = delete;
+    PathStore& operator=(const PathStore&) = delete;
+
+private:
+    // PRIVATE METHODS
+    std::shared_lock<std::shared_mutex> sharedLock() const;
+    std::unique_lock<std::shared_mutex> exclusiveLock();
+
+    // (mutex_ held)
+    uint32_t intern(std::string_view name);
+    uint32_t findName(std::string_view name) const;   // NONE if never interned
+    void growNameTable();
+    PathId addNode(PathId parent, uint32_t nameId, EntryType type, uint64_t size);
+
+    mutable std::shared_mutex mutex_;
+    mutable std::mutex gate_;   // taken while acquiring mutex_, keeps writers from starving
+
+    // Node columns
+    std::vector<PathId> parents_;
+    std::vector<uint32_t> nameIds_;
+    std::vector<EntryType> types_;
+    std::vector<uint64_t> sizes_;
+    std::vector<PathId> firstChildren_;
+    std::vector<uint32_t> childCounts_;
+    std::vector<PathId> roots_;
+
+    // Interned names: bytes in arena blocks that never move (NUL-terminated
+    // for fnmatch), an open-addressing table of name ids for lookups
+    std::vector<std::unique_ptr<char[]>> blocks_;
+    size_t blockUsed_ = 0;
+    size_t blockSize_ = 0;
+    size_t arenaBytes_ = 0;       // names plus their NULs
+    size_t arenaAllocated_ = 0;   // all blocks
+    std::vector<std::string_view> names_;
+    std::vector<uint32_t> nameTable_;
+};
+
+// Fills a PathStore from the disk without building a path per entry
+//
+// Directories are opened relative to their parent's descriptor (openat) and
+// read with getdents64 through DirectoryEnumerator; with `metadata` every
+// entry is fstatat()ed for its size, otherwise only entries whose type
+// readdir did not report. Depth-first, so at most one descriptor per level
+// is open (deep trees fall back to full paths below MAX_OPEN_DEPTH).
+// Readers of the store see each directory as soon as it was added.
+// A rate limiter is charged one op per directory read and per entry stat()ed.
+class TreeScanner {
+public:
+    struct Options {
+        bool metadata = true;          // sizes, needed for subtreeSize()
+        bool sameFilesystem = false;   // do not descend into other mounts
+        std::shared_ptr<RateLimiter> limiter;   // none = full speed
+    };
+
+    static constexpr size_t MAX_OPEN_DEPTH = 64;
+
+    explicit TreeScanner(PathStore& store);
+    TreeScanner(PathStore& store, Options options);
+
+    // Scans the tree at `root` into the store, returns its root node.
+    // Unreadable directories below the root are counted, not fatal
+    FsResult<PathId> scan(const std::string& root);
+
+    // Stops a scan in progress (from another thread) at the next directory
+    void cancel();
+
+    uint64_t directories() const { return directories_.load(std::memory_order_relaxed); }
+    uint64_t entries() const { return entries_.load(std::memory_order_relaxed); }
+    uint64_t errors() const { return errors_.load(std::memory_order_relaxed); }
+
+private:
+    PathStore& store_;
+    const Options options_;
+    std::atomic<bool> cancelled_{false};
+    std::atomic<uint64_t> directories_{0};
+    std::atomic<uint64_t> entries_{0};
+    std::atomic<uint64_t> errors_{0};
+};
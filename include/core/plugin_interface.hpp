@@ -2,6 +2,10 @@
 
 #include<string>
 #include<vector>
+#include <memory_resource>
+
+// Arguments of one call in a batch, allocated from the batch's memory resource
+using PluginArgs = std::pmr::vector<std::pmr::string>;
 
 //base interface class for all file manager plugins
 //Any plugin which is added must inherit from this class and
@@ -32,6 +36,45 @@ public:
     virtual bool execute(const std::string& operation, const std::vector<std::string>& args) = 0;
 };
 
+// Optional capability of a plugin that runs many calls of one operation at once
+//
+// Kept out of IFileManagerPlugin so that class's vtable, the plugin ABI,
+// stays as it was: a plugin built against an older header still loads and
+// simply gets its calls one at a time. A plugin offering batches derives
+// from both classes and exports get_batch_plugin() (see below).
+class IBatchPlugin {
+public:
+    virtual ~IBatchPlugin() = default;
+
+    // Runs `operation` once per element of `calls`, sets results[i] to the
+    // outcome of calls[i] and returns how many succeeded. A failed call does
+    // not stop the ones after it.
+    // The arguments live in `memory`, usually a monotonic arena the caller
+    // releases after the batch; a plugin can allocate its per-call strings
+    // and listings there as well (see the std::pmr overloads of FileSystem)
+    // instead of one heap allocation each.
+    virtual size_t executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                                std::pmr::memory_resource* memory, std::vector<bool>& results) = 0;
+};
+
+// What a batch is for a plugin without IBatchPlugin: each call copied into
+// one reused std::vector<std::string> and passed to execute()
+inline size_t executeEach(IFileManagerPlugin& plugin, const std::string& operation,
+                          const std::pmr::vector<PluginArgs>& calls, std::vector<bool>& results) {
+    results.assign(calls.size(), false);
+    size_t succeeded = 0;
+    std::vector<std::string> args;
+    for (size_t i = 0; i < calls.size(); ++i) {
+        args.resize(calls[i].size());
+        for (size_t j = 0; j < args.size(); ++j) {
+            args[j].assign(calls[i][j].data(), calls[i][j].size());
+        }
+        results[i] = plugin.execute(operation, args);
+        succeeded += results[i] ? 1 : 0;
+    }
+    return succeeded;
+}
+
 //extern "C" is used for disabling name mangling
 //Name mangling means compiler changes names behind the scenes
 //in order to account function overloading support
@@ -41,4 +84,9 @@ public:
 //
 extern "C" {
     IFileManagerPlugin* create_plugin();
+
+    // Optional: the IBatchPlugin side of a plugin made by create_plugin(),
+    // nullptr if it has none. Looked up with dlsym, plugins without it run
+    // batches through executeEach()
+    IBatchPlugin* get_batch_plugin(IFileManagerPlugin* plugin);
 }
\ No newline at end of file
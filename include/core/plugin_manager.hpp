@@ -20,6 +20,7 @@
 #endif
 
 #include "plugin_interface.hpp"  // Include the plugin interface that all plugins must implement
+#include "metrics.hpp"
 
 // Class responsible for managing plugins dynamically loaded from shared libraries
 class PluginManager {
@@ -42,6 +43,20 @@ public:
     // Return the number of successfully loaded plugins
     size_t pluginCount() const;
 
+    // Run an operation on the plugin that provides it (first loaded plugin wins)
+    // Each call is recorded in Metrics under "plugin.<operation>"
+    // Returns false if no plugin provides the operation
+    bool executeOperation(const std::string& operation, const std::vector<std::string>& args);
+
+    // Runs a batch of calls of one operation through the plugin's
+    // IBatchPlugin if it exports one, else through executeEach(). The batch is one sample of
+    // "plugin.<operation>" with the calls as its entries, failed if any call
+    // failed. While a workload is recorded the calls go one at a time through
+    // executeOperation() so each gets its record.
+    // Returns how many calls succeeded, 0 if no plugin provides the operation
+    size_t executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                        std::pmr::memory_resource* memory, std::vector<bool>& results);
+
 private:
     // Structure to keep track of a loaded plugin:
     // - The plugin instance (as a unique_ptr for automatic memory management)
@@ -59,6 +74,15 @@ private:
     // Fast lookup table mapping plugin name to its instance pointer
     std::unordered_map<std::string, IFileManagerPlugin*> nameToPlugin_;
 
+    // Plugin providing an operation, its batch side (nullptr if it has none,
+    // see get_batch_plugin()) and the metric its calls are recorded under
+    struct OperationEntry {
+        IFileManagerPlugin* plugin;
+        IBatchPlugin* batch;
+        MetricId metric;
+    };
+    std::unordered_map<std::string, OperationEntry> operationToPlugin_;
+
     //Helper function to tell which type of os files we need to use
     bool is_shared_library(const std::filesystem::path& path) const;
     // Internal helper function to load a single plugin file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "directory_cache.hpp"
+#include "operation_scheduler.hpp"
+
+// Lists directories the user is likely to open next, before they do
+//
+// The GUI names the candidates (hovered and selected folders, back/forward
+// history neighbours, the parent); each one is enumerated as a BACKGROUND
+// job on its device's scheduler queue at idle I/O priority, the first rows
+// are stat()ed to warm the inode cache, and the listing lands in the
+// DirectoryCache. Candidates that drop out of the target set are cancelled.
+class Prefetcher {
+public:
+    // Rows stat()ed per prefetched directory, enough for the first screens
+    static constexpr size_t METADATA_ROWS = 4096;
+
+    explicit Prefetcher(DirectoryCache& cache = DirectoryCache::instance(),
+                        OperationScheduler& scheduler = OperationScheduler::instance());
+    ~Prefetcher();   // cancels everything and waits for running jobs
+
+    // Makes `paths` the set worth prefetching: missing ones are queued,
+    // requests for anything else are cancelled
+    void setTargets(const std::vector<std::string>& paths);
+
+    // Adds one directory without cancelling the others
+    void prefetch(const std::string& path);
+
+    void cancelAll();
+
+    // Requests queued or running
+    size_t pending() const;
+
+    // Blocks until every request has finished or was cancelled
+    void waitIdle();
+
+    // Directories listed (not cancelled, not already cached) since construction
+    uint64_t completedCount() const { return completed_.load(std::memory_order_relaxed); }
+
+    Prefetcher(const Prefetcher&) = delete;
+    Prefetcher& operator=(const Prefetcher&) = delete;
+
+private:
+    struct Request {
+        std::atomic<bool> cancelled{false};
+    };
+
+    // mutex_ must be held
+    void startRequest(const std::string& path);
+
+    // Body of one scheduler job
+    void run(const std::string& path, const std::shared_ptr<Request>& request);
+
+    DirectoryCache& cache_;
+    OperationScheduler& scheduler_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    std::map<std::string, std::shared_ptr<Request>> requests_;
+    size_t running_ = 0;   // jobs submitted and not yet finished, cancelled or not
+    std::atomic<uint64_t> completed_{0};
+};
@@ -0,0 +1,142 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "fs_result.hpp"
+#include "operation_scheduler.hpp"
+#include "rate_limiter.hpp"
+
+// How much the trash may hold before the purge removes the oldest entries
+struct TrashLimits {
+    uint64_t maxBytes = 0;            // per trash directory, 0 = no size limit
+    std::chrono::seconds maxAge{0};   // 0 = entries do not expire
+};
+
+// One trashed file or tree
+struct TrashEntry {
+    std::string trashDirectory;   // holds files/ and info/
+    std::string name;             // under files/, the info file is name + ".trashinfo"
+    std::string originalPath;     // absolute
+    int64_t deletionTime = 0;     // seconds since the epoch
+
+    std::string filesPath() const { return trashDirectory + "/files/" + name; }
+    std::string infoPath() const { return trashDirectory + "/info/" + name + ".trashinfo"; }
+};
+
+// Delete by rename into a trash directory, purge later in the background
+//
+// Trashing is a rename(2) on the same filesystem, constant time whatever the
+// size of the tree. The layout is the freedesktop.org trash, so desktop file
+// managers see and restore the same entries:
+// - paths on the filesystem of the home trash ($XDG_DATA_HOME/Trash) go there
+// - anything else goes to $topdir/.Trash/$uid (if an admin created a sticky
+//   .Trash) or $topdir/.Trash-$uid on the mount it lives on
+// - info/<name>.trashinfo holds the original path and deletion date and is
+//   written (O_EXCL) before the rename, so a crash never leaves an entry
+//   that cannot be restored
+// Removing the trees happens in BACKGROUND scheduler jobs at idle I/O
+// priority: entries past maxAge, then the oldest ones while a trash
+// directory holds more than maxBytes, plus orphans left by crashes. A rate
+// limiter, if set, is charged one op per file or directory the purge removes.
+class TrashManager {
+public:
+    // Trash of the current user, limits from FM_TRASH_MAX_MB and FM_TRASH_MAX_DAYS,
+    // purges throttled by RateLimiter::background()
+    static TrashManager& instance();
+
+    // $XDG_DATA_HOME/Trash, else ~/.local/share/Trash
+    static std::string defaultHomeTrash();
+
+    static TrashLimits limitsFromEnvironment();
+
+    // With `scanMounts` the topdir trashes of every mounted filesystem are
+    // listed and purged, else only the ones this object trashed into
+    explicit TrashManager(std::string homeTrash = defaultHomeTrash(), bool scanMounts = true,
+                          OperationScheduler& scheduler = OperationScheduler::instance());
+    ~TrashManager();   // stops purging between entries, waits for the jobs
+
+    // Moves `path` to the trash of its filesystem. EXDEV if that filesystem
+    // has no usable trash directory (read-only, no permission to create one)
+    FsResult<TrashEntry> trash(const std::string& path);
+
+    // Moves the entry back, recreating missing parent directories. EEXIST if
+    // something was created at the original path in the meantime
+    FsStatus restore(const TrashEntry& entry);
+
+    // Most recently trashed entry that came from `originalPath`, ENOENT if none
+    FsResult<TrashEntry> lastTrashed(const std::string& originalPath) const;
+
+    // Every entry of every trash directory of this user, oldest first.
+    // Looks at each mount point, keep it off the GUI thread
+    std::vector<TrashEntry> list() const;
+
+    // Removes an entry for good, on the calling thread
+    FsStatus erase(const TrashEntry& entry);
+
+    void setLimits(const TrashLimits& limits);
+    TrashLimits limits() const;
+
+    // Throttles purges, including one in progress; nullptr = full speed
+    void setRateLimiter(std::shared_ptr<RateLimiter> limiter);
+    std::shared_ptr<RateLimiter> rateLimiter() const;
+
+    // Queues a purge of every trash directory; `everything` empties them
+    void schedulePurge(bool everything = false);
+
+    // Purges on the calling thread, returns the number of entries removed
+    size_t purge(bool everything = false);
+
+    // Blocks until queued purges have finished
+    void waitIdle();
+
+    const std::string& homeTrash() const { return homeTrash_; }
+    uint64_t trashedCount() const { return trashed_.load(std::memory_order_relaxed); }
+    uint64_t purgedCount() const { return purged_.load(std::memory_order_relaxed); }
+    uint64_t purgedBytes() const { return purgedBytes_.load(std::memory_order_relaxed); }
+
+    TrashManager(const TrashManager&) = delete;
+    TrashManager& operator=(const TrashManager&) = delete;
+
+private:
+    // Trash directory for files on the filesystem of `path`, created if
+    // needed; `topdir` is "" for the home trash
+    FsResult<std::string> trashDirectoryFor(const std::string& path, dev_t device, std::string& topdir);
+
+    // Home trash, the topdir trashes used and those found on mounted filesystems
+    std::vector<std::string> trashDirectories() const;
+    std::vector<TrashEntry> entriesOf(const std::string& directory) const;
+
+    // Adds the bytes freed, charges `limiter` if given
+    FsStatus eraseEntry(const TrashEntry& entry, uint64_t& bytes, RateLimiter* limiter = nullptr);
+    size_t purgeDirectory(const std::string& directory, bool everything);
+    uint64_t entrySize(const TrashEntry& entry);
+    void startPurge(const std::string& directory, bool everything);
+
+    const std::string homeTrash_;
+    const bool scanMounts_;
+    OperationScheduler& scheduler_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable idle_;
+    TrashLimits limits_;
+    std::shared_ptr<RateLimiter> limiter_;
+    std::map<dev_t, std::pair<std::string, std::string>> devices_;   // device -> trash directory, topdir
+    std::set<std::string> used_;                                      // trash directories written to
+    std::map<std::string, bool> queued_;      // trash directory -> everything, purge not started yet
+    std::map<std::string, uint64_t> sizes_;   // files path + deletion time -> bytes on disk
+    size_t running_ = 0;                      // purge jobs submitted and not finished
+
+    std::atomic<bool> stopping_{false};
+    std::atomic<uint64_t> trashed_{0};
+    std::atomic<uint64_t> purged_{0};
+    std::atomic<uint64_t> purgedBytes_{0};
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <sys/types.h>
+#include <unordered_map>
+
+// File types the detector knows, each with a MIME type and a description
+enum class FileType : uint8_t {
+    UNKNOWN,      // not detected (yet), or the file could not be read
+    DIRECTORY,
+    EMPTY,
+    TEXT,
+    BINARY,
+    // Images
+    PNG, JPEG, GIF, WEBP, BMP, TIFF, ICO, SVG,
+    // Documents
+    PDF, POSTSCRIPT, HTML, XML, JSON, MARKDOWN, RTF, OPEN_DOCUMENT, OFFICE_XML,
+    // Archives
+    ZIP, GZIP, BZIP2, XZ, ZSTD, SEVEN_ZIP, RAR, TAR,
+    // Audio and video
+    MP3, OGG, FLAC, WAV, MP4, MATROSKA, AVI,
+    // Programs and data
+    ELF, SHELL_SCRIPT, PYTHON, C_SOURCE, CPP_SOURCE, C_HEADER, SQLITE, FONT_TTF, FONT_OTF,
+    COUNT
+};
+
+// Classifies files by name, and by content when the name says nothing
+//
+// The extension decides first and costs no I/O. Files without a known
+// extension are sniffed: the first SNIFF_BYTES are pread() and compared
+// against a table of magic numbers, each signature pre-split into 64-bit
+// value/mask words so a match is two masked word compares. Sniffed results
+// are cached by (device, inode) and reused while mtime and size are
+// unchanged, so listing the same directory again only costs the fstatat().
+// Thread-safe.
+class TypeDetector {
+public:
+    // Covers every signature in the table (tar's "ustar" sits at offset 257)
+    static constexpr size_t SNIFF_BYTES = 512;
+
+    // Cached files; the oldest half is dropped when exceeded
+    static constexpr size_t DEFAULT_CAPACITY = 256 * 1024;
+
+    // Detector shared by the GUI and the background jobs
+    static TypeDetector& instance();
+
+    explicit TypeDetector(size_t capacity = DEFAULT_CAPACITY);
+
+    // By name only, UNKNOWN if the extension is not in the table
+    static FileType fromExtension(std::string_view name);
+
+    // By the first bytes of a file (at most SNIFF_BYTES are looked at)
+    static FileType fromContent(const unsigned char* data, size_t size);
+
+    // Extension first, then cache, then content; follows symlinks
+    // `name` is relative to `directoryFd` (AT_FDCWD for a plain path). The
+    // extension is trusted without a stat(), callers know directories from
+    // their listing.
+    FileType detect(int directoryFd, const std::string& name);
+    FileType detect(const std::string& path);
+
+    static std::string_view mimeType(FileType type);
+    static std::string_view description(FileType type);
+
+    void clearCache();
+    size_t cacheSize() const;
+    uint64_t cacheHits() const { return cacheHits_.load(std::memory_order_relaxed); }
+    uint64_t contentReads() const { return contentReads_.load(std::memory_order_relaxed); }
+
+    TypeDetector(const TypeDetector&) = delete;
+    TypeDetector& operator=(const TypeDetector&) = delete;
+
+private:
+    struct Key {
+        dev_t device;
+        ino_t inode;
+        bool operator==(const Key& other) const { return device == other.device && inode == other.inode; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& key) const {
+            return std::hash<uint64_t>()(static_cast<uint64_t>(key.inode) * 0x9E3779B97F4A7C15ull ^
+                                         static_cast<uint64_t>(key.device));
+        }
+    };
+    struct Entry {
+        int64_t mtime;   // nanoseconds
+        uint64_t size;
+        FileType type;
+    };
+    using Map = std::unordered_map<Key, Entry, KeyHash>;
+
+    bool lookup(const Key& key, int64_t mtime, uint64_t size, FileType& type);
+    void store(const Key& key, const Entry& entry);
+
+    const size_t capacity_;
+    mutable std::mutex mutex_;
+    // Two generations instead of a full LRU: hits in `previous_` move to
+    // `current_`, and when `current_` fills up it becomes `previous_`
+    Map current_;
+    Map previous_;
+    std::atomic<uint64_t> cacheHits_{0};
+    std::atomic<uint64_t> contentReads_{0};
+};
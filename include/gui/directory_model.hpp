@@ -0,0 +1,142 @@
+#pragma once
+
+#include <QAbstractTableModel>
+#include <QElapsedTimer>
+#include <QFileIconProvider>
+#include <QTimer>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/change_feed.hpp"
+#include "core/directory_listing.hpp"
+#include "core/type_detector.hpp"
+#include "gui/thumbnail_service.hpp"
+
+// Table model of one directory, built for directories with 500k+ entries
+//
+// Unlike QFileSystemModel it never stats the whole directory:
+// - entries are read in the background (DirectoryEnumerator) and appended
+//   in chunks, so the first rows show up while the rest is still loading
+// - rows live in a DirectoryListing (a few flat arrays, no node per file)
+// - size/date are stat()ed in the background only for rows the view asks for;
+//   the same jobs sniff the type of files without a known extension
+// - sorting and the name filter run on the thread pool; the view shows the
+//   old order until the new one is swapped in with a single layout change
+// - the directory is watched through the ChangeFeed: entries added, removed
+//   or renamed reload it, modified files only get their rows stat()ed again
+class DirectoryModel : public QAbstractTableModel {
+    Q_OBJECT
+
+public:
+    enum Column { NameColumn, SizeColumn, TypeColumn, DateColumn, ColumnCount };
+
+    explicit DirectoryModel(QObject* parent = nullptr);
+    ~DirectoryModel() override;
+
+    // Starts loading `path`, the previous contents are dropped right away
+    void setDirectory(const QString& path);
+    QString directory() const { return m_directory; }
+
+    // Case-insensitive substring filter on names, "" shows everything
+    void setNameFilter(const QString& text);
+    QString nameFilter() const { return m_filter; }
+
+    QString filePath(const QModelIndex& index) const;
+    bool isDir(const QModelIndex& index) const;
+    bool isLoading() const { return m_loading; }
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    int columnCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+    QVariant headerData(int section, Qt::Orientation orientation, int role = Qt::DisplayRole) const override;
+    void sort(int column, Qt::SortOrder order = Qt::AscendingOrder) override;
+
+    // Stats rows [first, last] if they are not loaded yet (the view's visible range)
+    void fetchMetadata(int first, int last);
+
+    // Image rows get previews from `service` (not owned, may be null)
+    void setThumbnailService(ThumbnailService* service);
+
+    // Makes the images among rows [first, last] the ones thumbnailed, queued
+    // work for other rows is cancelled
+    void requestThumbnails(int first, int last);
+
+signals:
+    void loadingFinished(qint64 entries, qint64 milliseconds);
+    void loadingFailed(const QString& message);
+
+private:
+    // Cancellation flag shared with background jobs (one load, or one sort/filter)
+    struct LoadContext {
+        std::atomic<bool> cancelled{false};
+        int64_t stamp = -1;   // directory mtime when the load started, for DirectoryCache
+    };
+
+    void appendChunk(quint64 generation, const std::shared_ptr<DirectoryListing>& chunk);
+    void finishLoading(quint64 generation, bool ok, const QString& message);
+    void showCachedListing(const DirectoryListing& cached);
+    void requestMetadata(int row) const;
+    void flushMetadataRequests();
+    void applyMetadata(quint64 generation, const std::vector<int>& rows, const DirectoryListing& batch,
+                       const std::vector<FileType>& sniffed);
+
+    // Live updates from the ChangeFeed
+    void watchDirectory(const QString& path);
+    void directoryChanged(quint64 generation, bool structural, const std::vector<std::string>& modifiedNames);
+    void reload();
+
+    // Type by extension, else as sniffed by a metadata job (UNKNOWN until then)
+    FileType fileTypeOf(size_t row) const;
+    QIcon iconFor(FileType type) const;
+    void thumbnailReady(const QString& path);
+
+    // Starts a background sort (if `resort`, or a superseded sort was never
+    // applied) and filter of the current listing
+    void startArrange(bool resort);
+    void applyArrangement(quint64 serial, bool resort, std::vector<uint32_t>& order,
+                          std::vector<uint32_t>& rows, const std::string& pattern, const DirectoryListing& snapshot);
+    void rebuildViewRows();
+    int listingRow(int viewRow) const { return static_cast<int>(m_rows[static_cast<size_t>(viewRow)]); }
+
+    QString m_directory;
+    DirectoryListing m_listing;
+    std::shared_ptr<LoadContext> m_context;
+    quint64 m_generation = 0;
+    bool m_loading = false;
+    QElapsedTimer m_loadTimer;
+
+    // Row mapping: m_order holds every listing row in sort order, m_rows the
+    // ones passing the filter (view row -> listing row), m_viewRowOf the inverse
+    std::vector<uint32_t> m_order;
+    std::vector<uint32_t> m_rows;
+    std::vector<int32_t> m_viewRowOf;
+    int m_sortColumn = -1;   // -1: directory order
+    Qt::SortOrder m_sortOrder = Qt::AscendingOrder;
+    QString m_filter;
+    std::string m_appliedFilter;   // folded pattern m_rows was built with
+    std::shared_ptr<LoadContext> m_arrangeContext;
+    quint64 m_arrangeSerial = 0;
+    bool m_resortPending = false;   // a sort was started and not applied yet
+
+    // Rows data() was asked for, stat()ed and sniffed in one batch
+    mutable std::vector<int> m_pendingRows;
+    mutable QTimer m_metadataTimer;
+    // Per listing row: a stat-and-sniff job was started. Not the same as
+    // hasMetadata(), a sort by size or date loads metadata without sniffing
+    std::vector<uint8_t> m_metadataRequested;
+    std::vector<FileType> m_sniffedTypes;   // per listing row, filled with the metadata
+
+    QFileIconProvider m_iconProvider;
+    QIcon m_folderIcon;
+    QIcon m_fileIcon;
+    mutable std::vector<QIcon> m_typeIcons;   // by FileType, looked up on first use
+
+    ChangeFeed::SubscriptionId m_subscription = 0;
+    std::string m_watchedDirectory;   // canonical, "" if not watched
+    QTimer m_reloadTimer;             // structural changes wait for a quiet moment
+
+    ThumbnailService* m_thumbnails = nullptr;
+    QHash<QString, uint32_t> m_thumbnailRows;   // file name -> listing row, for requested thumbnails
+};
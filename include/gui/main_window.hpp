@@ -1,8 +1,17 @@
 #pragma once
 
 #include <QMainWindow>
-#include <QFileSystemModel>
+#include <QLineEdit>
+#include <QTimer>
 #include <QTreeWidgetItem>
+#include <memory>
+
+#include "core/plugin_manager.hpp"
+#include "core/prefetcher.hpp"
+#include "gui/directory_model.hpp"
+#include "gui/operations_panel.hpp"
+#include "gui/thumbnail_service.hpp"
+#include "utilities/logger.hpp"
 
 // Forward declaration of the auto-generated UI class
 QT_BEGIN_NAMESPACE
@@ -16,6 +25,10 @@ public:
     MainWindow(QWidget* parent = nullptr);
     ~MainWindow();
 
+protected:
+    // Catches the first paint of the file table (time-to-first-paint)
+    bool eventFilter(QObject* watched, QEvent* event) override;
+
 private slots:
     void on_fileTableView_doubleClicked(const QModelIndex &index);
     void on_navigationTreeWidget_itemClicked(QTreeWidgetItem *item, int column);
@@ -27,9 +40,43 @@ private:
     void setupModels();
     void setupConnections();
     void navigateToPath(const QString& path);
+    void fetchVisibleMetadata();
+    void scheduleVisibleFetch();
+    void updatePrefetchTargets();
+
+    // File operations on the table selection, run as background jobs
+    void setupFileActions();
+    QStringList selectedPaths() const;
+    void copySelection(bool cut);
+    void pasteIntoCurrentDirectory();
+    void trashSelection();
+    void deleteSelection();   // permanently, after a confirmation
+    void undoTrash();
+
+    // Startup work that can wait until the window is on screen
+    void initializeDeferred();
+    void reportStartupIfReady();
 
     Ui::MainWindow *ui;
-    QFileSystemModel *m_fileSystemModel;
+    DirectoryModel *m_directoryModel;
+    QLineEdit *m_filterEdit;
+    std::unique_ptr<Prefetcher> m_prefetcher;
+    ThumbnailService *m_thumbnailService = nullptr;
+    QTimer *m_visibleFetchTimer;   // coalesces row insertions and layout changes
+    QString m_hoveredDirectory;    // folder under the mouse, prefetched
+    QString m_selectedDirectory;   // current folder row, prefetched
+    OperationsPanel *m_operationsPanel;
+    QStringList m_clipboardPaths;  // internal clipboard for copy/cut + paste
+    bool m_clipboardCut = false;
+    std::shared_ptr<FileOperationJob> m_lastTrashJob;   // undone by Ctrl+Z
+
+    // Created by initializeDeferred() after the first paint
+    std::unique_ptr<Logger> m_logger;
+    std::unique_ptr<PluginManager> m_pluginManager;
+    bool m_firstPaintSeen = false;
+    bool m_deferredDone = false;
+    bool m_initialListingDone = false;
+    bool m_startupReported = false;
     QList<QString> m_history;
     int m_historyIndex = -1;
 };
\ No newline at end of file
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QDockWidget>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <memory>
+#include <vector>
+
+#include "core/file_operation_job.hpp"
+
+class QLabel;
+class QProgressBar;
+class QPushButton;
+class QVBoxLayout;
+
+// Dock listing running and finished copy/move/remove jobs
+//
+// Jobs run on the OperationScheduler, the panel never waits for them. A
+// single 33 ms timer polls every job's atomic counters, so the UI repaints at
+// most ~30 times a second no matter how fast files complete; the timer only
+// runs while a job is active. Rates are smoothed over the ticks and do not
+// count time spent paused.
+class OperationsPanel : public QDockWidget {
+    Q_OBJECT
+
+public:
+    explicit OperationsPanel(QWidget* parent = nullptr);
+    ~OperationsPanel() override;
+
+    // Shows `job` and starts it on the scheduler at INTERACTIVE priority
+    void addJob(const std::shared_ptr<FileOperationJob>& job, const QString& title);
+
+    bool hasActiveJobs() const;
+
+signals:
+    // Directories whose contents the finished job changed
+    void jobFinished(const QStringList& directories, bool ok);
+
+private:
+    struct Row {
+        std::shared_ptr<FileOperationJob> job;
+        QWidget* widget = nullptr;
+        QLabel* title = nullptr;
+        QProgressBar* bar = nullptr;
+        QLabel* stats = nullptr;
+        QPushButton* pause = nullptr;
+        QPushButton* cancel = nullptr;
+        bool paused = false;   // as requested by the button, the job follows at its next checkpoint
+        bool done = false;
+
+        // Rate smoothing, updated once per tick
+        qint64 lastMs = 0;
+        uint64_t lastBytes = 0;
+        uint64_t lastFiles = 0;
+        double bytesPerSecond = 0;
+        double filesPerSecond = 0;
+    };
+
+    void tick();
+    void updateRow(Row& row, qint64 nowMs);
+    void clearFinished();
+    static QString formatStats(const Row& row, const JobProgress& progress);
+    static QStringList affectedDirectories(const FileOperationJob& job);
+
+    std::vector<std::unique_ptr<Row>> m_rows;
+    QWidget* m_container;
+    QVBoxLayout* m_rowsLayout;
+    QTimer m_timer;
+    QElapsedTimer m_clock;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <QCache>
+#include <QHash>
+#include <QIcon>
+#include <QImage>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+#include "core/type_detector.hpp"
+
+// Image previews for the file table, generated off the GUI thread
+//
+// The view names the paths it shows (plus a page ahead) with setWanted();
+// anything queued for a path no longer in that set is cancelled before it
+// is decoded. Workers run on a small dedicated pool so thumbnailing never
+// starves directory listing on the global pool.
+//
+// Thumbnails are shared with other desktop applications through the
+// freedesktop.org cache: $XDG_CACHE_HOME/thumbnails/normal/<md5 of URI>.png,
+// tagged with Thumb::URI and Thumb::MTime and regenerated when the source
+// changes. Files that cannot be decoded get an entry under fail/ so they are
+// not retried. Images are decoded at reduced size (QImageReader::setScaledSize)
+// where the format supports it, JPEG in particular.
+class ThumbnailService : public QObject {
+    Q_OBJECT
+
+public:
+    // freedesktop "normal" size
+    static constexpr int THUMBNAIL_SIZE = 128;
+
+    explicit ThumbnailService(QObject* parent = nullptr);
+    ~ThumbnailService() override;   // cancels queued work, waits for running decodes
+
+    // True for the image types a thumbnail is attempted for
+    static bool canThumbnail(FileType type);
+
+    // Makes `paths` the set worth generating: new ones are queued in order,
+    // requests for anything else are cancelled. `mtimes` (seconds, -1 if
+    // unknown) go with `paths`; a thumbnail made from another mtime is
+    // generated again
+    void setWanted(const QStringList& paths, const QList<qint64>& mtimes = {});
+
+    // Queues `path` again if its thumbnail was made from another `mtime`,
+    // for wanted files whose mtime became known or changed after setWanted()
+    void refresh(const QString& path, qint64 mtime);
+
+    // Thumbnail in memory, a null icon if not generated (yet) or failed;
+    // `mtime` (seconds, -1 if unknown) must match the file it was made from
+    QIcon cached(const QString& path, qint64 mtime = -1) const;
+
+    // Root of the shared cache, normally ~/.cache/thumbnails
+    static QString cacheDirectory();
+
+    // Path of the cached thumbnail for `path` ("normal" size)
+    static QString thumbnailPath(const QString& path);
+
+    ThumbnailService(const ThumbnailService&) = delete;
+    ThumbnailService& operator=(const ThumbnailService&) = delete;
+
+signals:
+    void thumbnailReady(const QString& path);
+
+private:
+    struct Request {
+        std::atomic<bool> cancelled{false};
+    };
+    struct Entry {
+        QIcon icon;      // null if the file could not be thumbnailed
+        qint64 mtime;
+    };
+
+    // A thumbnail (or failure) for `path` is cached and made from `mtime`
+    bool isCurrent(const QString& path, qint64 mtime) const;
+    void start(const QString& path);
+    void finish(const QString& path, const std::shared_ptr<Request>& request, const QImage& image, qint64 mtime);
+
+    QThreadPool m_pool;
+    QHash<QString, std::shared_ptr<Request>> m_requests;   // queued or running, GUI thread only
+    QCache<QString, Entry> m_cache;                          // cost in KiB
+};
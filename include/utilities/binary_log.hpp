@@ -0,0 +1,175 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+#include "error_handler.hpp" // for ErrorSeverity and the log level filter
+
+// Binary structured log
+//
+// Instead of formatting text on the hot path, every record stores the ID of a
+// static format string plus the raw argument values. The format strings are
+// written to the file once, the first time an ID is used, so the file can be
+// decoded offline (see tools/log_decoder) without the binary that wrote it.
+//
+// File layout (all integers in host byte order):
+//   "FMBLOG01"                                      file magic, once
+//   SESSION                                         one per opened sink, resets the format table
+//   FORMAT  u16 id, u16 length, bytes               format string definition
+//   EVENT   u64 time_ns, u8 severity, u16 format id, u8 arg count, args...
+// Every argument is a u8 type followed by its payload:
+//   INT64 / UINT64 / DOUBLE   8 bytes
+//   STRING                    u32 length, bytes
+//
+// Format strings use "{}" as the placeholder for the next argument.
+namespace binlog {
+    constexpr char MAGIC[8] = {'F', 'M', 'B', 'L', 'O', 'G', '0', '1'};
+
+    enum RecordTag : uint8_t {
+        TAG_FORMAT = 1,
+        TAG_EVENT = 2,
+        TAG_SESSION = 3
+    };
+
+    enum ArgType : uint8_t {
+        ARG_INT64 = 1,
+        ARG_UINT64 = 2,
+        ARG_DOUBLE = 3,
+        ARG_STRING = 4
+    };
+}
+
+// Writes binary log records to a file
+// Thread safe: records are appended to an in-memory buffer under a mutex and
+// the buffer goes to the file with one write() once it is large enough, on
+// ERROR and CRITICAL records, on flush() and in the destructor
+class BinaryLogSink {
+public:
+    // Opens (or creates) the file in append mode
+    BinaryLogSink(const std::string& filename);
+    ~BinaryLogSink();
+
+    // Assigns a process-wide ID to a static format string
+    // FM_BLOG calls this once per call site and caches the result
+    static uint16_t registerFormat(const char* format);
+
+    // Logs a record with raw arguments, see FM_BLOG
+    template<typename... Args>
+    void write(ErrorSeverity severity, uint16_t formatId, const Args&... args) {
+        static_assert(sizeof...(Args) < 256, "too many log arguments");
+        std::lock_guard<std::mutex> lock(mutex_);
+        beginEvent(severity, formatId, static_cast<uint8_t>(sizeof...(Args)));
+        (encodeArg(args), ...);
+        endEvent(severity);
+    }
+
+    // Same signature as Logger::log, the whole message becomes one string argument
+    void log(ErrorSeverity severity, const std::string& message);
+
+    // Write everything buffered so far to the file
+    void flush();
+
+    bool isOpen() const { return fd_ >= 0; }
+
+private:
+    void beginEvent(ErrorSeverity severity, uint16_t formatId, uint8_t argCount);
+    void endEvent(ErrorSeverity severity);
+    void flushLocked();
+
+    template<typename T>
+    void appendRaw(const T& value) {
+        const size_t offset = buffer_.size();
+        buffer_.resize(offset + sizeof(T));
+        std::memcpy(&buffer_[offset], &value, sizeof(T));
+    }
+
+    void appendString(std::string_view text) {
+        buffer_.push_back(static_cast<char>(binlog::ARG_STRING));
+        appendRaw(static_cast<uint32_t>(text.size()));
+        buffer_.append(text.data(), text.size());
+    }
+
+    // One overload per supported argument kind
+    template<typename T>
+    void encodeArg(const T& value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            buffer_.push_back(static_cast<char>(binlog::ARG_UINT64));
+            appendRaw(static_cast<uint64_t>(value));
+        } else if constexpr (std::is_enum_v<T>) {
+            buffer_.push_back(static_cast<char>(binlog::ARG_INT64));
+            appendRaw(static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            buffer_.push_back(static_cast<char>(binlog::ARG_INT64));
+            appendRaw(static_cast<int64_t>(value));
+        } else if constexpr (std::is_integral_v<T>) {
+            buffer_.push_back(static_cast<char>(binlog::ARG_UINT64));
+            appendRaw(static_cast<uint64_t>(value));
+        } else if constexpr (std::is_floating_point_v<T>) {
+            buffer_.push_back(static_cast<char>(binlog::ARG_DOUBLE));
+            appendRaw(static_cast<double>(value));
+        } else if constexpr (std::is_same_v<T, std::filesystem::path>) {
+            appendString(value.native());
+        } else {
+            // std::string, std::string_view, const char*, char arrays
+            appendString(std::string_view(value));
+        }
+    }
+
+    std::mutex mutex_;
+    int fd_ = -1;
+    std::string buffer_;                 // records not yet written to the file
+    std::vector<bool> formatWritten_;    // format IDs already defined in this file
+};
+
+// One decoded record
+struct BinaryLogEvent {
+    uint64_t timeNs = 0;   // nanoseconds since the Unix epoch
+    ErrorSeverity severity = ErrorSeverity::INFO;
+    std::string message;   // format string with the arguments substituted
+};
+
+// Reads a binary log file back, used by the decoder tool
+class BinaryLogReader {
+public:
+    BinaryLogReader(const std::string& filename);
+
+    // False if the file could not be opened or does not start with the magic
+    bool isValid() const { return valid_; }
+
+    // Reads the next event, skipping format definitions
+    // Returns false at the end of the file or on a truncated record
+    bool next(BinaryLogEvent& event);
+
+    // Renders an event the same way the text Logger writes it:
+    // "[YYYY-mm-dd HH:MM:SS] [SEVERITY] message"
+    static std::string toText(const BinaryLogEvent& event);
+
+private:
+    template<typename T>
+    bool readRaw(T& value) {
+        return static_cast<bool>(in_.read(reinterpret_cast<char*>(&value), sizeof(T)));
+    }
+    bool readString(std::string& text, size_t length);
+
+    std::ifstream in_;
+    bool valid_ = false;
+    std::vector<std::string> formats_;   // format table of the current session
+};
+
+// Binary logging macro
+// The format string is registered once per call site, after that a call costs
+// the filter check, a timestamp and copying the raw arguments
+#define FM_BLOG(sink, severity, format, ...) \
+do { \
+    if (ErrorHandler::isEnabled(severity)) { \
+        static const uint16_t fmBlogFormatId_ = BinaryLogSink::registerFormat(format); \
+        (sink).write(severity, fmBlogFormatId_, ##__VA_ARGS__); \
+    } \
+} while (0)
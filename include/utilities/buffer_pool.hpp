@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <vector>
+
+// Page-aligned I/O buffers, kept for reuse
+//
+// Each buffer is its own mapping, aligned to a huge page: explicit huge
+// pages (MAP_HUGETLB) if the system has some reserved, otherwise normal
+// pages advised with MADV_HUGEPAGE so transparent huge pages can back them.
+// Either way the kernel pins and maps a few large pages per buffer for
+// O_DIRECT instead of one per 4 KiB, and mapping and zeroing happen once
+// per buffer rather than once per copy. Idle buffers above `maxIdle` are
+// unmapped when they come back.
+class BufferPool {
+public:
+    static constexpr size_t HUGE_PAGE_SIZE = 2 * 1024 * 1024;
+
+    // A buffer on loan from the pool, returned when destroyed
+    class Buffer {
+    public:
+        Buffer() = default;
+        Buffer(Buffer&& other) noexcept;
+        Buffer& operator=(Buffer&& other) noexcept;
+        ~Buffer();
+
+        char* data() const { return data_; }
+        size_t size() const { return pool_ ? pool_->bufferSize_ : 0; }
+        explicit operator bool() const { return data_ != nullptr; }
+
+    private:
+        friend class BufferPool;
+        Buffer(BufferPool* pool, char* data) : pool_(pool), data_(data) {}
+
+        BufferPool* pool_ = nullptr;
+        char* data_ = nullptr;
+    };
+
+    // `bufferSize` is rounded up to whole huge pages
+    explicit BufferPool(size_t bufferSize, size_t maxIdle = 8);
+    ~BufferPool();   // every Buffer must have been returned
+
+    // An idle buffer or a new mapping, an empty Buffer if mmap failed
+    Buffer acquire();
+
+    size_t bufferSize() const { return bufferSize_; }
+    size_t idleCount() const;
+    size_t mappedCount() const;   // idle and on loan
+
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+private:
+    // PRIVATE METHODS
+    char* map();
+    void release(char* data);
+    void unmap(char* data);
+
+    const size_t bufferSize_;
+    const size_t maxIdle_;
+
+    mutable std::mutex mutex_;
+    std::vector<char*> idle_;
+    size_t mapped_ = 0;
+    bool hugetlbFailed_ = false;   // none reserved, stop asking
+};
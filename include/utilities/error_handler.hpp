@@ -5,6 +5,7 @@
 #include <sstream>        // for string based stream operations
 #include <iostream>
 #include <mutex>          // for thread safe operations
+#include <atomic>         // for the runtime log level filter
 #include <functional>     // used to store custom error callback function
 #include <cstring>        // provides C style string manipulation
 #include <cerrno>         // for identifying cause of low level system errors
@@ -49,13 +50,41 @@ public:
 //     : FileManagerException("Error: " + message) {}
 // };
 
+// Numeric log levels, usable in #if
+// FM_MIN_LOG_LEVEL picks the lowest level compiled in, everything below it
+// compiles away completely (set by CMake through -DFM_MIN_LOG_LEVEL=...)
+#define FM_LOG_LEVEL_DEBUG    0
+#define FM_LOG_LEVEL_INFO     1
+#define FM_LOG_LEVEL_WARNING  2
+#define FM_LOG_LEVEL_ERROR    3
+#define FM_LOG_LEVEL_CRITICAL 4
+
+#ifndef FM_MIN_LOG_LEVEL
+#define FM_MIN_LOG_LEVEL FM_LOG_LEVEL_DEBUG
+#endif
+
 // Enum for categorizing error severity
+// Values match the FM_LOG_LEVEL_* numbers above
 enum class ErrorSeverity {
-    WARNING,
-    ERROR,
-    CRITICAL
+    DEBUG = FM_LOG_LEVEL_DEBUG,
+    INFO = FM_LOG_LEVEL_INFO,
+    WARNING = FM_LOG_LEVEL_WARNING,
+    ERROR = FM_LOG_LEVEL_ERROR,
+    CRITICAL = FM_LOG_LEVEL_CRITICAL
 };
 
+// Upper case name of a severity, as written in the logs
+inline const char* severityName(ErrorSeverity severity) {
+    switch (severity) {
+        case ErrorSeverity::DEBUG: return "DEBUG";
+        case ErrorSeverity::INFO: return "INFO";
+        case ErrorSeverity::WARNING: return "WARNING";
+        case ErrorSeverity::ERROR: return "ERROR";
+        case ErrorSeverity::CRITICAL: return "CRITICAL";
+    }
+    return "";
+}
+
 // Error handler class
 // handles all exceptions
 class ErrorHandler {
@@ -172,21 +201,20 @@ public:
         }
     }
 
-    // Logging a warning message (Non-Throwing)
-    template<typename... TArgs>
-    static void warning(const TArgs&... args) {
-        std::ostringstream oss;
-        (oss << ... << args);
-        instance().logError(ErrorSeverity::WARNING, oss.str());
+    // Runtime filter: messages below this severity are not formatted or written
+    // Default is INFO, so FM_DEBUG costs one atomic load unless enabled
+    static void setMinimumSeverity(ErrorSeverity severity) {
+        minimumSeverity_.store(static_cast<int>(severity), std::memory_order_relaxed);
     }
 
-    // Critical failure (Terminates Application)
-    template<typename... TArgs>
-    [[noreturn]] static void critical(const TArgs&... args) {
-        std::ostringstream oss;
-        (oss << ... << args);
-        instance().logError(ErrorSeverity::CRITICAL, oss.str());
-        std::terminate();  // Immediately stop the program
+    static ErrorSeverity minimumSeverity() {
+        return static_cast<ErrorSeverity>(minimumSeverity_.load(std::memory_order_relaxed));
+    }
+
+    // True if a message of this severity passes both the compile-time and the runtime filter
+    static bool isEnabled(ErrorSeverity severity) {
+        return static_cast<int>(severity) >= FM_MIN_LOG_LEVEL &&
+               static_cast<int>(severity) >= minimumSeverity_.load(std::memory_order_relaxed);
     }
 
     template<typename... Args>
@@ -195,31 +223,50 @@ public:
         (oss << ... << args);  // Fold expression in C++17
         return oss.str();
     }
+
+    // Logging functions (Non-Throwing)
+    // The filter is checked first, the arguments are only formatted
+    // when the message is actually going to be written
+    template<typename... Args>
+    static void debug(Args&&... args) {
+        log(ErrorSeverity::DEBUG, std::forward<Args>(args)...);
+    }
+
     template<typename... Args>
     static void info(Args&&... args) {
-        instance().logError(ErrorSeverity::WARNING, format(std::forward<Args>(args)...));
+        log(ErrorSeverity::INFO, std::forward<Args>(args)...);
     }
 
     template<typename... Args>
-   static void warning(Args&&... args) {
-        instance().logError(ErrorSeverity::WARNING, format(std::forward<Args>(args)...));
+    static void warning(Args&&... args) {
+        log(ErrorSeverity::WARNING, std::forward<Args>(args)...);
     }
 
     template<typename... Args>
     static void error(Args&&... args) {
-        instance().logError(ErrorSeverity::ERROR, format(std::forward<Args>(args)...));
+        log(ErrorSeverity::ERROR, std::forward<Args>(args)...);
     }
 
+    // Critical failure (Terminates Application)
+    // Always logged, whatever the filters say
+    template<typename... Args>
+    [[noreturn]] static void critical(Args&&... args) {
+        instance().logError(ErrorSeverity::CRITICAL, format(std::forward<Args>(args)...));
+        std::terminate();  // Immediately stop the program
+    }
 
     template<typename... Args>
-    static void critical(Args&&... args) {
-        critical(format(std::forward<Args>(args)...));
+    static void log(ErrorSeverity severity, Args&&... args) {
+        if (isEnabled(severity)) {
+            instance().logError(severity, format(std::forward<Args>(args)...));
+        }
     }
 
 
 private:
     mutable std::mutex mutex_;      // Thread safety
     ErrorCallback errorCallback_;   // Custom callback
+    static std::atomic<int> minimumSeverity_;   // Runtime filter, see setMinimumSeverity
 
     // Private constructor
     ErrorHandler();
@@ -255,14 +302,40 @@ ErrorHandler::raiseError<PluginException>(__VA_ARGS__)
 #define FM_THROW_GUI(...) \
 ErrorHandler::raiseError<GuiException>(__VA_ARGS__)
 
-#define FM_WARNING(...) \
-ErrorHandler::warning(__VA_ARGS__)
-
+// Logging macros
+// A level below FM_MIN_LOG_LEVEL expands to dead code: the arguments are
+// still type checked but never evaluated, so it costs nothing at runtime
+// Enabled levels check the runtime filter before evaluating the arguments
+#define FM_LOG_ENABLED_(severity, ...) \
+do { if (ErrorHandler::isEnabled(severity)) { ErrorHandler::log(severity, __VA_ARGS__); } } while (0)
+
+#define FM_LOG_DISABLED_(...) \
+do { if (false) { (void)ErrorHandler::format(__VA_ARGS__); } } while (0)
+
+#if FM_MIN_LOG_LEVEL <= FM_LOG_LEVEL_DEBUG
+#define FM_DEBUG(...) FM_LOG_ENABLED_(ErrorSeverity::DEBUG, __VA_ARGS__)
+#else
+#define FM_DEBUG(...) FM_LOG_DISABLED_(__VA_ARGS__)
+#endif
+
+#if FM_MIN_LOG_LEVEL <= FM_LOG_LEVEL_INFO
+#define FM_INFO(...) FM_LOG_ENABLED_(ErrorSeverity::INFO, __VA_ARGS__)
+#else
+#define FM_INFO(...) FM_LOG_DISABLED_(__VA_ARGS__)
+#endif
+
+#if FM_MIN_LOG_LEVEL <= FM_LOG_LEVEL_WARNING
+#define FM_WARNING(...) FM_LOG_ENABLED_(ErrorSeverity::WARNING, __VA_ARGS__)
+#else
+#define FM_WARNING(...) FM_LOG_DISABLED_(__VA_ARGS__)
+#endif
+
+#if FM_MIN_LOG_LEVEL <= FM_LOG_LEVEL_ERROR
+#define FM_ERROR(...) FM_LOG_ENABLED_(ErrorSeverity::ERROR, __VA_ARGS__)
+#else
+#define FM_ERROR(...) FM_LOG_DISABLED_(__VA_ARGS__)
+#endif
+
+// Critical always logs and terminates
 #define FM_CRITICAL(...) \
 ErrorHandler::critical(__VA_ARGS__)
-
-#define FM_ERROR(...) \
-ErrorHandler::error(__VA_ARGS__)
-
-#define FM_INFO(...) \
-ErrorHandler::info(__VA_ARGS__)
@@ -0,0 +1,29 @@
+#pragma once
+
+// I/O scheduling class of a thread (see ioprio_set(2))
+enum class IoPriorityClass {
+    REALTIME = 1,
+    BEST_EFFORT = 2,
+    IDLE = 3        // only gets disk time nobody else wants
+};
+
+// Changes the calling thread's I/O priority for the lifetime of the object
+// and restores the previous one afterwards, so jobs running on shared
+// scheduler workers don't leave the worker deprioritized.
+// Failures (no ioprio support, seccomp) are ignored: the work still runs,
+// just at normal priority.
+class ScopedIoPriority {
+public:
+    explicit ScopedIoPriority(IoPriorityClass priorityClass, int level = 0);
+    ~ScopedIoPriority();
+
+    // True if the priority was actually changed
+    bool applied() const { return applied_; }
+
+    ScopedIoPriority(const ScopedIoPriority&) = delete;
+    ScopedIoPriority& operator=(const ScopedIoPriority&) = delete;
+
+private:
+    int previous_ = -1;
+    bool applied_ = false;
+};
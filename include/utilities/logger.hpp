@@ -4,25 +4,117 @@
 #include <fstream>
 #include <mutex>
 #include <sstream>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <ctime>
+#include <memory>
+#include <thread>
 
 #include "error_handler.hpp" // for using ErrorSeverity enum
 
+// What an async logger does when its ring buffer is full
+enum class OverflowPolicy {
+  BLOCK,   // wait until the background thread makes room (nothing is lost)
+  DROP,    // throw the message away silently
+  COUNT    // throw the message away and write "N messages dropped" to the log
+};
+
+// Settings for the asynchronous logging mode
+struct AsyncLogOptions {
+  size_t capacity = 8192;                                 // ring buffer slots, rounded up to a power of two
+  OverflowPolicy overflow = OverflowPolicy::BLOCK;        // behaviour when the ring is full
+  std::chrono::milliseconds flushInterval{50};            // longest time a record waits before it is written
+};
+
 // Thread-safe Logger class
 // Used to log error messages to file (and optionally to console)
+//
+// Two modes:
+// - synchronous (default): every call formats and writes the line under a mutex
+// - asynchronous: callers push records into a lock-free ring buffer and a
+//   background thread writes them in batches, one write() per batch
 class Logger {
 public:
   // Constructor that opens the log file
   // The file is opened in append mode so previous logs are preserved
   Logger(const std::string& filename = "file_manager.log");
 
+  // Constructor for the asynchronous mode
+  Logger(const std::string& filename, const AsyncLogOptions& options);
+
   // Destructor that ensures file is properly closed
+  // In async mode every queued record is written before returning
   ~Logger();
 
   // Logs the error message with given severity (WARNING, ERROR, CRITICAL)
   // Automatically prepends timestamp and severity label
   void log(ErrorSeverity severity, const std::string& message);
 
+  // Waits until every record logged before this call is in the file
+  void flush();
+
+  // Number of records thrown away because the ring buffer was full
+  uint64_t droppedCount() const;
+
+  bool isAsync() const { return ring_ != nullptr; }
+
+  // Write out whatever is still queued when the process crashes
+  // Installs handlers for SIGSEGV, SIGBUS, SIGFPE, SIGILL and SIGABRT that
+  // drain this logger, put back the handlers that were there before (a
+  // sanitizer's, a crash reporter's, or the default) and re-raise the signal
+  void installCrashHandler();
+
 private:
+  // One queued log record
+  struct Record {
+    std::time_t time = 0;
+    ErrorSeverity severity = ErrorSeverity::WARNING;
+    std::string message;
+  };
+
+  // Bounded multi-producer single-consumer ring buffer
+  // Each slot carries a sequence number telling producers and the consumer
+  // whose turn it is, so no lock is taken on the logging path
+  struct Slot {
+    std::atomic<size_t> sequence{0};
+    Record record;
+  };
+  struct Ring;
+
+  // Builds "[YYYY-mm-dd HH:MM:SS] [SEVERITY] message\n"
+  // The date part is cached and only reformatted when the second changes
+  void appendRecord(std::string& out, std::time_t time, ErrorSeverity severity,
+                    const std::string& message);
+
+  bool tryPush(Record& record);                 // producer side of the ring
+  bool tryPop(Record& record);                  // consumer side of the ring
+  void writerLoop();                            // background thread body
+  void writeAll(const char* data, size_t size); // write() until everything is out
+  void drainForCrash();                         // called from the signal handler
+  static void crashSignalHandler(int signal);
+
   std::ofstream logFile;   // Output file stream to store logs
   std::mutex mutex_;       // Mutex for ensuring thread-safe logging
+
+  // Per-second timestamp cache used by appendRecord
+  std::time_t cachedSecond_ = -1;
+  char cachedPrefix_[32] = {};
+  size_t cachedPrefixLength_ = 0;
+
+  // Async mode state
+  std::unique_ptr<Ring> ring_;
+  AsyncLogOptions options_;
+  int fd_ = -1;
+  std::thread writer_;
+  std::atomic<bool> stop_{false};
+  std::atomic<bool> writerSleeping_{false};
+  std::atomic<bool> draining_{false};           // held while the ring is being drained
+  std::atomic<uint64_t> dropped_{0};
+  std::atomic<uint64_t> droppedReported_{0};
+  long utcOffset_ = 0;                          // local time - UTC in seconds, for the crash path
+  std::atomic<size_t> written_{0};              // ring positions already written
+  std::mutex wakeMutex_;
+  std::condition_variable wake_;                // wakes the writer thread
+  std::condition_variable flushed_;             // wakes callers of flush()
 };
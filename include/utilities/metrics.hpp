@@ -0,0 +1,131 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Identifier of an instrumented operation, see Metrics::registerOperation
+using MetricId = uint16_t;
+
+// Latency histogram layout (HDR style)
+// Values are nanoseconds. Every power of two is split into 8 linear
+// sub-buckets, so a bucket is never wider than 12.5% of its value and
+// 496 buckets cover everything from 1 ns to centuries.
+class LatencyBuckets {
+public:
+    static constexpr unsigned SUB_BUCKET_BITS = 3;
+    static constexpr unsigned SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static constexpr unsigned COUNT = (64 - SUB_BUCKET_BITS + 1) * SUB_BUCKETS;
+
+    // Bucket a value falls into
+    static unsigned indexOf(uint64_t ns) {
+        if (ns < SUB_BUCKETS) {
+            return static_cast<unsigned>(ns);
+        }
+        const unsigned msb = 63u - static_cast<unsigned>(__builtin_clzll(ns));
+        const unsigned sub = static_cast<unsigned>(ns >> (msb - SUB_BUCKET_BITS)) & (SUB_BUCKETS - 1);
+        return (msb - SUB_BUCKET_BITS + 1) * SUB_BUCKETS + sub;
+    }
+
+    // Largest value that still falls into a bucket
+    static uint64_t upperBound(unsigned index) {
+        if (index < SUB_BUCKETS) {
+            return index;
+        }
+        const unsigned msb = index / SUB_BUCKETS + SUB_BUCKET_BITS - 1;
+        const uint64_t sub = index % SUB_BUCKETS;
+        const uint64_t low = (SUB_BUCKETS + sub) << (msb - SUB_BUCKET_BITS);
+        return low + (1ULL << (msb - SUB_BUCKET_BITS)) - 1;
+    }
+};
+
+// Built-in metrics: per-operation latency histograms and throughput counters
+//
+// Every thread records into its own shard (plain relaxed stores, no locks,
+// no shared cache lines), a snapshot sums the shards. Disabled by default;
+// while disabled an instrumented call costs one relaxed atomic load.
+class Metrics {
+public:
+    // Totals of one operation at the time of the snapshot
+    struct OperationStats {
+        std::string name;
+        uint64_t count = 0;       // calls
+        uint64_t errors = 0;      // calls that failed
+        uint64_t bytes = 0;       // bytes read, written or moved
+        uint64_t entries = 0;     // directory entries visited
+        uint64_t totalNs = 0;     // sum of latencies
+        std::vector<uint64_t> buckets = std::vector<uint64_t>(LatencyBuckets::COUNT, 0);
+
+        // Latency below which `fraction` of the calls finished, in nanoseconds
+        uint64_t percentile(double fraction) const;
+    };
+
+    // Returns the ID of an operation name, registering it on first use
+    // Cache the result (a static local), the lookup takes a lock
+    static MetricId registerOperation(const std::string& name);
+
+    static void setEnabled(bool enabled) { enabled_.store(enabled, std::memory_order_relaxed); }
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Adds one call to the calling thread's shard
+    static void record(MetricId id, uint64_t latencyNs, bool failed, uint64_t bytes, uint64_t entries);
+
+    // Sets a named value that is exported as a gauge (e.g. a configured rate)
+    static void setGauge(const std::string& name, double value);
+
+    // Sum of all threads, including threads that already exited
+    static std::vector<OperationStats> snapshot();
+
+    // Prometheus text exposition format of a snapshot
+    static std::string toPrometheus(const std::vector<OperationStats>& stats);
+
+    // Writes the current snapshot to a file (through a temporary file and
+    // rename, so a scraper never reads a half written file)
+    static bool writePrometheus(const std::string& path);
+
+    // Dumps to `path` every `interval` on a background thread
+    static void startPeriodicDump(const std::string& path, std::chrono::milliseconds interval);
+    static void stopPeriodicDump();
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Times one call of an operation and records it when it goes out of scope
+// Does nothing (not even read the clock) while metrics are disabled
+class MetricsScope {
+public:
+    explicit MetricsScope(MetricId id)
+        : id_(id), active_(Metrics::isEnabled()) {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~MetricsScope() {
+        if (active_) {
+            const auto elapsed = std::chrono::steady_clock::now() - start_;
+            Metrics::record(id_, static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()),
+                failed_, bytes_, entries_);
+        }
+    }
+
+    bool active() const { return active_; }
+    void fail() { failed_ = true; }
+    void addBytes(uint64_t bytes) { bytes_ += bytes; }
+    void addEntries(uint64_t entries) { entries_ += entries; }
+
+    MetricsScope(const MetricsScope&) = delete;
+    MetricsScope& operator=(const MetricsScope&) = delete;
+
+private:
+    MetricId id_;
+    bool active_;
+    bool failed_ = false;
+    uint64_t bytes_ = 0;
+    uint64_t entries_ = 0;
+    std::chrono::steady_clock::time_point start_;
+};
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Throughput a RateLimiter lets through, 0 = no limit
+struct RateLimits {
+    uint64_t bytesPerSecond = 0;
+    uint64_t opsPerSecond = 0;   // files created, removed, renamed or stat()ed
+    bool idleIo = false;         // jobs using the limiter also run in the IDLE I/O class
+
+    bool limited() const { return bytesPerSecond != 0 || opsPerSecond != 0; }
+};
+
+// Token buckets for bytes and operations, shared by the jobs it throttles
+//
+// Work is charged after the fact: acquire() waits while an earlier charge
+// has overdrawn a bucket, then takes its own amount, which may overdraw it
+// again. A 4 MiB chunk against a 1 MiB/s limit passes, the next one waits
+// four seconds, so the rate converges on the limit whatever the chunk size.
+// A bucket holds at most BURST worth of its rate: work that was idle does
+// not get to catch up in one burst.
+//
+// Limits can be changed while jobs wait, waiters recompute with the new
+// rate. The rate let through is measured once a second and, with metrics
+// enabled, exported as the gauges rate_limiter.<name>.bytes_per_second and
+// .ops_per_second, next to the configured .bytes_limit and .ops_limit.
+class RateLimiter {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds BURST{250};
+    static constexpr std::chrono::milliseconds MEASURE_INTERVAL{1000};
+
+    explicit RateLimiter(std::string name, RateLimits limits = {});
+
+    // Limits from FM_IO_MAX_MBPS, FM_IO_MAX_OPS and FM_IO_IDLE=1, unset = no limit
+    static RateLimits limitsFromEnvironment();
+
+    // Shared by the background work of the process (trash purges, plugin
+    // scans), limits from the environment
+    static std::shared_ptr<RateLimiter> background();
+
+    void setLimits(const RateLimits& limits);
+    RateLimits limits() const;
+
+    // Waits until neither bucket is in debt, then charges `bytes` and `ops`.
+    // Returns false without charging once `stop` returns true; it is checked
+    // before waiting and whenever the wait is interrupted by wake()
+    bool acquire(uint64_t bytes, uint64_t ops, const std::function<bool()>& stop = {});
+
+    // Interrupts the waits, so acquire()s check their stop condition (cancel)
+    void wake();
+
+    // Rates let through over the last measuring interval, falling to 0 when idle
+    double bytesRate() const;
+    double opsRate() const;
+
+    uint64_t totalBytes() const;
+    uint64_t totalOps() const;
+    Clock::duration totalWait() const;   // time acquire() spent throttled
+
+    const std::string& name() const { return name_; }
+
+    RateLimiter(const RateLimiter&) = delete;
+    RateLimiter& operator=(const RateLimiter&) = delete;
+
+private:
+    struct Bucket {
+        uint64_t rate = 0;
+        double tokens = 0;
+
+        void refill(double seconds);
+        void charge(uint64_t amount);
+        double debtSeconds() const;
+    };
+
+    // (mutex_ held)
+    void refill(Clock::time_point now);
+    void measure(Clock::time_point now);
+    double rateOf(double current, uint64_t window, Clock::time_point now) const;
+
+    const std::string name_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable changed_;
+    uint64_t generation_ = 0;   // bumped by setLimits() and wake()
+    bool idleIo_ = false;
+    Bucket bytes_;
+    Bucket ops_;
+    Clock::time_point refilled_;
+
+    uint64_t totalBytes_ = 0;
+    uint64_t totalOps_ = 0;
+    Clock::duration waited_{0};
+    Clock::time_point windowStart_;
+    uint64_t windowBytes_ = 0;
+    uint64_t windowOps_ = 0;
+    double bytesRate_ = 0;
+    double opsRate_ = 0;
+};
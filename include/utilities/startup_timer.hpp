@@ -0,0 +1,37 @@
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Startup milestones, in milliseconds since main() was entered
+//
+// main() calls begin() first thing; the GUI marks milestones such as
+// "first_paint" and "interactive" as it gets there. Every mark also becomes
+// a "startup.<name>_ms" gauge when metrics are on. Not thread-safe: startup
+// happens on the GUI thread.
+class StartupTimer {
+public:
+    static void begin();
+
+    // Records `name` at the current time, a second mark of the same name is ignored
+    static void mark(const std::string& name);
+
+    // Milliseconds from main() to the milestone, -1 if not reached yet
+    static double milestone(const std::string& name);
+
+    static double elapsedMs();
+
+    // Time the process spent before main() (dynamic loading, static
+    // constructors), from /proc/self/stat; -1 if unknown. Only 10 ms resolution.
+    static double beforeMainMs() { return beforeMainMs_; }
+
+    // "first_paint 84.2 ms, interactive 131.0 ms (+30 ms before main)"
+    static std::string summary();
+
+private:
+    static std::chrono::steady_clock::time_point start_;
+    static double beforeMainMs_;
+    static std::vector<std::pair<std::string, double>> milestones_;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+// Opt-in span tracing that writes Chrome trace-event JSON
+// (open the file in chrome://tracing or https://ui.perfetto.dev)
+//
+// Every thread appends finished spans to its own buffer, so recording takes
+// no shared lock. Buffers of exited threads are kept until the trace is
+// written. While tracing is off a TraceScope costs one relaxed atomic load.
+class Tracer {
+public:
+    // Spans kept per thread, later spans are counted as dropped
+    static constexpr size_t MAX_EVENTS_PER_THREAD = 1 << 20;
+
+    // Starts recording, the trace is written to `path` by stop()
+    static void start(const std::string& path);
+
+    // Stops recording, writes the trace file and clears all buffers
+    static bool stop();
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Name shown for the calling thread in the trace viewer
+    static void setThreadName(const std::string& name);
+
+    // Adds a finished span to the calling thread's buffer
+    // `category` and `name` must be string literals (they are not copied)
+    static void record(const char* category, const char* name,
+                       std::chrono::steady_clock::time_point start,
+                       std::chrono::steady_clock::time_point end,
+                       std::string detail);
+
+    // Spans dropped because a thread buffer was full
+    static uint64_t droppedCount();
+
+    // Writes the spans recorded so far to `path` without stopping
+    static bool writeJson(const std::string& path);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records one span from construction to destruction
+class TraceScope {
+public:
+    TraceScope(const char* category, const char* name)
+        : category_(category), name_(name), active_(Tracer::isEnabled()) {
+        if (active_) {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~TraceScope() {
+        if (active_) {
+            Tracer::record(category_, name_, start_, std::chrono::steady_clock::now(), std::move(detail_));
+        }
+    }
+
+    bool active() const { return active_; }
+
+    // Extra text shown in the span's arguments (a path, an operation name)
+    // Check active() first so nothing is built while tracing is off
+    void setDetail(std::string detail) { detail_ = std::move(detail); }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+private:
+    const char* category_;
+    const char* name_;
+    bool active_;
+    std::chrono::steady_clock::time_point start_;
+    std::string detail_;
+};
+
+#define FM_TRACE_CONCAT_(a, b) a##b
+#define FM_TRACE_CONCAT(a, b) FM_TRACE_CONCAT_(a, b)
+
+// Traces the rest of the enclosing block
+#define FM_TRACE_SCOPE(category, name) \
+    TraceScope FM_TRACE_CONCAT(fmTraceScope_, __LINE__)(category, name)
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Operations a workload trace can contain
+// The values are stored in trace files, only ever append new ones
+enum class WorkloadOp : uint8_t {
+    EXISTS = 0,
+    IS_DIRECTORY = 1,
+    IS_FILE = 2,
+    LIST_DIRECTORY = 3,
+    CREATE_DIRECTORY = 4,
+    REMOVE = 5,
+    COPY = 6,
+    MOVE = 7,
+    FILE_SIZE = 8,
+    LAST_WRITE_TIME = 9,
+    READ_FILE = 10,
+    WRITE_FILE = 11,
+    PLUGIN = 12,        // args: operation name, then the plugin arguments
+    COUNT_
+};
+
+// Short name of an operation ("readFile", "plugin", ...), a string literal
+const char* workloadOpName(WorkloadOp op);
+
+// One recorded call
+struct WorkloadRecord {
+    WorkloadOp op = WorkloadOp::EXISTS;
+    uint32_t thread = 0;        // small per-session thread number
+    uint64_t startNs = 0;       // since the recording started
+    uint64_t latencyNs = 0;
+    int result = 0;             // errno of the failure (1 for a failed plugin call), 0 on success
+    uint64_t size = 0;          // bytes, entries, or the answer of exists/isDirectory/isFile
+    uint8_t flags = 0;          // FLAG_* below
+    std::vector<std::string> args;
+
+    static constexpr uint8_t FLAG_OVERWRITE = 1;
+};
+
+namespace workload {
+    // File layout: MAGIC, then tagged records
+    //   TAG_PATH  varint id, varint length, bytes           (defines a string)
+    //   TAG_OP    u8 op, varint thread, varint zigzag(start delta), varint latency,
+    //             varint result, varint size, u8 flags, u8 argc, varint id...
+    //   TAG_CWD   varint length, bytes                      (working directory)
+    // Strings are interned, so a path used a thousand times is stored once.
+    // TAG_CWD follows MAGIC: relative arguments resolve against it.
+    constexpr char MAGIC[8] = {'F', 'M', 'W', 'L', 'O', 'A', 'D', '1'};
+    constexpr uint8_t TAG_PATH = 1;
+    constexpr uint8_t TAG_OP = 2;
+    constexpr uint8_t TAG_CWD = 3;
+}
+
+// Records the sequence of FileSystem and plugin calls of a session
+//
+// Only top-level calls are recorded: the FileSystem calls a plugin makes
+// while executing are part of the plugin call and would otherwise be
+// replayed twice. Off by default; while off a WorkloadScope costs one
+// relaxed atomic load.
+class WorkloadRecorder {
+public:
+    // Starts recording into `path` (truncated)
+    static bool start(const std::string& path);
+
+    // Writes everything still buffered and closes the file
+    static void stop();
+
+    static bool isEnabled() { return enabled_.load(std::memory_order_relaxed); }
+
+    // Appends one call, `start` is when the call began
+    static void record(WorkloadRecord& record, std::chrono::steady_clock::time_point start);
+
+private:
+    static std::atomic<bool> enabled_;
+};
+
+// Records one call from construction to destruction
+class WorkloadScope {
+public:
+    explicit WorkloadScope(WorkloadOp op) : entered_(WorkloadRecorder::isEnabled()) {
+        if (entered_) {
+            begin(op);
+        }
+    }
+
+    ~WorkloadScope() {
+        if (entered_) {
+            end();
+        }
+    }
+
+    // False while recording is off and for calls nested in a recorded call
+    bool active() const { return active_; }
+
+    // True if the calling thread is inside a recorded call
+    static bool insideRecordedCall();
+
+    // Marks a thread as running on behalf of a recorded call, for work handed
+    // to another thread (see OperationScheduler::submit)
+    class Nested {
+    public:
+        explicit Nested(bool nested);
+        ~Nested();
+        Nested(const Nested&) = delete;
+        Nested& operator=(const Nested&) = delete;
+    private:
+        bool nested_;
+    };
+
+    // Check active() first so no strings are built while recording is off
+    void addArg(std::string arg) { record_.args.push_back(std::move(arg)); }
+    void setResult(int code) { record_.result = code; }
+    void setSize(uint64_t size) { record_.size = size; }
+    void setFlags(uint8_t flags) { record_.flags = flags; }
+
+    WorkloadScope(const WorkloadScope&) = delete;
+    WorkloadScope& operator=(const WorkloadScope&) = delete;
+
+private:
+    void begin(WorkloadOp op);
+    void end();
+
+    bool entered_;
+    bool active_ = false;
+    WorkloadRecord record_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+// Reads a trace written by WorkloadRecorder
+class WorkloadTraceReader {
+public:
+    explicit WorkloadTraceReader(const std::string& path);
+
+    // False if the file is missing or not a workload trace
+    bool isValid() const { return valid_; }
+
+    // Reads the next call, false at the end of the file
+    bool next(WorkloadRecord& record);
+
+    // Working directory of the recorded session, known once the first call
+    // was read; empty for traces written before it was recorded
+    const std::string& workingDirectory() const { return workingDirectory_; }
+
+private:
+    bool readVarint(uint64_t& value);
+
+    std::ifstream in_;
+    bool valid_ = false;
+    uint64_t lastStartNs_ = 0;
+    std::vector<std::string> strings_;
+    std::string workingDirectory_;
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// XXH64, the 64-bit xxHash (https://github.com/Cyan4973/xxHash)
+//
+// Non-cryptographic, several GB/s per core, so hashing the buffers of a copy
+// costs little next to the I/O. It catches corruption, not tampering.
+// Digests match the reference implementation (and `xxhsum`).
+class Xxh64 {
+public:
+    explicit Xxh64(uint64_t seed = 0) { reset(seed); }
+
+    void reset(uint64_t seed = 0);
+
+    // Any split of the input into update() calls gives the same digest
+    void update(const void* data, size_t size);
+
+    uint64_t digest() const;
+
+    // One-shot hash of a buffer
+    static uint64_t hash(const void* data, size_t size, uint64_t seed = 0);
+
+private:
+    uint64_t accumulators_[4];
+    uint64_t seed_;
+    uint64_t totalLength_;
+    unsigned char pending_[32];   // input of a stripe not complete yet
+    size_t pendingSize_;
+};
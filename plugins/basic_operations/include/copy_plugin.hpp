@@ -2,10 +2,12 @@
 
 #include <core/plugin_interface.hpp>
 #include <core/file_system.hpp>
+#include <cstdint>
 #include <string>
 #include <vector>
 
-// The CopyPlugin implements the "copy" operation for the file manager.
+// The CopyPlugin implements the "copy" operation for the file manager,
+// plus "verified_copy" for a single file checked after the copy.
 class CopyPlugin : public IFileManagerPlugin {
 public:
     CopyPlugin();
@@ -16,6 +18,16 @@ public:
     std::string description() const override;
     std::vector<std::string> operations() const override;
 
-    // args[0] = source path, args[1] = destination path
+    // copy:          args[0] = source path, args[1] = destination path
+    // verified_copy: args[0] = source file, args[1] = destination file,
+    //                optional args[2] = "direct" to read the destination back
+    //                with O_DIRECT instead of after evicting it from the cache;
+    //                prints the XXH64 digest like xxhsum ("<hex>  <destination>")
     bool execute(const std::string& operation, const std::vector<std::string>& args) override;
+
+    // Digest of the last successful verified_copy, 0 before the first
+    uint64_t lastDigest() const { return lastDigest_; }
+
+private:
+    uint64_t lastDigest_ = 0;
 };
@@ -5,7 +5,8 @@
 #include <string>
 #include <vector>
 
-// The DeletePlugin implements the "delete" operation for the file manager.
+// The DeletePlugin implements the "delete" operation for the file manager,
+// plus "trash" / "restore" / "empty_trash" on top of the TrashManager.
 class DeletePlugin : public IFileManagerPlugin {
 public:
     DeletePlugin();
@@ -16,6 +17,9 @@ public:
     std::string description() const override;
     std::vector<std::string> operations() const override;
 
-    // args[0] = path to delete (file or directory)
+    // delete:      args[0] = path to delete for good (file or directory)
+    // trash:       args[0] = path to move to the trash
+    // restore:     args[0] = original path of the most recently trashed entry to bring back
+    // empty_trash: no args, removes every trashed tree at idle I/O priority
     bool execute(const std::string& operation, const std::vector<std::string>& args) override;
 };
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <core/plugin_interface.hpp>
+#include <core/path_store.hpp>
+#include <string>
+#include <vector>
+
+// The SearchPlugin implements "du" and "find" over a tree scanned into a
+// PathStore, so no path string is built for entries that are not printed.
+class SearchPlugin : public IFileManagerPlugin {
+public:
+    SearchPlugin();
+    ~SearchPlugin() override = default;
+
+    std::string name() const override;
+    std::string version() const override;
+    std::string description() const override;
+    std::vector<std::string> operations() const override;
+
+    // du:   args[0] = directory; prints the size of each entry and the total
+    // find: args[0] = directory, args[1] = glob matched against names
+    bool execute(const std::string& operation, const std::vector<std::string>& args) override;
+};
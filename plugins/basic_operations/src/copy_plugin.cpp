@@ -1,4 +1,11 @@
 #include "../include/copy_plugin.hpp"
+#include <core/copy_engine.hpp>
+#include <core/operation_scheduler.hpp>
+#include <utilities/io_priority.hpp>
+#include <utilities/rate_limiter.hpp>
+#include <cstdio>
+#include <iostream>
+#include <optional>
 
 CopyPlugin::CopyPlugin() {}
 
@@ -11,20 +18,66 @@ std::string CopyPlugin::version() const {
 }
 
 std::string CopyPlugin::description() const {
-    return "Provides file and directory copy functionality.";
+    return "Provides file and directory copy functionality, with an optional verified copy.";
 }
 
 std::vector<std::string> CopyPlugin::operations() const {
-    return {"copy"};
+    return {"copy", "verified_copy"};
 }
 
 bool CopyPlugin::execute(const std::string& operation, const std::vector<std::string>& args) {
-    if (operation != "copy" || args.size() < 2) {
+    if (args.size() < 2) {
         return false;
     }
     const std::string& src = args[0];
     const std::string& dst = args[1];
-    return FileSystem::copy(src, dst, /*overwrite=*/true);
+
+    // Every chunk is charged to the shared limiter (FM_IO_MAX_MBPS, FM_IO_IDLE)
+    const std::shared_ptr<RateLimiter> limiter = RateLimiter::background();
+    const auto throttled = [&](uint64_t bytes) { return limiter->acquire(bytes, 0); };
+
+    if (operation == "verified_copy") {
+        const CopyEngine::VerifyMode mode = args.size() > 2 && args[2] == "direct"
+                                                ? CopyEngine::VerifyMode::DIRECT
+                                                : CopyEngine::VerifyMode::DROP_CACHE;
+        return OperationScheduler::instance().run(dst, [&] {
+            // On the worker thread running the copy, restored before it takes the next job
+            std::optional<ScopedIoPriority> idle;
+            if (limiter->limits().idleIo) {
+                idle.emplace(IoPriorityClass::IDLE);
+            }
+            FsResult<uint64_t> digest = CopyEngine::copyVerified(src, dst, /*overwrite=*/true, mode, throttled);
+            if (!digest) {
+                std::cerr << "Error in verified copy: " << digest.message() << std::endl;
+                return false;
+            }
+            lastDigest_ = digest.value();
+            char hex[17];
+            std::snprintf(hex, sizeof(hex), "%016llx", static_cast<unsigned long long>(lastDigest_));
+            std::cout << hex << "  " << dst << std::endl;
+            return true;
+        });
+    }
+    if (operation != "copy") {
+        return false;
+    }
+    // Queued on the destination device, which takes the writes. A single
+    // file goes through CopyEngine, so a big one is copied with O_DIRECT
+    return OperationScheduler::instance().run(dst, [&] {
+        std::error_code ec;
+        if (!fs::is_regular_file(src, ec) || fs::is_directory(dst, ec)) {
+            return FileSystem::copy(src, dst, /*overwrite=*/true);
+        }
+        std::optional<ScopedIoPriority> idle;
+        if (limiter->limits().idleIo) {
+            idle.emplace(IoPriorityClass::IDLE);
+        }
+        const FsStatus status = CopyEngine::copyFile(src, dst, /*overwrite=*/true, throttled);
+        if (!status) {
+            std::cerr << "Error Copying: " << status.message() << std::endl;
+        }
+        return status.ok();
+    });
 }
 
 // Factory function for dynamic loading
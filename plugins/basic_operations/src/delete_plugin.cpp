@@ -1,4 +1,7 @@
 #include "../include/delete_plugin.hpp"
+#include <core/operation_scheduler.hpp>
+#include <core/trash_manager.hpp>
+#include <iostream>
 
 DeletePlugin::DeletePlugin() {}
 
@@ -11,20 +14,52 @@ std::string DeletePlugin::version() const {
 }
 
 std::string DeletePlugin::description() const {
-    return "Provides file and directory delete functionality.";
+    return "Provides file and directory delete functionality, permanent or through the trash.";
 }
 
 std::vector<std::string> DeletePlugin::operations() const {
-    return {"delete"};
+    return {"delete", "trash", "restore", "empty_trash"};
 }
 
 bool DeletePlugin::execute(const std::string& operation, const std::vector<std::string>& args) {
-    if (operation != "delete" || args.empty()) {
+    TrashManager& trash = TrashManager::instance();
+    if (operation == "empty_trash") {
+        // Same purge job as the limits use (idle I/O priority), waited for
+        trash.schedulePurge(true);
+        trash.waitIdle();
+        return true;
+    }
+    if (args.empty()) {
         return false;
     }
     const std::string& target = args[0];
+
+    // A rename, however big the tree; the purge runs later at idle priority
+    if (operation == "trash") {
+        return OperationScheduler::instance().run(target, [&] {
+            FsResult<TrashEntry> entry = trash.trash(target);
+            if (!entry) {
+                std::cerr << "Error moving to trash: " << entry.message() << std::endl;
+            }
+            return entry.ok();
+        });
+    }
+    if (operation == "restore") {
+        FsResult<TrashEntry> entry = trash.lastTrashed(target);
+        FsStatus restored = entry ? trash.restore(entry.value()) : FsStatus::failure(entry.code(), "not in trash");
+        if (!restored) {
+            std::cerr << "Error restoring " << target << ": " << restored.message() << std::endl;
+        }
+        return restored.ok();
+    }
+    if (operation != "delete") {
+        return false;
+    }
     // Use your core FileSystem utility for removal
-    return FileSystem::remove(target);
+    // Queued on the device of the target through the shared scheduler
+    return OperationScheduler::instance().run(target, [&] {
+        return FileSystem::remove(target);
+    });
 }
 
 // Factory function for dynamic loading
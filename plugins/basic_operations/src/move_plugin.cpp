@@ -1,4 +1,5 @@
 #include "../include/move_plugin.hpp"
+#include <core/operation_scheduler.hpp>
 
 MovePlugin::MovePlugin() {}
 
@@ -25,7 +26,10 @@ bool MovePlugin::execute(const std::string& operation, const std::vector<std::st
     const std::string& src = args[0];
     const std::string& dst = args[1];
     // Use your core FileSystem utility for moving
-    return FileSystem::move(src, dst, /*overwrite=*/true);
+    // Queued on the destination device through the shared scheduler
+    return OperationScheduler::instance().run(dst, [&] {
+        return FileSystem::move(src, dst, /*overwrite=*/true);
+    });
 }
 
 // Factory function for dynamic loading
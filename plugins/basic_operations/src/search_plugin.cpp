@@ -0,0 +1,81 @@
+#include "../include/search_plugin.hpp"
+#include <core/operation_scheduler.hpp>
+#include <iostream>
+
+SearchPlugin::SearchPlugin() {}
+
+std::string SearchPlugin::name() const {
+    return "Search Plugin";
+}
+
+std::string SearchPlugin::version() const {
+    return "1.0";
+}
+
+std::string SearchPlugin::description() const {
+    return "Provides disk usage and name search over directory trees.";
+}
+
+std::vector<std::string> SearchPlugin::operations() const {
+    return {"du", "find"};
+}
+
+bool SearchPlugin::execute(const std::string& operation, const std::vector<std::string>& args) {
+    const bool du = operation == "du";
+    if ((!du && operation != "find") || args.empty() || (!du && args.size() < 2)) {
+        return false;
+    }
+    const std::string& root = args[0];
+
+    // Queued on the device of the tree through the shared scheduler
+    return OperationScheduler::instance().run(root, [&] {
+        PathStore store;
+        TreeScanner::Options options;
+        options.metadata = du;   // find only needs names and types
+        options.limiter = RateLimiter::background();   // FM_IO_MAX_OPS, FM_IO_IDLE
+        TreeScanner scanner(store, options);
+        FsResult<PathId> scanned = scanner.scan(root);
+        if (!scanned) {
+            std::cerr << "Error scanning " << root << ": " << scanned.message() << std::endl;
+            return false;
+        }
+        if (scanner.errors()) {
+            std::cerr << scanner.errors() << " directories under " << root << " could not be read" << std::endl;
+        }
+
+        const PathId top = scanned.value();
+        std::string line;
+        if (du) {
+            // The root itself counts: `du` of a single file is its size
+            const uint64_t total = store.subtreeSize(top);
+            PathStore::Reader reader(store);
+            const PathId first = reader.firstChild(top);
+            for (PathId child = first; child < first + reader.childCount(top); ++child) {
+                uint64_t bytes = 0;
+                reader.forEach(child, [&](PathId id) {
+                    bytes += reader.isDirectory(id) ? 0 : reader.fileSize(id);
+                    return true;
+                });
+                line = std::to_string(bytes) + '\t';
+                reader.appendPath(child, line);
+                std::cout << line << '\n';
+            }
+            std::cout << total << '\t' << reader.path(top) << std::endl;
+        } else {
+            const std::vector<PathId> found = store.find(top, args[1]);
+            PathStore::Reader reader(store);
+            for (PathId id : found) {
+                line.clear();
+                reader.appendPath(id, line);
+                std::cout << line << '\n';
+            }
+            std::cout << std::flush;
+        }
+        return true;
+    });
+}
+
+// Factory function for dynamic loading
+extern "C" IFileManagerPlugin* create_plugin() {
+    return new SearchPlugin();
+}
@@ -1,13 +1,14 @@
 #pragma once
 
+#include <core/change_feed.hpp>
 #include <core/plugin_interface.hpp>
 #include <string>
 #include <vector>
 
-class ExamplePlugin : public IFileManagerPlugin {
+class ExamplePlugin : public IFileManagerPlugin, public IBatchPlugin {
 public:
     ExamplePlugin();
-    ~ExamplePlugin() override = default;
+    ~ExamplePlugin() override;   // Ends the subscription before the library is unloaded
 
     std::string name() const override;
     std::string version() const override;
@@ -15,4 +16,13 @@ public:
     std::vector<std::string> operations() const override;
 
     bool execute(const std::string& operation, const std::vector<std::string>& args) override;
+
+    // example_operation in bulk: the output of the whole batch is built in
+    // `memory` and written at once, other operations go through executeEach()
+    size_t executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                        std::pmr::memory_resource* memory, std::vector<bool>& results) override;
+
+private:
+    // example_watch: prints what changes below the watched directories
+    std::vector<std::pair<std::string, ChangeFeed::SubscriptionId>> watches_;
 };
@@ -3,6 +3,14 @@
 
 ExamplePlugin::ExamplePlugin() {}
 
+ExamplePlugin::~ExamplePlugin() {
+    // The feed thread must be out of our callbacks before the code is unmapped
+    for (const auto& [directory, subscription] : watches_) {
+        ChangeFeed::instance().unsubscribe(subscription);
+        ChangeFeed::instance().unwatch(directory);
+    }
+}
+
 std::string ExamplePlugin::name() const {
     return "Example Plugin";
 }
@@ -16,10 +24,28 @@ std::string ExamplePlugin::description() const {
 }
 
 std::vector<std::string> ExamplePlugin::operations() const {
-    return {"example_operation"};
+    return {"example_operation", "example_watch"};
 }
 
 bool ExamplePlugin::execute(const std::string& operation, const std::vector<std::string>& args) {
+    if (operation == "example_watch") {
+        if (args.size() != 1 || !ChangeFeed::instance().watch(args[0])) {
+            return false;
+        }
+        static const char* const kinds[] = {"created", "modified", "attributes", "deleted", "renamed", "rescan"};
+        const auto subscription = ChangeFeed::instance().subscribe(args[0], [](const std::vector<ChangeEvent>& events) {
+            for (const auto& event : events) {
+                std::cout << kinds[static_cast<int>(event.kind)] << ' ' << event.path;
+                if (!event.oldPath.empty()) {
+                    std::cout << " (from " << event.oldPath << ')';
+                }
+                std::cout << '\n';
+            }
+            std::cout << std::flush;
+        });
+        watches_.emplace_back(args[0], subscription);
+        return true;
+    }
     if (operation != "example_operation") {
         return false;
     }
@@ -31,6 +57,29 @@ bool ExamplePlugin::execute(const std::string& operation, const std::vector<std:
     return true;
 }
 
+size_t ExamplePlugin::executeBatch(const std::string& operation, const std::pmr::vector<PluginArgs>& calls,
+                                   std::pmr::memory_resource* memory, std::vector<bool>& results) {
+    if (operation != "example_operation") {
+        return executeEach(*this, operation, calls, results);
+    }
+    std::pmr::string out(memory);
+    for (const PluginArgs& args : calls) {
+        out += "Executing example operation with args:";
+        for (const auto& arg : args) {
+            out += ' ';
+            out += arg;
+        }
+        out += '\n';
+    }
+    std::cout << out << std::flush;
+    results.assign(calls.size(), true);
+    return calls.size();
+}
+
 extern "C" IFileManagerPlugin* create_plugin() {
     return new ExamplePlugin();
 }
+
+extern "C" IBatchPlugin* get_batch_plugin(IFileManagerPlugin* plugin) {
+    return static_cast<ExamplePlugin*>(plugin);
+}
@@ -0,0 +1,176 @@
+#include "utilities/binary_log.hpp"
+#include <cassert>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static uint64_t nowNs() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+static std::vector<BinaryLogEvent> readAll(const std::string& filename) {
+    BinaryLogReader reader(filename);
+    assert(reader.isValid());
+    std::vector<BinaryLogEvent> events;
+    BinaryLogEvent event;
+    while (reader.next(event)) {
+        events.push_back(event);
+    }
+    return events;
+}
+
+void test_records_round_trip() {
+    std::cout << "Running test_records_round_trip..." << std::endl;
+    const std::string filename = "test_round_trip.blog";
+    std::remove(filename.c_str());
+
+    const uint64_t before = nowNs();
+    {
+        BinaryLogSink sink(filename);
+        assert(sink.isOpen());
+        const std::filesystem::path destination = "/tmp/target file.txt";
+        const std::string name = "report.pdf";
+        FM_BLOG(sink, ErrorSeverity::INFO, "Copied {} bytes to {}", uint64_t{4096}, destination);
+        FM_BLOG(sink, ErrorSeverity::WARNING, "Retry {} of {} for {} ({})", -1, 3u, name, true);
+        FM_BLOG(sink, ErrorSeverity::ERROR, "Took {} s", 0.25);
+        FM_BLOG(sink, ErrorSeverity::INFO, "No arguments");
+        FM_BLOG(sink, ErrorSeverity::INFO, "Extra", "argument");
+        sink.log(ErrorSeverity::CRITICAL, "Plain {} message");
+    }
+    const uint64_t after = nowNs();
+
+    const std::vector<BinaryLogEvent> events = readAll(filename);
+    assert(events.size() == 6);
+    assert(events[0].severity == ErrorSeverity::INFO);
+    assert(events[0].message == "Copied 4096 bytes to /tmp/target file.txt");
+    assert(events[1].severity == ErrorSeverity::WARNING);
+    assert(events[1].message == "Retry -1 of 3 for report.pdf (1)");
+    assert(events[2].severity == ErrorSeverity::ERROR);
+    assert(events[2].message == "Took 0.25 s");
+    assert(events[3].message == "No arguments");
+    assert(events[4].message == "Extra argument");
+    assert(events[5].severity == ErrorSeverity::CRITICAL);
+    assert(events[5].message == "Plain {} message");   // braces in the argument stay as they are
+    for (size_t i = 0; i < events.size(); ++i) {
+        assert(events[i].timeNs >= before && events[i].timeNs <= after);
+        assert(i == 0 || events[i].timeNs >= events[i - 1].timeNs);
+    }
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_records_round_trip\n" << std::endl;
+}
+
+// Every sink opens a new session, format IDs of an earlier one are not reused
+void test_sessions_append() {
+    std::cout << "Running test_sessions_append..." << std::endl;
+    const std::string filename = "test_sessions.blog";
+    std::remove(filename.c_str());
+
+    for (int session = 0; session < 3; ++session) {
+        BinaryLogSink sink(filename);
+        FM_BLOG(sink, ErrorSeverity::INFO, "Session {} started", session);
+        FM_BLOG(sink, ErrorSeverity::INFO, "Session {} stopped", session);
+    }
+
+    const std::vector<BinaryLogEvent> events = readAll(filename);
+    assert(events.size() == 6);
+    for (int session = 0; session < 3; ++session) {
+        assert(events[2 * session].message == "Session " + std::to_string(session) + " started");
+        assert(events[2 * session + 1].message == "Session " + std::to_string(session) + " stopped");
+    }
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_sessions_append\n" << std::endl;
+}
+
+void test_filtered_records_are_not_written() {
+    std::cout << "Running test_filtered_records_are_not_written..." << std::endl;
+    const std::string filename = "test_filtered.blog";
+    std::remove(filename.c_str());
+
+    const ErrorSeverity previous = ErrorHandler::minimumSeverity();
+    ErrorHandler::setMinimumSeverity(ErrorSeverity::WARNING);
+    {
+        BinaryLogSink sink(filename);
+        FM_BLOG(sink, ErrorSeverity::DEBUG, "Hidden {}", 1);
+        FM_BLOG(sink, ErrorSeverity::INFO, "Hidden {}", 2);
+        FM_BLOG(sink, ErrorSeverity::WARNING, "Shown {}", 3);
+    }
+    ErrorHandler::setMinimumSeverity(previous);
+
+    const std::vector<BinaryLogEvent> events = readAll(filename);
+    assert(events.size() == 1 && events[0].message == "Shown 3");
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_filtered_records_are_not_written\n" << std::endl;
+}
+
+void test_concurrent_writers() {
+    std::cout << "Running test_concurrent_writers..." << std::endl;
+    const std::string filename = "test_concurrent.blog";
+    std::remove(filename.c_str());
+
+    constexpr int THREADS = 4;
+    constexpr int RECORDS = 5000;   // several flushes of the buffer
+    {
+        BinaryLogSink sink(filename);
+        std::vector<std::thread> threads;
+        for (int t = 0; t < THREADS; ++t) {
+            threads.emplace_back([&sink, t] {
+                for (int i = 0; i < RECORDS; ++i) {
+                    FM_BLOG(sink, ErrorSeverity::INFO, "thread {} record {}", t, i);
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // Records of each thread come back complete and in order
+    std::vector<int> nextRecord(THREADS, 0);
+    for (const auto& event : readAll(filename)) {
+        int t = -1;
+        int i = -1;
+        assert(std::sscanf(event.message.c_str(), "thread %d record %d", &t, &i) == 2);
+        assert(t >= 0 && t < THREADS && i == nextRecord[t]);
+        ++nextRecord[t];
+    }
+    for (int t = 0; t < THREADS; ++t) {
+        assert(nextRecord[t] == RECORDS);
+    }
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_concurrent_writers\n" << std::endl;
+}
+
+void test_reader_rejects_other_files() {
+    std::cout << "Running test_reader_rejects_other_files..." << std::endl;
+    const std::string filename = "test_not_binary.log";
+    {
+        std::ofstream out(filename);
+        out << "[2025-01-01 00:00:00] [INFO] text log\n";
+    }
+    assert(!BinaryLogReader(filename).isValid());
+    assert(!BinaryLogReader("does_not_exist.blog").isValid());
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_reader_rejects_other_files\n" << std::endl;
+}
+
+int main() {
+    ErrorHandler::setMinimumSeverity(ErrorSeverity::DEBUG);
+
+    test_records_round_trip();
+    test_sessions_append();
+    test_filtered_records_are_not_written();
+    test_concurrent_writers();
+    test_reader_rejects_other_files();
+
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
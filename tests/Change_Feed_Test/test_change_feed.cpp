@@ -0,0 +1,339 @@
+#include "core/change_feed.hpp"
+#include <cassert>
+#include <chrono>
+#include <condition_variable>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <mutex>
+
+namespace fs = std::filesystem;
+using namespace std::chrono_literals;
+
+static const fs::path testRoot = fs::weakly_canonical(fs::absolute("change_feed_test_dir"));
+
+static std::string under(const std::string& relative) {
+    return (testRoot / relative).string();
+}
+
+static void writeFile(const std::string& path, const std::string& contents = "data") {
+    std::ofstream(path) << contents;
+}
+
+// Collects delivered batches, tests wait on it for the events they expect
+class Collector {
+public:
+    ChangeFeed::Callback callback() {
+        return [this](const std::vector<ChangeEvent>& batch) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            events_.insert(events_.end(), batch.begin(), batch.end());
+            ++batches_;
+            changed_.notify_all();
+        };
+    }
+
+    // Waits until an event of `kind` for `path` arrived
+    bool waitFor(ChangeKind kind, const std::string& path, std::chrono::milliseconds timeout = 5000ms) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return changed_.wait_for(lock, timeout, [&] { return countLocked(kind, path) > 0; });
+    }
+
+    size_t count(ChangeKind kind, const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return countLocked(kind, path);
+    }
+
+    // Events naming `path` in any role
+    size_t mentions(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        size_t found = 0;
+        for (const auto& event : events_) {
+            found += event.path == path || event.oldPath == path ? 1 : 0;
+        }
+        return found;
+    }
+
+    std::vector<ChangeEvent> events() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return events_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        events_.clear();
+    }
+
+private:
+    size_t countLocked(ChangeKind kind, const std::string& path) const {
+        size_t found = 0;
+        for (const auto& event : events_) {
+            found += event.kind == kind && event.path == path ? 1 : 0;
+        }
+        return found;
+    }
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::vector<ChangeEvent> events_;
+    size_t batches_ = 0;
+};
+
+static const ChangeEvent* findEvent(const std::vector<ChangeEvent>& events, const std::string& path) {
+    for (const auto& event : events) {
+        if (event.path == path) {
+            return &event;
+        }
+    }
+    return nullptr;
+}
+
+void test_coalescer() {
+    std::cout << "Running test_coalescer..." << std::endl;
+    using Raw = ChangeCoalescer::Raw;
+    ChangeCoalescer coalescer;
+
+    // create + modify + close_write of a new file, attribute change of an old one
+    coalescer.add(Raw::CREATE, "/w/new", false);
+    coalescer.add(Raw::MODIFY, "/w/new", false);
+    coalescer.add(Raw::MODIFY, "/w/new", false);
+    coalescer.add(Raw::ATTRIB, "/w/old", false);
+    auto events = coalescer.take();
+    assert(events.size() == 2);
+    assert(events[0].kind == ChangeKind::CREATED && events[0].path == "/w/new");
+    assert(events[1].kind == ChangeKind::ATTRIBUTES && events[1].path == "/w/old");
+    assert(coalescer.empty() && coalescer.take().empty());
+
+    // Temporary files vanish, a replaced file is a modification
+    coalescer.add(Raw::CREATE, "/w/tmp", false);
+    coalescer.add(Raw::MODIFY, "/w/tmp", false);
+    coalescer.add(Raw::DELETE, "/w/tmp", false);
+    coalescer.add(Raw::DELETE, "/w/file", false);
+    coalescer.add(Raw::CREATE, "/w/file", false);
+    events = coalescer.take();
+    assert(events.size() == 1 && events[0].kind == ChangeKind::MODIFIED && events[0].path == "/w/file");
+
+    // Rename chains collapse, renaming back leaves only the modification
+    coalescer.rename("/w/a", "/w/b", false);
+    coalescer.rename("/w/b", "/w/c", false);
+    coalescer.add(Raw::MODIFY, "/w/x", false);
+    coalescer.rename("/w/x", "/w/y", false);
+    coalescer.rename("/w/y", "/w/x", false);
+    events = coalescer.take();
+    assert(events.size() == 2);
+    assert(events[0].kind == ChangeKind::RENAMED && events[0].oldPath == "/w/a" && events[0].path == "/w/c");
+    assert(events[1].kind == ChangeKind::MODIFIED && events[1].path == "/w/x");
+
+    // Saved through a temporary renamed over the target
+    coalescer.add(Raw::ATTRIB, "/w/doc", false);
+    coalescer.add(Raw::CREATE, "/w/doc.tmp", false);
+    coalescer.add(Raw::MODIFY, "/w/doc.tmp", false);
+    coalescer.rename("/w/doc.tmp", "/w/doc", false);
+    events = coalescer.take();
+    assert(events.size() == 1 && events[0].kind == ChangeKind::MODIFIED && events[0].path == "/w/doc");
+
+    // A renamed directory carries the pending changes of its children
+    coalescer.add(Raw::MODIFY, "/w/dir/sub/f", false);
+    coalescer.rename("/w/dir", "/w/moved", true);
+    coalescer.add(Raw::ATTRIB, "/w/moved/sub/f", false);
+    events = coalescer.take();
+    assert(events.size() == 2);
+    assert(events[0].kind == ChangeKind::MODIFIED && events[0].path == "/w/moved/sub/f");
+    assert(events[1].kind == ChangeKind::RENAMED && events[1].oldPath == "/w/dir" && events[1].path == "/w/moved");
+
+    // A new directory stands for its contents, a deleted one for what was in it
+    coalescer.add(Raw::CREATE, "/w/n", true);
+    for (int i = 0; i < 100; ++i) {
+        coalescer.add(Raw::CREATE, "/w/n/f" + std::to_string(i), false);
+        coalescer.add(Raw::MODIFY, "/w/n/f" + std::to_string(i), false);
+    }
+    coalescer.add(Raw::CREATE, "/w/n/deep", true);
+    coalescer.add(Raw::CREATE, "/w/n/deep/g", false);
+    coalescer.rename("/w/outside", "/w/n/inside", false);
+    coalescer.add(Raw::DELETE, "/w/d/f", false);
+    coalescer.add(Raw::DELETE, "/w/d", true);
+    events = coalescer.take();
+    assert(events.size() == 3);
+    assert(findEvent(events, "/w/n")->kind == ChangeKind::CREATED);
+    assert(findEvent(events, "/w/outside")->kind == ChangeKind::DELETED);
+    assert(findEvent(events, "/w/d")->kind == ChangeKind::DELETED && findEvent(events, "/w/d")->directory);
+
+    // A rescan replaces everything below it
+    coalescer.add(Raw::MODIFY, "/w/x", false);
+    coalescer.add(Raw::MODIFY, "/other", false);
+    coalescer.rescan("/w");
+    events = coalescer.take();
+    assert(events.size() == 2);
+    assert(events[0].kind == ChangeKind::RESCAN && events[0].path == "/w");
+    assert(events[1].path == "/other");
+
+    std::cout << "Passed: test_coalescer\n" << std::endl;
+}
+
+// Create, write, rename and delete under a watched tree, as seen by one backend
+static void exerciseFeed(ChangeFeed& feed, const std::string& root) {
+    Collector all;
+    Collector sub;
+    const auto allId = feed.subscribe("", all.callback());
+    const auto subId = feed.subscribe(root + "/sub", sub.callback());
+
+    // One CREATED for create + several writes + close
+    {
+        std::ofstream file(root + "/new.txt");
+        for (int i = 0; i < 50; ++i) {
+            file << "line " << i << '\n' << std::flush;
+        }
+    }
+    assert(all.waitFor(ChangeKind::CREATED, root + "/new.txt"));
+    assert(all.mentions(root + "/new.txt") == 1);
+
+    // Directories created later are followed
+    fs::create_directories(root + "/sub/deeper");
+    assert(all.waitFor(ChangeKind::CREATED, root + "/sub"));
+    writeFile(root + "/sub/deeper/file");
+    assert(all.waitFor(ChangeKind::CREATED, root + "/sub/deeper/file"));
+    assert(sub.waitFor(ChangeKind::CREATED, root + "/sub/deeper/file"));
+    assert(sub.mentions(root + "/new.txt") == 0);
+
+    // A directory rename is one event, later changes use the new path
+    fs::rename(root + "/sub/deeper", root + "/sub/renamed");
+    assert(all.waitFor(ChangeKind::RENAMED, root + "/sub/renamed"));
+    writeFile(root + "/sub/renamed/file", "more");
+    assert(all.waitFor(ChangeKind::MODIFIED, root + "/sub/renamed/file"));
+    for (const auto& event : all.events()) {
+        if (event.kind == ChangeKind::RENAMED) {
+            assert(event.oldPath == root + "/sub/deeper" && event.directory);
+        }
+    }
+
+    // Deleting a tree is one event for its top
+    all.clear();
+    fs::remove_all(root + "/sub");
+    assert(all.waitFor(ChangeKind::DELETED, root + "/sub"));
+    assert(sub.waitFor(ChangeKind::DELETED, root + "/sub"));
+    assert(all.mentions(root + "/sub/renamed/file") == 0);
+
+    // Changes next to the watched tree are not reported
+    writeFile(testRoot.string() + "/outside.txt");
+    writeFile(root + "/marker");
+    assert(all.waitFor(ChangeKind::CREATED, root + "/marker"));
+    assert(all.mentions(testRoot.string() + "/outside.txt") == 0);
+
+    feed.unsubscribe(subId);
+    feed.unsubscribe(allId);
+}
+
+void test_inotify_feed() {
+    std::cout << "Running test_inotify_feed..." << std::endl;
+
+    const std::string root = under("inotify");
+    fs::create_directories(root + "/existing/a/b");
+    ChangeFeed feed(ChangeFeed::Backend::INOTIFY, 50ms);
+    assert(feed.watch(root));
+    assert(feed.backend(root) == ChangeFeed::Backend::INOTIFY);
+    assert(feed.inotifyWatches() == 4);   // root, existing, a, b
+
+    exerciseFeed(feed, root);
+    assert(feed.rawEvents() > feed.deliveredEvents());
+
+    // Non-recursive: direct entries only, no watches below
+    const std::string flat = under("flat");
+    fs::create_directories(flat + "/child");
+    assert(feed.watch(flat, false));
+    assert(feed.inotifyWatches() == 5);
+    Collector collector;
+    const auto id = feed.subscribe(flat, collector.callback());
+    writeFile(flat + "/child/hidden");
+    writeFile(flat + "/visible");
+    assert(collector.waitFor(ChangeKind::CREATED, flat + "/visible"));
+    assert(collector.mentions(flat + "/child/hidden") == 0);
+    feed.unsubscribe(id);
+
+    // References: the second unwatch removes the watches
+    assert(feed.watch(root));
+    feed.unwatch(root);
+    assert(feed.backend(root) == ChangeFeed::Backend::INOTIFY);
+    feed.unwatch(root);
+    feed.unwatch(flat);
+    assert(feed.backend(root) == ChangeFeed::Backend::NONE);
+    assert(feed.inotifyWatches() == 0);
+
+    assert(!feed.watch(under("missing")));
+    writeFile(under("plain"));
+    assert(feed.watch(under("plain")).code() == ENOTDIR);
+
+    std::cout << "Passed: test_inotify_feed\n" << std::endl;
+}
+
+void test_fanotify_feed() {
+    std::cout << "Running test_fanotify_feed..." << std::endl;
+
+    const std::string root = under("fanotify");
+    fs::create_directories(root);
+    ChangeFeed feed(ChangeFeed::Backend::FANOTIFY, 50ms);
+    assert(feed.watch(root));
+    if (feed.backend(root) != ChangeFeed::Backend::FANOTIFY) {
+        // Unprivileged, or a filesystem without file handles: inotify took over
+        std::cout << "Skipped: fanotify filesystem marks not available here\n" << std::endl;
+        return;
+    }
+    assert(feed.inotifyWatches() == 0);
+
+    exerciseFeed(feed, root);
+    feed.unwatch(root);
+    assert(feed.backend(root) == ChangeFeed::Backend::NONE);
+
+    std::cout << "Passed: test_fanotify_feed\n" << std::endl;
+}
+
+void test_event_storm() {
+    std::cout << "Running test_event_storm..." << std::endl;
+
+    const std::string root = under("storm");
+    fs::create_directories(root);
+    ChangeFeed feed(ChangeFeed::Backend::INOTIFY, 100ms);
+    assert(feed.watch(root));
+    Collector collector;
+    const auto id = feed.subscribe(root, collector.callback());
+
+    // Every file gets create, several modifies and close_write; one CREATED
+    // comes out, plus a MODIFIED for the few files a window boundary cut in two
+    constexpr int FILES = 2000;
+    for (int i = 0; i < FILES; ++i) {
+        std::ofstream file(root + "/f" + std::to_string(i));
+        file << "a" << std::flush << "b" << std::flush << "c";
+    }
+    writeFile(root + "/last");
+    assert(collector.waitFor(ChangeKind::CREATED, root + "/last"));
+    std::map<std::string, int> seen;
+    size_t split = 0;
+    for (const auto& event : collector.events()) {
+        if (++seen[event.path] == 1) {
+            assert(event.kind == ChangeKind::CREATED);
+        } else {
+            assert(event.kind == ChangeKind::MODIFIED);
+            ++split;
+        }
+    }
+    assert(seen.size() == FILES + 1);
+    assert(split < FILES / 10);
+    assert(feed.rawEvents() >= 3 * FILES);
+    std::cout << "  " << feed.rawEvents() << " raw events delivered as " << feed.deliveredEvents() << std::endl;
+
+    feed.unsubscribe(id);
+    std::cout << "Passed: test_event_storm\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+
+    test_coalescer();
+    test_inotify_feed();
+    test_fanotify_feed();
+    test_event_storm();
+
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,393 @@
+#include "core/daemon_client.hpp"
+#include "core/daemon_server.hpp"
+#include "utilities/binary_log.hpp"
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = fs::absolute("daemon_test_dir");
+static const std::string socketPath = (testRoot / "daemon.sock").string();
+
+// Server running on its own thread for the duration of a test
+struct RunningServer {
+    PluginManager plugins;
+    DirectoryCache cache;
+    DaemonServer server{plugins, cache};
+    std::thread loop;
+
+    explicit RunningServer(BinaryLogSink* requestLog = nullptr) {
+        server.setRequestLog(requestLog);
+        const FsStatus listening = server.listen(socketPath);
+        assert(listening);
+        loop = std::thread([this] { server.run(); });
+    }
+    ~RunningServer() {
+        server.stop();
+        loop.join();
+    }
+};
+
+static std::string makeDirectory(const std::string& name, int files) {
+    const fs::path dir = testRoot / name;
+    fs::create_directories(dir);
+    for (int i = 0; i < files; ++i) {
+        std::ofstream(dir / ("file_" + std::to_string(i))) << "x";
+    }
+    return dir.string();
+}
+
+static uint64_t statValue(const fmd::Response& response, const std::string& key) {
+    for (const auto& item : response.items) {
+        if (item.value.compare(0, key.size() + 1, key + "=") == 0) {
+            return std::stoull(item.value.substr(key.size() + 1));
+        }
+    }
+    assert(false && "missing stat");
+    return 0;
+}
+
+void test_protocol_round_trip() {
+    std::cout << "Running test_protocol_round_trip..." << std::endl;
+
+    fmd::Request request;
+    request.id = 42;
+    request.opcode = fmd::Opcode::EXECUTE;
+    request.args = {"copy", "/a b", std::string("with\0nul", 8)};
+    std::string wire;
+    fmd::encodeRequest(wire, request);
+    fmd::encodeRequest(wire, request);
+
+    // Every prefix of the first frame is incomplete, the whole frame decodes
+    fmd::Request decoded;
+    size_t consumed = 0;
+    const size_t frame = wire.size() / 2;
+    for (size_t size = 0; size < frame; ++size) {
+        assert(fmd::decodeRequest(wire.data(), size, decoded, consumed) == fmd::Parse::INCOMPLETE);
+    }
+    assert(fmd::decodeRequest(wire.data(), wire.size(), decoded, consumed) == fmd::Parse::COMPLETE);
+    assert(consumed == frame);
+    assert(decoded.id == 42 && decoded.opcode == fmd::Opcode::EXECUTE && decoded.args == request.args);
+
+    fmd::Response response;
+    response.id = 7;
+    response.status = fmd::Status::FAILED;
+    response.error = 2;
+    response.items = {{1, "one"}, {2, ""}, {3, std::string(100000, 'x')}};
+    wire.clear();
+    fmd::encodeResponse(wire, response);
+    fmd::Response back;
+    assert(fmd::decodeResponse(wire.data(), wire.size(), back, consumed) == fmd::Parse::COMPLETE);
+    assert(consumed == wire.size());
+    assert(back.id == 7 && back.status == fmd::Status::FAILED && back.error == 2);
+    assert(back.items.size() == 3 && back.items[2].value.size() == 100000 && back.items[1].tag == 2);
+
+    // A length above MAX_FRAME or an item running past the frame is invalid
+    const uint32_t huge = fmd::MAX_FRAME + 1;
+    std::string bad(reinterpret_cast<const char*>(&huge), sizeof(huge));
+    assert(fmd::decodeRequest(bad.data(), bad.size(), decoded, consumed) == fmd::Parse::INVALID);
+    wire.clear();
+    fmd::encodeRequest(wire, request);
+    wire[4 + 6] = static_cast<char>(0xFF);   // length of the first argument
+    assert(fmd::decodeRequest(wire.data(), wire.size(), decoded, consumed) == fmd::Parse::INVALID);
+
+    // argc is one byte: more arguments than that are refused, not truncated
+    fmd::Request many;
+    many.opcode = fmd::Opcode::EXECUTE;
+    many.args.assign(fmd::MAX_ARGS, "x");
+    wire.clear();
+    assert(fmd::encodeRequest(wire, many));
+    assert(fmd::decodeRequest(wire.data(), wire.size(), decoded, consumed) == fmd::Parse::COMPLETE);
+    assert(decoded.args.size() == fmd::MAX_ARGS);
+    many.args.push_back("x");
+    wire = "kept";
+    assert(!fmd::encodeRequest(wire, many));
+    assert(wire == "kept");
+
+    // A response written past MAX_FRAME goes out as a readable EFBIG error
+    wire = "prefix";
+    fmd::ResponseWriter writer(wire, 9);
+    const std::string chunk(1024 * 1024, 'y');
+    for (int i = 0; i < 17; ++i) {
+        writer.add(0, chunk);
+    }
+    writer.finish();
+    assert(wire.compare(0, 6, "prefix") == 0);
+    assert(fmd::decodeResponse(wire.data() + 6, wire.size() - 6, back, consumed) == fmd::Parse::COMPLETE);
+    assert(back.id == 9 && back.status == fmd::Status::FAILED && back.error == EFBIG && back.items.empty());
+
+    std::cout << "Passed: test_protocol_round_trip\n" << std::endl;
+}
+
+void test_requests() {
+    std::cout << "Running test_requests..." << std::endl;
+
+    const std::string dir = makeDirectory("list", 100);
+    RunningServer running;
+    DaemonClient client;
+    assert(client.connect(socketPath));
+
+    auto response = client.call(fmd::Opcode::PING);
+    assert(response && response.value().status == fmd::Status::OK);
+
+    // The first listing reads the disk, the second comes from the cache
+    response = client.call(fmd::Opcode::LIST, {dir});
+    assert(response && response.value().status == fmd::Status::OK);
+    assert(response.value().items.size() == 100);
+    std::set<std::string> names;
+    for (const auto& item : response.value().items) {
+        names.insert(item.value);
+        assert(item.tag == static_cast<uint8_t>(EntryType::FILE));
+    }
+    assert(names.count("file_0") && names.count("file_99"));
+    response = client.call(fmd::Opcode::LIST, {dir});
+    assert(response && response.value().items.size() == 100);
+    response = client.call(fmd::Opcode::STATS);
+    assert(response && statValue(response.value(), "cache.hits") >= 1);
+    assert(statValue(response.value(), "clients") == 1);
+
+    // Errors come back as statuses, the connection stays usable
+    response = client.call(fmd::Opcode::LIST, {(testRoot / "missing").string()});
+    assert(response && response.value().status == fmd::Status::FAILED && response.value().error == ENOENT);
+    response = client.call(fmd::Opcode::LIST, {"relative/path"});
+    assert(response && response.value().status == fmd::Status::BAD_REQUEST);
+    response = client.call(fmd::Opcode::EXECUTE, {"no_such_operation", dir});
+    assert(response && response.value().status == fmd::Status::FAILED);
+    response = client.call(static_cast<fmd::Opcode>(200));
+    assert(response && response.value().status == fmd::Status::BAD_REQUEST);
+    // EXECUTE_IN needs an absolute, existing working directory, which only
+    // the worker running the operation switches to
+    const fs::path cwd = fs::current_path();
+    response = client.call(fmd::Opcode::EXECUTE_IN, {"relative", "no_such_operation"});
+    assert(response && response.value().status == fmd::Status::BAD_REQUEST);
+    response = client.call(fmd::Opcode::EXECUTE_IN, {(testRoot / "missing").string(), "no_such_operation"});
+    assert(response && response.value().status == fmd::Status::FAILED && response.value().error == ENOENT);
+    response = client.call(fmd::Opcode::EXECUTE_IN, {dir, "no_such_operation", "a"});
+    assert(response && response.value().status == fmd::Status::FAILED && response.value().error == 0);
+    assert(fs::current_path() == cwd);
+    std::vector<std::string> tooMany(fmd::MAX_ARGS + 1, dir);
+    tooMany.front() = "copy";
+    response = client.call(fmd::Opcode::EXECUTE, tooMany);
+    assert(response && response.value().status == fmd::Status::BAD_REQUEST && response.value().error == E2BIG);
+    assert(client.call(fmd::Opcode::PING));
+
+    std::cout << "Passed: test_requests\n" << std::endl;
+}
+
+void test_request_log() {
+    std::cout << "Running test_request_log..." << std::endl;
+
+    const std::string dir = makeDirectory("logged", 3);
+    const std::string logFile = (testRoot / "requests.blog").string();
+    {
+        BinaryLogSink requestLog(logFile);
+        RunningServer running(&requestLog);
+        DaemonClient client;
+        assert(client.connect(socketPath));
+        assert(client.call(fmd::Opcode::PING));
+        assert(client.call(fmd::Opcode::LIST, {dir}));
+        assert(client.call(fmd::Opcode::EXECUTE, {"no_such_operation", dir}));
+    }
+
+    BinaryLogReader reader(logFile);
+    assert(reader.isValid());
+    std::vector<BinaryLogEvent> events;
+    BinaryLogEvent event;
+    while (reader.next(event)) {
+        events.push_back(event);
+    }
+    assert(events.size() == 3);
+    assert(events[0].severity == ErrorSeverity::INFO);
+    assert(events[0].message.find("opcode 0, 0 arguments") != std::string::npos);
+    assert(events[1].message.find("opcode 2, 1 arguments, first " + dir) != std::string::npos);
+    assert(events[2].message.find("opcode 1, 2 arguments, first no_such_operation") != std::string::npos);
+
+    std::cout << "Passed: test_request_log\n" << std::endl;
+}
+
+void test_listing_over_frame_limit() {
+    std::cout << "Running test_listing_over_frame_limit..." << std::endl;
+
+    // 70000 names of 240 bytes: about 17 MB of listing, above MAX_FRAME
+    const fs::path dir = testRoot / "huge";
+    fs::create_directories(dir);
+    const std::string padding(234, 'n');
+    for (int i = 0; i < 70000; ++i) {
+        char number[8];
+        std::snprintf(number, sizeof(number), "%06d", i);
+        const int fd = ::open((dir / (number + padding)).c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+        assert(fd >= 0);
+        ::close(fd);
+    }
+    assert(fmd::responseLength(70000, 70000 * 240) > fmd::MAX_FRAME);
+
+    // Refused with EFBIG, from the disk and from the cache, and the
+    // connection stays usable
+    RunningServer running;
+    DaemonClient client;
+    assert(client.connect(socketPath));
+    for (int attempt = 0; attempt < 2; ++attempt) {
+        auto response = client.call(fmd::Opcode::LIST, {dir.string()});
+        assert(response && response.value().status == fmd::Status::FAILED);
+        assert(response.value().error == EFBIG && response.value().items.empty());
+    }
+    assert(client.call(fmd::Opcode::PING));
+    fs::remove_all(dir);
+
+    std::cout << "Passed: test_listing_over_frame_limit\n" << std::endl;
+}
+
+void test_pipelining_and_concurrent_clients() {
+    std::cout << "Running test_pipelining_and_concurrent_clients..." << std::endl;
+
+    const std::string dir = makeDirectory("pipeline", 10);
+    RunningServer running;
+
+    // More outstanding requests than MAX_IN_FLIGHT, mixing loop and scheduler work
+    auto runClient = [&dir](size_t requests) {
+        DaemonClient client;
+        assert(client.connect(socketPath));
+        std::set<uint32_t> ids;
+        for (size_t i = 0; i < requests; ++i) {
+            ids.insert(client.send(i % 3 == 0 ? fmd::Opcode::LIST : fmd::Opcode::PING,
+                                   i % 3 == 0 ? std::vector<std::string>{dir} : std::vector<std::string>{}));
+        }
+        for (size_t i = 0; i < requests; ++i) {
+            const auto response = client.receive();
+            assert(response && response.value().status == fmd::Status::OK);
+            assert(ids.erase(response.value().id) == 1);
+        }
+        assert(ids.empty());
+    };
+    runClient(DaemonServer::MAX_IN_FLIGHT * 8);
+
+    std::vector<std::thread> clients;
+    for (int c = 0; c < 8; ++c) {
+        clients.emplace_back(runClient, 300);
+    }
+    for (auto& thread : clients) {
+        thread.join();
+    }
+    assert(running.server.requestCount() == DaemonServer::MAX_IN_FLIGHT * 8 + 8 * 300);
+
+    std::cout << "Passed: test_pipelining_and_concurrent_clients\n" << std::endl;
+}
+
+void test_half_close_and_malformed_frames() {
+    std::cout << "Running test_half_close_and_malformed_frames..." << std::endl;
+
+    const std::string dir = makeDirectory("half_close", 5);
+    RunningServer running;
+
+    // A client that sends its batch and shuts down its side still gets every answer
+    {
+        std::string batch;
+        for (uint32_t id = 1; id <= 20; ++id) {
+            fmd::encodeRequest(batch, fmd::Request{id, fmd::Opcode::LIST, {dir}});
+        }
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath.c_str());
+        assert(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        assert(::write(fd, batch.data(), batch.size()) == static_cast<ssize_t>(batch.size()));
+        ::shutdown(fd, SHUT_WR);
+
+        std::string received;
+        char buffer[4096];
+        ssize_t got;
+        while ((got = ::read(fd, buffer, sizeof(buffer))) > 0) {
+            received.append(buffer, static_cast<size_t>(got));
+        }
+        ::close(fd);
+        size_t offset = 0;
+        int responses = 0;
+        fmd::Response response;
+        size_t consumed = 0;
+        while (fmd::decodeResponse(received.data() + offset, received.size() - offset, response, consumed) ==
+               fmd::Parse::COMPLETE) {
+            assert(response.items.size() == 5);
+            offset += consumed;
+            ++responses;
+        }
+        assert(responses == 20 && offset == received.size());
+    }
+
+    // Garbage gets the connection closed, other clients are not affected
+    DaemonClient good;
+    assert(good.connect(socketPath));
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath.c_str());
+        assert(::connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        const uint32_t huge = fmd::MAX_FRAME + 1;
+        assert(::write(fd, &huge, sizeof(huge)) == sizeof(huge));
+        char byte;
+        assert(::read(fd, &byte, 1) == 0);   // closed by the daemon
+        ::close(fd);
+    }
+    assert(good.call(fmd::Opcode::PING));
+
+    std::cout << "Passed: test_half_close_and_malformed_frames\n" << std::endl;
+}
+
+void test_socket_ownership() {
+    std::cout << "Running test_socket_ownership..." << std::endl;
+
+    {
+        RunningServer running;
+        // A live daemon keeps its socket
+        PluginManager plugins;
+        DaemonServer second(plugins);
+        const FsStatus status = second.listen(socketPath);
+        assert(!status && status.code() == EADDRINUSE);
+        assert(fs::exists(socketPath));
+    }
+    assert(!fs::exists(socketPath));   // removed on shutdown
+
+    // A stale socket file left by a crashed daemon is replaced
+    {
+        const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un address {};
+        address.sun_family = AF_UNIX;
+        std::snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath.c_str());
+        assert(::bind(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+        ::close(fd);
+    }
+    assert(fs::exists(socketPath));
+    RunningServer running;
+    DaemonClient client;
+    assert(client.connect(socketPath));
+    assert(client.call(fmd::Opcode::PING));
+
+    std::cout << "Passed: test_socket_ownership\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+
+    test_protocol_round_trip();
+    test_requests();
+    test_request_log();
+    test_listing_over_frame_limit();
+    test_pipelining_and_concurrent_clients();
+    test_half_close_and_malformed_frames();
+    test_socket_ownership();
+
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,91 @@
+#include "core/directory_listing.hpp"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+
+namespace fs = std::filesystem;
+
+void test_columnar_store() {
+    std::cout << "Running test_columnar_store..." << std::endl;
+
+    DirectoryListing listing;
+    listing.append("alpha", EntryType::FILE);
+    listing.append("", EntryType::OTHER);
+    listing.append("beta", EntryType::DIRECTORY);
+
+    DirectoryListing chunk;
+    chunk.append("gamma", EntryType::UNKNOWN);
+    listing.append(chunk);
+
+    assert(listing.size() == 4);
+    assert(listing.name(0) == "alpha");
+    assert(listing.name(1).empty());
+    assert(listing.name(2) == "beta" && listing.isDirectory(2));
+    assert(listing.name(3) == "gamma");
+    assert(!listing.hasMetadata(3));
+
+    listing.setMetadata(3, 42, 1000, EntryType::FILE);
+    assert(listing.hasMetadata(3) && listing.metadataValid(3));
+    assert(listing.fileSize(3) == 42 && listing.type(3) == EntryType::FILE);
+
+    std::cout << "Passed: test_columnar_store\n" << std::endl;
+}
+
+void test_enumerate_in_chunks() {
+    std::cout << "Running test_enumerate_in_chunks..." << std::endl;
+
+    const fs::path dir = "listing_test_dir";
+    fs::remove_all(dir);
+    fs::create_directories(dir / "subdir");
+    for (int i = 0; i < 1000; ++i) {
+        std::ofstream(dir / ("file_" + std::to_string(i))) << std::string(i, 'x');
+    }
+
+    DirectoryEnumerator enumerator;
+    assert(enumerator.open(dir.string()));
+    DirectoryListing listing;
+    size_t chunks = 0;
+    while (true) {
+        auto added = enumerator.next(listing, 64);
+        assert(added);
+        if (added.value() == 0) {
+            break;
+        }
+        assert(added.value() <= 64);
+        ++chunks;
+    }
+    assert(listing.size() == 1001);
+    assert(chunks >= 1001 / 64);
+
+    std::set<std::string> names;
+    for (size_t i = 0; i < listing.size(); ++i) {
+        names.emplace(listing.name(i));
+    }
+    assert(names.size() == 1001 && names.count("subdir") && names.count("file_999"));
+    assert(!names.count(".") && !names.count(".."));
+
+    // Metadata only for the requested rows
+    listing.loadMetadata(enumerator.fd(), 0, 10);
+    for (size_t i = 0; i < listing.size(); ++i) {
+        assert(listing.hasMetadata(i) == (i < 10));
+        if (i < 10 && listing.name(i).substr(0, 5) == "file_") {
+            assert(listing.fileSize(i) == std::stoul(std::string(listing.name(i).substr(5))));
+        }
+    }
+
+    DirectoryEnumerator missing;
+    assert(missing.open("/non/existing/dir").code() == ENOENT);
+
+    fs::remove_all(dir);
+    std::cout << "Passed: test_enumerate_in_chunks\n" << std::endl;
+}
+
+int main() {
+    test_columnar_store();
+    test_enumerate_in_chunks();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
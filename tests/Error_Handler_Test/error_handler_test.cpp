@@ -59,10 +59,43 @@ void test_handle_system_error() {
     std::cout << "Passed: test_handle_system_error\n" << std::endl;
 }
 
+static int evaluations = 0;
+static int countEvaluation() {
+    return ++evaluations;
+}
+
+void test_log_level_filter() {
+    std::cout << "Running test_log_level_filter..." << std::endl;
+
+    bool callbackTriggered = false;
+    ErrorHandler::instance().setErrorCallback(
+        [&](ErrorSeverity, const std::string&) { callbackTriggered = true; }
+    );
+
+    // Filtered out at runtime: no callback and the arguments are never evaluated
+    ErrorHandler::setMinimumSeverity(ErrorSeverity::ERROR);
+    assert(!ErrorHandler::isEnabled(ErrorSeverity::WARNING));
+    FM_WARNING("Filtered warning ", countEvaluation());
+    FM_DEBUG("Filtered debug ", countEvaluation());
+    assert(!callbackTriggered);
+    assert(evaluations == 0);
+
+    // Passes the filter
+    FM_ERROR("Unfiltered error ", countEvaluation());
+    assert(callbackTriggered);
+    assert(evaluations == 1);
+
+    ErrorHandler::setMinimumSeverity(ErrorSeverity::INFO);
+    ErrorHandler::instance().setErrorCallback(nullptr);
+
+    std::cout << "Passed: test_log_level_filter\n" << std::endl;
+}
+
 int main() {
     test_info_warning_error_methods();
     test_custom_callback();
     test_handle_system_error();
+    test_log_level_filter();
 
     std::cout << "All tests passed!" << std::endl;
     return 0;
@@ -0,0 +1,543 @@
+#include "core/copy_engine.hpp"
+#include "core/file_operation_job.hpp"
+#include "utilities/io_priority.hpp"
+#include "utilities/metrics.hpp"
+#include "utilities/rate_limiter.hpp"
+#include "utilities/xxhash64.hpp"
+#include <atomic>
+#include <cassert>
+#include <cerrno>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include "../../plugins/basic_operations/include/copy_plugin.hpp"
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = "file_operation_job_test_dir";
+
+static void writeFile(const fs::path& path, size_t bytes) {
+    fs::create_directories(path.parent_path());
+    std::ofstream out(path, std::ios::binary);
+    std::string block(64 * 1024, 'x');
+    for (size_t written = 0; written < bytes; written += block.size()) {
+        out.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), bytes - written)));
+    }
+}
+
+// src/a.txt (10 bytes), src/sub/b.bin (100000 bytes), src/sub/link -> b.bin
+static fs::path makeTree(const std::string& name) {
+    const fs::path root = testRoot / name;
+    writeFile(root / "a.txt", 10);
+    writeFile(root / "sub" / "b.bin", 100000);
+    fs::create_symlink("b.bin", root / "sub" / "link");
+    return root;
+}
+
+void test_copy_engine() {
+    std::cout << "Running test_copy_engine..." << std::endl;
+
+    const fs::path source = testRoot / "engine_source";
+    const fs::path target = testRoot / "engine_target";
+    writeFile(source, CopyEngine::CHUNK_SIZE * 2 + 123);
+
+    uint64_t reported = 0;
+    FsStatus status = CopyEngine::copyFile(source, target, false, [&](uint64_t bytes) {
+        reported += bytes;
+        return true;
+    });
+    assert(status);
+    assert(reported == fs::file_size(source));
+    assert(fs::file_size(target) == fs::file_size(source));
+
+    // Existing target without overwrite
+    status = CopyEngine::copyFile(source, target, false);
+    assert(!status && status.code() == EEXIST);
+    assert(CopyEngine::copyFile(source, target, true));
+
+    // Cancelled half way: the partial target is gone
+    const fs::path partial = testRoot / "engine_partial";
+    status = CopyEngine::copyFile(source, partial, false, [](uint64_t) { return false; });
+    assert(!status && status.code() == ECANCELED);
+    assert(!fs::exists(partial));
+
+    // Not a regular file
+    assert(!CopyEngine::copyFile(testRoot, testRoot / "engine_dir", false));
+
+    std::cout << "Passed: test_copy_engine\n" << std::endl;
+}
+
+void test_verified_copy() {
+    std::cout << "Running test_verified_copy..." << std::endl;
+
+    // Reference digests (xxhsum -H1)
+    assert(Xxh64::hash("", 0) == 0xEF46DB3751D8E999ULL);
+    assert(Xxh64::hash("a", 1) == 0xD24EC4F1A98C6E5BULL);
+    assert(Xxh64::hash("abc", 3) == 0x44BC2CF5AD770999ULL);
+
+    // Varied content, an unaligned size and more than one chunk
+    const fs::path source = testRoot / "verified_source";
+    std::string content(CopyEngine::CHUNK_SIZE + 4099, '\0');
+    for (size_t i = 0; i < content.size(); ++i) {
+        content[i] = static_cast<char>((i * 2654435761u) >> 13);
+    }
+    std::ofstream(source, std::ios::binary).write(content.data(), static_cast<std::streamsize>(content.size()));
+
+    // Any split of the input gives the one-shot digest
+    const uint64_t expected = Xxh64::hash(content.data(), content.size());
+    Xxh64 streamed;
+    for (size_t offset = 0, step = 1; offset < content.size(); offset += step, step = step * 3 % 1021 + 1) {
+        streamed.update(content.data() + offset, std::min(step, content.size() - offset));
+    }
+    assert(streamed.digest() == expected);
+
+    for (CopyEngine::VerifyMode mode : {CopyEngine::VerifyMode::DROP_CACHE, CopyEngine::VerifyMode::DIRECT}) {
+        const fs::path target = testRoot / "verified_target";
+        uint64_t copied = 0;
+        uint64_t checks = 0;
+        FsResult<uint64_t> digest = CopyEngine::copyVerified(source, target, true, mode, [&](uint64_t bytes) {
+            copied += bytes;
+            checks += bytes == 0 ? 1 : 0;
+            return true;
+        });
+        assert(digest.ok());
+        assert(digest.value() == expected);
+        assert(copied == content.size());
+        assert(checks == 2);   // two chunks read back
+        assert(fs::file_size(target) == content.size());
+    }
+
+    // Empty file
+    const fs::path empty = testRoot / "verified_empty";
+    std::ofstream(empty).close();
+    assert(CopyEngine::copyVerified(empty, testRoot / "verified_empty_copy", false).value() == 0xEF46DB3751D8E999ULL);
+
+    // Same failures as copyFile, stopping in the read back included
+    assert(CopyEngine::copyVerified(source, testRoot / "verified_target", false).code() == EEXIST);
+    const fs::path stopped = testRoot / "verified_stopped";
+    FsResult<uint64_t> cancelled = CopyEngine::copyVerified(source, stopped, false, CopyEngine::VerifyMode::DROP_CACHE,
+                                                            [](uint64_t bytes) { return bytes != 0; });
+    assert(cancelled.code() == ECANCELED);
+    assert(!fs::exists(stopped));
+
+    // Onto itself: no digest, the source left whole
+    const fs::path self = testRoot / "." / source.filename();
+    FsResult<uint64_t> onto = CopyEngine::copyVerified(source, self, true);
+    assert(!onto.ok() && onto.code() == EINVAL);
+    assert(fs::file_size(source) == content.size());
+    std::ifstream in(source, std::ios::binary);
+    assert(std::string((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>()) == content);
+
+    std::cout << "Passed: test_verified_copy\n" << std::endl;
+}
+
+// Every 4 KiB block holds its own number, so a chunk written at the wrong offset shows
+static void writePattern(const fs::path& path, size_t bytes) {
+    std::ofstream out(path, std::ios::binary);
+    std::string block(4096, '\0');
+    for (size_t offset = 0; offset < bytes; offset += block.size()) {
+        const std::string number = std::to_string(offset / block.size()) + ' ';
+        for (size_t i = 0; i < block.size(); ++i) {
+            block[i] = number[i % number.size()];
+        }
+        out.write(block.data(), static_cast<std::streamsize>(std::min(block.size(), bytes - offset)));
+    }
+}
+
+static uint64_t digestOf(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    const std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return Xxh64::hash(data.data(), data.size());
+}
+
+static uint64_t directCopies() {
+    for (const auto& op : Metrics::snapshot()) {
+        if (op.name == "copy.direct") {
+            return op.count;
+        }
+    }
+    return 0;
+}
+
+void test_direct_copy() {
+    std::cout << "Running test_direct_copy..." << std::endl;
+    Metrics::setEnabled(true);
+
+    const size_t sizes[] = {
+        0, 100, 4096 * 3,
+        CopyEngine::CHUNK_SIZE * 2,                      // aligned, no tail
+        CopyEngine::CHUNK_SIZE * 6 + 4096 * 5 + 77,      // every buffer used twice, unaligned tail
+    };
+    for (size_t size : sizes) {
+        const fs::path source = testRoot / ("direct_" + std::to_string(size));
+        const fs::path target = testRoot / ("direct_" + std::to_string(size) + ".copy");
+        writePattern(source, size);
+        uint64_t reported = 0;
+        const FsStatus status = CopyEngine::copyFile(source, target, false, [&](uint64_t bytes) {
+            reported += bytes;
+            return true;
+        }, CopyEngine::TransferMode::DIRECT);
+        assert(status);
+        assert(reported == size);
+        assert(fs::file_size(target) == size);
+        assert(digestOf(target) == digestOf(source));
+    }
+
+    // Buffers come back to the pool and are reused by the next copy
+    BufferPool& pool = CopyEngine::bufferPool();
+    assert(pool.idleCount() > 0 && pool.idleCount() <= pool.mappedCount());
+    const size_t mapped = pool.mappedCount();
+    {
+        BufferPool::Buffer buffer = pool.acquire();
+        assert(buffer && buffer.size() % BufferPool::HUGE_PAGE_SIZE == 0);
+        assert(reinterpret_cast<uintptr_t>(buffer.data()) % CopyEngine::DIRECT_ALIGNMENT == 0);
+    }
+    assert(pool.mappedCount() == mapped);
+
+    // AUTO picks DIRECT from the threshold on
+    const fs::path big = testRoot / ("direct_" + std::to_string(sizes[4]));
+    const uint64_t before = directCopies();
+    CopyEngine::setDirectThreshold(CopyEngine::CHUNK_SIZE);
+    assert(CopyEngine::copyFile(big, testRoot / "auto_big", false));
+    assert(CopyEngine::copyFile(testRoot / "direct_100", testRoot / "auto_small", false));
+    assert(directCopies() == before + 1);
+    CopyEngine::setDirectThreshold(0);
+    assert(CopyEngine::copyFile(big, testRoot / "auto_off", false));
+    assert(directCopies() == before + 1);
+    CopyEngine::setDirectThreshold(CopyEngine::DEFAULT_DIRECT_THRESHOLD);
+    assert(digestOf(testRoot / "auto_big") == digestOf(big));
+    assert(digestOf(testRoot / "auto_off") == digestOf(big));
+
+    // Stopped with chunks in flight: they drain, the partial target goes
+    int chunks = 0;
+    const FsStatus stopped = CopyEngine::copyFile(big, testRoot / "direct_stopped", false, [&](uint64_t) {
+        return ++chunks < 2;
+    }, CopyEngine::TransferMode::DIRECT);
+    assert(!stopped && stopped.code() == ECANCELED);
+    assert(!fs::exists(testRoot / "direct_stopped"));
+
+    // Onto itself, under another spelling or through a hard link: refused
+    // before the target is truncated
+    const uint64_t digest = digestOf(big);
+    fs::create_hard_link(big, testRoot / "direct_link");
+    const fs::path aliases[] = {big, testRoot / "." / big.filename(), testRoot / "direct_link"};
+    for (const fs::path& alias : aliases) {
+        for (CopyEngine::TransferMode mode : {CopyEngine::TransferMode::AUTO, CopyEngine::TransferMode::DIRECT}) {
+            const FsStatus self = CopyEngine::copyFile(big, alias, true, {}, mode);
+            assert(!self && self.code() == EINVAL);
+            assert(fs::file_size(big) == sizes[4]);
+        }
+    }
+    assert(digestOf(big) == digest);
+
+    Metrics::setEnabled(false);
+    std::cout << "Passed: test_direct_copy\n" << std::endl;
+}
+
+void test_copy_tree_and_rename_conflicts() {
+    std::cout << "Running test_copy_tree_and_rename_conflicts..." << std::endl;
+
+    const fs::path source = makeTree("copy_src");
+    const fs::path destination = testRoot / "copy_dst";
+    fs::create_directories(destination);
+
+    auto job = FileOperationJob::create(FileOperationKind::COPY, {source}, destination);
+    assert(job->state() == JobState::QUEUED);
+    job->run();
+    assert(job->state() == JobState::COMPLETED);
+
+    const JobProgress progress = job->progress();
+    assert(progress.filesTotal == 5 && progress.filesDone == 5);   // 2 dirs, 2 files, 1 link
+    assert(progress.bytesTotal == 100010 && progress.bytesDone == 100010);
+    assert(fs::file_size(destination / "copy_src" / "sub" / "b.bin") == 100000);
+    assert(fs::is_symlink(destination / "copy_src" / "sub" / "link"));
+    assert(fs::read_symlink(destination / "copy_src" / "sub" / "link") == "b.bin");
+
+    // Same copy again lands next to the first one
+    auto again = FileOperationJob::create(FileOperationKind::COPY, {source, source / "a.txt"}, destination);
+    again->run();
+    assert(again->state() == JobState::COMPLETED);
+    again = FileOperationJob::create(FileOperationKind::COPY, {source / "a.txt"}, destination);
+    again->run();
+    assert(fs::exists(destination / "copy_src (2)" / "sub" / "b.bin"));
+    assert(fs::exists(destination / "a.txt"));
+    assert(fs::exists(destination / "a (2).txt"));
+
+    // FAIL policy reports the conflict
+    auto strict = FileOperationJob::create(FileOperationKind::COPY, {source}, destination, ConflictPolicy::FAIL);
+    strict->run();
+    assert(strict->state() == JobState::FAILED);
+    assert(!strict->progress().error.empty());
+
+    std::cout << "Passed: test_copy_tree_and_rename_conflicts\n" << std::endl;
+}
+
+void test_copy_into_itself_fails() {
+    std::cout << "Running test_copy_into_itself_fails..." << std::endl;
+
+    const fs::path source = makeTree("self");
+    auto job = FileOperationJob::create(FileOperationKind::COPY, {source}, source / "sub");
+    job->run();
+    assert(job->state() == JobState::FAILED);
+    assert(job->progress().error.find("into itself") != std::string::npos);
+    assert(!fs::exists(source / "sub" / "self"));
+
+    std::cout << "Passed: test_copy_into_itself_fails\n" << std::endl;
+}
+
+void test_copy_onto_itself_overwrite() {
+    std::cout << "Running test_copy_onto_itself_overwrite..." << std::endl;
+
+    // A file and a folder copied into the folder they are in: nothing to do
+    const fs::path source = makeTree("onto_self");
+    auto job = FileOperationJob::create(FileOperationKind::COPY, {source / "a.txt"}, source, ConflictPolicy::OVERWRITE);
+    job->run();
+    assert(job->state() == JobState::COMPLETED);
+    job = FileOperationJob::create(FileOperationKind::COPY, {source}, testRoot, ConflictPolicy::OVERWRITE);
+    job->run();
+    assert(job->state() == JobState::COMPLETED);
+    const JobProgress progress = job->progress();
+    assert(progress.filesDone == 5 && progress.bytesDone == progress.bytesTotal);
+    assert(fs::file_size(source / "a.txt") == 10);
+    assert(fs::file_size(source / "sub" / "b.bin") == 100000);
+    assert(fs::read_symlink(source / "sub" / "link") == "b.bin");
+
+    // Over a hard link of the source
+    fs::create_directories(testRoot / "onto_link");
+    fs::create_hard_link(source / "sub" / "b.bin", testRoot / "onto_link" / "b.bin");
+    job = FileOperationJob::create(FileOperationKind::COPY, {source / "sub" / "b.bin"}, testRoot / "onto_link",
+                                   ConflictPolicy::OVERWRITE);
+    job->run();
+    assert(job->state() == JobState::COMPLETED);
+    assert(fs::file_size(source / "sub" / "b.bin") == 100000);
+
+    std::cout << "Passed: test_copy_onto_itself_overwrite\n" << std::endl;
+}
+
+void test_move_and_remove() {
+    std::cout << "Running test_move_and_remove..." << std::endl;
+
+    const fs::path source = makeTree("move_src");
+    const fs::path destination = testRoot / "move_dst";
+    fs::create_directories(destination);
+
+    auto move = FileOperationJob::create(FileOperationKind::MOVE, {source}, destination);
+    move->run();
+    assert(move->state() == JobState::COMPLETED);
+    assert(!fs::exists(source));
+    assert(fs::file_size(destination / "move_src" / "sub" / "b.bin") == 100000);
+
+    // Moving into the folder it is already in changes nothing
+    auto noop = FileOperationJob::create(FileOperationKind::MOVE, {destination / "move_src"}, destination);
+    noop->run();
+    assert(noop->state() == JobState::COMPLETED);
+    assert(fs::exists(destination / "move_src"));
+
+    auto remove = FileOperationJob::create(FileOperationKind::REMOVE, {destination / "move_src"});
+    remove->run();
+    assert(remove->state() == JobState::COMPLETED);
+    assert(remove->progress().filesDone == 5 && remove->progress().filesTotal == 5);
+    assert(!fs::exists(destination / "move_src"));
+
+    auto missing = FileOperationJob::create(FileOperationKind::REMOVE, {destination / "missing"});
+    missing->run();
+    assert(missing->state() == JobState::FAILED);
+
+    std::cout << "Passed: test_move_and_remove\n" << std::endl;
+}
+
+void test_pause_resume_and_cancel() {
+    std::cout << "Running test_pause_resume_and_cancel..." << std::endl;
+
+    const fs::path big = testRoot / "big" / "big.bin";
+    writeFile(big, CopyEngine::CHUNK_SIZE * 16);
+    const fs::path destination = testRoot / "big_dst";
+    fs::create_directories(destination);
+
+    OperationScheduler scheduler;
+
+    // Paused before it starts: it stops at the first checkpoint
+    auto job = FileOperationJob::create(FileOperationKind::COPY, {big.parent_path()}, destination);
+    job->pause();
+    job->start(scheduler);
+    while (job->state() != JobState::PAUSED) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    const uint64_t before = job->progress().bytesDone;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    assert(job->progress().bytesDone == before);
+
+    job->resume();
+    job->wait();
+    assert(job->state() == JobState::COMPLETED);
+    assert(fs::file_size(destination / "big" / "big.bin") == fs::file_size(big));
+
+    // Cancelled while paused in the middle of the file
+    auto cancelled = FileOperationJob::create(FileOperationKind::COPY, {big}, destination);
+    cancelled->pause();
+    cancelled->start(scheduler);
+    while (cancelled->state() != JobState::PAUSED) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    cancelled->cancel();
+    cancelled->wait();
+    assert(cancelled->state() == JobState::CANCELLED);
+    assert(!fs::exists(destination / "big (2).bin"));
+
+    // Cancelled before a worker picked it up
+    auto queued = FileOperationJob::create(FileOperationKind::REMOVE, {destination});
+    queued->cancel();
+    assert(queued->state() == JobState::CANCELLED);
+    queued->run();
+    assert(fs::exists(destination));
+
+    std::cout << "Passed: test_pause_resume_and_cancel\n" << std::endl;
+}
+
+void test_interactive_job_runs_first() {
+    std::cout << "Running test_interactive_job_runs_first..." << std::endl;
+
+    OperationScheduler scheduler;
+    scheduler.setDeviceConcurrency(OperationScheduler::deviceOf(testRoot), 1);
+    std::atomic<bool> release{false};
+    auto blocker = scheduler.submit(testRoot, [&] {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    });
+
+    // Queued behind background work, started ahead of it
+    const fs::path doomed = makeTree("interactive");
+    auto job = FileOperationJob::create(FileOperationKind::REMOVE, {doomed});
+    job->setPriority(JobPriority::INTERACTIVE);
+    std::atomic<bool> jobFirst{false};
+    auto background = scheduler.submit(testRoot, [&] {
+        jobFirst = job->finished();
+        return true;
+    }, JobPriority::BACKGROUND);
+    job->start(scheduler);
+
+    release = true;
+    blocker.get();
+    background.get();
+    job->wait();
+    assert(job->state() == JobState::COMPLETED);
+    assert(jobFirst);
+
+    std::cout << "Passed: test_interactive_job_runs_first\n" << std::endl;
+}
+
+void test_throttled_job() {
+    std::cout << "Running test_throttled_job..." << std::endl;
+
+    // 8 files of 256 KiB against 2 MiB/s: about a second
+    const fs::path source = testRoot / "throttled_src";
+    for (int i = 0; i < 8; ++i) {
+        writeFile(source / ("part" + std::to_string(i)), 256 * 1024);
+    }
+    const fs::path destination = testRoot / "throttled_dst";
+    fs::create_directories(destination);
+
+    RateLimits limits;
+    limits.bytesPerSecond = 2 << 20;
+    auto limiter = std::make_shared<RateLimiter>("job_test", limits);
+    auto job = FileOperationJob::create(FileOperationKind::COPY, {source}, destination);
+    job->setRateLimiter(limiter);
+    const auto start = std::chrono::steady_clock::now();
+    job->run();
+    const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    assert(job->state() == JobState::COMPLETED);
+    assert(elapsed > 0.6);
+    assert(limiter->totalBytes() == 8 * 256 * 1024);
+    assert(limiter->totalOps() == 2 * 9);   // counted, then copied: the directory and 8 files
+
+    // Cancel reaches a job waiting for the limiter
+    limits.bytesPerSecond = 0;
+    limits.opsPerSecond = 1;
+    limiter->setLimits(limits);
+    limiter->acquire(0, 60);   // a minute of debt
+    auto slow = FileOperationJob::create(FileOperationKind::REMOVE, {destination});
+    slow->setRateLimiter(limiter);
+    OperationScheduler scheduler;
+    slow->start(scheduler);
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const auto cancelledAt = std::chrono::steady_clock::now();
+    slow->cancel();
+    slow->wait();
+    assert(slow->state() == JobState::CANCELLED);
+    assert(std::chrono::steady_clock::now() - cancelledAt < std::chrono::milliseconds(500));
+    assert(fs::exists(destination / "throttled_src" / "part0"));
+
+    std::cout << "Passed: test_throttled_job\n" << std::endl;
+}
+
+// I/O priority of the calling thread, as ioprio_get(IOPRIO_WHO_PROCESS, 0) reports it
+static int threadIoPriority() {
+    return static_cast<int>(::syscall(SYS_ioprio_get, 1, 0));
+}
+
+// FM_IO_IDLE lowers the worker running a plugin copy, and only for that copy:
+// the shared device worker must not keep the idle class for later jobs
+void test_copy_plugin_restores_worker_priority() {
+    std::cout << "Running test_copy_plugin_restores_worker_priority..." << std::endl;
+
+    const fs::path source = testRoot / "idle_src.bin";
+    writeFile(source, 256 * 1024);
+    OperationScheduler& scheduler = OperationScheduler::instance();
+    scheduler.setDeviceConcurrency(OperationScheduler::deviceOf(testRoot), 1);   // one worker to look at
+
+    const int before = threadIoPriority();
+    int workerBefore = -1;
+    scheduler.run(testRoot, [&] { workerBefore = threadIoPriority(); return true; });
+
+    RateLimits limits;
+    limits.idleIo = true;
+    RateLimiter::background()->setLimits(limits);
+    int workerDuring = -1;
+    CopyPlugin plugin;
+    assert(plugin.execute("copy", {source.string(), (testRoot / "idle_copy.bin").string()}));
+    assert(plugin.execute("verified_copy", {source.string(), (testRoot / "idle_verified.bin").string()}));
+    // What the plugin does around each copy, to know the class can be set here at all
+    scheduler.run(testRoot, [&] {
+        ScopedIoPriority idle(IoPriorityClass::IDLE);
+        workerDuring = idle.applied() ? threadIoPriority() : -1;
+        return true;
+    });
+    RateLimiter::background()->setLimits(RateLimits{});
+
+    int workerAfter = -1;
+    scheduler.run(testRoot, [&] { workerAfter = threadIoPriority(); return true; });
+    assert(workerAfter == workerBefore);
+    assert(threadIoPriority() == before);   // the caller is left alone as well
+    if (workerDuring >= 0) {
+        assert(workerDuring != workerAfter);
+    }
+    assert(fs::file_size(testRoot / "idle_copy.bin") == 256 * 1024);
+
+    std::cout << "Passed: test_copy_plugin_restores_worker_priority\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+    test_copy_engine();
+    test_verified_copy();
+    test_direct_copy();
+    test_copy_tree_and_rename_conflicts();
+    test_copy_into_itself_fails();
+    test_copy_onto_itself_overwrite();
+    test_move_and_remove();
+    test_pause_resume_and_cancel();
+    test_interactive_job_runs_first();
+    test_throttled_job();
+    test_copy_plugin_restores_worker_priority();
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -1,6 +1,102 @@
 #include "core/file_system.hpp"
+#include <cassert>
+#include <cerrno>
 #include <iostream>
 #include <fstream>
+#include <memory_resource>
+#include <set>
+
+// Exception-free API: errors come back as errno codes, nothing is printed
+void test_try_functions() {
+    std::cout << "Running test_try_functions..." << std::endl;
+    const std::filesystem::path dir = "try_functions_dir";
+    std::filesystem::remove_all(dir);
+
+    auto created = FileSystem::tryCreateDirectory(dir);
+    assert(created.ok() && created.value());
+    assert(FileSystem::tryCreateDirectory(dir).ok());   // already there is not an error
+
+    const auto file = dir / "data.bin";
+    assert(FileSystem::tryWriteFile(file, std::string("abc\0def", 7)).ok());
+    auto content = FileSystem::tryReadFile(file);
+    assert(content.ok() && content.value().size() == 7);
+    assert(FileSystem::tryFileSize(file).value() == 7);
+    assert(FileSystem::tryIsFile(file).value());
+    assert(FileSystem::tryIsDirectory(dir).value());
+    assert(FileSystem::tryListDirectory(dir).value().size() == 1);
+
+    auto missing = FileSystem::tryReadFile(dir / "missing");
+    assert(!missing && missing.code() == ENOENT);
+    assert(std::string(missing.context()) == "open");
+    assert(!FileSystem::tryExists(dir / "missing").value());   // missing is a successful false
+    assert(FileSystem::tryFileSize(dir).code() == EISDIR);
+
+    assert(FileSystem::tryMove(file, dir / "moved.bin", true).ok());
+    assert(FileSystem::tryRemove(dir).value() == 2);
+
+    std::cout << "Passed: test_try_functions\n" << std::endl;
+}
+
+// std::pmr overloads: same answers as the fs::path versions, every string
+// from the caller's resource
+void test_pmr_functions() {
+    std::cout << "Running test_pmr_functions..." << std::endl;
+    const std::filesystem::path dir = std::filesystem::absolute("pmr_functions_dir");
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directories(dir / "sub");
+    std::ofstream(dir / "a_file_with_a_long_name.txt") << "12345";
+    std::filesystem::create_symlink("sub", dir / "link");
+
+    // Counts what the listing takes from the resource, nothing may come from the heap
+    struct CountingResource : std::pmr::memory_resource {
+        size_t bytes = 0;
+        std::pmr::memory_resource* upstream = std::pmr::new_delete_resource();
+        void* do_allocate(size_t size, size_t alignment) override {
+            bytes += size;
+            return upstream->allocate(size, alignment);
+        }
+        void do_deallocate(void* p, size_t size, size_t alignment) override {
+            upstream->deallocate(p, size, alignment);
+        }
+        bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+    } counting;
+    std::pmr::monotonic_buffer_resource arena(&counting);
+    std::pmr::memory_resource* previous = std::pmr::set_default_resource(std::pmr::null_memory_resource());
+
+    const std::string path = dir.string();
+    auto listed = FileSystem::tryListDirectory(path, &arena);
+    assert(listed.ok());
+    std::set<std::string> names;
+    for (const ListedEntry& entry : listed.value()) {
+        assert(entry.path.get_allocator().resource() == &arena);
+        assert(std::string_view(entry.path).substr(0, path.size() + 1) == path + "/");
+        names.insert(std::string(entry.name()));
+        if (entry.name() == "sub") {
+            assert(entry.type == std::filesystem::file_type::directory);
+        } else if (entry.name() == "link") {
+            assert(entry.type == std::filesystem::file_type::symlink);
+        } else {
+            assert(entry.type == std::filesystem::file_type::regular);
+        }
+    }
+    assert((names == std::set<std::string>{"sub", "link", "a_file_with_a_long_name.txt"}));
+    assert(counting.bytes > 0);
+
+    const std::string file = path + "/a_file_with_a_long_name.txt";
+    assert(FileSystem::tryFileSize(file, &arena).value() == 5);
+    assert(FileSystem::tryIsFile(file, &arena).value());
+    assert(FileSystem::tryIsDirectory(path + "/link", &arena).value());
+    assert(!FileSystem::tryExists(path + "/missing", &arena).value());
+    assert(FileSystem::tryFileSize(path, &arena).code() == EISDIR);
+    assert(FileSystem::tryListDirectory(path + "/missing", &arena).code() == ENOENT);
+    std::pmr::set_default_resource(previous);
+
+    // Same time as the fs::path version, to the nanosecond
+    assert(FileSystem::tryLastWriteTime(file, &arena).value() == FileSystem::tryLastWriteTime(dir / "a_file_with_a_long_name.txt").value());
+
+    std::filesystem::remove_all(dir);
+    std::cout << "Passed: test_pmr_functions\n" << std::endl;
+}
 
 int main() {
     std::filesystem::path testPath = "example.txt";
@@ -16,5 +112,7 @@ int main() {
     // Clean up
     std::filesystem::remove(testPath);
 
+    test_try_functions();
+    test_pmr_functions();
     return 0;
 }
@@ -0,0 +1,135 @@
+#include "core/listing_sort.hpp"
+#include <atomic>
+#include <cassert>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+static std::vector<std::string> namesInOrder(const DirectoryListing& listing, const std::vector<uint32_t>& rows) {
+    std::vector<std::string> names;
+    for (uint32_t row : rows) {
+        names.emplace_back(listing.name(row));
+    }
+    return names;
+}
+
+void test_natural_order() {
+    std::cout << "Running test_natural_order..." << std::endl;
+
+    DirectoryListing listing;
+    listing.append("docs", EntryType::DIRECTORY);
+    for (const char* name : {"file10.txt", "File2.txt", "file1.txt", "zeta", "Alpha", "file02.txt"}) {
+        listing.append(name, EntryType::FILE);
+    }
+
+    SortKeys keys(listing);
+    auto rows = sortListing(listing, keys, SortOptions{});
+    const std::vector<std::string> expected = {"docs", "Alpha", "file1.txt", "File2.txt", "file02.txt", "file10.txt", "zeta"};
+    assert(namesInOrder(listing, rows) == expected);
+
+    // Directories stay first when descending
+    SortOptions descending;
+    descending.descending = true;
+    rows = sortListing(listing, keys, descending);
+    assert(listing.name(rows[0]) == "docs" && listing.isDirectory(rows[0]));
+    assert(listing.name(rows[1]) == "zeta");
+    assert(listing.name(rows.back()) == "Alpha");
+
+    assert(SortKeys::naturalKey("a9") < SortKeys::naturalKey("a10"));
+    assert(SortKeys::naturalKey("a0") < SortKeys::naturalKey("a1"));
+    assert(SortKeys::naturalKey("ABC") == SortKeys::naturalKey("abc"));
+
+    std::cout << "Passed: test_natural_order\n" << std::endl;
+}
+
+void test_sort_columns() {
+    std::cout << "Running test_sort_columns..." << std::endl;
+
+    DirectoryListing listing;
+    listing.append("b.TXT", EntryType::FILE);
+    listing.append("a.png", EntryType::FILE);
+    listing.append("c.txt", EntryType::FILE);
+    listing.setMetadata(0, 300, 10, EntryType::FILE);
+    listing.setMetadata(1, 100, 30, EntryType::FILE);
+    listing.setMetadata(2, 200, 20, EntryType::FILE);
+    SortKeys keys(listing);
+
+    SortOptions options;
+    options.column = SortColumn::SIZE;
+    assert(namesInOrder(listing, sortListing(listing, keys, options)) == (std::vector<std::string>{"a.png", "c.txt", "b.TXT"}));
+    options.column = SortColumn::DATE;
+    assert(namesInOrder(listing, sortListing(listing, keys, options)) == (std::vector<std::string>{"b.TXT", "c.txt", "a.png"}));
+    options.column = SortColumn::TYPE;
+    assert(namesInOrder(listing, sortListing(listing, keys, options)) == (std::vector<std::string>{"a.png", "b.TXT", "c.txt"}));
+
+    std::cout << "Passed: test_sort_columns\n" << std::endl;
+}
+
+void test_parallel_matches_serial() {
+    std::cout << "Running test_parallel_matches_serial..." << std::endl;
+
+    std::mt19937 rng(7);
+    DirectoryListing listing;
+    for (int i = 0; i < 200000; ++i) {
+        std::string name = "f" + std::to_string(rng() % 50000) + (rng() % 2 ? "_A" : "_a") + ".dat";
+        listing.append(name, rng() % 10 == 0 ? EntryType::DIRECTORY : EntryType::FILE);
+        listing.setMetadata(static_cast<size_t>(i), rng() % 1000, 0, EntryType::FILE);
+    }
+    SortKeys keys(listing);
+
+    for (SortColumn column : {SortColumn::NAME, SortColumn::SIZE}) {
+        SortOptions serial;
+        serial.column = column;
+        serial.threads = 1;
+        SortOptions parallel = serial;
+        parallel.threads = 7;   // odd run count exercises the unpaired run
+        assert(sortListing(listing, keys, serial) == sortListing(listing, keys, parallel));
+    }
+
+    std::atomic<bool> cancelled{true};
+    SortOptions options;
+    options.threads = 4;
+    options.cancelled = &cancelled;
+    assert(sortListing(listing, keys, options).empty());
+
+    std::cout << "Passed: test_parallel_matches_serial\n" << std::endl;
+}
+
+void test_incremental_filter() {
+    std::cout << "Running test_incremental_filter..." << std::endl;
+
+    DirectoryListing listing;
+    for (int i = 0; i < 100000; ++i) {
+        listing.append((i % 3 == 0 ? "Report_" : "image_") + std::to_string(i), EntryType::FILE);
+    }
+    std::vector<uint32_t> all(listing.size());
+    for (uint32_t i = 0; i < all.size(); ++i) {
+        all[i] = i;
+    }
+
+    // Typing "R", "RE", "REP": each step filters the previous result
+    auto rows = filterRows(listing, all, foldCase("R"), 4);
+    rows = filterRows(listing, rows, foldCase("RE"), 4);
+    const auto rep = filterRows(listing, rows, foldCase("REP"), 4);
+    assert(rep == filterRows(listing, all, "rep", 1));
+    assert(rep.size() == 33334);
+    for (size_t i = 1; i < rep.size(); ++i) {
+        assert(rep[i - 1] < rep[i]);   // order of the candidates is kept
+    }
+
+    assert(nameMatches("Hello.TXT", "o.t"));
+    assert(!nameMatches("Hello", "hello!"));
+    assert(filterRows(listing, all, "").size() == all.size());
+
+    std::cout << "Passed: test_incremental_filter\n" << std::endl;
+}
+
+int main() {
+    test_natural_order();
+    test_sort_columns();
+    test_parallel_matches_serial();
+    test_incremental_filter();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -1,5 +1,154 @@
 #include "utilities/logger.hpp"  // Adjust the path as per your structure
+#include <cassert>
+#include <cmath>
+#include <csignal>
+#include <ctime>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <thread>
+#include <vector>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Count the lines written to a log file
+static size_t countLines(const std::string& filename) {
+    std::ifstream in(filename);
+    size_t lines = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        ++lines;
+    }
+    return lines;
+}
+
+void test_async_logger_writes_everything() {
+    std::cout << "Running test_async_logger_writes_everything..." << std::endl;
+    const std::string filename = "test_async_log.txt";
+    std::remove(filename.c_str());
+
+    {
+        AsyncLogOptions options;
+        options.capacity = 256;   // small ring so BLOCK is exercised
+        Logger logger(filename, options);
+        assert(logger.isAsync());
+
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; ++t) {
+            threads.emplace_back([&logger, t] {
+                for (int i = 0; i < 1000; ++i) {
+                    logger.log(ErrorSeverity::WARNING, "thread " + std::to_string(t) + " message " + std::to_string(i));
+                }
+            });
+        }
+        for (auto& thread : threads) {
+            thread.join();
+        }
+        logger.flush();
+        assert(countLines(filename) == 4000);
+        assert(logger.droppedCount() == 0);
+    }
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_async_logger_writes_everything\n" << std::endl;
+}
+
+void test_async_logger_counts_drops() {
+    std::cout << "Running test_async_logger_counts_drops..." << std::endl;
+    const std::string filename = "test_async_drop_log.txt";
+    std::remove(filename.c_str());
+
+    uint64_t dropped = 0;
+    {
+        AsyncLogOptions options;
+        options.capacity = 4;
+        options.overflow = OverflowPolicy::COUNT;
+        options.flushInterval = std::chrono::milliseconds(500);
+        Logger logger(filename, options);
+        for (int i = 0; i < 1000; ++i) {
+            logger.log(ErrorSeverity::ERROR, "burst message");
+        }
+        dropped = logger.droppedCount();
+    }
+
+    // every message is either in the file or counted, plus the "dropped" notices
+    std::ifstream in(filename);
+    size_t written = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        if (line.find("burst message") != std::string::npos) {
+            ++written;
+        }
+    }
+    assert(written + dropped == 1000);
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_async_logger_counts_drops\n" << std::endl;
+}
+
+static void markAndExit(int) {
+    _exit(42);
+}
+
+// Crashes a child with records still queued; returns its wait status
+static int crashWithQueuedRecords(const std::string& filename, bool previousHandler) {
+    const pid_t child = fork();
+    if (child == 0) {
+        if (previousHandler) {
+            struct sigaction action {};
+            action.sa_handler = &markAndExit;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGABRT, &action, nullptr);
+        }
+        AsyncLogOptions options;
+        options.flushInterval = std::chrono::milliseconds(60000);   // nothing written before the crash
+        Logger logger(filename, options);
+        logger.installCrashHandler();
+        for (int i = 0; i < 3; ++i) {
+            logger.log(ErrorSeverity::ERROR, "queued before crash " + std::to_string(i));
+        }
+        std::abort();
+    }
+    int status = 0;
+    waitpid(child, &status, 0);
+    return status;
+}
+
+// The records of the crash path carry the same local time as the writer's
+static void checkCrashLog(const std::string& filename) {
+    std::ifstream in(filename);
+    std::string line;
+    size_t found = 0;
+    while (std::getline(in, line)) {
+        assert(line.find("queued before crash " + std::to_string(found)) != std::string::npos);
+        std::tm tm {};
+        assert(strptime(line.c_str(), "[%Y-%m-%d %H:%M:%S] [ERROR] ", &tm) != nullptr);
+        tm.tm_isdst = -1;
+        assert(std::abs(std::difftime(std::mktime(&tm), std::time(nullptr))) < 30);
+        ++found;
+    }
+    assert(found == 3);
+}
+
+void test_crash_handler_drains_and_chains() {
+    std::cout << "Running test_crash_handler_drains_and_chains..." << std::endl;
+    const std::string filename = "test_crash_log.txt";
+
+    // Nothing installed before: the default action still ends the process
+    std::remove(filename.c_str());
+    int status = crashWithQueuedRecords(filename, false);
+    assert(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+    checkCrashLog(filename);
+
+    // A handler installed earlier (a crash reporter) still runs afterwards
+    std::remove(filename.c_str());
+    status = crashWithQueuedRecords(filename, true);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 42);
+    checkCrashLog(filename);
+
+    std::remove(filename.c_str());
+    std::cout << "Passed: test_crash_handler_drains_and_chains\n" << std::endl;
+}
 
 int main() {
     // Create a logger instance (log file will be created in current directory)
@@ -11,5 +160,9 @@ int main() {
     logger.log(ErrorSeverity::CRITICAL, "This is a critical message.");
 
     std::cout << "Logging completed. Check test_log.txt for output.\n";
+
+    test_async_logger_writes_everything();
+    test_async_logger_counts_drops();
+    test_crash_handler_drains_and_chains();
     return 0;
 }
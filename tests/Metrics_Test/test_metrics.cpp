@@ -0,0 +1,109 @@
+#include "utilities/metrics.hpp"
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const Metrics::OperationStats* findOperation(const std::vector<Metrics::OperationStats>& stats,
+                                                    const std::string& name) {
+    for (const auto& op : stats) {
+        if (op.name == name) {
+            return &op;
+        }
+    }
+    return nullptr;
+}
+
+void test_bucket_layout() {
+    std::cout << "Running test_bucket_layout..." << std::endl;
+
+    // Every value lies inside its bucket and buckets never overlap
+    for (uint64_t value : {0ULL, 1ULL, 7ULL, 8ULL, 15ULL, 16ULL, 1000ULL, 123456789ULL, 1ULL << 62}) {
+        const unsigned index = LatencyBuckets::indexOf(value);
+        assert(index < LatencyBuckets::COUNT);
+        assert(value <= LatencyBuckets::upperBound(index));
+        assert(index == 0 || value > LatencyBuckets::upperBound(index - 1));
+    }
+    assert(LatencyBuckets::indexOf(UINT64_MAX) == LatencyBuckets::COUNT - 1);
+
+    std::cout << "Passed: test_bucket_layout\n" << std::endl;
+}
+
+void test_threads_are_summed() {
+    std::cout << "Running test_threads_are_summed..." << std::endl;
+
+    const MetricId id = Metrics::registerOperation("test.op");
+    assert(Metrics::registerOperation("test.op") == id);
+
+    // Threads exit before the snapshot, their shards must be kept
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([id] {
+            for (int i = 0; i < 1000; ++i) {
+                Metrics::record(id, 1000, i % 100 == 0, 10, 1);
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    Metrics::record(id, 5000000, false, 0, 0);
+
+    const auto stats = Metrics::snapshot();
+    const auto* op = findOperation(stats, "test.op");
+    assert(op != nullptr);
+    assert(op->count == 4001);
+    assert(op->errors == 40);
+    assert(op->bytes == 40000);
+    assert(op->entries == 4000);
+
+    // 1us for the median, the single slow call only shows at the top
+    assert(op->percentile(0.5) >= 1000 && op->percentile(0.5) < 1200);
+    assert(op->percentile(1.0) >= 5000000);
+
+    std::cout << "Passed: test_threads_are_summed\n" << std::endl;
+}
+
+void test_prometheus_output() {
+    std::cout << "Running test_prometheus_output..." << std::endl;
+
+    const MetricId id = Metrics::registerOperation("test.prom");
+    Metrics::record(id, 2000, true, 0, 0);
+    Metrics::setGauge("test_gauge", 42);
+
+    const std::string text = Metrics::toPrometheus(Metrics::snapshot());
+    assert(text.find("fm_operation_duration_seconds_bucket{op=\"test.prom\",le=\"1e-06\"} 0") != std::string::npos);
+    assert(text.find("fm_operation_duration_seconds_bucket{op=\"test.prom\",le=\"1e-05\"} 1") != std::string::npos);
+    assert(text.find("fm_operation_duration_seconds_count{op=\"test.prom\"} 1") != std::string::npos);
+    assert(text.find("fm_operation_errors_total{op=\"test.prom\"} 1") != std::string::npos);
+    assert(text.find("fm_gauge{name=\"test_gauge\"} 42") != std::string::npos);
+
+    std::cout << "Passed: test_prometheus_output\n" << std::endl;
+}
+
+void test_scope_disabled() {
+    std::cout << "Running test_scope_disabled..." << std::endl;
+
+    const MetricId id = Metrics::registerOperation("test.scope");
+    Metrics::setEnabled(false);
+    { MetricsScope scope(id); assert(!scope.active()); }
+    Metrics::setEnabled(true);
+    { MetricsScope scope(id); scope.addBytes(5); }
+    Metrics::setEnabled(false);
+
+    const auto stats = Metrics::snapshot();
+    const auto* op = findOperation(stats, "test.scope");
+    assert(op != nullptr && op->count == 1 && op->bytes == 5);
+
+    std::cout << "Passed: test_scope_disabled\n" << std::endl;
+}
+
+int main() {
+    test_bucket_layout();
+    test_threads_are_summed();
+    test_prometheus_output();
+    test_scope_disabled();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
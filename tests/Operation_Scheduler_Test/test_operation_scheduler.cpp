@@ -0,0 +1,133 @@
+#include "core/operation_scheduler.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+void test_results_are_returned() {
+    std::cout << "Running test_results_are_returned..." << std::endl;
+
+    OperationScheduler scheduler;
+    auto ok = scheduler.submit(".", [] { return true; });
+    auto failed = scheduler.submit(".", [] { return false; });
+    assert(ok.get() == true);
+    assert(failed.get() == false);
+
+    std::cout << "Passed: test_results_are_returned\n" << std::endl;
+}
+
+void test_interactive_jumps_ahead() {
+    std::cout << "Running test_interactive_jumps_ahead..." << std::endl;
+
+    OperationScheduler scheduler;
+    const dev_t device = OperationScheduler::deviceOf(".");
+    scheduler.setDeviceConcurrency(device, 1);
+
+    // Occupy the only worker so the next jobs have to queue up
+    std::atomic<bool> release{false};
+    auto blocker = scheduler.submit(".", [&] {
+        while (!release) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return true;
+    });
+
+    std::mutex orderMutex;
+    std::vector<std::string> order;
+    auto record = [&](const std::string& name) {
+        return [&, name] {
+            std::lock_guard<std::mutex> lock(orderMutex);
+            order.push_back(name);
+            return true;
+        };
+    };
+
+    scheduler.submit(".", record("background1"), JobPriority::BACKGROUND);
+    scheduler.submit(".", record("background2"), JobPriority::BACKGROUND);
+    scheduler.submit(".", record("interactive"), JobPriority::INTERACTIVE);
+
+    release = true;
+    blocker.get();
+    scheduler.waitIdle();
+
+    assert(order.size() == 3);
+    assert(order[0] == "interactive");
+    assert(order[1] == "background1");
+    assert(order[2] == "background2");
+
+    std::cout << "Passed: test_interactive_jumps_ahead\n" << std::endl;
+}
+
+void test_exception_reaches_future() {
+    std::cout << "Running test_exception_reaches_future..." << std::endl;
+
+    OperationScheduler scheduler;
+    auto result = scheduler.submit("/non/existing/path", []() -> bool {
+        throw std::runtime_error("job failed");
+    });
+
+    bool caught = false;
+    try {
+        result.get();
+    } catch (const std::runtime_error&) {
+        caught = true;
+    }
+    assert(caught);
+
+    std::cout << "Passed: test_exception_reaches_future\n" << std::endl;
+}
+
+void test_job_released_before_result() {
+    std::cout << "Running test_job_released_before_result..." << std::endl;
+
+    // The callable may live in a plugin that is unloaded as soon as the
+    // waiter wakes: whatever it captured must already be gone by then
+    OperationScheduler scheduler;
+    for (int i = 0; i < 100; ++i) {
+        auto captured = std::make_shared<int>(i);
+        std::weak_ptr<int> watcher = captured;
+        auto result = scheduler.submit(".", [captured] { return *captured >= 0; });
+        captured.reset();
+        assert(result.get());
+        assert(watcher.expired());
+
+        auto thrown = std::make_shared<int>(i);
+        watcher = thrown;
+        auto failed = scheduler.submit(".", [thrown]() -> bool { throw std::runtime_error("job failed"); });
+        thrown.reset();
+        try {
+            failed.get();
+            assert(false);
+        } catch (const std::runtime_error&) {
+        }
+        assert(watcher.expired());
+    }
+
+    std::cout << "Passed: test_job_released_before_result\n" << std::endl;
+}
+
+void test_device_detection() {
+    std::cout << "Running test_device_detection..." << std::endl;
+
+    const dev_t device = OperationScheduler::deviceOf("/");
+    const DeviceKind kind = OperationScheduler::detectDeviceKind(device);
+    std::cout << "Root device concurrency: " << OperationScheduler::defaultConcurrency(kind) << std::endl;
+    assert(OperationScheduler::defaultConcurrency(DeviceKind::ROTATIONAL) == 1);
+
+    std::cout << "Passed: test_device_detection\n" << std::endl;
+}
+
+int main() {
+    test_results_are_returned();
+    test_interactive_jumps_ahead();
+    test_exception_reaches_future();
+    test_job_released_before_result();
+    test_device_detection();
+
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,245 @@
+#include "core/path_store.hpp"
+#include <atomic>
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = fs::weakly_canonical(fs::absolute("path_store_test_dir"));
+
+static void writeFile(const fs::path& path, size_t bytes) {
+    std::ofstream(path) << std::string(bytes, 'x');
+}
+
+static DirectoryListing listingOf(std::initializer_list<std::pair<const char*, EntryType>> rows) {
+    DirectoryListing listing;
+    for (const auto& [name, type] : rows) {
+        listing.append(name, type);
+    }
+    return listing;
+}
+
+void test_store_basics() {
+    std::cout << "Running test_store_basics..." << std::endl;
+    PathStore store;
+
+    const PathId root = store.addRoot("/srv/data/");
+    const PathId first = store.setChildren(root, listingOf({{"src", EntryType::DIRECTORY},
+                                                            {"docs", EntryType::DIRECTORY},
+                                                            {"README", EntryType::FILE}}));
+    const PathId src = first;
+    const PathId docs = first + 1;
+    const PathId srcChildren = store.setChildren(src, listingOf({{"README", EntryType::FILE},
+                                                                 {"main.cpp", EntryType::FILE}}));
+    const PathId docsSrc = store.setChildren(docs, listingOf({{"src", EntryType::DIRECTORY}}));
+
+    assert(store.size() == 7);
+    assert(store.nameCount() == 5);   // "/srv/data", src, docs, README, main.cpp
+    assert(store.path(root) == "/srv/data");
+    assert(store.path(srcChildren + 1) == "/srv/data/src/main.cpp");
+    assert(store.path(docsSrc) == "/srv/data/docs/src");
+
+    assert(store.lookup("/srv/data") == root);
+    assert(store.lookup("/srv/data/src/README") == srcChildren);
+    assert(store.lookup("/srv/data/docs/src/") == docsSrc);
+    assert(store.lookup("/srv/data/src/missing") == PathStore::NONE);
+    assert(store.lookup("/srv/other") == PathStore::NONE);
+    assert(store.lookup("/srv/database") == PathStore::NONE);
+
+    {
+        PathStore::Reader reader(store);
+        assert(reader.isWithin(srcChildren + 1, src));
+        assert(reader.isWithin(src, root));
+        assert(!reader.isWithin(srcChildren, docs));
+        assert(reader.name(srcChildren) == "README");
+        assert(reader.nameId(srcChildren) == reader.nameId(first + 2));   // interned once
+
+        std::vector<PathId> order;
+        reader.forEach(root, [&](PathId id) {
+            order.push_back(id);
+            return id != docs;   // skip below docs
+        });
+        assert(order.size() == 6);
+        assert(order[0] == root && order[1] == src && order[2] == srcChildren);
+
+        // One buffer for many paths
+        std::string buffer = "> ";
+        reader.appendPath(src, buffer);
+        assert(buffer == "> /srv/data/src");
+    }
+
+    // A second root, and the filesystem root
+    PathStore other;
+    const PathId slash = other.addRoot("/");
+    const PathId etc = other.setChildren(slash, listingOf({{"etc", EntryType::DIRECTORY}}));
+    other.setChildren(etc, listingOf({{"hosts", EntryType::FILE}}));
+    assert(other.path(slash) == "/");
+    assert(other.path(etc) == "/etc");
+    assert(other.lookup("/etc/hosts") == etc + 1);
+    assert(other.lookup("/") == slash);
+
+    std::cout << "Passed: test_store_basics\n" << std::endl;
+}
+
+void test_scan_matches_disk() {
+    std::cout << "Running test_scan_matches_disk..." << std::endl;
+    const fs::path tree = testRoot / "tree";
+    uint64_t bytes = 0;
+    size_t readmes = 0;
+    for (int project = 0; project < 30; ++project) {
+        const fs::path base = tree / ("project" + std::to_string(project));
+        fs::create_directories(base / "src" / "detail");
+        fs::create_directories(base / "include");
+        writeFile(base / "README.md", 100 + project);
+        bytes += 100 + project;
+        ++readmes;
+        for (int file = 0; file < 20; ++file) {
+            writeFile(base / "src" / ("file" + std::to_string(file) + ".cpp"), file);
+            writeFile(base / "src" / "detail" / ("file" + std::to_string(file) + ".hpp"), 1);
+            bytes += file + 1;
+        }
+    }
+    fs::create_symlink("project0", tree / "link");
+
+    PathStore store;
+    TreeScanner scanner(store);
+    FsResult<PathId> root = scanner.scan(tree.string());
+    assert(root.ok());
+    assert(scanner.errors() == 0);
+
+    std::set<std::string> onDisk;
+    for (const auto& entry : fs::recursive_directory_iterator(tree)) {
+        onDisk.insert(entry.path().string());
+    }
+    assert(scanner.entries() == onDisk.size());
+    assert(store.size() == onDisk.size() + 1);
+    for (const auto& path : onDisk) {
+        const PathId id = store.lookup(path);
+        assert(id != PathStore::NONE);
+        assert(store.path(id) == path);
+    }
+
+    // Symlinks are entries, not followed
+    const PathId link = store.lookup((tree / "link").string());
+    {
+        PathStore::Reader reader(store);
+        assert(reader.type(link) == EntryType::SYMLINK);
+        assert(reader.childCount(link) == 0);
+    }
+
+    // du: files plus the symlink's own size ("project0", 8 bytes)
+    assert(store.subtreeSize(root.value()) == bytes + 8);
+    const PathId project3 = store.lookup((tree / "project3").string());
+    assert(store.subtreeSize(project3) == 103 + 190 + 20);
+
+    // find: per distinct name, a few hundred entries share a handful of names
+    assert(store.find(root.value(), "README.*").size() == readmes);
+    assert(store.find(root.value(), "*.hpp").size() == 30 * 20);
+    assert(store.find(project3, "file1?.cpp").size() == 10);
+    assert(store.nameCount() < 80);
+
+    // Names only: no sizes
+    PathStore names;
+    TreeScanner::Options options;
+    options.metadata = false;
+    TreeScanner nameScanner(names, options);
+    FsResult<PathId> namesRoot = nameScanner.scan(tree.string());
+    assert(namesRoot.ok());
+    assert(names.size() == store.size());
+    assert(names.subtreeSize(namesRoot.value()) == 0);
+
+    std::cout << "  " << store.size() << " nodes, " << store.nameCount() << " names, "
+              << store.memoryUsage() << " bytes" << std::endl;
+    std::cout << "Passed: test_scan_matches_disk\n" << std::endl;
+}
+
+void test_deep_tree() {
+    std::cout << "Running test_deep_tree..." << std::endl;
+    // Deeper than one descriptor per level allows
+    fs::path deep = testRoot / "deep";
+    const size_t depth = TreeScanner::MAX_OPEN_DEPTH + 20;
+    fs::path leaf = deep;
+    for (size_t level = 0; level < depth; ++level) {
+        leaf /= "d";
+    }
+    fs::create_directories(leaf);
+    writeFile(leaf / "bottom.txt", 7);
+
+    PathStore store;
+    TreeScanner scanner(store);
+    FsResult<PathId> root = scanner.scan(deep.string());
+    assert(root.ok());
+    assert(scanner.directories() == depth + 1);
+    const PathId bottom = store.lookup((leaf / "bottom.txt").string());
+    assert(bottom != PathStore::NONE);
+    assert(store.path(bottom) == (leaf / "bottom.txt").string());
+    assert(store.subtreeSize(root.value()) == 7);
+
+    assert(scanner.scan((testRoot / "missing").string()).code() == ENOENT);
+    std::cout << "Passed: test_deep_tree\n" << std::endl;
+}
+
+void test_concurrent_readers() {
+    std::cout << "Running test_concurrent_readers..." << std::endl;
+    const fs::path tree = testRoot / "wide";
+    for (int dir = 0; dir < 200; ++dir) {
+        const fs::path base = tree / ("dir" + std::to_string(dir));
+        fs::create_directories(base);
+        for (int file = 0; file < 50; ++file) {
+            writeFile(base / ("f" + std::to_string(file)), 0);
+        }
+    }
+
+    PathStore store;
+    const std::string prefix = tree.string();
+    std::atomic<bool> done{false};
+    std::atomic<uint64_t> checked{0};
+
+    // Readers rebuild paths of whatever is there while the scan appends
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 3; ++i) {
+        readers.emplace_back([&, i] {
+            std::string path;
+            while (!done) {
+                PathStore::Reader reader(store);
+                const size_t size = reader.size();
+                for (size_t id = i; id < size; id += 97) {
+                    path.clear();
+                    reader.appendPath(static_cast<PathId>(id), path);
+                    assert(path.compare(0, prefix.size(), prefix) == 0);
+                    checked.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+        });
+    }
+
+    TreeScanner scanner(store);
+    FsResult<PathId> root = scanner.scan(prefix);
+    done = true;
+    for (auto& reader : readers) {
+        reader.join();
+    }
+    assert(root.ok());
+    assert(store.size() == 1 + 200 + 200 * 50);
+    assert(store.find(root.value(), "f4?").size() == 200 * 10);
+    std::cout << "  " << checked.load() << " paths rebuilt during the scan" << std::endl;
+    std::cout << "Passed: test_concurrent_readers\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+
+    test_store_basics();
+    test_scan_matches_disk();
+    test_deep_tree();
+    test_concurrent_readers();
+
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,169 @@
+#include "core/prefetcher.hpp"
+#include <cassert>
+#include <filesystem>
+#include <fstream>
+#include <future>
+#include <iostream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = "prefetcher_test_dir";
+
+static std::string makeDirectory(const std::string& name, int files) {
+    const fs::path dir = testRoot / name;
+    fs::create_directories(dir);
+    for (int i = 0; i < files; ++i) {
+        std::ofstream(dir / ("file_" + std::to_string(i))) << "x";
+    }
+    return fs::absolute(dir).string();
+}
+
+static std::shared_ptr<DirectoryListing> listingOf(int rows) {
+    auto listing = std::make_shared<DirectoryListing>();
+    for (int i = 0; i < rows; ++i) {
+        listing->append("entry_" + std::to_string(i), EntryType::FILE);
+    }
+    return listing;
+}
+
+void test_cache_budget_and_lru() {
+    std::cout << "Running test_cache_budget_and_lru..." << std::endl;
+
+    const std::string a = makeDirectory("a", 0);
+    const std::string b = makeDirectory("b", 0);
+    const std::string c = makeDirectory("c", 0);
+
+    auto listing = listingOf(1000);
+    const size_t entryBytes = listing->memoryUsage() + a.size() + 128;
+    DirectoryCache cache(entryBytes * 2 + entryBytes / 2);   // room for two
+
+    cache.insert(a, listingOf(1000), DirectoryCache::modificationStamp(a));
+    cache.insert(b, listingOf(1000), DirectoryCache::modificationStamp(b));
+    assert(cache.size() == 2);
+    assert(cache.find(a) != nullptr);   // a is now the most recent
+
+    cache.insert(c, listingOf(1000), DirectoryCache::modificationStamp(c));
+    assert(cache.size() == 2);
+    assert(cache.find(b) == nullptr);   // least recently used was evicted
+    assert(cache.find(a) != nullptr && cache.find(c) != nullptr);
+    assert(cache.memoryUsage() <= cache.budget());
+
+    // Too large for the whole budget: not cached
+    cache.insert(b, listingOf(100000), DirectoryCache::modificationStamp(b));
+    assert(!cache.contains(b));
+
+    cache.setBudget(0);
+    assert(cache.size() == 0 && cache.memoryUsage() == 0);
+
+    std::cout << "Passed: test_cache_budget_and_lru\n" << std::endl;
+}
+
+void test_cache_drops_changed_directory() {
+    std::cout << "Running test_cache_drops_changed_directory..." << std::endl;
+
+    const std::string dir = makeDirectory("changing", 3);
+    DirectoryCache cache;
+    cache.insert(dir, listingOf(3), DirectoryCache::modificationStamp(dir));
+    assert(cache.find(dir) != nullptr);
+
+    // Backdate the stamp instead of sleeping until the mtime visibly changes
+    cache.insert(dir, listingOf(3), DirectoryCache::modificationStamp(dir) - 1);
+    assert(cache.find(dir) == nullptr);
+    assert(cache.size() == 0);
+
+    std::cout << "Passed: test_cache_drops_changed_directory\n" << std::endl;
+}
+
+// Rewriting a file leaves the directory's mtime alone, so the cache must not
+// hand out the size and mtime it had when the listing was stored
+void test_cache_drops_entry_metadata() {
+    std::cout << "Running test_cache_drops_entry_metadata..." << std::endl;
+
+    const std::string dir = makeDirectory("metadata", 0);
+    auto listing = std::make_shared<DirectoryListing>();
+    listing->append("grows", EntryType::UNKNOWN);
+    listing->append("gone", EntryType::FILE);
+    listing->setMetadata(0, 1, 1000, EntryType::FILE);
+    listing->setMetadataFailed(1);
+
+    DirectoryCache cache;
+    cache.insert(dir, listing, DirectoryCache::modificationStamp(dir));
+    auto cached = cache.find(dir);
+    assert(cached && cached->size() == 2);
+    assert(cached->name(0) == "grows" && cached->type(0) == EntryType::FILE);   // resolved type kept
+    assert(!cached->hasMetadata(0) && !cached->hasMetadata(1));
+    assert(listing->hasMetadata(0) && listing->fileSize(0) == 1);   // the caller's copy is untouched
+
+    std::cout << "Passed: test_cache_drops_entry_metadata\n" << std::endl;
+}
+
+void test_prefetch_fills_cache() {
+    std::cout << "Running test_prefetch_fills_cache..." << std::endl;
+
+    const std::string dir = makeDirectory("big", 5000);
+    DirectoryCache cache;
+    OperationScheduler scheduler;
+    {
+        Prefetcher prefetcher(cache, scheduler);
+        prefetcher.prefetch(dir);
+        prefetcher.prefetch(dir);   // duplicate request is ignored
+        prefetcher.waitIdle();
+        assert(prefetcher.completedCount() == 1);
+        assert(prefetcher.pending() == 0);
+
+        // Already cached: nothing to do
+        prefetcher.prefetch(dir);
+        prefetcher.waitIdle();
+        assert(prefetcher.completedCount() == 1);
+    }
+
+    auto listing = cache.find(dir);
+    assert(listing && listing->size() == 5000);
+    // The stat()s only warmed the inode cache, the cache keeps names and types
+    for (size_t row = 0; row < listing->size(); ++row) {
+        assert(!listing->hasMetadata(row) && listing->type(row) == EntryType::FILE);
+    }
+
+    std::cout << "Passed: test_prefetch_fills_cache\n" << std::endl;
+}
+
+void test_moving_away_cancels() {
+    std::cout << "Running test_moving_away_cancels..." << std::endl;
+
+    const std::string first = makeDirectory("first", 10);
+    const std::string second = makeDirectory("second", 10);
+    DirectoryCache cache;
+    OperationScheduler scheduler;
+    scheduler.setDeviceConcurrency(OperationScheduler::deviceOf(first), 1);
+
+    // Occupy the only worker so the prefetches stay queued
+    std::promise<void> release;
+    std::shared_future<void> released = release.get_future().share();
+    scheduler.submit(first, [released] { released.wait(); return true; }, JobPriority::INTERACTIVE);
+
+    Prefetcher prefetcher(cache, scheduler);
+    prefetcher.setTargets({first});
+    prefetcher.setTargets({second});   // hovered another folder
+    assert(prefetcher.pending() == 1);
+
+    release.set_value();
+    prefetcher.waitIdle();
+    assert(!cache.contains(first));
+    assert(cache.contains(second));
+    assert(prefetcher.completedCount() == 1);
+
+    std::cout << "Passed: test_moving_away_cancels\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    test_cache_budget_and_lru();
+    test_cache_drops_changed_directory();
+    test_cache_drops_entry_metadata();
+    test_prefetch_fills_cache();
+    test_moving_away_cancels();
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include "utilities/rate_limiter.hpp"
+#include "utilities/metrics.hpp"
+#include <atomic>
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+using Clock = std::chrono::steady_clock;
+
+static double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void test_unlimited() {
+    std::cout << "Running test_unlimited..." << std::endl;
+    RateLimiter limiter("unlimited");
+    const auto start = Clock::now();
+    for (int i = 0; i < 1000; ++i) {
+        assert(limiter.acquire(1ULL << 30, 100));
+    }
+    assert(secondsSince(start) < 0.5);
+    assert(limiter.totalBytes() == 1000ULL << 30);
+    assert(limiter.totalOps() == 100000);
+    assert(limiter.totalWait() == RateLimiter::Clock::duration::zero());
+    std::cout << "Passed: test_unlimited\n" << std::endl;
+}
+
+void test_byte_rate_and_gauges() {
+    std::cout << "Running test_byte_rate_and_gauges..." << std::endl;
+    Metrics::setEnabled(true);
+
+    // 6 MiB at 4 MiB/s, charged after the fact: the first chunk is free
+    RateLimits limits;
+    limits.bytesPerSecond = 4 << 20;
+    RateLimiter limiter("test", limits);
+    const uint64_t chunk = 256 << 10;
+    const auto start = Clock::now();
+    for (int i = 0; i < 24; ++i) {
+        assert(limiter.acquire(chunk, 0));
+    }
+    const double elapsed = secondsSince(start);
+    std::cout << "  6 MiB in " << elapsed << " s, measured " << limiter.bytesRate() / (1 << 20) << " MiB/s"
+              << std::endl;
+    assert(elapsed > 1.2 && elapsed < 2.5);
+    assert(limiter.bytesRate() > 3.0 * (1 << 20) && limiter.bytesRate() < 5.5 * (1 << 20));
+
+    const std::string exported = Metrics::toPrometheus(Metrics::snapshot());
+    assert(exported.find("rate_limiter.test.bytes_per_second") != std::string::npos);
+    assert(exported.find("rate_limiter.test.bytes_limit") != std::string::npos);
+
+    // Idle: the rate falls towards 0
+    std::this_thread::sleep_for(2 * RateLimiter::MEASURE_INTERVAL);
+    assert(limiter.bytesRate() < 1.0 * (1 << 20));
+    Metrics::setEnabled(false);
+    std::cout << "Passed: test_byte_rate_and_gauges\n" << std::endl;
+}
+
+void test_live_change() {
+    std::cout << "Running test_live_change..." << std::endl;
+    RateLimits limits;
+    limits.opsPerSecond = 10;
+    RateLimiter limiter("live", limits);
+
+    // 1000 ops of debt at 10/s would be 100 s
+    assert(limiter.acquire(0, 1000));
+    std::atomic<bool> through{false};
+    std::thread waiter([&] {
+        assert(limiter.acquire(0, 1));
+        through = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    assert(!through);
+
+    const auto start = Clock::now();
+    limits.opsPerSecond = 0;
+    limiter.setLimits(limits);
+    waiter.join();
+    assert(through);
+    assert(secondsSince(start) < 0.5);
+    assert(limiter.limits().opsPerSecond == 0);
+
+    // Raising a limit shortens the wait of debt already taken
+    limits.opsPerSecond = 10;
+    limiter.setLimits(limits);
+    assert(limiter.acquire(0, 20));   // 2 s of debt at 10/s
+    std::thread raised([&] { assert(limiter.acquire(0, 1)); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    const auto raisedAt = Clock::now();
+    limits.opsPerSecond = 1000;
+    limiter.setLimits(limits);
+    raised.join();
+    assert(secondsSince(raisedAt) < 0.5);
+    std::cout << "Passed: test_live_change\n" << std::endl;
+}
+
+void test_stop_and_wake() {
+    std::cout << "Running test_stop_and_wake..." << std::endl;
+    RateLimits limits;
+    limits.bytesPerSecond = 1024;
+    RateLimiter limiter("stop", limits);
+    assert(limiter.acquire(1 << 20, 0));   // 1024 s of debt
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> result{-1};
+    std::thread waiter([&] {
+        result = limiter.acquire(4096, 0, [&] { return stop.load(); }) ? 1 : 0;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    assert(result == -1);
+    const auto start = Clock::now();
+    stop = true;
+    limiter.wake();
+    waiter.join();
+    assert(result == 0);
+    assert(secondsSince(start) < 0.5);
+    assert(limiter.totalBytes() == 1 << 20);   // the stopped acquire charged nothing
+
+    // A stop condition that already holds returns without waiting
+    assert(!limiter.acquire(1, 0, [] { return true; }));
+    std::cout << "Passed: test_stop_and_wake\n" << std::endl;
+}
+
+int main() {
+    test_unlimited();
+    test_byte_rate_and_gauges();
+    test_live_change();
+    test_stop_and_wake();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
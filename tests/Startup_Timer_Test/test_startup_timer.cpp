@@ -0,0 +1,65 @@
+#include "utilities/startup_timer.hpp"
+#include "utilities/metrics.hpp"
+#include <cassert>
+#include <chrono>
+#include <iostream>
+#include <thread>
+
+void test_milestones() {
+    std::cout << "Running test_milestones..." << std::endl;
+
+    StartupTimer::begin();
+    assert(StartupTimer::milestone("first_paint") < 0);
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    StartupTimer::mark("first_paint");
+    const double firstPaint = StartupTimer::milestone("first_paint");
+    assert(firstPaint >= 20 && firstPaint < 2000);
+
+    // A repeated mark keeps the first time
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    StartupTimer::mark("first_paint");
+    assert(StartupTimer::milestone("first_paint") == firstPaint);
+
+    StartupTimer::mark("interactive");
+    assert(StartupTimer::milestone("interactive") >= firstPaint);
+
+    const std::string summary = StartupTimer::summary();
+    assert(summary.find("first_paint ") == 0);
+    assert(summary.find(", interactive ") != std::string::npos);
+
+    std::cout << "Passed: test_milestones\n" << std::endl;
+}
+
+static std::chrono::steady_clock::time_point mainStarted;
+
+void test_before_main_and_gauges() {
+    std::cout << "Running test_before_main_and_gauges..." << std::endl;
+
+    // begin() takes the process age: at least the time since main(), less one
+    // 10 ms clock tick, and not seconds more for a small test binary
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    StartupTimer::begin();
+    const double sinceMain = std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - mainStarted).count();
+    const double age = StartupTimer::beforeMainMs();
+    assert(sinceMain >= 100);
+    assert(age >= sinceMain - 20 && age < sinceMain + 5000);
+
+    Metrics::setEnabled(true);
+    StartupTimer::begin();
+    StartupTimer::mark("ready");
+    const std::string text = Metrics::toPrometheus(Metrics::snapshot());
+    assert(text.find("startup.ready_ms") != std::string::npos);
+    Metrics::setEnabled(false);
+
+    std::cout << "Passed: test_before_main_and_gauges\n" << std::endl;
+}
+
+int main() {
+    mainStarted = std::chrono::steady_clock::now();
+    test_milestones();
+    test_before_main_and_gauges();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
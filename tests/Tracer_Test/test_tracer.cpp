@@ -0,0 +1,80 @@
+#include "utilities/tracer.hpp"
+#include <cassert>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+static std::string readAll(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static size_t countOf(const std::string& text, const std::string& needle) {
+    size_t count = 0;
+    for (size_t pos = text.find(needle); pos != std::string::npos; pos = text.find(needle, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+void test_disabled_records_nothing() {
+    std::cout << "Running test_disabled_records_nothing..." << std::endl;
+
+    {
+        FM_TRACE_SCOPE("test", "ignored");
+    }
+    const std::string path = "test_trace_disabled.json";
+    Tracer::start(path);
+    assert(Tracer::stop());
+    assert(readAll(path).find("ignored") == std::string::npos);
+    std::remove(path.c_str());
+
+    std::cout << "Passed: test_disabled_records_nothing\n" << std::endl;
+}
+
+void test_spans_from_threads() {
+    std::cout << "Running test_spans_from_threads..." << std::endl;
+
+    const std::string path = "test_trace.json";
+    Tracer::start(path);
+    Tracer::setThreadName("main");
+    {
+        TraceScope scope("test", "outer");
+        assert(scope.active());
+        scope.setDetail("a \"quoted\" path");
+        FM_TRACE_SCOPE("test", "inner");
+    }
+    // The worker exits before the trace is written, its spans must survive
+    std::thread worker([] {
+        Tracer::setThreadName("worker");
+        for (int i = 0; i < 10; ++i) {
+            FM_TRACE_SCOPE("test", "work");
+        }
+    });
+    worker.join();
+    assert(Tracer::stop());
+    assert(!Tracer::isEnabled());
+
+    const std::string json = readAll(path);
+    assert(json.rfind("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", 0) == 0);
+    assert(countOf(json, "\"name\":\"outer\"") == 1);
+    assert(countOf(json, "\"name\":\"inner\"") == 1);
+    assert(countOf(json, "\"name\":\"work\"") == 10);
+    assert(countOf(json, "\"ph\":\"M\"") == 2);
+    assert(json.find("a \\\"quoted\\\" path") != std::string::npos);
+    std::remove(path.c_str());
+
+    std::cout << "Passed: test_spans_from_threads\n" << std::endl;
+}
+
+int main() {
+    test_disabled_records_nothing();
+    test_spans_from_threads();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
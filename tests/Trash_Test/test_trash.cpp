@@ -0,0 +1,275 @@
+#include "core/trash_manager.hpp"
+#include <cassert>
+#include <chrono>
+#include <ctime>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = fs::weakly_canonical(fs::absolute("trash_test_dir"));
+static const std::string homeTrash = (testRoot / "home" / "Trash").string();
+
+static std::string under(const std::string& relative) {
+    return (testRoot / "data" / relative).string();
+}
+
+static void writeFile(const std::string& path, size_t bytes = 4) {
+    std::ofstream(path) << std::string(bytes, 'x');
+}
+
+static std::string readFile(const std::string& path) {
+    std::ifstream in(path);
+    std::stringstream contents;
+    contents << in.rdbuf();
+    return contents.str();
+}
+
+// An entry as another file manager would have left it, deleted `age` ago
+static void plantEntry(const std::string& name, std::chrono::seconds age, size_t bytes) {
+    const time_t when = std::time(nullptr) - static_cast<time_t>(age.count());
+    struct tm local {};
+    localtime_r(&when, &local);
+    char date[32];
+    std::strftime(date, sizeof(date), "%Y-%m-%dT%H:%M:%S", &local);
+    std::ofstream(homeTrash + "/info/" + name + ".trashinfo")
+        << "[Trash Info]\nPath=/nowhere/" << name << "\nDeletionDate=" << date << "\n";
+    writeFile(homeTrash + "/files/" + name, bytes);
+}
+
+void test_trash_and_restore() {
+    std::cout << "Running test_trash_and_restore..." << std::endl;
+    TrashManager trash(homeTrash, false);
+
+    fs::create_directories(under("project/src/deep"));
+    for (int i = 0; i < 100; ++i) {
+        writeFile(under("project/src/deep/file" + std::to_string(i)));
+    }
+    writeFile(under("a b%.txt"));
+
+    FsResult<TrashEntry> tree = trash.trash(under("project"));
+    assert(tree.ok());
+    assert(!fs::exists(under("project")));
+    assert(tree.value().trashDirectory == homeTrash);
+    assert(tree.value().name == "project");
+    assert(tree.value().originalPath == under("project"));
+    assert(fs::exists(tree.value().filesPath() + "/src/deep/file99"));
+
+    // Escaped path and a local deletion date in the info file
+    FsResult<TrashEntry> file = trash.trash(under("a b%.txt"));
+    assert(file.ok());
+    const std::string info = readFile(file.value().infoPath());
+    assert(info.rfind("[Trash Info]\n", 0) == 0);
+    assert(info.find("Path=" + under("a%20b%25.txt") + "\n") != std::string::npos);
+    assert(info.find("DeletionDate=") != std::string::npos);
+
+    const std::vector<TrashEntry> entries = trash.list();
+    assert(entries.size() == 2);
+    assert(entries[0].originalPath == under("project"));
+    assert(entries[1].originalPath == under("a b%.txt"));
+    assert(trash.trashedCount() == 2);
+
+    // Restoring recreates missing parents
+    assert(trash.restore(tree.value()).ok());
+    assert(fs::exists(under("project/src/deep/file42")));
+    assert(!fs::exists(tree.value().infoPath()));
+
+    fs::remove_all(testRoot / "data");
+    assert(trash.restore(file.value()).ok());
+    assert(fs::exists(under("a b%.txt")));
+    assert(trash.list().empty());
+
+    // Nothing to trash, or the trash itself
+    assert(trash.trash(under("missing")).code() == ENOENT);
+    assert(trash.trash(homeTrash + "/files").code() == EINVAL);
+    assert(trash.trash(homeTrash).code() == EINVAL);
+
+    fs::remove_all(testRoot / "data");
+    std::cout << "Passed: test_trash_and_restore\n" << std::endl;
+}
+
+void test_name_clashes() {
+    std::cout << "Running test_name_clashes..." << std::endl;
+    TrashManager trash(homeTrash, false);
+    fs::create_directories(under(""));
+
+    writeFile(under("report.txt"), 1);
+    FsResult<TrashEntry> first = trash.trash(under("report.txt"));
+    writeFile(under("report.txt"), 2);
+    FsResult<TrashEntry> second = trash.trash(under("report.txt"));
+    assert(first.ok() && second.ok());
+    assert(first.value().name == "report.txt");
+    assert(second.value().name == "report.txt.2");
+
+    // A leftover in files/ without an info file is skipped, not replaced
+    writeFile(homeTrash + "/files/report.txt.3");
+    writeFile(under("report.txt"), 3);
+    FsResult<TrashEntry> third = trash.trash(under("report.txt"));
+    assert(third.ok());
+    assert(third.value().name == "report.txt.4");
+    assert(!fs::exists(homeTrash + "/info/report.txt.3.trashinfo"));
+
+    // Undo brings back the latest one; the older ones no longer fit
+    FsResult<TrashEntry> last = trash.lastTrashed(under("report.txt"));
+    assert(last.ok());
+    assert(last.value().name == "report.txt.4");
+    assert(trash.restore(last.value()).ok());
+    assert(fs::file_size(under("report.txt")) == 3);
+    assert(trash.restore(first.value()).code() == EEXIST);
+    assert(fs::exists(first.value().filesPath()));
+    assert(trash.lastTrashed(under("other.txt")).code() == ENOENT);
+
+    assert(trash.purge(true) == 3);   // two entries and the leftover
+    assert(fs::is_empty(homeTrash + "/files"));
+    assert(fs::is_empty(homeTrash + "/info"));
+
+    fs::remove_all(testRoot / "data");
+    std::cout << "Passed: test_name_clashes\n" << std::endl;
+}
+
+void test_purge_limits() {
+    std::cout << "Running test_purge_limits..." << std::endl;
+    using namespace std::chrono;
+    TrashManager trash(homeTrash, false);
+
+    plantEntry("ancient", hours(24 * 40), 4096);
+    plantEntry("old", hours(24 * 3), 64 * 1024);
+    plantEntry("recent", hours(2), 64 * 1024);
+    plantEntry("new", seconds(0), 64 * 1024);
+
+    // An info file whose tree is gone: removed once it is old enough not to
+    // belong to a trash() in progress
+    std::ofstream(homeTrash + "/info/stale.trashinfo") << "[Trash Info]\nPath=/x\nDeletionDate=2001-01-01T00:00:00\n";
+    struct timespec old[2] = {{std::time(nullptr) - 3600, 0}, {std::time(nullptr) - 3600, 0}};
+    utimensat(AT_FDCWD, (homeTrash + "/info/stale.trashinfo").c_str(), old, 0);
+    std::ofstream(homeTrash + "/info/fresh.trashinfo") << "[Trash Info]\nPath=/y\nDeletionDate=2001-01-01T00:00:00\n";
+
+    // Age first
+    trash.setLimits({0, hours(24 * 30)});
+    trash.schedulePurge();
+    trash.waitIdle();
+    assert(!fs::exists(homeTrash + "/files/ancient"));
+    assert(!fs::exists(homeTrash + "/info/ancient.trashinfo"));
+    assert(!fs::exists(homeTrash + "/info/stale.trashinfo"));
+    assert(fs::exists(homeTrash + "/info/fresh.trashinfo"));
+    assert(fs::exists(homeTrash + "/files/old"));
+    assert(trash.purgedCount() == 1);
+    fs::remove(homeTrash + "/info/fresh.trashinfo");
+
+    // Then size: the oldest go until the rest fits
+    trash.setLimits({100 * 1024, hours(0)});
+    trash.schedulePurge();
+    trash.waitIdle();
+    assert(!fs::exists(homeTrash + "/files/old"));
+    assert(!fs::exists(homeTrash + "/files/recent"));
+    assert(fs::exists(homeTrash + "/files/new"));
+    assert(trash.purgedCount() == 3);
+    assert(trash.purgedBytes() >= 2 * 64 * 1024);
+
+    // With limits set a trash() schedules the purge itself
+    fs::create_directories(under("big"));
+    for (int i = 0; i < 4; ++i) {
+        writeFile(under("big/part" + std::to_string(i)), 64 * 1024);
+    }
+    assert(trash.trash(under("big")).ok());
+    trash.waitIdle();
+    assert(!fs::exists(homeTrash + "/files/new"));
+    assert(!fs::exists(homeTrash + "/files/big"));   // over the limit on its own
+
+    // Emptying ignores the limits
+    trash.setLimits({});
+    writeFile(under("keep"));
+    assert(trash.trash(under("keep")).ok());
+    trash.schedulePurge(true);
+    trash.waitIdle();
+    assert(trash.list().empty());
+    assert(fs::is_empty(homeTrash + "/files"));
+
+    fs::remove_all(testRoot / "data");
+    std::cout << "Passed: test_purge_limits\n" << std::endl;
+}
+
+void test_read_only_tree() {
+    std::cout << "Running test_read_only_tree..." << std::endl;
+    TrashManager trash(homeTrash, false);
+
+    fs::create_directories(under("locked/inner"));
+    writeFile(under("locked/inner/file"));
+    chmod(under("locked/inner").c_str(), 0500);
+    chmod(under("locked").c_str(), 0500);
+
+    FsResult<TrashEntry> entry = trash.trash(under("locked"));
+    assert(entry.ok());
+    assert(trash.erase(entry.value()).ok());
+    assert(!fs::exists(entry.value().filesPath()));
+    assert(!fs::exists(entry.value().infoPath()));
+
+    fs::remove_all(testRoot / "data");
+    std::cout << "Passed: test_read_only_tree\n" << std::endl;
+}
+
+void test_topdir_trash() {
+    std::cout << "Running test_topdir_trash..." << std::endl;
+
+    // Needs a writable filesystem other than the one of the home trash
+    struct stat home {}, shm {};
+    if (stat(homeTrash.c_str(), &home) != 0 || stat("/dev/shm", &shm) != 0 || home.st_dev == shm.st_dev ||
+        access("/dev/shm", W_OK) != 0) {
+        std::cout << "  /dev/shm is not a separate writable filesystem, skipped" << std::endl;
+        std::cout << "Passed: test_topdir_trash\n" << std::endl;
+        return;
+    }
+
+    // The topdir of /dev/shm is /dev/shm if it is a mount of its own
+    struct stat dev {};
+    stat("/dev", &dev);
+    const std::string topdir = dev.st_dev == shm.st_dev ? "/dev" : "/dev/shm";
+    const std::string trashDirectory = topdir + "/.Trash-" + std::to_string(getuid());
+    const bool existed = fs::exists(trashDirectory);
+
+    const std::string file = "/dev/shm/fm_trash_test_" + std::to_string(getpid());
+    writeFile(file);
+
+    TrashManager trash(homeTrash, false);
+    FsResult<TrashEntry> entry = trash.trash(file);
+    assert(entry.ok());
+    assert(entry.value().trashDirectory == trashDirectory);
+    assert(!fs::exists(file));
+    struct stat st {};
+    assert(stat(trashDirectory.c_str(), &st) == 0 && (st.st_mode & 0777) == 0700);
+
+    // Paths are stored relative to the topdir and come back absolute
+    const std::string info = readFile(entry.value().infoPath());
+    assert(info.find("Path=" + file.substr(topdir.size() + 1) + "\n") != std::string::npos);
+    FsResult<TrashEntry> last = trash.lastTrashed(file);
+    assert(last.ok());
+    assert(last.value().originalPath == file);
+    assert(trash.restore(last.value()).ok());
+    assert(fs::exists(file));
+
+    fs::remove(file);
+    if (!existed) {
+        fs::remove_all(trashDirectory);
+    }
+    std::cout << "Passed: test_topdir_trash\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+
+    test_trash_and_restore();
+    test_name_clashes();
+    test_purge_limits();
+    test_read_only_tree();
+    test_topdir_trash();
+
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,165 @@
+#include "core/type_detector.hpp"
+#include <cassert>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+static const fs::path testRoot = "type_detector_test_dir";
+
+static FileType sniff(const std::string& bytes) {
+    return TypeDetector::fromContent(reinterpret_cast<const unsigned char*>(bytes.data()), bytes.size());
+}
+
+static void writeFile(const fs::path& path, const std::string& content) {
+    std::ofstream(path, std::ios::binary) << content;
+}
+
+void test_extensions() {
+    std::cout << "Running test_extensions..." << std::endl;
+
+    assert(TypeDetector::fromExtension("photo.jpg") == FileType::JPEG);
+    assert(TypeDetector::fromExtension("PHOTO.JPEG") == FileType::JPEG);
+    assert(TypeDetector::fromExtension("archive.tar.gz") == FileType::GZIP);
+    assert(TypeDetector::fromExtension("main.cpp") == FileType::CPP_SOURCE);
+    assert(TypeDetector::fromExtension("README") == FileType::UNKNOWN);
+    assert(TypeDetector::fromExtension(".bashrc") == FileType::UNKNOWN);
+    assert(TypeDetector::fromExtension("name.") == FileType::UNKNOWN);
+    assert(TypeDetector::fromExtension("x.averyverylongextension") == FileType::UNKNOWN);
+
+    assert(TypeDetector::mimeType(FileType::PNG) == "image/png");
+    assert(TypeDetector::description(FileType::DIRECTORY) == "Folder");
+
+    std::cout << "Passed: test_extensions\n" << std::endl;
+}
+
+void test_magic_bytes() {
+    std::cout << "Running test_magic_bytes..." << std::endl;
+
+    assert(sniff("") == FileType::EMPTY);
+    assert(sniff(std::string("\x89PNG\r\n\x1a\n\0\0\0\rIHDR", 16)) == FileType::PNG);
+    assert(sniff("\xff\xd8\xff\xe0\0\x10JFIF") == FileType::JPEG);
+    assert(sniff("\xff\xfb\x90\x64") == FileType::MP3);   // frame sync, no ID3 tag
+    assert(sniff("%PDF-1.7\n") == FileType::PDF);
+    assert(sniff(std::string("\x7f" "ELF\2\1\1\0", 8)) == FileType::ELF);
+
+    // Masked bytes: the RIFF chunk size may be anything
+    assert(sniff(std::string("RIFF\x24\x10\x02\0WEBPVP8 ", 16)) == FileType::WEBP);
+    assert(sniff(std::string("RIFF\x99\x99\x99\x99WAVEfmt ", 16)) == FileType::WAV);
+
+    // Signature past the start
+    std::string tar(512, '\0');
+    tar.replace(0, 8, "file.txt");
+    tar.replace(257, 6, "ustar ");
+    assert(sniff(tar) == FileType::TAR);
+    assert(sniff(tar.substr(0, 260)) != FileType::TAR);   // too short to reach the signature
+    assert(sniff(std::string("\0\0\0\x20" "ftypisom", 12)) == FileType::MP4);
+
+    // Zip containers
+    std::string zip("PK\3\4", 4);
+    zip.append(26, '\0');
+    assert(sniff(zip + "mimetypeapplication/vnd.oasis.opendocument.text") == FileType::OPEN_DOCUMENT);
+    assert(sniff(zip + "[Content_Types].xml") == FileType::OFFICE_XML);
+    assert(sniff(zip + "photos/1.jpg") == FileType::ZIP);
+
+    // Text
+    assert(sniff("hello world\n") == FileType::TEXT);
+    assert(sniff("#!/bin/sh\necho hi\n") == FileType::SHELL_SCRIPT);
+    assert(sniff("#!/usr/bin/env python3\nprint()\n") == FileType::PYTHON);
+    assert(sniff("\n  <!DOCTYPE HTML>\n<html>") == FileType::HTML);
+    assert(sniff("<?xml version=\"1.0\"?>\n<svg xmlns=") == FileType::SVG);
+    assert(sniff("<?xml version=\"1.0\"?>\n<root/>") == FileType::XML);
+    assert(sniff("{\"key\": 1}") == FileType::JSON);
+    assert(sniff("gr\xc3\xbc\xc3\x9f dich\n") == FileType::TEXT);   // UTF-8
+    assert(sniff(std::string("abc\0def", 7)) == FileType::BINARY);
+
+    std::cout << "Passed: test_magic_bytes\n" << std::endl;
+}
+
+void test_detect_uses_cache() {
+    std::cout << "Running test_detect_uses_cache..." << std::endl;
+
+    const fs::path dir = testRoot / "many";
+    fs::create_directories(dir);
+    constexpr int FILES = 1000;
+    for (int i = 0; i < FILES; ++i) {
+        writeFile(dir / ("file_" + std::to_string(i)), i % 2 ? "%PDF-1.4\n" : "plain text\n");
+    }
+    writeFile(dir / "named.png", "not really a png");
+    writeFile(dir / "empty", "");
+
+    TypeDetector detector;
+    const int dirFd = ::open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    assert(dirFd >= 0);
+
+    // The extension wins and costs no read
+    assert(detector.detect(dirFd, "named.png") == FileType::PNG);
+    assert(detector.detect(dirFd, "empty") == FileType::EMPTY);
+    assert(detector.detect(dirFd, "missing") == FileType::UNKNOWN);
+    assert(detector.detect(testRoot.string()) == FileType::DIRECTORY);
+    assert(detector.contentReads() == 0);
+
+    for (int i = 0; i < FILES; ++i) {
+        const FileType type = detector.detect(dirFd, "file_" + std::to_string(i));
+        assert(type == (i % 2 ? FileType::PDF : FileType::TEXT));
+    }
+    assert(detector.contentReads() == FILES);
+    assert(detector.cacheSize() == FILES);
+
+    // Second visit: no content reads at all
+    for (int i = 0; i < FILES; ++i) {
+        detector.detect(dirFd, "file_" + std::to_string(i));
+    }
+    assert(detector.contentReads() == FILES);
+    assert(detector.cacheHits() == FILES);
+
+    // A changed file is sniffed again
+    writeFile(dir / "file_0", "%PDF-1.5 and now longer\n");
+    assert(detector.detect(dirFd, "file_0") == FileType::PDF);
+    assert(detector.contentReads() == FILES + 1);
+
+    ::close(dirFd);
+    std::cout << "Passed: test_detect_uses_cache\n" << std::endl;
+}
+
+void test_cache_capacity() {
+    std::cout << "Running test_cache_capacity..." << std::endl;
+
+    const fs::path dir = testRoot / "capacity";
+    fs::create_directories(dir);
+    for (int i = 0; i < 10; ++i) {
+        writeFile(dir / ("f" + std::to_string(i)), "text");
+    }
+
+    TypeDetector detector(4);
+    for (int i = 0; i < 10; ++i) {
+        detector.detect((dir / ("f" + std::to_string(i))).string());
+    }
+    assert(detector.cacheSize() <= 4);
+
+    // The most recent files survive
+    const uint64_t reads = detector.contentReads();
+    detector.detect((dir / "f9").string());
+    assert(detector.contentReads() == reads);
+
+    detector.clearCache();
+    assert(detector.cacheSize() == 0);
+
+    std::cout << "Passed: test_cache_capacity\n" << std::endl;
+}
+
+int main() {
+    fs::remove_all(testRoot);
+    fs::create_directories(testRoot);
+    test_extensions();
+    test_magic_bytes();
+    test_detect_uses_cache();
+    test_cache_capacity();
+    fs::remove_all(testRoot);
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,92 @@
+#include "core/file_system.hpp"
+#include "utilities/workload_recorder.hpp"
+#include <cassert>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+static std::vector<WorkloadRecord> readTrace(const std::string& path) {
+    WorkloadTraceReader reader(path);
+    assert(reader.isValid());
+    std::vector<WorkloadRecord> records;
+    for (WorkloadRecord record; reader.next(record);) {
+        records.push_back(record);
+    }
+    return records;
+}
+
+void test_calls_are_recorded() {
+    std::cout << "Running test_calls_are_recorded..." << std::endl;
+
+    const fs::path dir = fs::absolute("workload_test_dir");
+    const std::string trace = "workload_test.fmw";
+    fs::remove_all(dir);
+
+    assert(WorkloadRecorder::start(trace));
+    FileSystem::createDirectory(dir);
+    FileSystem::writeFile(dir / "a.txt", "hello");
+    FileSystem::copy(dir / "a.txt", dir / "b.txt", true);
+    FileSystem::readFile(dir / "b.txt");
+    FileSystem::listDirectory(dir);
+    FileSystem::tryFileSize(dir / "missing.txt");
+    WorkloadRecorder::stop();
+
+    // Not recorded after stop()
+    FileSystem::remove(dir);
+
+    const auto records = readTrace(trace);
+    assert(records.size() == 6);
+    assert(records[0].op == WorkloadOp::CREATE_DIRECTORY && records[0].args[0] == dir.string());
+    assert(records[1].op == WorkloadOp::WRITE_FILE && records[1].size == 5);
+    assert(records[2].op == WorkloadOp::COPY && records[2].args.size() == 2);
+    assert(records[2].args[1] == (dir / "b.txt").string());
+    assert(records[2].flags == WorkloadRecord::FLAG_OVERWRITE);
+    assert(records[3].op == WorkloadOp::READ_FILE && records[3].size == 5);
+    assert(records[4].op == WorkloadOp::LIST_DIRECTORY && records[4].size == 2);
+    assert(records[5].op == WorkloadOp::FILE_SIZE && records[5].result == ENOENT);
+    for (size_t i = 1; i < records.size(); ++i) {
+        assert(records[i].startNs >= records[i - 1].startNs);
+    }
+
+    // Relative arguments are replayed against the session's working directory
+    WorkloadTraceReader reader(trace);
+    WorkloadRecord first;
+    assert(reader.next(first) && reader.workingDirectory() == fs::current_path().string());
+
+    fs::remove(trace);
+    std::cout << "Passed: test_calls_are_recorded\n" << std::endl;
+}
+
+void test_nested_calls_are_skipped() {
+    std::cout << "Running test_nested_calls_are_skipped..." << std::endl;
+
+    const std::string trace = "workload_nested.fmw";
+    assert(WorkloadRecorder::start(trace));
+    {
+        // Stands in for a plugin call that uses FileSystem internally
+        WorkloadScope outer(WorkloadOp::PLUGIN);
+        assert(outer.active());
+        outer.addArg("copy");
+        FileSystem::exists("/");
+        assert(WorkloadScope::insideRecordedCall());
+    }
+    FileSystem::exists("/");
+    WorkloadRecorder::stop();
+
+    const auto records = readTrace(trace);
+    assert(records.size() == 2);
+    assert(records[0].op == WorkloadOp::PLUGIN && records[0].args[0] == "copy");
+    assert(records[1].op == WorkloadOp::EXISTS && records[1].size == 1);
+
+    fs::remove(trace);
+    std::cout << "Passed: test_nested_calls_are_skipped\n" << std::endl;
+}
+
+int main() {
+    test_calls_are_recorded();
+    test_nested_calls_are_skipped();
+    std::cout << "All tests passed!" << std::endl;
+    return 0;
+}
@@ -0,0 +1,213 @@
+// fm-daemon-load: load test for fm-daemon
+//
+// Usage: fm-daemon-load [--socket PATH] [--clients N] [--requests N] [--pipeline N] [--json FILE]
+//                       [ping | stats | list DIR | execute OPERATION ARGS...]
+//   --socket    daemon socket (default: fmd::defaultSocketPath())
+//   --clients   concurrent connections, one thread each (default 8)
+//   --requests  requests per client (default 10000)
+//   --pipeline  requests each client keeps outstanding (default 16, 1 = request/response)
+//   --json      also write the report as JSON
+//
+// Every client sends the same request over and over and measures the time
+// from writing a request to reading its response. The report gives the total
+// throughput and the p50/p90/p99/p99.9/max latency over all clients.
+// Exit status: 0 if every request was answered OK, 1 if one failed or a
+// client could not connect or lost its connection, 2 for usage errors or
+// no connection at all.
+
+#include "core/daemon_client.hpp"
+#include "utilities/metrics.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unordered_map>
+
+using Clock = std::chrono::steady_clock;
+
+static void printUsage() {
+    std::cerr << "Usage: fm-daemon-load [--socket PATH] [--clients N] [--requests N] [--pipeline N] [--json FILE]\n"
+                 "                      [ping | stats | list DIR | execute OPERATION ARGS...]\n";
+}
+
+static std::string formatNs(uint64_t ns) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (ns >= 1000000000ULL) out << ns / 1e9 << "s";
+    else if (ns >= 1000000ULL) out << ns / 1e6 << "ms";
+    else if (ns >= 1000ULL) out << ns / 1e3 << "us";
+    else out << ns << "ns";
+    return out.str();
+}
+
+static uint64_t maxLatency(const Metrics::OperationStats& stats) {
+    for (unsigned i = LatencyBuckets::COUNT; i-- > 0;) {
+        if (stats.buckets[i]) {
+            return LatencyBuckets::upperBound(i);
+        }
+    }
+    return 0;
+}
+
+struct ClientResult {
+    Metrics::OperationStats latency;
+    bool connected = false;
+    bool lost = false;   // the connection broke before every answer came
+};
+
+// One connection: keeps `pipeline` requests outstanding until `requests` are answered
+static void runClient(const std::string& socket, fmd::Opcode opcode, const std::vector<std::string>& args,
+                      size_t requests, size_t pipeline, std::atomic<bool>& start, ClientResult& result) {
+    DaemonClient client;
+    if (!client.connect(socket)) {
+        return;
+    }
+    result.connected = true;
+    while (!start.load(std::memory_order_acquire)) {
+        std::this_thread::yield();
+    }
+
+    std::unordered_map<uint32_t, Clock::time_point> sentAt;
+    size_t sent = 0;
+    size_t received = 0;
+    while (received < requests) {
+        while (sent < requests && sent - received < pipeline) {
+            sentAt[client.send(opcode, args)] = Clock::now();
+            ++sent;
+        }
+        const auto response = client.receive();
+        if (!response) {
+            std::cerr << "fm-daemon-load: " << response.message() << '\n';
+            result.lost = true;
+            return;
+        }
+        const auto it = sentAt.find(response.value().id);
+        if (it == sentAt.end()) {
+            continue;
+        }
+        const uint64_t ns = static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - it->second).count());
+        sentAt.erase(it);
+        ++received;
+        ++result.latency.count;
+        result.latency.totalNs += ns;
+        result.latency.entries += response.value().items.size();
+        ++result.latency.buckets[LatencyBuckets::indexOf(ns)];
+        if (response.value().status != fmd::Status::OK) {
+            ++result.latency.errors;
+        }
+    }
+}
+
+int main(int argc, char* argv[]) {
+    std::string socket = fmd::defaultSocketPath();
+    size_t clients = 8;
+    size_t requests = 10000;
+    size_t pipeline = 16;
+    std::string jsonFile;
+
+    int i = 1;
+    for (; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--socket" && i + 1 < argc) {
+            socket = argv[++i];
+        } else if (arg == "--clients" && i + 1 < argc) {
+            clients = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--requests" && i + 1 < argc) {
+            requests = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--pipeline" && i + 1 < argc) {
+            pipeline = std::strtoull(argv[++i], nullptr, 10);
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonFile = argv[++i];
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else {
+            break;
+        }
+    }
+
+    fmd::Opcode opcode = fmd::Opcode::PING;
+    std::vector<std::string> args(argv + i, argv + argc);
+    const std::string name = args.empty() ? "ping" : args[0];
+    if (!args.empty()) {
+        args.erase(args.begin());
+    }
+    if (name == "ping" && args.empty()) {
+        opcode = fmd::Opcode::PING;
+    } else if (name == "stats" && args.empty()) {
+        opcode = fmd::Opcode::STATS;
+    } else if (name == "list" && args.size() == 1) {
+        opcode = fmd::Opcode::LIST;
+    } else if (name == "execute" && !args.empty()) {
+        opcode = fmd::Opcode::EXECUTE;
+    } else {
+        printUsage();
+        return 2;
+    }
+    if (clients == 0 || requests == 0 || pipeline == 0) {
+        printUsage();
+        return 2;
+    }
+
+    std::vector<ClientResult> results(clients);
+    std::vector<std::thread> threads;
+    std::atomic<bool> start{false};
+    for (size_t c = 0; c < clients; ++c) {
+        threads.emplace_back(runClient, std::cref(socket), opcode, std::cref(args), requests, pipeline,
+                             std::ref(start), std::ref(results[c]));
+    }
+    // Connect everyone first, then measure only the requests
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    const auto started = Clock::now();
+    start.store(true, std::memory_order_release);
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    const double seconds = std::chrono::duration<double>(Clock::now() - started).count();
+
+    Metrics::OperationStats total;
+    size_t connected = 0;
+    size_t lost = 0;
+    for (const auto& result : results) {
+        connected += result.connected ? 1 : 0;
+        lost += result.lost ? 1 : 0;
+        total.count += result.latency.count;
+        total.errors += result.latency.errors;
+        total.entries += result.latency.entries;
+        total.totalNs += result.latency.totalNs;
+        for (unsigned b = 0; b < LatencyBuckets::COUNT; ++b) {
+            total.buckets[b] += result.latency.buckets[b];
+        }
+    }
+    if (connected == 0) {
+        std::cerr << "fm-daemon-load: cannot connect to " << socket << '\n';
+        return 2;
+    }
+
+    const double rate = seconds > 0 ? total.count / seconds : 0.0;
+    std::cout << name << ": " << connected << " clients, pipeline " << pipeline << ", " << total.count
+              << " requests (" << total.errors << " failed) in " << std::fixed << std::setprecision(2) << seconds
+              << " s, " << static_cast<uint64_t>(rate) << " req/s\n"
+              << "latency p50 " << formatNs(total.percentile(0.5)) << ", p90 " << formatNs(total.percentile(0.9))
+              << ", p99 " << formatNs(total.percentile(0.99)) << ", p99.9 " << formatNs(total.percentile(0.999))
+              << ", max " << formatNs(maxLatency(total)) << '\n';
+    if (lost || connected < clients) {
+        std::cout << clients - connected << " clients could not connect, " << lost << " lost the connection\n";
+    }
+
+    if (!jsonFile.empty()) {
+        std::ofstream json(jsonFile);
+        json << "{\"request\": \"" << name << "\", \"clients\": " << connected << ", \"pipeline\": " << pipeline
+             << ", \"requests\": " << total.count << ", \"errors\": " << total.errors << ", \"lost\": " << lost
+             << ", \"seconds\": " << seconds << ", \"requests_per_second\": " << rate
+             << ", \"p50_ns\": " << total.percentile(0.5) << ", \"p90_ns\": " << total.percentile(0.9)
+             << ", \"p99_ns\": " << total.percentile(0.99) << ", \"p999_ns\": " << total.percentile(0.999)
+             << ", \"max_ns\": " << maxLatency(total) << "}\n";
+    }
+    return total.errors || lost || connected < clients ? 1 : 0;
+}
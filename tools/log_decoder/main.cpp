@@ -0,0 +1,113 @@
+// fm-logdecode: turns a binary log back into the text log format
+//
+// Usage: fm-logdecode [--min-severity LEVEL] [--since TIME] [--until TIME] FILE...
+//   LEVEL  DEBUG, INFO, WARNING, ERROR or CRITICAL
+//   TIME   "YYYY-mm-dd HH:MM:SS" (local time) or seconds since the epoch
+// Both bounds are inclusive: --until keeps the records of its whole second.
+
+#include "utilities/binary_log.hpp"
+#include <cstdlib>
+#include <ctime>
+#include <iostream>
+#include <optional>
+#include <string>
+#include <vector>
+
+static void printUsage() {
+    std::cerr << "Usage: fm-logdecode [--min-severity LEVEL] [--since TIME] [--until TIME] FILE...\n"
+              << "  LEVEL  DEBUG, INFO, WARNING, ERROR or CRITICAL\n"
+              << "  TIME   \"YYYY-mm-dd HH:MM:SS\" (local time) or seconds since the epoch\n";
+}
+
+static std::optional<ErrorSeverity> parseSeverity(const std::string& text) {
+    for (ErrorSeverity severity : {ErrorSeverity::DEBUG, ErrorSeverity::INFO, ErrorSeverity::WARNING,
+                                   ErrorSeverity::ERROR, ErrorSeverity::CRITICAL}) {
+        if (text == severityName(severity)) {
+            return severity;
+        }
+    }
+    return std::nullopt;
+}
+
+// Returns nanoseconds since the epoch
+static std::optional<uint64_t> parseTime(const std::string& text) {
+    char* end = nullptr;
+    const unsigned long long seconds = std::strtoull(text.c_str(), &end, 10);
+    if (end && *end == '\0' && !text.empty()) {
+        return static_cast<uint64_t>(seconds) * 1000000000ULL;
+    }
+
+    std::tm tm {};
+    const char* rest = strptime(text.c_str(), "%Y-%m-%d %H:%M:%S", &tm);
+    if (!rest || *rest != '\0') {
+        return std::nullopt;
+    }
+    tm.tm_isdst = -1;   // let mktime work out daylight saving time
+    const std::time_t local = std::mktime(&tm);
+    if (local < 0) {
+        return std::nullopt;
+    }
+    return static_cast<uint64_t>(local) * 1000000000ULL;
+}
+
+int main(int argc, char* argv[]) {
+    ErrorSeverity minSeverity = ErrorSeverity::DEBUG;
+    uint64_t since = 0;
+    uint64_t until = UINT64_MAX;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        const bool hasValue = i + 1 < argc;
+        if (arg == "--help" || arg == "-h") {
+            printUsage();
+            return 0;
+        } else if (arg == "--min-severity" && hasValue) {
+            auto severity = parseSeverity(argv[++i]);
+            if (!severity) {
+                std::cerr << "Unknown severity: " << argv[i] << std::endl;
+                return 2;
+            }
+            minSeverity = *severity;
+        } else if ((arg == "--since" || arg == "--until") && hasValue) {
+            auto time = parseTime(argv[++i]);
+            if (!time) {
+                std::cerr << "Cannot parse time: " << argv[i] << std::endl;
+                return 2;
+            }
+            if (arg == "--since") {
+                since = *time;
+            } else {
+                until = *time + 999999999ULL;   // TIME has whole seconds, keep all of the last one
+            }
+        } else if (!arg.empty() && arg[0] == '-') {
+            printUsage();
+            return 2;
+        } else {
+            files.push_back(arg);
+        }
+    }
+
+    if (files.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    int status = 0;
+    for (const auto& file : files) {
+        BinaryLogReader reader(file);
+        if (!reader.isValid()) {
+            std::cerr << "Not a binary log file: " << file << std::endl;
+            status = 1;
+            continue;
+        }
+        BinaryLogEvent event;
+        while (reader.next(event)) {
+            if (event.severity < minSeverity || event.timeNs < since || event.timeNs > until) {
+                continue;
+            }
+            std::cout << BinaryLogReader::toText(event) << '\n';
+        }
+    }
+    return status;
+}
@@ -0,0 +1,465 @@
+// fm-replay: replays a workload trace recorded with FM_WORKLOAD_FILE
+//
+// Usage: fm-replay [--speed original|max] [--scratch DIR] [--plugins DIR] [--json FILE] [--keep] TRACE
+//   --speed    original keeps the recorded gaps between calls, max (default) runs flat out
+//   --scratch  directory the synthetic tree is built in (default: temp directory)
+//   --plugins  plugin directory, needed to replay plugin operations
+//   --json     also write the report as JSON
+//   --keep     do not delete the scratch tree afterwards
+//
+// Every path of the trace is mapped below the scratch directory. Before the
+// replay a synthetic tree is generated with everything the session read
+// but did not create itself: directories with the recorded number of
+// entries, files with the recorded sizes. Calls are replayed in start
+// order on one thread, in the recorded working directory mapped below the
+// scratch directory, so relative paths stay inside it too. A trace without
+// a working directory (older recordings) has its calls with relative
+// arguments skipped, they would touch files around fm-replay's own cwd.
+
+#include "core/file_system.hpp"
+#include "core/plugin_manager.hpp"
+#include "utilities/metrics.hpp"
+#include "utilities/workload_recorder.hpp"
+#include <algorithm>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <unordered_map>
+#include <unordered_set>
+
+namespace fs = std::filesystem;
+
+static void printUsage() {
+    std::cerr << "Usage: fm-replay [--speed original|max] [--scratch DIR] [--plugins DIR] [--json FILE] [--keep] TRACE\n";
+}
+
+// Original path -> path below the scratch directory, a relative one taken
+// from the recorded working directory `cwd`. ".." cannot climb out
+static fs::path mapPath(const fs::path& scratch, const std::string& cwd, const std::string& original) {
+    return scratch / (fs::path(cwd) / original).lexically_normal().relative_path();
+}
+
+// Every argument of a FileSystem call is a path. Of a plugin call anything
+// but the operation name may be one ("direct" or "*.txt" too, harmless)
+static bool isPathArg(const WorkloadRecord& record, size_t i) {
+    return record.op != WorkloadOp::PLUGIN || (i > 0 && !record.args[i].empty());
+}
+
+static bool isAbsolute(const std::string& arg) {
+    return !arg.empty() && arg[0] == '/';
+}
+
+static bool hasRelativeArg(const WorkloadRecord& record) {
+    for (size_t i = 0; i < record.args.size(); ++i) {
+        if (isPathArg(record, i) && !isAbsolute(record.args[i])) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// =======================
+// Synthetic tree generator
+// =======================
+
+class TreeGenerator {
+public:
+    TreeGenerator(fs::path scratch, std::string cwd) : scratch_(std::move(scratch)), cwd_(std::move(cwd)) {}
+
+    // First pass: remember which names the trace itself uses in each directory,
+    // listings are padded with filler entries only up to the recorded count
+    void scan(const WorkloadRecord& record) {
+        for (size_t i = 0; i < record.args.size(); ++i) {
+            if (isPathArg(record, i)) {
+                const fs::path path = mapPath(scratch_, cwd_, record.args[i]);
+                if (named_.insert(path.string()).second) {
+                    ++namedChildren_[path.parent_path().string()];
+                }
+            }
+        }
+    }
+
+    // Creates whatever `record` needs to exist before it runs
+    void prepare(const WorkloadRecord& record) {
+        std::vector<fs::path> paths;
+        for (size_t i = 0; i < record.args.size(); ++i) {
+            if (isPathArg(record, i)) {
+                paths.push_back(mapPath(scratch_, cwd_, record.args[i]));
+            }
+        }
+        for (const auto& path : paths) {
+            std::error_code ec;
+            fs::create_directories(path.parent_path(), ec);
+        }
+        if (paths.empty()) {
+            return;
+        }
+
+        // A call that failed in the session should fail again, don't create its input
+        if (record.result == 0) {
+            const fs::path& input = paths[0];
+            switch (record.op) {
+                case WorkloadOp::LIST_DIRECTORY:
+                    makeDirectory(input, record.size);
+                    break;
+                case WorkloadOp::IS_DIRECTORY:
+                    if (record.size) makeDirectory(input, 0);
+                    break;
+                case WorkloadOp::EXISTS:
+                case WorkloadOp::IS_FILE:
+                    if (record.size) makeFile(input, 0);
+                    break;
+                case WorkloadOp::READ_FILE:
+                case WorkloadOp::FILE_SIZE:
+                case WorkloadOp::COPY:
+                case WorkloadOp::MOVE:
+                case WorkloadOp::LAST_WRITE_TIME:
+                    makeFile(input, record.size);
+                    break;
+                case WorkloadOp::REMOVE:
+                    if (record.size > 1) {
+                        makeDirectory(input, record.size - 1);
+                    } else {
+                        makeFile(input, 0);
+                    }
+                    break;
+                case WorkloadOp::PLUGIN:
+                    makeFile(input, 0);   // first path argument is the operation's source
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        // Outputs exist from now on, later reads of them are not generated
+        switch (record.op) {
+            case WorkloadOp::WRITE_FILE:
+            case WorkloadOp::CREATE_DIRECTORY:
+                known_.insert(paths[0].string());
+                break;
+            case WorkloadOp::COPY:
+            case WorkloadOp::MOVE:
+                if (paths.size() > 1) known_.insert(paths[1].string());
+                break;
+            case WorkloadOp::PLUGIN:
+                for (size_t i = 1; i < paths.size(); ++i) known_.insert(paths[i].string());
+                break;
+            default:
+                break;
+        }
+    }
+
+    uint64_t filesCreated() const { return files_; }
+    uint64_t bytesCreated() const { return bytes_; }
+
+private:
+    bool claim(const fs::path& path) {
+        return known_.insert(path.string()).second;
+    }
+
+    void makeDirectory(const fs::path& path, uint64_t entries) {
+        if (!claim(path)) {
+            return;
+        }
+        std::error_code ec;
+        fs::create_directories(path, ec);
+        const uint64_t named = namedChildren_[path.string()];
+        for (uint64_t i = named; i < entries; ++i) {
+            makeFile(path / ("fill_" + std::to_string(i)), 0);
+        }
+    }
+
+    void makeFile(const fs::path& path, uint64_t size) {
+        if (!claim(path)) {
+            return;
+        }
+        const int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            return;
+        }
+        // Real data rather than a sparse file, so reads hit the page cache like the original
+        static const std::string chunk(1 << 20, 'r');
+        uint64_t remaining = size;
+        while (remaining > 0) {
+            const ssize_t n = ::write(fd, chunk.data(), std::min<uint64_t>(remaining, chunk.size()));
+            if (n <= 0) {
+                break;
+            }
+            remaining -= static_cast<uint64_t>(n);
+        }
+        ::close(fd);
+        ++files_;
+        bytes_ += size - remaining;
+    }
+
+    fs::path scratch_;
+    std::string cwd_;
+    std::unordered_set<std::string> known_;
+    std::unordered_set<std::string> named_;
+    std::unordered_map<std::string, uint64_t> namedChildren_;
+    uint64_t files_ = 0;
+    uint64_t bytes_ = 0;
+};
+
+// =======================
+// Replay
+// =======================
+
+// Runs one call, returns true on success
+static bool replay(const WorkloadRecord& record, const fs::path& scratch, const std::string& cwd,
+                   PluginManager& plugins) {
+    auto path = [&](size_t i) {
+        return mapPath(scratch, cwd, i < record.args.size() ? record.args[i] : std::string("/"));
+    };
+    const bool overwrite = record.flags & WorkloadRecord::FLAG_OVERWRITE;
+
+    switch (record.op) {
+        case WorkloadOp::EXISTS: return FileSystem::tryExists(path(0)).ok();
+        case WorkloadOp::IS_DIRECTORY: return FileSystem::tryIsDirectory(path(0)).ok();
+        case WorkloadOp::IS_FILE: return FileSystem::tryIsFile(path(0)).ok();
+        case WorkloadOp::LIST_DIRECTORY: return FileSystem::tryListDirectory(path(0)).ok();
+        case WorkloadOp::CREATE_DIRECTORY: return FileSystem::tryCreateDirectory(path(0)).ok();
+        case WorkloadOp::REMOVE: return FileSystem::tryRemove(path(0)).ok();
+        case WorkloadOp::COPY: return FileSystem::tryCopy(path(0), path(1), overwrite).ok();
+        case WorkloadOp::MOVE: return FileSystem::tryMove(path(0), path(1), overwrite).ok();
+        case WorkloadOp::FILE_SIZE: return FileSystem::tryFileSize(path(0)).ok();
+        case WorkloadOp::LAST_WRITE_TIME: return FileSystem::tryLastWriteTime(path(0)).ok();
+        case WorkloadOp::READ_FILE: return FileSystem::tryReadFile(path(0)).ok();
+        case WorkloadOp::WRITE_FILE: return FileSystem::tryWriteFile(path(0), std::string(record.size, 'w')).ok();
+        case WorkloadOp::PLUGIN: {
+            if (record.args.empty()) {
+                return false;
+            }
+            // Relative arguments are left alone: the replay runs in the mapped
+            // working directory, and "direct" must stay "direct"
+            std::vector<std::string> args;
+            for (size_t i = 1; i < record.args.size(); ++i) {
+                args.push_back(isAbsolute(record.args[i]) ? path(i).string() : record.args[i]);
+            }
+            return plugins.executeOperation(record.args[0], args);
+        }
+        default:
+            return false;
+    }
+}
+
+// Metric name a replayed call is reported under by FileSystem/PluginManager
+static std::string metricName(const WorkloadRecord& record) {
+    if (record.op == WorkloadOp::PLUGIN) {
+        return "plugin." + (record.args.empty() ? std::string() : record.args[0]);
+    }
+    return std::string("fs.") + workloadOpName(record.op);
+}
+
+static std::string formatNs(uint64_t ns) {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(1);
+    if (ns >= 1000000000ULL) out << ns / 1e9 << "s";
+    else if (ns >= 1000000ULL) out << ns / 1e6 << "ms";
+    else if (ns >= 1000ULL) out << ns / 1e3 << "us";
+    else out << ns << "ns";
+    return out.str();
+}
+
+static uint64_t maxLatency(const Metrics::OperationStats& stats) {
+    for (unsigned i = LatencyBuckets::COUNT; i-- > 0;) {
+        if (stats.buckets[i]) {
+            return LatencyBuckets::upperBound(i);
+        }
+    }
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool originalSpeed = false;
+    bool keep = false;
+    fs::path scratchBase = fs::temp_directory_path();
+    std::string pluginDir;
+    std::string jsonPath;
+    std::string tracePath;
+
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg == "--speed" && i + 1 < argc) {
+            const std::string speed = argv[++i];
+            if (speed != "original" && speed != "max") {
+                printUsage();
+                return 2;
+            }
+            originalSpeed = speed == "original";
+        } else if (arg == "--scratch" && i + 1 < argc) {
+            scratchBase = argv[++i];
+        } else if (arg == "--plugins" && i + 1 < argc) {
+            pluginDir = argv[++i];
+        } else if (arg == "--json" && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (arg == "--keep") {
+            keep = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage();
+            return 0;
+        } else if (!arg.empty() && arg[0] != '-' && tracePath.empty()) {
+            tracePath = arg;
+        } else {
+            printUsage();
+            return 2;
+        }
+    }
+    if (tracePath.empty()) {
+        printUsage();
+        return 2;
+    }
+
+    WorkloadTraceReader reader(tracePath);
+    if (!reader.isValid()) {
+        std::cerr << "Not a workload trace: " << tracePath << std::endl;
+        return 1;
+    }
+    std::vector<WorkloadRecord> records;
+    for (WorkloadRecord record; reader.next(record);) {
+        records.push_back(record);
+    }
+    std::stable_sort(records.begin(), records.end(),
+                     [](const WorkloadRecord& a, const WorkloadRecord& b) { return a.startNs < b.startNs; });
+    std::cout << "Loaded " << records.size() << " calls from " << tracePath << std::endl;
+
+    const std::string cwd = reader.workingDirectory();
+    if (cwd.empty()) {
+        const size_t before = records.size();
+        records.erase(std::remove_if(records.begin(), records.end(), hasRelativeArg), records.end());
+        if (records.size() != before) {
+            std::cout << "Skipped " << before - records.size()
+                      << " calls with relative paths: the trace has no working directory" << std::endl;
+        }
+    }
+
+    // Absolute: the replay changes into the mapped working directory
+    const fs::path scratch = fs::absolute(scratchBase) / ("fm_replay_" + std::to_string(::getpid()));
+    TreeGenerator generator(scratch, cwd);
+    for (const auto& record : records) {
+        generator.scan(record);
+    }
+    for (const auto& record : records) {
+        generator.prepare(record);
+    }
+    std::cout << "Generated " << generator.filesCreated() << " files (" << generator.bytesCreated()
+              << " bytes) in " << scratch << std::endl;
+
+    PluginManager plugins;
+    if (!pluginDir.empty()) {
+        plugins.loadPlugins(pluginDir);
+    }
+
+    // The recorded latencies go through the same histograms as the replayed ones
+    std::unordered_map<std::string, MetricId> recordedIds;
+    for (const auto& record : records) {
+        const std::string name = metricName(record);
+        auto it = recordedIds.find(name);
+        if (it == recordedIds.end()) {
+            it = recordedIds.emplace(name, Metrics::registerOperation("recorded." + name)).first;
+        }
+        Metrics::record(it->second, record.latencyNs, record.result != 0, 0, 0);
+    }
+
+    // --- Replay ---
+    Metrics::setEnabled(true);
+    uint64_t diverged = 0;
+    uint64_t maxLagNs = 0;
+    std::error_code ec;
+    const fs::path ownDirectory = fs::current_path(ec);
+    if (!cwd.empty()) {
+        const fs::path replayDirectory = mapPath(scratch, cwd, cwd);
+        fs::create_directories(replayDirectory, ec);
+        fs::current_path(replayDirectory, ec);
+    }
+    const auto replayStart = std::chrono::steady_clock::now();
+    for (const auto& record : records) {
+        if (originalSpeed) {
+            const auto due = replayStart + std::chrono::nanoseconds(record.startNs);
+            const auto now = std::chrono::steady_clock::now();
+            if (now < due) {
+                std::this_thread::sleep_until(due);
+            } else {
+                maxLagNs = std::max<uint64_t>(maxLagNs, static_cast<uint64_t>(
+                    std::chrono::duration_cast<std::chrono::nanoseconds>(now - due).count()));
+            }
+        }
+        if (replay(record, scratch, cwd, plugins) != (record.result == 0)) {
+            ++diverged;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - replayStart).count();
+    Metrics::setEnabled(false);
+    fs::current_path(ownDirectory, ec);   // --json and the clean up are relative to it
+
+    // --- Report ---
+    const auto stats = Metrics::snapshot();
+    std::unordered_map<std::string, const Metrics::OperationStats*> byName;
+    for (const auto& op : stats) {
+        byName[op.name] = &op;
+    }
+
+    uint64_t totalBytes = 0;
+    std::cout << "\n" << std::left << std::setw(26) << "operation" << std::right
+              << std::setw(9) << "count" << std::setw(8) << "errors"
+              << std::setw(10) << "p50" << std::setw(10) << "p90" << std::setw(10) << "p99"
+              << std::setw(10) << "p99.9" << std::setw(10) << "max" << std::setw(14) << "recorded p99" << "\n";
+    std::ostringstream json;
+    json << "{\n  \"trace\": \"" << tracePath << "\",\n  \"speed\": \"" << (originalSpeed ? "original" : "max")
+         << "\",\n  \"operations\": [\n";
+    bool first = true;
+    for (const auto& [name, recordedId] : recordedIds) {
+        auto it = byName.find(name);
+        if (it == byName.end() || it->second->count == 0) {
+            continue;
+        }
+        const Metrics::OperationStats& op = *it->second;
+        const Metrics::OperationStats* recorded = byName["recorded." + name];
+        totalBytes += op.bytes;
+        std::cout << std::left << std::setw(26) << name << std::right
+                  << std::setw(9) << op.count << std::setw(8) << op.errors
+                  << std::setw(10) << formatNs(op.percentile(0.5)) << std::setw(10) << formatNs(op.percentile(0.9))
+                  << std::setw(10) << formatNs(op.percentile(0.99)) << std::setw(10) << formatNs(op.percentile(0.999))
+                  << std::setw(10) << formatNs(maxLatency(op))
+                  << std::setw(14) << (recorded ? formatNs(recorded->percentile(0.99)) : "-") << "\n";
+        json << (first ? "" : ",\n") << "    {\"name\": \"" << name << "\", \"count\": " << op.count
+             << ", \"errors\": " << op.errors << ", \"bytes\": " << op.bytes
+             << ", \"p50_ns\": " << op.percentile(0.5) << ", \"p90_ns\": " << op.percentile(0.9)
+             << ", \"p99_ns\": " << op.percentile(0.99) << ", \"p999_ns\": " << op.percentile(0.999)
+             << ", \"max_ns\": " << maxLatency(op)
+             << ", \"recorded_p99_ns\": " << (recorded ? recorded->percentile(0.99) : 0) << "}";
+        first = false;
+    }
+
+    const double opsPerSecond = seconds > 0 ? static_cast<double>(records.size()) / seconds : 0;
+    const double megabytesPerSecond = seconds > 0 ? static_cast<double>(totalBytes) / seconds / 1e6 : 0;
+    std::cout << "\n" << records.size() << " calls in " << std::fixed << std::setprecision(3) << seconds << "s: "
+              << std::setprecision(0) << opsPerSecond << " ops/s, " << std::setprecision(1) << megabytesPerSecond
+              << " MB/s\n";
+    if (diverged) {
+        std::cout << diverged << " calls succeeded/failed differently than in the recorded session\n";
+    }
+    if (originalSpeed) {
+        std::cout << "Largest delay behind the recorded schedule: " << formatNs(maxLagNs) << "\n";
+    }
+
+    json << "\n  ],\n  \"calls\": " << records.size() << ",\n  \"seconds\": " << seconds
+         << ",\n  \"ops_per_sec\": " << opsPerSecond << ",\n  \"mb_per_sec\": " << megabytesPerSecond
+         << ",\n  \"diverged\": " << diverged << ",\n  \"max_lag_ns\": " << maxLagNs << "\n}\n";
+    if (!jsonPath.empty()) {
+        std::ofstream out(jsonPath);
+        out << json.str();
+        if (!out) {
+            std::cerr << "Cannot write " << jsonPath << std::endl;
+        }
+    }
+
+    if (!keep) {
+        fs::remove_all(scratch, ec);
+    }
+    return 0;
+}